@@ -0,0 +1,607 @@
+/*
+ * BlockCompressedStream.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/BlockCompressedStream.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <istream>
+#include <ostream>
+
+#include <zlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+// file layout: the magic number followed by blocks, each of which has a
+// header (uncompressed size, stored size, and crc32 of the uncompressed
+// data; all little endian) followed by its stored data. blocks whose
+// stored size equals their uncompressed size weren't compressed. a block
+// with an uncompressed size of zero marks the end of the stream.
+const char kMagic[] = { 'R', 'S', 'B', 'L', 'K', '\001', '\r', '\n' };
+const std::size_t kMagicSize = sizeof(kMagic);
+const std::size_t kBlockHeaderSize = 12;
+
+// size of the blocks we write (and the largest we'll read)
+const std::size_t kBlockSize = 1024 * 1024;
+
+// blocks in flight per thread (bounds the memory we use)
+const std::size_t kBlocksPerThread = 2;
+
+void put32(uint32_t value, char* pBuffer)
+{
+   for (int i = 0; i < 4; i++)
+      pBuffer[i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+}
+
+uint32_t get32(const char* pBuffer)
+{
+   uint32_t value = 0;
+   for (int i = 0; i < 4; i++)
+      value |= static_cast<uint32_t>(static_cast<unsigned char>(pBuffer[i])) << (i * 8);
+   return value;
+}
+
+uint32_t checksum(const std::string& data)
+{
+   uLong crc = ::crc32(0L, Z_NULL, 0);
+   return static_cast<uint32_t>(::crc32(
+                        crc,
+                        reinterpret_cast<const Bytef*>(data.data()),
+                        static_cast<uInt>(data.size())));
+}
+
+Error formatError(const std::string& description, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::illegal_byte_sequence,
+                      description,
+                      location);
+}
+
+Error zlibError(int result, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::io_error,
+                      "zlib error " + safe_convert::numberToString(result),
+                      location);
+}
+
+struct Block
+{
+   Block() : size(0), crc(0), done(false) {}
+
+   // input and output of the transformation (compression or decompression)
+   std::string input;
+   std::string output;
+
+   // uncompressed size and checksum
+   uint32_t size;
+   uint32_t crc;
+
+   bool done;
+   Error error;
+};
+
+typedef boost::shared_ptr<Block> BlockPtr;
+
+void compressBlock(int compressionLevel, Block* pBlock)
+{
+   pBlock->size = static_cast<uint32_t>(pBlock->input.size());
+   pBlock->crc = checksum(pBlock->input);
+
+   if (compressionLevel > 0)
+   {
+      uLongf compressedSize = ::compressBound(pBlock->input.size());
+      pBlock->output.resize(compressedSize);
+      int result = ::compress2(
+                     reinterpret_cast<Bytef*>(&pBlock->output[0]),
+                     &compressedSize,
+                     reinterpret_cast<const Bytef*>(pBlock->input.data()),
+                     pBlock->input.size(),
+                     compressionLevel);
+      if (result != Z_OK)
+      {
+         pBlock->error = zlibError(result, ERROR_LOCATION);
+         return;
+      }
+
+      // keep the compressed data if it's smaller
+      if (compressedSize < pBlock->input.size())
+      {
+         pBlock->output.resize(compressedSize);
+         pBlock->input.clear();
+         return;
+      }
+   }
+
+   pBlock->output.swap(pBlock->input);
+   pBlock->input.clear();
+}
+
+void decompressBlock(Block* pBlock)
+{
+   if (pBlock->input.size() == pBlock->size)
+   {
+      pBlock->output.swap(pBlock->input);
+   }
+   else
+   {
+      uLongf size = pBlock->size;
+      pBlock->output.resize(size);
+      int result = ::uncompress(
+                     reinterpret_cast<Bytef*>(&pBlock->output[0]),
+                     &size,
+                     reinterpret_cast<const Bytef*>(pBlock->input.data()),
+                     pBlock->input.size());
+      if (result != Z_OK)
+      {
+         pBlock->error = zlibError(result, ERROR_LOCATION);
+         return;
+      }
+      if (size != pBlock->size)
+      {
+         pBlock->error = formatError("Block size mismatch", ERROR_LOCATION);
+         return;
+      }
+   }
+   pBlock->input.clear();
+
+   if (checksum(pBlock->output) != pBlock->crc)
+      pBlock->error = formatError("Block checksum mismatch", ERROR_LOCATION);
+}
+
+// Transforms blocks on a pool of threads, handing them back in the order
+// they were submitted
+class BlockPipeline : boost::noncopyable
+{
+public:
+   typedef boost::function<void(Block*)> Transform;
+
+   BlockPipeline(int threads, const Transform& transform)
+      : transform_(transform), stopping_(false)
+   {
+      threads = std::max(threads, 1);
+      maxBlocks_ = threads * kBlocksPerThread;
+      for (int i = 0; i < threads; i++)
+      {
+         threads_.create_thread(boost::bind(&BlockPipeline::worker, this));
+      }
+   }
+
+   ~BlockPipeline()
+   {
+      try
+      {
+         {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stopping_ = true;
+         }
+         workCondition_.notify_all();
+         threads_.join_all();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   bool full()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return blocks_.size() >= maxBlocks_;
+   }
+
+   void submit(const BlockPtr& pBlock)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         blocks_.push_back(pBlock);
+         work_.push_back(pBlock);
+      }
+      workCondition_.notify_one();
+   }
+
+   // take the oldest block (waiting for it to be transformed if necessary;
+   // returns null if there are no blocks or if we aren't waiting and it
+   // isn't yet done)
+   BlockPtr next(bool wait)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      if (blocks_.empty())
+         return BlockPtr();
+
+      while (!blocks_.front()->done)
+      {
+         if (!wait)
+            return BlockPtr();
+         doneCondition_.wait(lock);
+      }
+
+      BlockPtr pBlock = blocks_.front();
+      blocks_.pop_front();
+      return pBlock;
+   }
+
+private:
+   void worker()
+   {
+      while (true)
+      {
+         BlockPtr pBlock;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (work_.empty() && !stopping_)
+               workCondition_.wait(lock);
+            if (stopping_)
+               return;
+
+            pBlock = work_.front();
+            work_.pop_front();
+         }
+
+         try
+         {
+            transform_(pBlock.get());
+         }
+         catch(const std::exception& e)
+         {
+            pBlock->error = systemError(boost::system::errc::not_enough_memory,
+                                        e.what(),
+                                        ERROR_LOCATION);
+         }
+
+         {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            pBlock->done = true;
+         }
+         doneCondition_.notify_all();
+      }
+   }
+
+private:
+   Transform transform_;
+   std::size_t maxBlocks_;
+   boost::mutex mutex_;
+   boost::condition_variable workCondition_;
+   boost::condition_variable doneCondition_;
+   std::deque<BlockPtr> blocks_;
+   std::deque<BlockPtr> work_;
+   bool stopping_;
+   boost::thread_group threads_;
+};
+
+} // anonymous namespace
+
+bool isBlockCompressedFile(const FilePath& filePath)
+{
+   boost::shared_ptr<std::istream> pStream;
+   Error error = filePath.open_r(&pStream);
+   if (error)
+      return false;
+
+   char magic[kMagicSize];
+   pStream->read(magic, kMagicSize);
+   return pStream->gcount() == static_cast<std::streamsize>(kMagicSize) &&
+          std::memcmp(magic, kMagic, kMagicSize) == 0;
+}
+
+struct BlockCompressedWriter::Impl
+{
+   Impl(int threads, int compressionLevel)
+      : pipeline(threads, boost::bind(compressBlock, compressionLevel, _1)),
+        pBlock(new Block()),
+        bytesWritten(0)
+   {
+   }
+
+   // write completed blocks in order (waiting for all of them to complete
+   // if requested)
+   Error writeBlocks(bool wait)
+   {
+      while (BlockPtr pDone = pipeline.next(wait))
+      {
+         Error error = writeBlock(pDone);
+         if (error)
+            return error;
+      }
+      return Success();
+   }
+
+   Error submitBlock()
+   {
+      if (pBlock->input.empty())
+         return Success();
+
+      // write out completed blocks (waiting for the oldest if we have as
+      // many in flight as we allow)
+      while (pipeline.full())
+      {
+         BlockPtr pDone = pipeline.next(true);
+         Error error = writeBlock(pDone);
+         if (error)
+            return error;
+      }
+
+      pipeline.submit(pBlock);
+      pBlock.reset(new Block());
+      pBlock->input.reserve(kBlockSize);
+      return writeBlocks(false);
+   }
+
+   Error writeBlock(const BlockPtr& pDone)
+   {
+      if (pDone->error)
+         return pDone->error;
+
+      char header[kBlockHeaderSize];
+      put32(pDone->size, header);
+      put32(static_cast<uint32_t>(pDone->output.size()), header + 4);
+      put32(pDone->crc, header + 8);
+      pStream->write(header, kBlockHeaderSize);
+      pStream->write(pDone->output.data(), pDone->output.size());
+      if (!pStream->good())
+         return streamError(ERROR_LOCATION);
+
+      return Success();
+   }
+
+   Error streamError(const ErrorLocation& location)
+   {
+      Error error = systemError(boost::system::errc::io_error, location);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   FilePath filePath;
+   boost::shared_ptr<std::ostream> pStream;
+   BlockPipeline pipeline;
+   BlockPtr pBlock;
+   uintmax_t bytesWritten;
+};
+
+BlockCompressedWriter::BlockCompressedWriter(int threads, int compressionLevel)
+   : pImpl_(new Impl(threads, compressionLevel))
+{
+}
+
+BlockCompressedWriter::~BlockCompressedWriter()
+{
+}
+
+Error BlockCompressedWriter::open(const FilePath& filePath)
+{
+   pImpl_->filePath = filePath;
+   Error error = filePath.open_w(&pImpl_->pStream);
+   if (error)
+      return error;
+
+   pImpl_->pStream->write(kMagic, kMagicSize);
+   if (!pImpl_->pStream->good())
+      return pImpl_->streamError(ERROR_LOCATION);
+
+   pImpl_->pBlock->input.reserve(kBlockSize);
+   return Success();
+}
+
+Error BlockCompressedWriter::write(const char* data, std::size_t length)
+{
+   if (!pImpl_->pStream)
+      return systemError(boost::system::errc::bad_file_descriptor,
+                         ERROR_LOCATION);
+
+   pImpl_->bytesWritten += length;
+   while (length > 0)
+   {
+      std::string& input = pImpl_->pBlock->input;
+      std::size_t count = std::min(length, kBlockSize - input.size());
+      input.append(data, count);
+      data += count;
+      length -= count;
+
+      if (input.size() == kBlockSize)
+      {
+         Error error = pImpl_->submitBlock();
+         if (error)
+            return error;
+      }
+   }
+
+   return Success();
+}
+
+Error BlockCompressedWriter::close()
+{
+   if (!pImpl_->pStream)
+      return systemError(boost::system::errc::bad_file_descriptor,
+                         ERROR_LOCATION);
+
+   // write the remaining blocks
+   Error error = pImpl_->submitBlock();
+   if (error)
+      return error;
+   error = pImpl_->writeBlocks(true);
+   if (error)
+      return error;
+
+   // terminate the stream
+   char header[kBlockHeaderSize];
+   std::memset(header, 0, kBlockHeaderSize);
+   pImpl_->pStream->write(header, kBlockHeaderSize);
+   pImpl_->pStream->flush();
+   bool good = pImpl_->pStream->good();
+   pImpl_->pStream.reset();
+   if (!good)
+      return pImpl_->streamError(ERROR_LOCATION);
+
+   return Success();
+}
+
+uintmax_t BlockCompressedWriter::bytesWritten() const
+{
+   return pImpl_->bytesWritten;
+}
+
+struct BlockCompressedReader::Impl
+{
+   explicit Impl(int threads)
+      : pipeline(threads, decompressBlock),
+        offset(0),
+        endOfStream(false)
+   {
+   }
+
+   // read blocks from the file and submit them for decompression until
+   // we have as many in flight as we allow
+   Error readBlocks()
+   {
+      while (!endOfStream && !pipeline.full())
+      {
+         char header[kBlockHeaderSize];
+         pStream->read(header, kBlockHeaderSize);
+         if (pStream->gcount() != static_cast<std::streamsize>(kBlockHeaderSize))
+            return truncatedError(ERROR_LOCATION);
+
+         BlockPtr pBlock(new Block());
+         pBlock->size = get32(header);
+         uint32_t storedSize = get32(header + 4);
+         pBlock->crc = get32(header + 8);
+
+         if (pBlock->size == 0)
+         {
+            endOfStream = true;
+            break;
+         }
+
+         if (pBlock->size > kBlockSize ||
+             storedSize > ::compressBound(kBlockSize))
+         {
+            Error error = formatError("Invalid block header", ERROR_LOCATION);
+            error.addProperty("path", filePath);
+            return error;
+         }
+
+         pBlock->input.resize(storedSize);
+         pStream->read(&pBlock->input[0], storedSize);
+         if (pStream->gcount() != static_cast<std::streamsize>(storedSize))
+            return truncatedError(ERROR_LOCATION);
+
+         pipeline.submit(pBlock);
+      }
+
+      return Success();
+   }
+
+   Error truncatedError(const ErrorLocation& location)
+   {
+      Error error = formatError("Block compressed file is truncated", location);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   FilePath filePath;
+   boost::shared_ptr<std::istream> pStream;
+   BlockPipeline pipeline;
+   BlockPtr pBlock;
+   std::size_t offset;
+   bool endOfStream;
+};
+
+BlockCompressedReader::BlockCompressedReader(int threads)
+   : pImpl_(new Impl(threads))
+{
+}
+
+BlockCompressedReader::~BlockCompressedReader()
+{
+}
+
+Error BlockCompressedReader::open(const FilePath& filePath)
+{
+   pImpl_->filePath = filePath;
+   Error error = filePath.open_r(&pImpl_->pStream);
+   if (error)
+      return error;
+
+   char magic[kMagicSize];
+   pImpl_->pStream->read(magic, kMagicSize);
+   if (pImpl_->pStream->gcount() != static_cast<std::streamsize>(kMagicSize) ||
+       std::memcmp(magic, kMagic, kMagicSize) != 0)
+   {
+      error = formatError("Not a block compressed file", ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   return pImpl_->readBlocks();
+}
+
+Error BlockCompressedReader::read(char* data,
+                                  std::size_t length,
+                                  std::size_t* pBytesRead)
+{
+   *pBytesRead = 0;
+   if (!pImpl_->pStream)
+      return systemError(boost::system::errc::bad_file_descriptor,
+                         ERROR_LOCATION);
+
+   while (length > 0)
+   {
+      // move on to the next block if we've read all of this one
+      if (!pImpl_->pBlock ||
+          pImpl_->offset == pImpl_->pBlock->output.size())
+      {
+         Error error = pImpl_->readBlocks();
+         if (error)
+            return error;
+
+         pImpl_->pBlock = pImpl_->pipeline.next(true);
+         pImpl_->offset = 0;
+         if (!pImpl_->pBlock)
+            return Success();
+         if (pImpl_->pBlock->error)
+         {
+            error = pImpl_->pBlock->error;
+            error.addProperty("path", pImpl_->filePath);
+            return error;
+         }
+      }
+
+      const std::string& output = pImpl_->pBlock->output;
+      std::size_t count = std::min(length, output.size() - pImpl_->offset);
+      std::memcpy(data, output.data() + pImpl_->offset, count);
+      pImpl_->offset += count;
+      data += count;
+      length -= count;
+      *pBytesRead += count;
+   }
+
+   return Success();
+}
+
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,177 @@
+/*
+ * BlockCompressedStreamTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <string>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/BlockCompressedStream.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+// data which compresses somewhat (mixes runs with pseudo-random bytes)
+std::string testData(std::size_t size)
+{
+   std::string data(size, 'a');
+   uint32_t value = 12345;
+   for (std::size_t i = 0; i < size; i += 3)
+   {
+      value = value * 1103515245 + 12345;
+      data[i] = static_cast<char>(value >> 16);
+   }
+   return data;
+}
+
+FilePath testFilePath()
+{
+   FilePath filePath;
+   Error error = FilePath::tempFilePath(&filePath);
+   if (error)
+      LOG_ERROR(error);
+   return filePath;
+}
+
+Error writeData(const FilePath& filePath,
+                const std::string& data,
+                int threads,
+                int compressionLevel,
+                std::size_t chunkSize)
+{
+   BlockCompressedWriter writer(threads, compressionLevel);
+   Error error = writer.open(filePath);
+   if (error)
+      return error;
+
+   for (std::size_t i = 0; i < data.size(); i += chunkSize)
+   {
+      std::size_t length = std::min(chunkSize, data.size() - i);
+      error = writer.write(data.data() + i, length);
+      if (error)
+         return error;
+   }
+
+   return writer.close();
+}
+
+Error readData(const FilePath& filePath,
+               int threads,
+               std::size_t chunkSize,
+               std::string* pData)
+{
+   BlockCompressedReader reader(threads);
+   Error error = reader.open(filePath);
+   if (error)
+      return error;
+
+   std::string buffer(chunkSize, '\0');
+   while (true)
+   {
+      std::size_t bytesRead = 0;
+      error = reader.read(&buffer[0], buffer.size(), &bytesRead);
+      if (error)
+         return error;
+      pData->append(buffer.data(), bytesRead);
+      if (bytesRead < buffer.size())
+         return Success();
+   }
+}
+
+} // anonymous namespace
+
+context("BlockCompressedStream")
+{
+   test_that("data survives a round trip")
+   {
+      // sizes either side of (and spanning several) blocks
+      std::size_t sizes[] = { 0, 1, 1024 * 1024, 1024 * 1024 + 1,
+                              7 * 1024 * 1024 + 5 };
+      int threads[] = { 1, 4 };
+      for (std::size_t i = 0; i < sizeof(sizes)/sizeof(std::size_t); i++)
+      {
+         for (std::size_t j = 0; j < sizeof(threads)/sizeof(int); j++)
+         {
+            std::string data = testData(sizes[i]);
+            FilePath filePath = testFilePath();
+            expect_true(!writeData(filePath, data, threads[j], 1, 100000));
+            expect_true(isBlockCompressedFile(filePath));
+
+            std::string readBack;
+            expect_true(!readData(filePath, threads[j], 65536, &readBack));
+            expect_true(readBack == data);
+            filePath.removeIfExists();
+         }
+      }
+   }
+
+   test_that("data is compressed unless compression is disabled")
+   {
+      std::string data = testData(4 * 1024 * 1024);
+
+      FilePath compressedPath = testFilePath();
+      expect_true(!writeData(compressedPath, data, 2, 1, data.size()));
+      expect_true(compressedPath.size() < data.size());
+
+      FilePath storedPath = testFilePath();
+      expect_true(!writeData(storedPath, data, 2, 0, data.size()));
+      expect_true(storedPath.size() > data.size());
+
+      std::string readBack;
+      expect_true(!readData(storedPath, 2, data.size() + 1, &readBack));
+      expect_true(readBack == data);
+
+      compressedPath.removeIfExists();
+      storedPath.removeIfExists();
+   }
+
+   test_that("corrupt and truncated files are errors")
+   {
+      std::string data = testData(3 * 1024 * 1024);
+      FilePath filePath = testFilePath();
+      expect_true(!writeData(filePath, data, 2, 0, data.size()));
+
+      std::string contents;
+      expect_true(!readStringFromFile(filePath, &contents));
+
+      // flip a byte of stored data
+      std::string corrupt = contents;
+      corrupt[100] = corrupt[100] ^ 0xFF;
+      expect_true(!writeStringToFile(filePath, corrupt));
+      std::string readBack;
+      expect_false(!readData(filePath, 2, 65536, &readBack));
+
+      // drop the end of the stream
+      std::string truncated = contents.substr(0, contents.size() - 100);
+      expect_true(!writeStringToFile(filePath, truncated));
+      readBack.clear();
+      expect_false(!readData(filePath, 2, 65536, &readBack));
+
+      // not a block compressed file at all
+      expect_true(!writeStringToFile(filePath, data.substr(0, 1000)));
+      expect_false(isBlockCompressedFile(filePath));
+      readBack.clear();
+      expect_false(!readData(filePath, 2, 65536, &readBack));
+
+      filePath.removeIfExists();
+   }
+}
+
+} // namespace core
+} // namespace rstudio
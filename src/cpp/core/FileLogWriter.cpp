@@ -15,19 +15,130 @@
 
 #include <core/FileLogWriter.hpp>
 
+#include <set>
+#include <cstdlib>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/FileInfo.hpp>
+#include <core/SafeConvert.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/system/System.hpp>
 
+// NOTE: errors which occur while writing the log are swallowed throughout
+// this file (we can't log them so it doesn't matter). in particular the
+// LOCK_MUTEX macros aren't used since they log errors locking the mutex
+
+using namespace boost::posix_time;
+
 namespace rstudio {
 namespace core {
 
+namespace {
+
+#define LOGMAX (2048*1024)  // rotate/remove every 2 megabytes
+
+// messages logged while this many are waiting to be written are dropped
+// (errors have a reserve of their own beyond this so that they are only
+// dropped once the queue is well and truly backed up)
+const std::size_t kMaxQueuedEntries = 10000;
+const std::size_t kMaxQueuedErrors = 10000;
+
+// repeats of a message are reported at least this often
+const int kRepeatReportSeconds = 5;
+
+// the log file's size is checked at least this often (in addition to
+// counting what we write) in case other processes are writing to it
+const int kSizeCheckSeconds = 1;
+
+// how long we wait at exit (or abort) for queued messages to be written
+const int kExitFlushMilliseconds = 1000;
+
+// writers which have messages to flush at exit
+boost::mutex* s_pWritersMutex = NULL;
+std::set<FileLogWriter*>* s_pWriters = NULL;
+
+void flushWriters()
+{
+   FileLogWriter::flushAll(milliseconds(kExitFlushMilliseconds));
+}
+
+void registerWriter(FileLogWriter* pWriter)
+{
+   if (s_pWritersMutex == NULL)
+   {
+      s_pWritersMutex = new boost::mutex();
+      s_pWriters = new std::set<FileLogWriter*>();
+      std::atexit(flushWriters);
+   }
+
+   boost::lock_guard<boost::mutex> lock(*s_pWritersMutex);
+   s_pWriters->insert(pWriter);
+}
+
+void unregisterWriter(FileLogWriter* pWriter)
+{
+   boost::lock_guard<boost::mutex> lock(*s_pWritersMutex);
+   s_pWriters->erase(pWriter);
+}
+
+} // anonymous namespace
+
+struct FileLogWriter::Entry
+{
+   std::string programIdentity;
+   std::string message;
+   ptime time;
+};
+
+struct FileLogWriter::Impl
+{
+   Impl()
+      : pid(core::system::currentProcessId()),
+        dropped(0), writing(false), stopping(false),
+        started(false), size(0), repeats(0)
+   {
+   }
+
+   // the process which owns the writer thread (processes forked from it
+   // write their messages directly)
+   PidType pid;
+
+   // queue (shared with the threads logging messages)
+   boost::mutex mutex;
+   boost::condition_variable queuedCondition;
+   boost::condition_variable writtenCondition;
+   std::vector<Entry> entries;
+   std::size_t dropped;
+   bool writing;
+   bool stopping;
+
+   bool started;
+   boost::thread thread;
+
+   // writer thread state
+   boost::shared_ptr<std::ostream> pStream;
+   uintmax_t size;
+   ptime sizeCheckTime;
+   std::string lastProgramIdentity;
+   std::string lastMessage;
+   std::size_t repeats;
+   ptime firstRepeatTime;
+   ptime lastRepeatTime;
+};
+
 FileLogWriter::FileLogWriter(const std::string& programIdentity,
                              int logLevel,
                              const FilePath& logDir)
                                 : programIdentity_(programIdentity),
-                                  logLevel_(logLevel)
+                                  logLevel_(logLevel),
+                                  pImpl_(new Impl())
 {
    logDir.ensureDirectory();
 
@@ -39,13 +150,43 @@ FileLogWriter::FileLogWriter(const std::string& programIdentity,
       // swallow errors -- we can't log so it doesn't matter
       core::appendToFile(logFile_, "");
    }
+
+   // start the writer thread (if it can't be started messages are written
+   // directly by the threads which log them)
+   try
+   {
+      pImpl_->thread = boost::thread(
+                  boost::bind(&FileLogWriter::writeQueuedEntries, this));
+      pImpl_->started = true;
+      registerWriter(this);
+   }
+   catch(...)
+   {
+   }
 }
 
 FileLogWriter::~FileLogWriter()
 {
    try
    {
-      // we don't keep a file handle open so do nothing here
+      if (pImpl_->started &&
+          pImpl_->pid == core::system::currentProcessId())
+      {
+         unregisterWriter(this);
+
+         // stop the writer thread once it has written the queued messages
+         {
+            boost::lock_guard<boost::mutex> lock(pImpl_->mutex);
+            pImpl_->stopping = true;
+         }
+         pImpl_->queuedCondition.notify_all();
+         pImpl_->thread.join();
+      }
+      else if (pImpl_->started)
+      {
+         // the writer thread belongs to the process we were forked from
+         pImpl_->thread.detach();
+      }
    }
    catch(...)
    {
@@ -65,29 +206,302 @@ void FileLogWriter::log(const std::string& programIdentity,
    if (logLevel > logLevel_)
       return;
 
-   rotateLogFile();
+   // processes forked from ours don't have the writer thread (and the
+   // queue's mutex may have been held when they were forked)
+   if (!pImpl_->started || pImpl_->pid != core::system::currentProcessId())
+   {
+      writeDirect(programIdentity, message);
+      return;
+   }
 
-   // Swallow errors--we can't do anything anyway
-   core::appendToFile(logFile_, formatLogEntry(programIdentity, message));
+   try
+   {
+      ptime time = microsec_clock::universal_time();
+
+      std::size_t maxEntries = kMaxQueuedEntries;
+      if (logLevel <= core::system::kLogLevelError)
+         maxEntries += kMaxQueuedErrors;
+
+      bool notify = false;
+      {
+         boost::lock_guard<boost::mutex> lock(pImpl_->mutex);
+         if (pImpl_->entries.size() >= maxEntries)
+         {
+            pImpl_->dropped++;
+            return;
+         }
+
+         pImpl_->entries.push_back(Entry());
+         Entry& entry = pImpl_->entries.back();
+         entry.programIdentity = programIdentity;
+         entry.message = message;
+         entry.time = time;
+
+         // the writer only waits when there's nothing queued
+         notify = pImpl_->entries.size() == 1;
+      }
+
+      if (notify)
+         pImpl_->queuedCondition.notify_one();
+   }
+   catch(...)
+   {
+   }
 }
 
+bool FileLogWriter::flush(const boost::posix_time::time_duration& timeout)
+{
+   if (!pImpl_->started || pImpl_->pid != core::system::currentProcessId())
+      return true;
 
+   try
+   {
+      boost::system_time deadline = boost::get_system_time() + timeout;
+      boost::unique_lock<boost::mutex> lock(pImpl_->mutex);
+      while (!pImpl_->entries.empty() ||
+             pImpl_->dropped > 0 ||
+             pImpl_->writing)
+      {
+         if (!pImpl_->writtenCondition.timed_wait(lock, deadline))
+            return false;
+      }
+      return true;
+   }
+   catch(...)
+   {
+      return false;
+   }
+}
 
-#define LOGMAX (2048*1024)  // rotate/remove every 2 megabytes
-bool FileLogWriter::rotateLogFile()
+void FileLogWriter::flushAll(const boost::posix_time::time_duration& timeout)
 {
-   if (logFile_.exists() && logFile_.size() > LOGMAX)
+   if (s_pWritersMutex == NULL)
+      return;
+
+   try
    {
-      // first remove the rotated log file if it exists (ignore errors because
-      // there's nothing we can do with them at this level)
-      rotatedLogFile_.removeIfExists();
+      boost::lock_guard<boost::mutex> lock(*s_pWritersMutex);
+      std::for_each(s_pWriters->begin(),
+                    s_pWriters->end(),
+                    boost::bind(&FileLogWriter::flush, _1, timeout));
+   }
+   catch(...)
+   {
+   }
+}
 
-      // now rotate the log file
-      logFile_.move(rotatedLogFile_);
+void FileLogWriter::writeQueuedEntries()
+{
+   try
+   {
+      std::vector<Entry> entries;
+      while (true)
+      {
+         std::size_t dropped = 0;
+         bool stopping = false;
+         bool timedOut = false;
+         {
+            boost::unique_lock<boost::mutex> lock(pImpl_->mutex);
+            pImpl_->writing = false;
+            pImpl_->writtenCondition.notify_all();
 
-      return true;
+            // wait for messages (or, when repeats of the last message have
+            // yet to be reported, until it's time to report them)
+            while (pImpl_->entries.empty() &&
+                   pImpl_->dropped == 0 &&
+                   !pImpl_->stopping &&
+                   !timedOut)
+            {
+               if (pImpl_->repeats > 0)
+               {
+                  timedOut = !pImpl_->queuedCondition.timed_wait(
+                                          lock, seconds(kRepeatReportSeconds));
+               }
+               else
+               {
+                  pImpl_->queuedCondition.wait(lock);
+               }
+            }
+
+            entries.swap(pImpl_->entries);
+            dropped = pImpl_->dropped;
+            pImpl_->dropped = 0;
+            stopping = pImpl_->stopping;
+            pImpl_->writing = true;
+         }
+
+         writeEntries(entries, dropped, stopping || timedOut);
+         entries.clear();
+
+         if (stopping)
+            break;
+      }
+
+      pImpl_->pStream.reset();
+   }
+   catch(...)
+   {
+   }
+}
+
+void FileLogWriter::writeEntries(const std::vector<Entry>& entries,
+                                 std::size_t dropped,
+                                 bool reportRepeats)
+{
+   Impl& impl = *pImpl_;
+   std::string output;
+
+   for (std::vector<Entry>::const_iterator it = entries.begin();
+        it != entries.end();
+        ++it)
+   {
+      // count repeats of the last message rather than writing them
+      if (it->message == impl.lastMessage &&
+          it->programIdentity == impl.lastProgramIdentity)
+      {
+         if (impl.repeats == 0)
+            impl.firstRepeatTime = it->time;
+         impl.repeats++;
+         impl.lastRepeatTime = it->time;
+
+         // don't wait for the repeats to end to report them
+         if (impl.lastRepeatTime - impl.firstRepeatTime <
+             seconds(kRepeatReportSeconds))
+         {
+            continue;
+         }
+      }
+
+      if (impl.repeats > 0)
+      {
+         output.append(formatLogEntry(
+            impl.lastProgramIdentity,
+            "Last message repeated " +
+               safe_convert::numberToString(impl.repeats) + " times",
+            impl.lastRepeatTime));
+         impl.repeats = 0;
+
+         // the repeat which prompted the report has been counted
+         if (it->message == impl.lastMessage &&
+             it->programIdentity == impl.lastProgramIdentity)
+         {
+            continue;
+         }
+      }
+
+      output.append(formatLogEntry(it->programIdentity,
+                                   it->message,
+                                   it->time));
+      impl.lastProgramIdentity = it->programIdentity;
+      impl.lastMessage = it->message;
+   }
+
+   if (reportRepeats && impl.repeats > 0)
+   {
+      output.append(formatLogEntry(
+         impl.lastProgramIdentity,
+         "Last message repeated " +
+            safe_convert::numberToString(impl.repeats) + " times",
+         impl.lastRepeatTime));
+      impl.repeats = 0;
+   }
+
+   if (dropped > 0)
+   {
+      output.append(formatLogEntry(
+         programIdentity_,
+         safe_convert::numberToString(dropped) +
+            " messages were dropped (logged faster than they could be "
+            "written)"));
+
+      // the next message isn't a repeat of one written before the drop
+      impl.lastMessage.clear();
+      impl.lastProgramIdentity.clear();
+   }
+
+   write(output);
+}
+
+void FileLogWriter::write(const std::string& output)
+{
+   if (output.empty())
+      return;
+
+   Impl& impl = *pImpl_;
+
+   // check the file's size when opening it, rotating it and at intervals in
+   // between (since other processes may be writing to it or rotating it).
+   // otherwise we count the bytes we write
+   ptime now = microsec_clock::universal_time();
+   if (!impl.pStream || now - impl.sizeCheckTime >= seconds(kSizeCheckSeconds))
+   {
+      impl.sizeCheckTime = now;
+      if (!logFile_.exists())
+      {
+         impl.pStream.reset();
+         impl.size = 0;
+      }
+      else
+      {
+         impl.size = logFile_.size();
+      }
+   }
+
+   if (impl.size > LOGMAX)
+   {
+      impl.pStream.reset();
+      rotateLogFile();
+      impl.size = 0;
+   }
+
+#ifdef _WIN32
+   // open the file for each write on windows (keeping it open would prevent
+   // other processes writing to it and rotating it, since it is opened
+   // without sharing)
+   Error error = appendToFile(logFile_, output);
+   if (!error)
+      impl.size += output.size();
+#else
+   if (!impl.pStream)
+   {
+      Error error = logFile_.open_w(&impl.pStream, false);
+      if (error)
+         return;
+
+      // (open_w doesn't seek to the end of the file on all platforms)
+      impl.pStream->seekp(0, std::ios_base::end);
    }
-   return false;
+
+   impl.pStream->write(output.data(), output.size());
+   impl.pStream->flush();
+   if (impl.pStream->fail())
+   {
+      // reopen the file next time
+      impl.pStream.reset();
+      return;
+   }
+   impl.size += output.size();
+#endif
+}
+
+void FileLogWriter::writeDirect(const std::string& programIdentity,
+                                const std::string& message)
+{
+   if (logFile_.exists() && logFile_.size() > LOGMAX)
+      rotateLogFile();
+
+   // Swallow errors--we can't do anything anyway
+   core::appendToFile(logFile_, formatLogEntry(programIdentity, message));
+}
+
+void FileLogWriter::rotateLogFile()
+{
+   // first remove the rotated log file if it exists (ignore errors because
+   // there's nothing we can do with them at this level)
+   rotatedLogFile_.removeIfExists();
+
+   // now rotate the log file
+   logFile_.move(rotatedLogFile_);
 }
 
 
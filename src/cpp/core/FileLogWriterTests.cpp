@@ -0,0 +1,223 @@
+/*
+ * FileLogWriterTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <string>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileLogWriter.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+FilePath testLogDir()
+{
+   FilePath logDir;
+   Error error = FilePath::tempFilePath(&logDir);
+   if (error)
+      LOG_ERROR(error);
+   logDir.ensureDirectory();
+   return logDir;
+}
+
+std::vector<std::string> logLines(const FilePath& logFile)
+{
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(logFile, &lines);
+   if (error)
+      LOG_ERROR(error);
+   return lines;
+}
+
+// log lines are prefixed by the time and program identity
+bool lineEndsWith(const std::string& line, const std::string& message)
+{
+   return boost::algorithm::ends_with(line, "] " + message);
+}
+
+// writes log entries the way the file log writer did before it was
+// asynchronous (for comparison)
+class DirectLogWriter : public LogWriter
+{
+public:
+   explicit DirectLogWriter(const FilePath& logFile) : logFile_(logFile) {}
+
+   virtual void log(core::system::LogLevel level,
+                    const std::string& message)
+   {
+      log("test", level, message);
+   }
+
+   virtual void log(const std::string& programIdentity,
+                    core::system::LogLevel level,
+                    const std::string& message)
+   {
+      if (logFile_.exists() && logFile_.size() > (2048*1024))
+         logFile_.remove();
+      appendToFile(logFile_, formatLogEntry(programIdentity, message));
+   }
+
+private:
+   FilePath logFile_;
+};
+
+} // anonymous namespace
+
+context("FileLogWriter")
+{
+   test_that("messages are written in order")
+   {
+      FilePath logDir = testLogDir();
+      {
+         FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+         writer.log(core::system::kLogLevelError, "first");
+         writer.log(core::system::kLogLevelDebug, "filtered");
+         writer.log(core::system::kLogLevelWarning, "second");
+         expect_true(writer.flush(boost::posix_time::seconds(5)));
+
+         std::vector<std::string> lines =
+                                 logLines(logDir.childPath("test.log"));
+         expect_true(lines.size() == 2);
+         if (lines.size() == 2)
+         {
+            expect_true(lineEndsWith(lines[0], "first"));
+            expect_true(lineEndsWith(lines[1], "second"));
+         }
+
+         writer.log(core::system::kLogLevelError, "third");
+      }
+
+      // the writer writes what's queued when it's destroyed
+      std::vector<std::string> lines = logLines(logDir.childPath("test.log"));
+      expect_true(lines.size() == 3);
+
+      logDir.remove();
+   }
+
+   test_that("all writers are flushed")
+   {
+      FilePath logDir = testLogDir();
+      FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+      writer.log(core::system::kLogLevelInfo, "info");
+      writer.log(core::system::kLogLevelError, "error");
+
+      // (as at exit or abort)
+      FileLogWriter::flushAll(boost::posix_time::seconds(5));
+      std::vector<std::string> lines = logLines(logDir.childPath("test.log"));
+      expect_true(lines.size() == 2);
+      if (lines.size() == 2)
+      {
+         expect_true(lineEndsWith(lines[0], "info"));
+         expect_true(lineEndsWith(lines[1], "error"));
+      }
+
+      logDir.remove();
+   }
+
+   test_that("repeated messages are counted")
+   {
+      FilePath logDir = testLogDir();
+      {
+         FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+         writer.log(core::system::kLogLevelError, "storm");
+         expect_true(writer.flush(boost::posix_time::seconds(5)));
+         for (int i = 0; i < 100; i++)
+            writer.log(core::system::kLogLevelError, "storm");
+         writer.log(core::system::kLogLevelError, "calm");
+      }
+
+      std::vector<std::string> lines = logLines(logDir.childPath("test.log"));
+      expect_true(lines.size() == 3);
+      if (lines.size() == 3)
+      {
+         expect_true(lineEndsWith(lines[0], "storm"));
+         expect_true(lineEndsWith(lines[1], "Last message repeated 100 times"));
+         expect_true(lineEndsWith(lines[2], "calm"));
+      }
+
+      logDir.remove();
+   }
+
+   test_that("log files are rotated")
+   {
+      FilePath logDir = testLogDir();
+      std::string message(1024, 'x');
+      {
+         FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+         for (int i = 0; i < 3000; i++)
+         {
+            writer.log(core::system::kLogLevelError,
+                       message + boost::lexical_cast<std::string>(i));
+            if (i % 100 == 0)
+               writer.flush(boost::posix_time::seconds(5));
+         }
+      }
+
+      FilePath logFile = logDir.childPath("test.log");
+      FilePath rotatedLogFile = logDir.childPath("test.rotated.log");
+      expect_true(rotatedLogFile.exists());
+      expect_true(logFile.size() < 2048*1024 + 200*1024);
+      expect_true(lineEndsWith(logLines(logFile).back(), message + "2999"));
+
+      logDir.remove();
+   }
+
+   test_that("benchmark: log throughput")
+   {
+      if (tests::benchmarksEnabled())
+      {
+         const int kMessages = 100000;
+         FilePath logDir = testLogDir();
+         {
+            DirectLogWriter writer(logDir.childPath("direct.log"));
+            PerformanceTimer timer("log " +
+               boost::lexical_cast<std::string>(kMessages) +
+               " messages directly");
+            for (int i = 0; i < kMessages; i++)
+            {
+               writer.log(core::system::kLogLevelWarning,
+                          "message " + boost::lexical_cast<std::string>(i));
+            }
+         }
+         {
+            // (flushing as we go so that none are dropped)
+            FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+            PerformanceTimer timer("log " +
+               boost::lexical_cast<std::string>(kMessages) +
+               " messages asynchronously");
+            for (int i = 0; i < kMessages; i++)
+            {
+               writer.log(core::system::kLogLevelWarning,
+                          "message " + boost::lexical_cast<std::string>(i));
+               if (i % 5000 == 4999)
+                  writer.flush(boost::posix_time::seconds(60));
+            }
+         }
+         logDir.remove();
+      }
+   }
+}
+
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,1750 @@
+/*
+ * GitObjects.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/GitObjects.hpp>
+
+#include <set>
+#include <queue>
+#include <limits>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+
+namespace rstudio {
+namespace core {
+namespace gitobjects {
+
+namespace {
+
+const std::size_t kIdSize = 20;
+
+// pack object types (in addition to the base object types)
+const int kOfsDelta = 6;
+const int kRefDelta = 7;
+
+// inflated delta bases are cached (up to this many bytes) since a chain of
+// deltas usually shares its bases with its neighbours
+const std::size_t kMaxBaseCacheBytes = 32 * 1024 * 1024;
+
+// deltas chains deeper than this are assumed to be corrupt
+const int kMaxDeltaDepth = 10000;
+
+// persisted commit graph files start with this (the last character is the
+// version of the format; files of other versions are ignored)
+const char kCommitGraphMagic[] = "RSGITCG2";
+const std::size_t kCommitGraphMagicSize = 8;
+
+Error notSupportedError(const std::string& what, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::not_supported, location);
+   error.addProperty("description", what);
+   return error;
+}
+
+Error objectNotFoundError(const ObjectId& id, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::no_such_file_or_directory,
+                             location);
+   error.addProperty("object", id.hex());
+   return error;
+}
+
+Error corruptError(const std::string& what, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("description", what);
+   return error;
+}
+
+boost::uint32_t get32(const unsigned char* pData)
+{
+   return (static_cast<boost::uint32_t>(pData[0]) << 24) |
+          (static_cast<boost::uint32_t>(pData[1]) << 16) |
+          (static_cast<boost::uint32_t>(pData[2]) << 8) |
+          static_cast<boost::uint32_t>(pData[3]);
+}
+
+boost::uint64_t get64(const unsigned char* pData)
+{
+   return (static_cast<boost::uint64_t>(get32(pData)) << 32) |
+          get32(pData + 4);
+}
+
+// inflate a zlib stream of (if known) expectedSize bytes
+Error inflate(const unsigned char* pData,
+              std::size_t size,
+              std::size_t expectedSize,
+              std::string* pOutput)
+{
+   z_stream stream;
+   std::memset(&stream, 0, sizeof(stream));
+   if (::inflateInit(&stream) != Z_OK)
+      return corruptError("inflateInit failed", ERROR_LOCATION);
+
+   pOutput->resize(expectedSize > 0 ? expectedSize : 4096);
+   std::size_t produced = 0;
+   int result = Z_OK;
+   while (result != Z_STREAM_END)
+   {
+      if (produced == pOutput->size())
+      {
+         // (only grow past the expected size if it wasn't known)
+         if (expectedSize > 0)
+            break;
+         pOutput->resize(pOutput->size() * 2);
+      }
+
+      std::size_t available = size - stream.total_in;
+      stream.next_in = const_cast<Bytef*>(pData + stream.total_in);
+      stream.avail_in = static_cast<uInt>(
+         std::min<std::size_t>(available, std::numeric_limits<uInt>::max()));
+      stream.next_out = reinterpret_cast<Bytef*>(&(*pOutput)[produced]);
+      stream.avail_out = static_cast<uInt>(pOutput->size() - produced);
+
+      result = ::inflate(&stream, Z_NO_FLUSH);
+      produced = stream.total_out;
+      if (result != Z_OK && result != Z_STREAM_END)
+         break;
+      if (result == Z_OK && stream.avail_in == 0 && stream.avail_out > 0)
+         break;
+   }
+   ::inflateEnd(&stream);
+
+   if (result != Z_STREAM_END ||
+       (expectedSize > 0 && produced != expectedSize))
+   {
+      return corruptError("invalid compressed object data", ERROR_LOCATION);
+   }
+
+   pOutput->resize(produced);
+   return Success();
+}
+
+bool readVarint(const unsigned char** ppData,
+                const unsigned char* pEnd,
+                std::size_t* pValue)
+{
+   std::size_t value = 0;
+   int shift = 0;
+   unsigned char c;
+   do
+   {
+      if (*ppData >= pEnd || shift > 63)
+         return false;
+      c = *(*ppData)++;
+      value |= static_cast<std::size_t>(c & 0x7f) << shift;
+      shift += 7;
+   } while (c & 0x80);
+
+   *pValue = value;
+   return true;
+}
+
+Error applyDelta(const std::string& base,
+                 const std::string& delta,
+                 std::string* pResult)
+{
+   const unsigned char* p = reinterpret_cast<const unsigned char*>(delta.data());
+   const unsigned char* pEnd = p + delta.size();
+
+   std::size_t baseSize, resultSize;
+   if (!readVarint(&p, pEnd, &baseSize) ||
+       !readVarint(&p, pEnd, &resultSize) ||
+       baseSize != base.size())
+   {
+      return corruptError("invalid delta header", ERROR_LOCATION);
+   }
+
+   pResult->clear();
+   pResult->reserve(resultSize);
+   while (p < pEnd)
+   {
+      unsigned char op = *p++;
+      if (op & 0x80)
+      {
+         // copy from the base
+         std::size_t offset = 0, size = 0;
+         for (int i = 0; i < 4; i++)
+         {
+            if (op & (1 << i))
+            {
+               if (p >= pEnd)
+                  return corruptError("truncated delta", ERROR_LOCATION);
+               offset |= static_cast<std::size_t>(*p++) << (8 * i);
+            }
+         }
+         for (int i = 0; i < 3; i++)
+         {
+            if (op & (0x10 << i))
+            {
+               if (p >= pEnd)
+                  return corruptError("truncated delta", ERROR_LOCATION);
+               size |= static_cast<std::size_t>(*p++) << (8 * i);
+            }
+         }
+         if (size == 0)
+            size = 0x10000;
+         if (offset + size > base.size())
+            return corruptError("delta copy out of range", ERROR_LOCATION);
+         pResult->append(base, offset, size);
+      }
+      else if (op > 0)
+      {
+         // insert literal data
+         if (p + op > pEnd)
+            return corruptError("truncated delta", ERROR_LOCATION);
+         pResult->append(reinterpret_cast<const char*>(p), op);
+         p += op;
+      }
+      else
+      {
+         return corruptError("invalid delta opcode", ERROR_LOCATION);
+      }
+   }
+
+   if (pResult->size() != resultSize)
+      return corruptError("delta result size mismatch", ERROR_LOCATION);
+
+   return Success();
+}
+
+ObjectType objectTypeFromName(const std::string& name)
+{
+   if (name == "commit")
+      return ObjectCommit;
+   else if (name == "tree")
+      return ObjectTree;
+   else if (name == "blob")
+      return ObjectBlob;
+   else if (name == "tag")
+      return ObjectTag;
+   else
+      return ObjectNone;
+}
+
+// the value of a header line (e.g. "object <id>") of a commit or tag
+bool headerValue(const std::string& data,
+                 const std::string& key,
+                 std::string* pValue)
+{
+   std::size_t pos = 0;
+   while (pos < data.size() && data[pos] != '\n')
+   {
+      std::size_t end = data.find('\n', pos);
+      if (end == std::string::npos)
+         end = data.size();
+      if (data.compare(pos, key.size(), key) == 0 &&
+          pos + key.size() < end && data[pos + key.size()] == ' ')
+      {
+         *pValue = data.substr(pos + key.size() + 1,
+                               end - pos - key.size() - 1);
+         return true;
+      }
+      pos = end + 1;
+   }
+   return false;
+}
+
+// "name <email> 1234567890 +0100"
+void parseSignature(const std::string& value,
+                    std::string* pName,
+                    boost::int64_t* pTime,
+                    std::string* pTimeZone)
+{
+   std::size_t emailEnd = value.rfind('>');
+   if (emailEnd == std::string::npos)
+   {
+      *pName = value;
+      return;
+   }
+
+   *pName = value.substr(0, emailEnd + 1);
+   std::vector<std::string> fields;
+   std::string rest = boost::algorithm::trim_copy(value.substr(emailEnd + 1));
+   boost::algorithm::split(fields, rest, boost::algorithm::is_any_of(" "),
+                           boost::algorithm::token_compress_on);
+   if (fields.size() >= 1)
+      *pTime = safe_convert::stringTo<boost::int64_t>(fields[0], 0);
+   if (fields.size() >= 2 && pTimeZone)
+      *pTimeZone = fields[1];
+}
+
+// a pack file and its index
+struct Pack : boost::noncopyable
+{
+   explicit Pack(const FilePath& indexPath)
+      : indexPath(indexPath), version(0), count(0), pIndex(NULL), pIndexEnd(NULL)
+   {
+   }
+
+   Error open()
+   {
+      try
+      {
+         index.open(indexPath.absolutePath());
+         std::string packPath = indexPath.absolutePath();
+         packPath.replace(packPath.size() - 4, 4, ".pack");
+         pack.open(packPath);
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   e.what(),
+                                   ERROR_LOCATION);
+         error.addProperty("path", indexPath);
+         return error;
+      }
+
+      pIndex = reinterpret_cast<const unsigned char*>(index.data());
+      pIndexEnd = pIndex + index.size();
+
+      // version 2 indexes begin with a magic number (version 1 indexes
+      // begin with the fanout table)
+      if (index.size() >= 8 && std::memcmp(pIndex, "\377tOc", 4) == 0)
+      {
+         version = get32(pIndex + 4);
+         if (version != 2)
+            return notSupportedError("pack index version", ERROR_LOCATION);
+      }
+      else
+      {
+         version = 1;
+      }
+
+      if (index.size() < fanoutOffset() + 1024)
+         return corruptError("truncated pack index", ERROR_LOCATION);
+      count = get32(pIndex + fanoutOffset() + 255 * 4);
+
+      std::size_t required = (version == 1) ?
+                              1024 + count * 24 :
+                              8 + 1024 + count * 28;
+      if (index.size() < required || pack.size() < 12)
+         return corruptError("truncated pack index", ERROR_LOCATION);
+
+      return Success();
+   }
+
+   std::size_t fanoutOffset() const { return version == 1 ? 0 : 8; }
+
+   const unsigned char* idAt(boost::uint32_t i) const
+   {
+      if (version == 1)
+         return pIndex + 1024 + i * 24 + 4;
+      else
+         return pIndex + 8 + 1024 + i * kIdSize;
+   }
+
+   bool offsetAt(boost::uint32_t i, boost::uint64_t* pOffset) const
+   {
+      if (version == 1)
+      {
+         *pOffset = get32(pIndex + 1024 + i * 24);
+         return true;
+      }
+
+      const unsigned char* pOffsets = pIndex + 8 + 1024 + count * 24;
+      boost::uint32_t offset = get32(pOffsets + i * 4);
+      if (offset & 0x80000000)
+      {
+         // index into the table of large offsets
+         const unsigned char* pLarge = pOffsets + count * 4 +
+                                       (offset & 0x7fffffff) * 8;
+         if (pLarge + 8 > pIndexEnd)
+            return false;
+         *pOffset = get64(pLarge);
+      }
+      else
+      {
+         *pOffset = offset;
+      }
+      return true;
+   }
+
+   bool find(const ObjectId& id, boost::uint64_t* pOffset) const
+   {
+      const unsigned char* pFanout = pIndex + fanoutOffset();
+      int first = id.bytes()[0];
+      boost::uint32_t lo = first > 0 ? get32(pFanout + (first - 1) * 4) : 0;
+      boost::uint32_t hi = get32(pFanout + first * 4);
+      while (lo < hi)
+      {
+         boost::uint32_t mid = lo + (hi - lo) / 2;
+         int cmp = std::memcmp(idAt(mid), id.bytes(), kIdSize);
+         if (cmp == 0)
+            return offsetAt(mid, pOffset);
+         else if (cmp < 0)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      return false;
+   }
+
+   const unsigned char* data() const
+   {
+      return reinterpret_cast<const unsigned char*>(pack.data());
+   }
+
+   std::size_t size() const { return pack.size(); }
+
+   FilePath indexPath;
+   boost::uint32_t version;
+   boost::uint32_t count;
+   boost::iostreams::mapped_file_source index;
+   boost::iostreams::mapped_file_source pack;
+   const unsigned char* pIndex;
+   const unsigned char* pIndexEnd;
+};
+
+// the parents, commit time, and tree of a commit (all that's needed to
+// order history and filter it by path)
+struct CommitNode
+{
+   CommitNode() : commitTime(0) {}
+
+   ObjectId tree;
+   boost::int64_t commitTime;
+   std::vector<ObjectId> parents;
+};
+
+typedef boost::unordered_map<ObjectId, CommitNode> CommitNodes;
+
+struct BaseCacheEntry
+{
+   ObjectType type;
+   boost::shared_ptr<std::string> pData;
+};
+
+// a commit reached by a history walk
+struct Visit
+{
+   Visit() : children(0), included(false), commitTime(0) {}
+
+   int children;
+   bool included;
+   boost::int64_t commitTime;
+   std::vector<ObjectId> parents;
+};
+
+// commits waiting to be output by a date ordered walk (the most recently
+// committed first, otherwise in the order they became ready)
+struct ReadyCommit
+{
+   ReadyCommit(const ObjectId& id, boost::int64_t commitTime, std::size_t seq)
+      : id(id), commitTime(commitTime), seq(seq)
+   {
+   }
+
+   bool operator<(const ReadyCommit& other) const
+   {
+      if (commitTime != other.commitTime)
+         return commitTime < other.commitTime;
+      return seq > other.seq;
+   }
+
+   ObjectId id;
+   boost::int64_t commitTime;
+   std::size_t seq;
+};
+
+bool addLooseRef(const FilePath& gitDir,
+                 std::map<std::string, std::string>* pRefs,
+                 int,
+                 const FilePath& path)
+{
+   if (path.isDirectory())
+      return true;
+
+   std::string contents;
+   Error error = readStringFromFile(path, &contents);
+   if (error)
+      return true;
+
+   (*pRefs)[path.relativePath(gitDir)] = boost::algorithm::trim_copy(contents);
+   return true;
+}
+
+} // anonymous namespace
+
+ObjectId::ObjectId()
+{
+   std::fill(bytes_, bytes_ + kIdSize, 0);
+}
+
+bool ObjectId::fromHex(const std::string& hex, ObjectId* pId)
+{
+   if (hex.size() != kIdSize * 2)
+      return false;
+
+   for (std::size_t i = 0; i < kIdSize; i++)
+   {
+      int value = 0;
+      for (std::size_t j = 0; j < 2; j++)
+      {
+         char ch = hex[i * 2 + j];
+         int digit;
+         if (ch >= '0' && ch <= '9')
+            digit = ch - '0';
+         else if (ch >= 'a' && ch <= 'f')
+            digit = ch - 'a' + 10;
+         else if (ch >= 'A' && ch <= 'F')
+            digit = ch - 'A' + 10;
+         else
+            return false;
+         value = value * 16 + digit;
+      }
+      pId->bytes_[i] = static_cast<unsigned char>(value);
+   }
+   return true;
+}
+
+ObjectId ObjectId::fromBytes(const unsigned char* pBytes)
+{
+   ObjectId id;
+   std::memcpy(id.bytes_, pBytes, kIdSize);
+   return id;
+}
+
+bool ObjectId::isNull() const
+{
+   for (std::size_t i = 0; i < kIdSize; i++)
+   {
+      if (bytes_[i] != 0)
+         return false;
+   }
+   return true;
+}
+
+std::string ObjectId::hex() const
+{
+   const char* const kDigits = "0123456789abcdef";
+   std::string hex(kIdSize * 2, '0');
+   for (std::size_t i = 0; i < kIdSize; i++)
+   {
+      hex[i * 2] = kDigits[bytes_[i] >> 4];
+      hex[i * 2 + 1] = kDigits[bytes_[i] & 0xf];
+   }
+   return hex;
+}
+
+bool ObjectId::operator==(const ObjectId& other) const
+{
+   return std::memcmp(bytes_, other.bytes_, kIdSize) == 0;
+}
+
+bool ObjectId::operator<(const ObjectId& other) const
+{
+   return std::memcmp(bytes_, other.bytes_, kIdSize) < 0;
+}
+
+std::size_t hash_value(const ObjectId& id)
+{
+   // object ids are already uniformly distributed
+   std::size_t value = 0;
+   std::memcpy(&value, id.bytes(), sizeof(value));
+   return value;
+}
+
+struct Repository::Impl
+{
+   explicit Impl(const FilePath& gitDir)
+      : gitDir(gitDir),
+        packsScanned(false),
+        baseCacheBytes(0),
+        commitNodesChanged(false)
+   {
+   }
+
+   FilePath gitDir;
+
+   std::vector<boost::shared_ptr<Pack> > packs;
+   bool packsScanned;
+   std::vector<std::string> packIndexes;
+
+   // commits whose parents were cut off by a shallow clone (their nodes
+   // keep the parents they name, since the graph is persisted and the
+   // parents appear once the repository is deepened)
+   boost::unordered_set<ObjectId> shallowCommits;
+
+   std::map<std::pair<const Pack*, boost::uint64_t>, BaseCacheEntry> baseCache;
+   std::size_t baseCacheBytes;
+
+   CommitNodes commitNodes;
+   bool commitNodesChanged;
+
+   // features which change the meaning of the object graph
+   Error checkSupported()
+   {
+      if (gitDir.childPath("objects/info/alternates").exists())
+         return notSupportedError("alternates", ERROR_LOCATION);
+      if (gitDir.childPath("info/grafts").exists())
+         return notSupportedError("grafts", ERROR_LOCATION);
+      if (gitDir.childPath("refs/replace").exists())
+         return notSupportedError("replace refs", ERROR_LOCATION);
+      return Success();
+   }
+
+   // the paths of the index files of the repository's packs (sorted)
+   Error listPackIndexes(std::vector<std::string>* pIndexes)
+   {
+      pIndexes->clear();
+      FilePath packDir = gitDir.childPath("objects/pack");
+      if (!packDir.exists())
+         return Success();
+
+      std::vector<FilePath> children;
+      Error error = packDir.children(&children);
+      if (error)
+         return error;
+
+      for (std::size_t i = 0; i < children.size(); i++)
+      {
+         if (children[i].extensionLowerCase() == ".idx")
+            pIndexes->push_back(children[i].absolutePath());
+      }
+      std::sort(pIndexes->begin(), pIndexes->end());
+      return Success();
+   }
+
+   Error scanPacks()
+   {
+      packs.clear();
+      baseCache.clear();
+      baseCacheBytes = 0;
+      packsScanned = true;
+
+      Error error = listPackIndexes(&packIndexes);
+      if (error)
+         return error;
+
+      for (std::size_t i = 0; i < packIndexes.size(); i++)
+      {
+         boost::shared_ptr<Pack> pPack(new Pack(FilePath(packIndexes[i])));
+         error = pPack->open();
+         if (error)
+            return error;
+         packs.push_back(pPack);
+      }
+
+      return Success();
+   }
+
+   // rescan the packs if they have changed since we last looked (e.g.
+   // after a fetch or gc). the packs are compared by name rather than by
+   // the modification time of their directory, which doesn't change for
+   // packs written within the same second as our last look
+   bool rescanPacksIfChanged()
+   {
+      if (packsScanned)
+      {
+         std::vector<std::string> indexes;
+         Error error = listPackIndexes(&indexes);
+         if (!error && indexes == packIndexes)
+            return false;
+      }
+
+      Error error = scanPacks();
+      if (error)
+         LOG_ERROR(error);
+      return true;
+   }
+
+   Error readLooseObject(const ObjectId& id,
+                         bool* pFound,
+                         ObjectType* pType,
+                         std::string* pData)
+   {
+      std::string hex = id.hex();
+      FilePath objectPath = gitDir.childPath(
+               "objects/" + hex.substr(0, 2) + "/" + hex.substr(2));
+      *pFound = objectPath.exists();
+      if (!*pFound)
+         return Success();
+
+      std::string compressed;
+      Error error = readStringFromFile(objectPath, &compressed);
+      if (error)
+         return error;
+
+      std::string object;
+      error = inflate(reinterpret_cast<const unsigned char*>(compressed.data()),
+                      compressed.size(),
+                      0,
+                      &object);
+      if (error)
+         return error;
+
+      // "<type> <size>\0<data>"
+      std::size_t space = object.find(' ');
+      std::size_t nul = object.find('\0');
+      if (space == std::string::npos || nul == std::string::npos || nul < space)
+         return corruptError("invalid loose object header", ERROR_LOCATION);
+
+      *pType = objectTypeFromName(object.substr(0, space));
+      if (*pType == ObjectNone)
+         return corruptError("invalid loose object type", ERROR_LOCATION);
+      pData->assign(object, nul + 1, std::string::npos);
+      return Success();
+   }
+
+   Error readPackObject(const Pack& pack,
+                        boost::uint64_t offset,
+                        int depth,
+                        ObjectType* pType,
+                        std::string* pData)
+   {
+      if (depth > kMaxDeltaDepth)
+         return corruptError("delta chain too deep", ERROR_LOCATION);
+
+      std::pair<const Pack*, boost::uint64_t> key(&pack, offset);
+      std::map<std::pair<const Pack*, boost::uint64_t>, BaseCacheEntry>::
+                                 const_iterator cached = baseCache.find(key);
+      if (cached != baseCache.end())
+      {
+         *pType = cached->second.type;
+         *pData = *cached->second.pData;
+         return Success();
+      }
+
+      const unsigned char* pStart = pack.data();
+      const unsigned char* pEnd = pStart + pack.size();
+      if (offset >= pack.size())
+         return corruptError("pack offset out of range", ERROR_LOCATION);
+      const unsigned char* p = pStart + offset;
+
+      // type and (inflated) size
+      unsigned char c = *p++;
+      int type = (c >> 4) & 7;
+      std::size_t size = c & 15;
+      int shift = 4;
+      while (c & 0x80)
+      {
+         if (p >= pEnd || shift > 57)
+            return corruptError("invalid pack object header", ERROR_LOCATION);
+         c = *p++;
+         size |= static_cast<std::size_t>(c & 0x7f) << shift;
+         shift += 7;
+      }
+
+      if (type == kOfsDelta || type == kRefDelta)
+      {
+         std::string base;
+         ObjectType baseType;
+         if (type == kOfsDelta)
+         {
+            // the base's offset relative to this object
+            if (p >= pEnd)
+               return corruptError("truncated pack object", ERROR_LOCATION);
+            c = *p++;
+            boost::uint64_t relative = c & 0x7f;
+            while (c & 0x80)
+            {
+               if (p >= pEnd)
+                  return corruptError("truncated pack object", ERROR_LOCATION);
+               c = *p++;
+               relative = ((relative + 1) << 7) | (c & 0x7f);
+            }
+            if (relative > offset)
+               return corruptError("delta base out of range", ERROR_LOCATION);
+
+            Error error = readPackObject(pack, offset - relative, depth + 1,
+                                         &baseType, &base);
+            if (error)
+               return error;
+         }
+         else
+         {
+            if (p + kIdSize > pEnd)
+               return corruptError("truncated pack object", ERROR_LOCATION);
+            ObjectId baseId = ObjectId::fromBytes(p);
+            p += kIdSize;
+
+            Error error = readObject(baseId, depth + 1, &baseType, &base);
+            if (error)
+               return error;
+         }
+
+         std::string delta;
+         Error error = inflate(p, pEnd - p, size, &delta);
+         if (error)
+            return error;
+
+         error = applyDelta(base, delta, pData);
+         if (error)
+            return error;
+
+         *pType = baseType;
+      }
+      else if (type >= ObjectCommit && type <= ObjectTag)
+      {
+         Error error = inflate(p, pEnd - p, size, pData);
+         if (error)
+            return error;
+         *pType = static_cast<ObjectType>(type);
+      }
+      else
+      {
+         return corruptError("invalid pack object type", ERROR_LOCATION);
+      }
+
+      // cache bases (i.e. objects read on behalf of deltas)
+      if (depth > 0)
+      {
+         if (baseCacheBytes + pData->size() > kMaxBaseCacheBytes)
+         {
+            baseCache.clear();
+            baseCacheBytes = 0;
+         }
+         BaseCacheEntry& entry = baseCache[key];
+         entry.type = *pType;
+         entry.pData.reset(new std::string(*pData));
+         baseCacheBytes += pData->size();
+      }
+
+      return Success();
+   }
+
+   Error readObject(const ObjectId& id,
+                    int depth,
+                    ObjectType* pType,
+                    std::string* pData)
+   {
+      if (!packsScanned)
+      {
+         Error error = scanPacks();
+         if (error)
+            return error;
+      }
+
+      for (int attempt = 0; attempt < 2; attempt++)
+      {
+         for (std::size_t i = 0; i < packs.size(); i++)
+         {
+            boost::uint64_t offset;
+            if (packs[i]->find(id, &offset))
+               return readPackObject(*packs[i], offset, depth, pType, pData);
+         }
+
+         bool found;
+         Error error = readLooseObject(id, &found, pType, pData);
+         if (error)
+            return error;
+         if (found)
+            return Success();
+
+         // the object may have been packed since we looked
+         if (!rescanPacksIfChanged())
+            break;
+      }
+
+      return objectNotFoundError(id, ERROR_LOCATION);
+   }
+
+   Error readCommit(const ObjectId& id, Commit* pCommit)
+   {
+      ObjectType type;
+      std::string data;
+      Error error = readObject(id, 0, &type, &data);
+      if (error)
+         return error;
+      if (type != ObjectCommit)
+         return corruptError("object is not a commit", ERROR_LOCATION);
+
+      *pCommit = Commit();
+      pCommit->id = id;
+
+      std::size_t pos = 0;
+      while (pos < data.size())
+      {
+         std::size_t end = data.find('\n', pos);
+         if (end == std::string::npos)
+            end = data.size();
+
+         // the headers end with an empty line
+         if (end == pos)
+         {
+            pCommit->message = data.substr(end + 1);
+            break;
+         }
+
+         // (continuation lines of multi-line headers begin with a space)
+         std::size_t space = data.find(' ', pos);
+         if (data[pos] != ' ' && space != std::string::npos && space < end)
+         {
+            std::string key = data.substr(pos, space - pos);
+            std::string value = data.substr(space + 1, end - space - 1);
+            if (key == "tree")
+            {
+               ObjectId::fromHex(value, &pCommit->tree);
+            }
+            else if (key == "parent")
+            {
+               ObjectId parent;
+               if (ObjectId::fromHex(value, &parent))
+                  pCommit->parents.push_back(parent);
+            }
+            else if (key == "author")
+            {
+               parseSignature(value, &pCommit->author, &pCommit->authorTime,
+                              NULL);
+            }
+            else if (key == "committer")
+            {
+               parseSignature(value, &pCommit->committer,
+                              &pCommit->commitTime, &pCommit->commitTimeZone);
+            }
+            else if (key == "encoding")
+            {
+               pCommit->encoding = value;
+            }
+         }
+
+         pos = end + 1;
+      }
+
+      return Success();
+   }
+
+   // (re)read the shallow commits, which git fetch --deepen or --unshallow
+   // change while we may be holding the repository open
+   Error readShallow()
+   {
+      shallowCommits.clear();
+
+      FilePath shallowPath = gitDir.childPath("shallow");
+      if (!shallowPath.exists())
+         return Success();
+
+      std::string contents;
+      Error error = readStringFromFile(shallowPath, &contents);
+      if (error)
+         return error;
+
+      std::vector<std::string> lines;
+      boost::algorithm::split(lines, contents,
+                              boost::algorithm::is_any_of("\n"));
+      for (std::size_t i = 0; i < lines.size(); i++)
+      {
+         ObjectId shallowId;
+         if (ObjectId::fromHex(boost::algorithm::trim_copy(lines[i]),
+                               &shallowId))
+         {
+            shallowCommits.insert(shallowId);
+         }
+      }
+      return Success();
+   }
+
+   // the parents of a commit which are present
+   void presentParents(const ObjectId& id,
+                       const CommitNode& node,
+                       std::vector<ObjectId>* pParents)
+   {
+      if (shallowCommits.count(id))
+         pParents->clear();
+      else
+         *pParents = node.parents;
+   }
+
+   Error commitNode(const ObjectId& id, const CommitNode** ppNode)
+   {
+      CommitNodes::const_iterator it = commitNodes.find(id);
+      if (it == commitNodes.end())
+      {
+         ObjectType type;
+         std::string data;
+         Error error = readObject(id, 0, &type, &data);
+         if (error)
+            return error;
+         if (type != ObjectCommit)
+            return corruptError("object is not a commit", ERROR_LOCATION);
+
+         // (only the headers we need are parsed, since walks of large
+         // histories spend much of their time here)
+         CommitNode node;
+         std::size_t pos = 0;
+         while (pos < data.size() && data[pos] != '\n')
+         {
+            std::size_t end = data.find('\n', pos);
+            if (end == std::string::npos)
+               end = data.size();
+
+            if (data.compare(pos, 5, "tree ") == 0)
+            {
+               ObjectId::fromHex(data.substr(pos + 5, end - pos - 5),
+                                 &node.tree);
+            }
+            else if (data.compare(pos, 7, "parent ") == 0)
+            {
+               ObjectId parent;
+               if (ObjectId::fromHex(data.substr(pos + 7, end - pos - 7),
+                                     &parent))
+               {
+                  node.parents.push_back(parent);
+               }
+            }
+            else if (data.compare(pos, 10, "committer ") == 0)
+            {
+               std::string name;
+               parseSignature(data.substr(pos + 10, end - pos - 10),
+                              &name, &node.commitTime, NULL);
+            }
+
+            pos = end + 1;
+         }
+
+         it = commitNodes.insert(std::make_pair(id, node)).first;
+         commitNodesChanged = true;
+      }
+
+      *ppNode = &it->second;
+      return Success();
+   }
+
+   // follow tags to the object they tag
+   Error peel(const ObjectId& id, ObjectId* pTarget, ObjectType* pType)
+   {
+      ObjectId target = id;
+      for (int i = 0; i < 100; i++)
+      {
+         // (commits we've seen needn't be read again)
+         if (commitNodes.count(target))
+         {
+            *pTarget = target;
+            *pType = ObjectCommit;
+            return Success();
+         }
+
+         std::string data;
+         Error error = readObject(target, 0, pType, &data);
+         if (error)
+            return error;
+         if (*pType != ObjectTag)
+         {
+            *pTarget = target;
+            return Success();
+         }
+
+         std::string object;
+         if (!headerValue(data, "object", &object) ||
+             !ObjectId::fromHex(object, &target))
+         {
+            return corruptError("invalid tag", ERROR_LOCATION);
+         }
+      }
+      return corruptError("tag chain too deep", ERROR_LOCATION);
+   }
+
+   // all refs (name to value, which is either an object id or a symbolic
+   // "ref: <name>"), loose refs taking precedence over packed refs
+   Error readRefs(std::map<std::string, std::string>* pRefs,
+                  std::map<std::string, ObjectId>* pPeeled)
+   {
+      FilePath packedRefsPath = gitDir.childPath("packed-refs");
+      if (packedRefsPath.exists())
+      {
+         std::string contents;
+         Error error = readStringFromFile(packedRefsPath, &contents);
+         if (error)
+            return error;
+
+         std::vector<std::string> lines;
+         boost::algorithm::split(lines, contents,
+                                 boost::algorithm::is_any_of("\n"));
+         std::string lastRef;
+         for (std::size_t i = 0; i < lines.size(); i++)
+         {
+            const std::string& line = lines[i];
+            if (line.empty() || line[0] == '#')
+               continue;
+
+            if (line[0] == '^')
+            {
+               // the peeled value of the preceding (tag) ref
+               ObjectId peeled;
+               if (!lastRef.empty() &&
+                   ObjectId::fromHex(boost::algorithm::trim_copy(line.substr(1)),
+                                     &peeled))
+               {
+                  (*pPeeled)[lastRef] = peeled;
+               }
+               continue;
+            }
+
+            std::size_t space = line.find(' ');
+            if (space == std::string::npos)
+               continue;
+            lastRef = boost::algorithm::trim_copy(line.substr(space + 1));
+            (*pRefs)[lastRef] = line.substr(0, space);
+         }
+      }
+
+      FilePath refsDir = gitDir.childPath("refs");
+      if (refsDir.exists())
+      {
+         std::map<std::string, std::string> looseRefs;
+         Error error = refsDir.childrenRecursive(
+                     boost::bind(addLooseRef, gitDir, &looseRefs, _1, _2));
+         if (error)
+            return error;
+
+         for (std::map<std::string, std::string>::const_iterator it =
+                                                         looseRefs.begin();
+              it != looseRefs.end();
+              ++it)
+         {
+            (*pRefs)[it->first] = it->second;
+            pPeeled->erase(it->first);
+         }
+      }
+
+      return Success();
+   }
+
+   // resolve the value of a ref (following symbolic refs)
+   bool resolveRefValue(const std::map<std::string, std::string>& refs,
+                        const std::string& name,
+                        ObjectId* pId)
+   {
+      std::string current = name;
+      for (int i = 0; i < 10; i++)
+      {
+         std::string value;
+         if (current == "HEAD")
+         {
+            Error error = readStringFromFile(gitDir.childPath("HEAD"), &value);
+            if (error)
+               return false;
+            boost::algorithm::trim(value);
+         }
+         else
+         {
+            std::map<std::string, std::string>::const_iterator it =
+                                                      refs.find(current);
+            if (it == refs.end())
+               return false;
+            value = it->second;
+         }
+
+         if (boost::algorithm::starts_with(value, "ref:"))
+            current = boost::algorithm::trim_copy(value.substr(4));
+         else
+            return ObjectId::fromHex(value, pId);
+      }
+      return false;
+   }
+
+   // the commit a ref points to (if it points to a commit)
+   bool refCommit(const std::map<std::string, std::string>& refs,
+                  const std::map<std::string, ObjectId>& peeled,
+                  const std::string& name,
+                  ObjectId* pCommit)
+   {
+      std::map<std::string, ObjectId>::const_iterator peeledIt =
+                                                      peeled.find(name);
+      ObjectId id;
+      if (peeledIt != peeled.end())
+         id = peeledIt->second;
+      else if (!resolveRefValue(refs, name, &id))
+         return false;
+
+      ObjectType type;
+      Error error = peel(id, pCommit, &type);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      return type == ObjectCommit;
+   }
+
+   // walk history in date order from tips, where nextParents gives the
+   // parents to follow (and whether the commit is included)
+   Error dateOrder(
+         const std::vector<ObjectId>& tips,
+         const boost::function<Error(const ObjectId&,
+                                     std::vector<ObjectId>*,
+                                     bool*)>& nextParents,
+         std::vector<HistoryEntry>* pHistory)
+   {
+      // find the reachable commits (and how many children each has)
+      boost::unordered_map<ObjectId, Visit> visits;
+      visits.rehash(commitNodes.size());
+
+      std::vector<ObjectId> stack;
+      std::vector<ObjectId> uniqueTips;
+      for (std::size_t i = 0; i < tips.size(); i++)
+      {
+         if (visits.find(tips[i]) == visits.end())
+         {
+            visits[tips[i]];
+            stack.push_back(tips[i]);
+            uniqueTips.push_back(tips[i]);
+         }
+      }
+
+      while (!stack.empty())
+      {
+         ObjectId id = stack.back();
+         stack.pop_back();
+
+         const CommitNode* pNode;
+         Error error = commitNode(id, &pNode);
+         if (error)
+            return error;
+         boost::int64_t commitTime = pNode->commitTime;
+
+         std::vector<ObjectId> parents;
+         bool included;
+         error = nextParents(id, &parents, &included);
+         if (error)
+            return error;
+
+         Visit& visit = visits[id];
+         visit.commitTime = commitTime;
+         visit.included = included;
+         visit.parents = parents;
+
+         for (std::size_t i = 0; i < parents.size(); i++)
+         {
+            boost::unordered_map<ObjectId, Visit>::iterator parentIt =
+                                                   visits.find(parents[i]);
+            if (parentIt == visits.end())
+            {
+               visits[parents[i]].children = 1;
+               stack.push_back(parents[i]);
+            }
+            else
+            {
+               parentIt->second.children++;
+            }
+         }
+      }
+
+      // output commits once all of their children have been output
+      std::priority_queue<ReadyCommit> ready;
+      std::size_t seq = 0;
+      for (std::size_t i = 0; i < uniqueTips.size(); i++)
+      {
+         const Visit& visit = visits[uniqueTips[i]];
+         if (visit.children == 0)
+            ready.push(ReadyCommit(uniqueTips[i], visit.commitTime, seq++));
+      }
+
+      while (!ready.empty())
+      {
+         ObjectId id = ready.top().id;
+         ready.pop();
+
+         Visit& visit = visits[id];
+         if (visit.included)
+         {
+            HistoryEntry entry;
+            entry.id = id;
+            entry.parents = visit.parents;
+            pHistory->push_back(entry);
+         }
+
+         for (std::size_t i = 0; i < visit.parents.size(); i++)
+         {
+            Visit& parent = visits[visit.parents[i]];
+            if (--parent.children == 0)
+            {
+               ready.push(ReadyCommit(visit.parents[i],
+                                      parent.commitTime,
+                                      seq++));
+            }
+         }
+      }
+
+      return Success();
+   }
+
+   Error allParents(const ObjectId& id,
+                    std::vector<ObjectId>* pParents,
+                    bool* pIncluded)
+   {
+      const CommitNode* pNode;
+      Error error = commitNode(id, &pNode);
+      if (error)
+         return error;
+      presentParents(id, *pNode, pParents);
+      *pIncluded = true;
+      return Success();
+   }
+
+   // the id of the entry at path within a tree (null if there isn't one).
+   // trees are memoized at each depth since most are shared by commits
+   Error pathEntry(const ObjectId& tree,
+                   const std::vector<std::string>& components,
+                   std::vector<boost::unordered_map<ObjectId, ObjectId> >* pMemo,
+                   ObjectId* pEntry)
+   {
+      ObjectId current = tree;
+      for (std::size_t depth = 0; depth < components.size(); depth++)
+      {
+         if (current.isNull())
+            break;
+
+         boost::unordered_map<ObjectId, ObjectId>& memo = (*pMemo)[depth];
+         boost::unordered_map<ObjectId, ObjectId>::const_iterator it =
+                                                      memo.find(current);
+         if (it != memo.end())
+         {
+            current = it->second;
+            continue;
+         }
+
+         ObjectType type;
+         std::string data;
+         Error error = readObject(current, 0, &type, &data);
+         if (error)
+            return error;
+
+         // entries are "<mode> <name>\0<20 byte id>"
+         ObjectId child;
+         if (type == ObjectTree)
+         {
+            const std::string& name = components[depth];
+            std::size_t pos = 0;
+            while (pos < data.size())
+            {
+               std::size_t space = data.find(' ', pos);
+               std::size_t nul = data.find('\0', pos);
+               if (space == std::string::npos || nul == std::string::npos ||
+                   nul + 1 + kIdSize > data.size())
+               {
+                  return corruptError("invalid tree", ERROR_LOCATION);
+               }
+
+               if (data.compare(space + 1, nul - space - 1, name) == 0)
+               {
+                  child = ObjectId::fromBytes(
+                     reinterpret_cast<const unsigned char*>(data.data()) +
+                     nul + 1);
+                  break;
+               }
+               pos = nul + 1 + kIdSize;
+            }
+         }
+
+         memo[current] = child;
+         current = child;
+      }
+
+      *pEntry = current;
+      return Success();
+   }
+
+   // git's default history simplification: a commit is included unless
+   // its entry for path is the same as a parent's (merges which have such
+   // a parent are followed through that parent alone)
+   Error simplifiedParents(
+         const ObjectId& id,
+         const std::vector<std::string>& components,
+         std::vector<boost::unordered_map<ObjectId, ObjectId> >* pMemo,
+         std::vector<ObjectId>* pParents,
+         bool* pIncluded)
+   {
+      const CommitNode* pNode;
+      Error error = commitNode(id, &pNode);
+      if (error)
+         return error;
+      std::vector<ObjectId> parents;
+      presentParents(id, *pNode, &parents);
+
+      ObjectId entry;
+      error = pathEntry(pNode->tree, components, pMemo, &entry);
+      if (error)
+         return error;
+
+      if (parents.empty())
+      {
+         *pIncluded = !entry.isNull();
+         pParents->clear();
+         return Success();
+      }
+
+      for (std::size_t i = 0; i < parents.size(); i++)
+      {
+         const CommitNode* pParentNode;
+         error = commitNode(parents[i], &pParentNode);
+         if (error)
+            return error;
+
+         ObjectId parentEntry;
+         error = pathEntry(pParentNode->tree, components, pMemo, &parentEntry);
+         if (error)
+            return error;
+
+         if (parentEntry == entry)
+         {
+            *pIncluded = false;
+            pParents->assign(1, parents[i]);
+            return Success();
+         }
+      }
+
+      *pIncluded = true;
+      *pParents = parents;
+      return Success();
+   }
+};
+
+Repository::Repository(const FilePath& gitDir)
+   : pImpl_(new Impl(gitDir))
+{
+}
+
+Repository::~Repository()
+{
+}
+
+const FilePath& Repository::gitDir() const
+{
+   return pImpl_->gitDir;
+}
+
+Error Repository::readObject(const ObjectId& id,
+                             ObjectType* pType,
+                             std::string* pData)
+{
+   Error error = pImpl_->checkSupported();
+   if (error)
+      return error;
+
+   return pImpl_->readObject(id, 0, pType, pData);
+}
+
+Error Repository::readCommit(const ObjectId& id, Commit* pCommit)
+{
+   Error error = pImpl_->checkSupported();
+   if (error)
+      return error;
+
+   return pImpl_->readCommit(id, pCommit);
+}
+
+Error Repository::resolveRevision(const std::string& rev,
+                                  std::vector<ObjectId>* pCommits)
+{
+   Error error = pImpl_->checkSupported();
+   if (error)
+      return error;
+
+   std::map<std::string, std::string> refs;
+   std::map<std::string, ObjectId> peeled;
+   error = pImpl_->readRefs(&refs, &peeled);
+   if (error)
+      return error;
+
+   ObjectId commit;
+   if (rev.empty() || rev == "HEAD")
+   {
+      if (!pImpl_->refCommit(refs, peeled, "HEAD", &commit))
+         return notSupportedError("unresolved HEAD", ERROR_LOCATION);
+      pCommits->push_back(commit);
+      return Success();
+   }
+
+   if (rev == "--all")
+   {
+      // HEAD (which may be detached) and every ref which names a commit
+      if (pImpl_->refCommit(refs, peeled, "HEAD", &commit))
+         pCommits->push_back(commit);
+      for (std::map<std::string, std::string>::const_iterator it = refs.begin();
+           it != refs.end();
+           ++it)
+      {
+         if (boost::algorithm::starts_with(it->first, "refs/") &&
+             pImpl_->refCommit(refs, peeled, it->first, &commit))
+         {
+            pCommits->push_back(commit);
+         }
+      }
+      return Success();
+   }
+
+   ObjectId id;
+   if (ObjectId::fromHex(rev, &id))
+   {
+      ObjectType type;
+      error = pImpl_->peel(id, &commit, &type);
+      if (error)
+         return error;
+      if (type != ObjectCommit)
+         return notSupportedError("revision isn't a commit", ERROR_LOCATION);
+      pCommits->push_back(commit);
+      return Success();
+   }
+
+   // ref names are looked up the way git does
+   const char* const kRulePrefixes[] = { "", "refs/", "refs/tags/",
+                                         "refs/heads/", "refs/remotes/" };
+   for (std::size_t i = 0; i < 5; i++)
+   {
+      std::string name = kRulePrefixes[i] + rev;
+      if (refs.count(name) && pImpl_->refCommit(refs, peeled, name, &commit))
+      {
+         pCommits->push_back(commit);
+         return Success();
+      }
+   }
+   std::string remoteHead = "refs/remotes/" + rev + "/HEAD";
+   if (refs.count(remoteHead) &&
+       pImpl_->refCommit(refs, peeled, remoteHead, &commit))
+   {
+      pCommits->push_back(commit);
+      return Success();
+   }
+
+   return notSupportedError("revision " + rev, ERROR_LOCATION);
+}
+
+Error Repository::decorations(
+                  std::map<ObjectId, std::vector<std::string> >* pRefs)
+{
+   Error error = pImpl_->checkSupported();
+   if (error)
+      return error;
+
+   std::map<std::string, std::string> refs;
+   std::map<std::string, ObjectId> peeled;
+   error = pImpl_->readRefs(&refs, &peeled);
+   if (error)
+      return error;
+
+   ObjectId commit;
+   if (pImpl_->refCommit(refs, peeled, "HEAD", &commit))
+      (*pRefs)[commit].push_back("HEAD");
+
+   for (std::map<std::string, std::string>::const_iterator it = refs.begin();
+        it != refs.end();
+        ++it)
+   {
+      const std::string& name = it->first;
+      if (!boost::algorithm::starts_with(name, "refs/") ||
+          !pImpl_->refCommit(refs, peeled, name, &commit))
+      {
+         continue;
+      }
+
+      if (boost::algorithm::starts_with(name, "refs/tags/"))
+         (*pRefs)[commit].push_back("tag: " + name);
+      else
+         (*pRefs)[commit].push_back(name);
+   }
+
+   return Success();
+}
+
+Error Repository::shallowCommits(std::vector<ObjectId>* pCommits)
+{
+   Error error = pImpl_->readShallow();
+   if (error)
+      return error;
+
+   pCommits->assign(pImpl_->shallowCommits.begin(),
+                    pImpl_->shallowCommits.end());
+   std::sort(pCommits->begin(), pCommits->end());
+   return Success();
+}
+
+Error Repository::history(const std::vector<ObjectId>& tips,
+                          const std::string& path,
+                          std::vector<HistoryEntry>* pHistory)
+{
+   Error error = pImpl_->checkSupported();
+   if (error)
+      return error;
+
+   error = pImpl_->readShallow();
+   if (error)
+      return error;
+
+   if (path.empty())
+   {
+      return pImpl_->dateOrder(
+               tips,
+               boost::bind(&Impl::allParents, pImpl_.get(), _1, _2, _3),
+               pHistory);
+   }
+
+   std::vector<std::string> components;
+   boost::algorithm::split(components, path, boost::algorithm::is_any_of("/"),
+                           boost::algorithm::token_compress_on);
+   components.erase(std::remove(components.begin(), components.end(), ""),
+                    components.end());
+   if (components.empty())
+   {
+      return pImpl_->dateOrder(
+               tips,
+               boost::bind(&Impl::allParents, pImpl_.get(), _1, _2, _3),
+               pHistory);
+   }
+
+   std::vector<boost::unordered_map<ObjectId, ObjectId> > memo(
+                                                         components.size());
+   return pImpl_->dateOrder(
+            tips,
+            boost::bind(&Impl::simplifiedParents, pImpl_.get(),
+                        _1, boost::cref(components), &memo, _2, _3),
+            pHistory);
+}
+
+// the commit graph file is the magic number followed by a record for each
+// commit: its id, tree, commit time (8 bytes, big endian), number of
+// parents (4 bytes), and parents
+Error Repository::loadCommitGraph(const FilePath& cacheFile)
+{
+   if (!cacheFile.exists())
+      return Success();
+
+   std::string data;
+   Error error = readStringFromFile(cacheFile, &data);
+   if (error)
+      return error;
+
+   if (data.size() < kCommitGraphMagicSize ||
+       data.compare(0, kCommitGraphMagicSize - 1, kCommitGraphMagic,
+                    kCommitGraphMagicSize - 1) != 0)
+   {
+      return corruptError("invalid commit graph file", ERROR_LOCATION);
+   }
+
+   // (a file of another version is simply replaced when we next save)
+   if (data.compare(0, kCommitGraphMagicSize, kCommitGraphMagic) != 0)
+      return Success();
+
+   const unsigned char* p =
+         reinterpret_cast<const unsigned char*>(data.data()) +
+         kCommitGraphMagicSize;
+   const unsigned char* pEnd =
+         reinterpret_cast<const unsigned char*>(data.data()) + data.size();
+
+   CommitNodes nodes;
+   while (p < pEnd)
+   {
+      if (pEnd - p < static_cast<std::ptrdiff_t>(2 * kIdSize + 12))
+         return corruptError("truncated commit graph file", ERROR_LOCATION);
+
+      ObjectId id = ObjectId::fromBytes(p);
+      CommitNode node;
+      node.tree = ObjectId::fromBytes(p + kIdSize);
+      node.commitTime = static_cast<boost::int64_t>(get64(p + 2 * kIdSize));
+      boost::uint32_t parents = get32(p + 2 * kIdSize + 8);
+      p += 2 * kIdSize + 12;
+
+      if (static_cast<std::size_t>(pEnd - p) < parents * kIdSize)
+         return corruptError("truncated commit graph file", ERROR_LOCATION);
+      for (boost::uint32_t i = 0; i < parents; i++)
+      {
+         node.parents.push_back(ObjectId::fromBytes(p));
+         p += kIdSize;
+      }
+
+      nodes[id] = node;
+   }
+
+   // (commits read in this session are kept)
+   for (CommitNodes::const_iterator it = pImpl_->commitNodes.begin();
+        it != pImpl_->commitNodes.end();
+        ++it)
+   {
+      nodes[it->first] = it->second;
+   }
+   pImpl_->commitNodes.swap(nodes);
+
+   return Success();
+}
+
+Error Repository::saveCommitGraph(const FilePath& cacheFile)
+{
+   if (!pImpl_->commitNodesChanged)
+      return Success();
+
+   std::string data(kCommitGraphMagic, kCommitGraphMagicSize);
+   data.reserve(kCommitGraphMagicSize +
+                pImpl_->commitNodes.size() * (2 * kIdSize + 12 + kIdSize));
+   for (CommitNodes::const_iterator it = pImpl_->commitNodes.begin();
+        it != pImpl_->commitNodes.end();
+        ++it)
+   {
+      const CommitNode& node = it->second;
+      data.append(reinterpret_cast<const char*>(it->first.bytes()), kIdSize);
+      data.append(reinterpret_cast<const char*>(node.tree.bytes()), kIdSize);
+
+      boost::uint64_t time = static_cast<boost::uint64_t>(node.commitTime);
+      for (int shift = 56; shift >= 0; shift -= 8)
+         data.push_back(static_cast<char>((time >> shift) & 0xff));
+      boost::uint32_t parents = static_cast<boost::uint32_t>(
+                                                   node.parents.size());
+      for (int shift = 24; shift >= 0; shift -= 8)
+         data.push_back(static_cast<char>((parents >> shift) & 0xff));
+
+      for (std::size_t i = 0; i < node.parents.size(); i++)
+      {
+         data.append(reinterpret_cast<const char*>(node.parents[i].bytes()),
+                     kIdSize);
+      }
+   }
+
+   // write to a temporary file and move it into place so that a partially
+   // written file is never read
+   FilePath tempFile = cacheFile.parent().childPath(cacheFile.filename() +
+                                                    ".tmp");
+   Error error = writeStringToFile(tempFile, data);
+   if (error)
+      return error;
+
+   error = tempFile.move(cacheFile);
+   if (error)
+      return error;
+
+   pImpl_->commitNodesChanged = false;
+   return Success();
+}
+
+void Repository::releaseFiles()
+{
+   pImpl_->packs.clear();
+   pImpl_->baseCache.clear();
+   pImpl_->baseCacheBytes = 0;
+   pImpl_->packsScanned = false;
+}
+
+} // namespace gitobjects
+} // namespace core
+} // namespace rstudio
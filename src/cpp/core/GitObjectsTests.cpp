@@ -0,0 +1,441 @@
+/*
+ * GitObjectsTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/GitObjects.hpp>
+#include <core/PerformanceTimer.hpp>
+#include <core/system/Process.hpp>
+
+namespace rstudio {
+namespace core {
+namespace gitobjects {
+
+namespace {
+
+// the history of the test repository has branches, merges, commits with
+// the same commit time, lightweight and annotated tags, and files in
+// subdirectories
+const char* const kCreateRepoScript =
+   "set -e\n"
+   "git init -q .\n"
+   "git symbolic-ref HEAD refs/heads/master\n"
+   "git config user.name Test\n"
+   "git config user.email test@example.com\n"
+   "c() {\n"
+   "  mkdir -p \"$(dirname \"$1\")\"\n"
+   "  echo \"$2\" >> \"$1\"\n"
+   "  git add -A\n"
+   "  GIT_AUTHOR_DATE=\"@$3 +0100\" GIT_COMMITTER_DATE=\"@$3 +0100\" \\\n"
+   "     git commit -q -m \"$4\"\n"
+   "}\n"
+   "c a.txt 1 1000 one\n"
+   "c dir/b.txt 2 1010 two\n"
+   "git checkout -q -b topic\n"
+   "c a.txt 3 1020 three\n"
+   "c dir/b.txt 4 1020 four\n"
+   "git checkout -q master\n"
+   "c c.txt 5 1015 five\n"
+   "GIT_COMMITTER_DATE='@1025 +0100' git merge -q --no-ff -m merge topic\n"
+   "git tag v1 HEAD~1\n"
+   "git tag -a -m annotated v2 HEAD\n"
+   "git checkout -q -b side HEAD~1\n"
+   "c dir/b.txt 6 1030 six\n"
+   "git checkout -q master\n"
+   "i=0\n"
+   "while [ $i -lt 30 ]; do\n"
+   "  c a.txt $i $((1040 + i / 3)) \"more $i\"\n"
+   "  i=$((i + 1))\n"
+   "done\n"
+   "c dir/d/e.txt 7 1100 deep\n";
+
+// run a shell command in dir (returning its output)
+bool run(const FilePath& dir, const std::string& command, std::string* pOutput)
+{
+   core::system::ProcessOptions options;
+   options.workingDir = dir;
+   core::system::ProcessResult result;
+   Error error = core::system::runCommand(command, options, &result);
+   if (error || result.exitStatus != EXIT_SUCCESS)
+      return false;
+   if (pOutput)
+      *pOutput = result.stdOut;
+   return true;
+}
+
+bool gitAvailable()
+{
+   std::string output;
+   return run(FilePath("/"), "git --version", &output);
+}
+
+FilePath createRepo(const std::string& script)
+{
+   FilePath repoDir;
+   Error error = FilePath::tempFilePath(&repoDir);
+   if (error)
+      LOG_ERROR(error);
+   repoDir.ensureDirectory();
+
+   FilePath scriptFile = repoDir.childPath("create.sh");
+   writeStringToFile(scriptFile, script);
+   if (!run(repoDir, "sh create.sh", NULL))
+      LOG_ERROR_MESSAGE("Unable to create test repository");
+   scriptFile.remove();
+   return repoDir;
+}
+
+std::vector<std::string> lines(const std::string& output)
+{
+   std::vector<std::string> result;
+   std::string trimmed = boost::algorithm::trim_copy(output);
+   if (!trimmed.empty())
+      boost::algorithm::split(result, trimmed, boost::algorithm::is_any_of("\n"));
+   return result;
+}
+
+// history in the form of rev-list --parents output
+std::vector<std::string> historyLines(const std::vector<HistoryEntry>& history)
+{
+   std::vector<std::string> result;
+   for (std::size_t i = 0; i < history.size(); i++)
+   {
+      std::string line = history[i].id.hex();
+      for (std::size_t j = 0; j < history[i].parents.size(); j++)
+         line += " " + history[i].parents[j].hex();
+      result.push_back(line);
+   }
+   return result;
+}
+
+std::vector<std::string> historyIds(const std::vector<HistoryEntry>& history)
+{
+   std::vector<std::string> result;
+   for (std::size_t i = 0; i < history.size(); i++)
+      result.push_back(history[i].id.hex());
+   return result;
+}
+
+std::vector<std::string> nativeHistory(const FilePath& repoDir,
+                                       const std::string& rev,
+                                       const std::string& path = std::string())
+{
+   Repository repo(repoDir.childPath(".git"));
+   std::vector<ObjectId> tips;
+   Error error = repo.resolveRevision(rev, &tips);
+   if (error)
+      return std::vector<std::string>(1, "error: " + error.summary());
+
+   std::vector<HistoryEntry> history;
+   error = repo.history(tips, path, &history);
+   if (error)
+      return std::vector<std::string>(1, "error: " + error.summary());
+
+   return path.empty() ? historyLines(history) : historyIds(history);
+}
+
+std::vector<std::string> gitHistory(const FilePath& repoDir,
+                                    const std::string& rev,
+                                    const std::string& path = std::string())
+{
+   std::string output;
+   if (path.empty())
+      run(repoDir, "git rev-list --date-order --parents " + rev, &output);
+   else
+      run(repoDir, "git rev-list --date-order " + rev + " -- " + path, &output);
+   return lines(output);
+}
+
+} // anonymous namespace
+
+context("GitObjects")
+{
+   test_that("history matches git rev-list")
+   {
+      if (gitAvailable())
+      {
+         FilePath repoDir = createRepo(kCreateRepoScript);
+         for (int packed = 0; packed < 2; packed++)
+         {
+            // (once with loose objects, once with deltified packs)
+            if (packed)
+               run(repoDir, "git gc -q --aggressive", NULL);
+
+            expect_true(nativeHistory(repoDir, "HEAD") ==
+                        gitHistory(repoDir, "HEAD"));
+            expect_true(nativeHistory(repoDir, "") ==
+                        gitHistory(repoDir, "HEAD"));
+            expect_true(nativeHistory(repoDir, "--all") ==
+                        gitHistory(repoDir, "--all"));
+            expect_true(nativeHistory(repoDir, "topic") ==
+                        gitHistory(repoDir, "topic"));
+            expect_true(nativeHistory(repoDir, "v1") ==
+                        gitHistory(repoDir, "v1"));
+            expect_true(nativeHistory(repoDir, "v2") ==
+                        gitHistory(repoDir, "v2"));
+            expect_true(nativeHistory(repoDir, "refs/heads/side") ==
+                        gitHistory(repoDir, "refs/heads/side"));
+         }
+      }
+   }
+
+   test_that("path filtered history matches git rev-list")
+   {
+      if (gitAvailable())
+      {
+         FilePath repoDir = createRepo(kCreateRepoScript);
+         for (int packed = 0; packed < 2; packed++)
+         {
+            if (packed)
+               run(repoDir, "git gc -q --aggressive", NULL);
+
+            const char* const kPaths[] = { "a.txt", "dir", "dir/b.txt",
+                                           "dir/d/e.txt", "c.txt",
+                                           "missing.txt" };
+            for (std::size_t i = 0; i < 6; i++)
+            {
+               expect_true(nativeHistory(repoDir, "HEAD", kPaths[i]) ==
+                           gitHistory(repoDir, "HEAD", kPaths[i]));
+               expect_true(nativeHistory(repoDir, "--all", kPaths[i]) ==
+                           gitHistory(repoDir, "--all", kPaths[i]));
+            }
+         }
+      }
+   }
+
+   test_that("commits and decorations are read")
+   {
+      if (gitAvailable())
+      {
+         FilePath repoDir = createRepo(kCreateRepoScript);
+         run(repoDir, "git gc -q", NULL);
+
+         Repository repo(repoDir.childPath(".git"));
+         std::vector<ObjectId> tips;
+         expect_false(repo.resolveRevision("v2", &tips));
+         expect_true(tips.size() == 1);
+         if (tips.size() != 1)
+            return;
+
+         Commit commit;
+         expect_false(repo.readCommit(tips[0], &commit));
+         expect_true(commit.id == tips[0]);
+         expect_true(commit.parents.size() == 2);
+         expect_true(commit.author == "Test <test@example.com>");
+         expect_true(commit.commitTime == 1025);
+         expect_true(commit.commitTimeZone == "+0100");
+         expect_true(commit.message == "merge\n");
+
+         std::map<ObjectId, std::vector<std::string> > decorations;
+         expect_false(repo.decorations(&decorations));
+         const std::vector<std::string>& refs = decorations[tips[0]];
+         expect_true(std::find(refs.begin(), refs.end(),
+                               "tag: refs/tags/v2") != refs.end());
+
+         std::string head;
+         run(repoDir, "git rev-parse HEAD", &head);
+         ObjectId headId;
+         expect_true(ObjectId::fromHex(boost::algorithm::trim_copy(head),
+                                       &headId));
+         const std::vector<std::string>& headRefs = decorations[headId];
+         expect_true(std::find(headRefs.begin(), headRefs.end(), "HEAD") !=
+                     headRefs.end());
+         expect_true(std::find(headRefs.begin(), headRefs.end(),
+                               "refs/heads/master") != headRefs.end());
+      }
+   }
+
+   test_that("unsupported revisions and repositories are reported")
+   {
+      if (gitAvailable())
+      {
+         FilePath repoDir = createRepo(kCreateRepoScript);
+         Repository repo(repoDir.childPath(".git"));
+         std::vector<ObjectId> tips;
+         Error error = repo.resolveRevision("HEAD~2", &tips);
+         expect_true(error);
+         expect_true(error.code() == boost::system::errc::not_supported);
+
+         run(repoDir, "mkdir -p .git/refs/replace", NULL);
+         error = repo.resolveRevision("HEAD", &tips);
+         expect_true(error.code() == boost::system::errc::not_supported);
+      }
+   }
+
+   test_that("the commit graph can be persisted")
+   {
+      if (gitAvailable())
+      {
+         FilePath repoDir = createRepo(kCreateRepoScript);
+         FilePath cacheFile = repoDir.childPath("commit-graph.cache");
+         std::vector<std::string> expected = nativeHistory(repoDir, "--all");
+         {
+            Repository repo(repoDir.childPath(".git"));
+            std::vector<ObjectId> tips;
+            std::vector<HistoryEntry> history;
+            expect_false(repo.resolveRevision("--all", &tips));
+            expect_false(repo.history(tips, "", &history));
+            expect_false(repo.saveCommitGraph(cacheFile));
+         }
+
+         // the history comes from the cache when the objects are gone
+         run(repoDir, "git gc -q && rm -f .git/objects/pack/*.pack", NULL);
+         Repository repo(repoDir.childPath(".git"));
+         expect_false(repo.loadCommitGraph(cacheFile));
+         std::vector<ObjectId> tips;
+         std::vector<HistoryEntry> history;
+         expect_false(repo.resolveRevision("--all", &tips));
+         expect_false(repo.history(tips, "", &history));
+         expect_true(historyLines(history) == expected);
+      }
+   }
+
+   test_that("shallow history is deepened")
+   {
+      if (gitAvailable())
+      {
+         FilePath repoDir = createRepo(kCreateRepoScript);
+         FilePath cloneDir = createRepo(
+            "git clone -q --depth 3 file://" + repoDir.absolutePath() +
+            " clone\n").childPath("clone");
+         FilePath cacheFile = repoDir.childPath("commit-graph.cache");
+
+         Repository repo(cloneDir.childPath(".git"));
+         std::vector<ObjectId> tips;
+         std::vector<HistoryEntry> history;
+         expect_false(repo.resolveRevision("HEAD", &tips));
+         expect_false(repo.history(tips, "", &history));
+         expect_true(historyLines(history) == gitHistory(cloneDir, "HEAD"));
+         expect_false(repo.saveCommitGraph(cacheFile));
+
+         std::vector<ObjectId> shallow;
+         expect_false(repo.shallowCommits(&shallow));
+         expect_false(shallow.empty());
+
+         // (the open repository and the persisted graph both see the
+         // parents once they are fetched)
+         run(cloneDir, "git fetch -q --unshallow", NULL);
+         expect_false(repo.shallowCommits(&shallow));
+         expect_true(shallow.empty());
+         history.clear();
+         expect_false(repo.history(tips, "", &history));
+         expect_true(historyLines(history) == gitHistory(cloneDir, "HEAD"));
+
+         Repository reloaded(cloneDir.childPath(".git"));
+         expect_false(reloaded.loadCommitGraph(cacheFile));
+         history.clear();
+         expect_false(reloaded.history(tips, "", &history));
+         expect_true(historyLines(history) == gitHistory(cloneDir, "HEAD"));
+         expect_true(history.size() > 3);
+      }
+   }
+
+   test_that("benchmark: history of a large repository")
+   {
+      if (tests::benchmarksEnabled() && gitAvailable())
+      {
+         // 200,000 commits written with fast-import
+         const int kCommits = 200000;
+         FilePath repoDir = createRepo(
+            "set -e\n"
+            "git init -q .\n"
+            "i=1\n"
+            "{\n"
+            "while [ $i -le " + boost::lexical_cast<std::string>(kCommits) +
+                  " ]; do\n"
+            "  echo \"commit refs/heads/master\"\n"
+            "  echo \"committer Test <test@example.com> $((1000000000 + i)) +0000\"\n"
+            "  echo \"data 8\"\n"
+            "  printf 'commit\\n\\n'\n"
+            "  echo \"M 644 inline file$((i % 100)).txt\"\n"
+            "  echo \"data <<EOF\"\n"
+            "  echo \"$i\"\n"
+            "  echo \"EOF\"\n"
+            "  echo\n"
+            "  i=$((i + 1))\n"
+            "done\n"
+            "} | git fast-import --quiet\n"
+            "git symbolic-ref HEAD refs/heads/master\n");
+
+         std::string output;
+         {
+            PerformanceTimer timer("git rev-list --date-order --parents "
+                                   "(200,000 commits)");
+            run(repoDir, "git rev-list --date-order --parents HEAD", &output);
+         }
+         std::vector<std::string> expected = lines(output);
+
+         FilePath cacheFile = repoDir.childPath("commit-graph.cache");
+         std::vector<HistoryEntry> history;
+         {
+            Repository repo(repoDir.childPath(".git"));
+            std::vector<ObjectId> tips;
+            PerformanceTimer timer("native history (200,000 commits)");
+            repo.resolveRevision("HEAD", &tips);
+            repo.history(tips, "", &history);
+            repo.saveCommitGraph(cacheFile);
+         }
+         expect_true(historyLines(history) == expected);
+
+         {
+            Repository repo(repoDir.childPath(".git"));
+            std::vector<ObjectId> tips;
+            history.clear();
+            PerformanceTimer timer("native history from the commit graph "
+                                   "cache (200,000 commits)");
+            repo.loadCommitGraph(cacheFile);
+            repo.resolveRevision("HEAD", &tips);
+            repo.history(tips, "", &history);
+         }
+         expect_true(historyLines(history) == expected);
+
+         {
+            PerformanceTimer timer("git rev-list -- file7.txt "
+                                   "(200,000 commits)");
+            run(repoDir, "git rev-list --date-order HEAD -- file7.txt",
+                &output);
+         }
+         {
+            Repository repo(repoDir.childPath(".git"));
+            std::vector<ObjectId> tips;
+            history.clear();
+            PerformanceTimer timer("native history of file7.txt "
+                                   "(200,000 commits)");
+            repo.loadCommitGraph(cacheFile);
+            repo.resolveRevision("HEAD", &tips);
+            repo.history(tips, "file7.txt", &history);
+         }
+         expect_true(historyIds(history) == lines(output));
+      }
+   }
+}
+
+} // namespace gitobjects
+} // namespace core
+} // namespace rstudio
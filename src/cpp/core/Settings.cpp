@@ -15,53 +15,183 @@
 
 #include <core/Settings.hpp>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#endif
+
 #include <boost/lexical_cast.hpp>
 
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
 #include <core/SafeConvert.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
 
 namespace rstudio {
 namespace core {
 
+namespace {
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+// resolve a symlink to the file it points to (false if it doesn't exist)
+bool resolveSymlink(const FilePath& link, FilePath* pTarget)
+{
+#ifndef _WIN32
+   char* resolved = ::realpath(link.absolutePath().c_str(), NULL);
+   if (resolved == NULL)
+      return false;
+   *pTarget = FilePath(resolved);
+   ::free(resolved);
+   return true;
+#else
+   return false;
+#endif
+}
+
+// give a replacement file the permissions of the file it replaces
+void copyFileMode(const FilePath& from, const FilePath& to)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(from.absolutePath().c_str(), &st) == -1)
+      return;
+
+   if (::chmod(to.absolutePath().c_str(), st.st_mode & 07777) == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+#endif
+}
+
+template <typename T>
+T parseValue(const std::string& text, boost::optional<T>* pValue)
+{
+   if (!*pValue)
+      *pValue = boost::lexical_cast<T>(text);
+   return **pValue;
+}
+
+} // anonymous namespace
+
 Settings::Settings()
    : updatePending_(false),
-     isDirty_(false)
+     isDirty_(false),
+     generation_(0)
 {
 }
 
 Settings::~Settings()
 {
+   try
+   {
+      if (isDirty_ && !settingsFile_.empty())
+         writeSettings();
+   }
+   catch(...)
+   {
+   }
 }
 
 Error Settings::initialize(const FilePath& filePath) 
 {
+   // pending changes are merged into what's read from the same file (rather
+   // than written first, which would overwrite changes made to it elsewhere)
+   // and written to a different file before it's read
+   std::map<std::string,std::string> pending;
+   if (isDirty_ && !settingsFile_.empty())
+   {
+      if (filePath == settingsFile_)
+      {
+         for (std::set<std::string>::const_iterator it = dirtyNames_.begin();
+              it != dirtyNames_.end(); ++it)
+         {
+            const Value* pValue = find(*it);
+            if (pValue)
+               pending[*it] = pValue->text;
+         }
+      }
+      else
+      {
+         writeSettings();
+      }
+   }
+   isDirty_ = false;
+   dirtyNames_.clear();
+
    settingsFile_ = filePath ;
-   settingsMap_.clear() ;
-   Error error = core::readStringMapFromFile(settingsFile_, &settingsMap_) ;
+   std::map<std::string,std::string> settings;
+   Error error = core::readStringMapFromFile(settingsFile_, &settings) ;
    if (error)
    {
       // we don't consider file-not-found and error because it is a 
       // common initialization case
       if (error.code() != boost::system::errc::no_such_file_or_directory)
       {
+         settingsMap_.clear() ;
+         generation_++;
          error.addProperty("settings-file", settingsFile_);
          return error ;
       }
    }
+
+   for (std::map<std::string,std::string>::const_iterator
+         it = pending.begin(); it != pending.end(); ++it)
+   {
+      std::string& text = settings[it->first];
+      if (text != it->second)
+      {
+         text = it->second;
+         dirtyNames_.insert(it->first);
+         isDirty_ = true;
+      }
+   }
+
+   // settings which are unchanged keep their generation (and any values
+   // already parsed from them)
+   uint64_t generation = generation_ + 1;
+   bool changed = false;
+   std::size_t unchanged = 0;
+   std::map<std::string,Value> settingsMap;
+   for (std::map<std::string,std::string>::const_iterator
+         it = settings.begin(); it != settings.end(); ++it)
+   {
+      const Value* pValue = find(it->first);
+      if (pValue && pValue->text == it->second)
+      {
+         settingsMap[it->first] = *pValue;
+         unchanged++;
+      }
+      else
+      {
+         settingsMap[it->first] = Value(it->second, generation);
+         changed = true;
+      }
+   }
+
+   // settings which were removed are also a change
+   if (changed || unchanged < settingsMap_.size())
+      generation_ = generation;
+
+   settingsMap_.swap(settingsMap);
    
    return Success() ;
 }
 
 void Settings::set(const std::string& name, const std::string& value)
 {
-   if (value != settingsMap_[name])
+   const Value* pValue = find(name);
+   std::string previousValue = pValue ? pValue->text : std::string();
+   if (value != previousValue)
    {
-      settingsMap_[name] = value ;
+      settingsMap_[name] = Value(value, ++generation_);
+      dirtyNames_.insert(name);
       isDirty_ = true;
       
-      if (!updatePending_)
+      if (!updatePending_ && writeDue())
          writeSettings() ;
    }
 }
@@ -90,52 +220,57 @@ bool Settings::contains(const std::string& name) const
 std::string Settings::get(const std::string& name, 
                           const std::string& defaultValue) const
 {
-   std::map<std::string,std::string>::const_iterator pos = 
-                                                   settingsMap_.find(name) ;
-   if (pos != settingsMap_.end())
-      return (*pos).second ;
+   const Value* pValue = find(name);
+   if (pValue)
+      return pValue->text ;
    else
       return defaultValue ;
 }
    
 int Settings::getInt(const std::string& name, int defaultValue) const
 {
-   std::string value = get(name) ;
-   if (value.empty())
+   const Value* pValue = find(name);
+   if (!pValue || pValue->text.empty())
        return defaultValue ;
    else
-       return boost::lexical_cast<int>(value);
+       return parseValue(pValue->text, &pValue->intValue);
 }
 
 double Settings::getDouble(const std::string& name, double defaultValue) const
 {
-   std::string value = get(name) ;
-   if (value.empty())
+   const Value* pValue = find(name);
+   if (!pValue || pValue->text.empty())
        return defaultValue ;
    else
-       return boost::lexical_cast<double>(value);
+       return parseValue(pValue->text, &pValue->doubleValue);
 }
 
 bool Settings::getBool(const std::string& name, bool defaultValue) const
 {
-   std::string value = get(name) ;
-   if (value.empty())
+   const Value* pValue = find(name);
+   if (!pValue || pValue->text.empty())
       return defaultValue ;
    else
-      return boost::lexical_cast<bool>(value);
+      return parseValue(pValue->text, &pValue->boolValue);
 }   
    
 void Settings::forEach(const boost::function<void(const std::string&,
                                                   const std::string&)>& func)
                                                                          const
 {
-   for (std::map<std::string,std::string>::const_iterator
+   for (std::map<std::string,Value>::const_iterator
          it = settingsMap_.begin(); it != settingsMap_.end(); ++it)
    {
-      func(it->first, it->second);
+      func(it->first, it->second.text);
    }
 }
 
+uint64_t Settings::generation(const std::string& name) const
+{
+   const Value* pValue = find(name);
+   return pValue ? pValue->generation : 0;
+}
+
 void Settings::beginUpdate()
 {
    updatePending_ = true ;
@@ -148,16 +283,85 @@ void Settings::endUpdate()
       writeSettings();
 }
 
+void Settings::setWriteDelay(const boost::posix_time::time_duration& delay)
+{
+   writeDelay_ = delay;
+}
+
+void Settings::flush()
+{
+   if (isDirty_)
+      writeSettings();
+}
+
+const Settings::Value* Settings::find(const std::string& name) const
+{
+   std::map<std::string,Value>::const_iterator pos = settingsMap_.find(name);
+   if (pos != settingsMap_.end())
+      return &(pos->second);
+   else
+      return NULL;
+}
+
+bool Settings::writeDue() const
+{
+   return writeDelay_.ticks() <= 0 ||
+          lastWrite_.is_not_a_date_time() ||
+          (now() - lastWrite_) >= writeDelay_;
+}
+
 void Settings::writeSettings() 
 {
    isDirty_ = false;
-   Error error = core::writeStringMapToFile(settingsFile_, settingsMap_) ; 
+   dirtyNames_.clear();
+   lastWrite_ = now();
+   if (settingsFile_.empty())
+      return;
+
+   std::map<std::string,std::string> settings;
+   for (std::map<std::string,Value>::const_iterator
+         it = settingsMap_.begin(); it != settingsMap_.end(); ++it)
+   {
+      settings.insert(settings.end(),
+                      std::make_pair(it->first, it->second.text));
+   }
+
+   // replace the file a symlink points to rather than the symlink (if the
+   // target doesn't exist yet then write through the symlink)
+   FilePath targetFile = settingsFile_;
+   if (settingsFile_.isSymlink())
+   {
+      if (!resolveSymlink(settingsFile_, &targetFile))
+      {
+         Error error = core::writeStringMapToFile(settingsFile_, settings);
+         if (error)
+            LOG_ERROR(error);
+         return;
+      }
+   }
+
+   // write to a temporary file alongside the settings and then move it
+   // into place (so the settings file is never seen partially written,
+   // even by other processes sharing it)
+   FilePath tempFile = targetFile.parent().complete(
+            targetFile.filename() + ".tmp-" +
+            safe_convert::numberToString(core::system::currentProcessId()));
+   Error error = core::writeStringMapToFile(tempFile, settings) ;
+   if (!error)
+   {
+      copyFileMode(targetFile, tempFile);
+      error = tempFile.move(targetFile);
+   }
    if (error)
-     LOG_ERROR(error);
+   {
+      LOG_ERROR(error);
+
+      Error removeError = tempFile.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+   }
 }
 
 
 }
 }
-
-
@@ -0,0 +1,244 @@
+/*
+ * SettingsTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <map>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Settings.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+FilePath testFilePath()
+{
+   FilePath filePath;
+   Error error = FilePath::tempFilePath(&filePath);
+   if (error)
+      LOG_ERROR(error);
+   return filePath;
+}
+
+std::string fileValue(const FilePath& filePath, const std::string& name)
+{
+   std::map<std::string,std::string> values;
+   Error error = readStringMapFromFile(filePath, &values);
+   if (error)
+      return std::string();
+   return values[name];
+}
+
+} // anonymous namespace
+
+context("Settings")
+{
+   test_that("typed values survive a round trip")
+   {
+      FilePath filePath = testFilePath();
+      {
+         Settings settings;
+         expect_true(!settings.initialize(filePath));
+         settings.set("int", 42);
+         settings.set("double", 2.5);
+         settings.set("bool", true);
+         settings.set("string", std::string("value"));
+      }
+
+      Settings settings;
+      expect_true(!settings.initialize(filePath));
+      expect_true(settings.getInt("int") == 42);
+      expect_true(settings.getDouble("double") == 2.5);
+      expect_true(settings.getBool("bool"));
+      expect_true(settings.get("string") == "value");
+      expect_true(settings.getInt("missing", 7) == 7);
+      expect_false(settings.contains("missing"));
+
+      // values are parsed again when they change
+      settings.set("int", 43);
+      expect_true(settings.getInt("int") == 43);
+
+      filePath.removeIfExists();
+   }
+
+   test_that("generations track changes")
+   {
+      FilePath filePath = testFilePath();
+      Settings settings;
+      expect_true(!settings.initialize(filePath));
+      expect_true(settings.generation("name") == 0);
+
+      settings.set("name", std::string("a"));
+      uint64_t generation = settings.generation();
+      expect_true(settings.generation("name") == generation);
+
+      // setting the same value isn't a change
+      settings.set("name", std::string("a"));
+      expect_true(settings.generation() == generation);
+
+      settings.set("other", 1);
+      expect_true(settings.generation() > generation);
+      expect_true(settings.generation("name") == generation);
+
+      // re-reading unchanged settings isn't a change
+      uint64_t current = settings.generation();
+      expect_true(!settings.initialize(filePath));
+      expect_true(settings.generation() == current);
+
+      // but re-reading settings changed elsewhere is
+      std::map<std::string,std::string> values;
+      values["name"] = "b";
+      values["other"] = "1";
+      expect_true(!writeStringMapToFile(filePath, values));
+      expect_true(!settings.initialize(filePath));
+      expect_true(settings.generation() > current);
+      expect_true(settings.generation("name") == settings.generation());
+      expect_true(settings.generation("other") < settings.generation());
+      expect_true(settings.get("name") == "b");
+
+      filePath.removeIfExists();
+   }
+
+   test_that("re-reading keeps pending changes and changes made elsewhere")
+   {
+      FilePath filePath = testFilePath();
+      Settings settings;
+      expect_true(!settings.initialize(filePath));
+      settings.setWriteDelay(boost::posix_time::hours(1));
+      settings.set("name", std::string("a"));
+      settings.set("other", 1);
+      settings.flush();
+
+      // a pending change
+      settings.set("name", std::string("b"));
+      expect_true(settings.writePending());
+
+      // and a change made elsewhere
+      std::map<std::string,std::string> values;
+      values["name"] = "a";
+      values["other"] = "2";
+      values["added"] = "3";
+      expect_true(!writeStringMapToFile(filePath, values));
+
+      expect_true(!settings.initialize(filePath));
+      expect_true(settings.get("name") == "b");
+      expect_true(settings.getInt("other") == 2);
+      expect_true(settings.getInt("added") == 3);
+      expect_true(settings.writePending());
+
+      settings.flush();
+      expect_true(fileValue(filePath, "name") == "b");
+      expect_true(fileValue(filePath, "other") == "2");
+      expect_true(fileValue(filePath, "added") == "3");
+
+      filePath.removeIfExists();
+   }
+
+   test_that("writes are deferred within the write delay")
+   {
+      FilePath filePath = testFilePath();
+      Settings settings;
+      expect_true(!settings.initialize(filePath));
+      settings.setWriteDelay(boost::posix_time::hours(1));
+
+      // the first change is written immediately
+      settings.set("first", 1);
+      expect_false(settings.writePending());
+      expect_true(fileValue(filePath, "first") == "1");
+
+      // later changes wait until they're flushed
+      settings.set("second", 2);
+      expect_true(settings.writePending());
+      expect_true(fileValue(filePath, "second").empty());
+
+      settings.flush();
+      expect_false(settings.writePending());
+      expect_true(fileValue(filePath, "second") == "2");
+
+      // and are written if the settings are destroyed before a flush
+      settings.set("third", 3);
+      expect_true(fileValue(filePath, "third").empty());
+      {
+         Settings other;
+         expect_true(!other.initialize(filePath));
+         other.setWriteDelay(boost::posix_time::hours(1));
+         other.set("first", 10);
+         other.set("fourth", 4);
+      }
+      expect_true(fileValue(filePath, "fourth") == "4");
+
+      filePath.removeIfExists();
+   }
+
+   test_that("writes replace the file without leaving temporary files")
+   {
+      FilePath filePath = testFilePath();
+      Settings settings;
+      expect_true(!settings.initialize(filePath));
+      for (int i = 0; i < 10; i++)
+         settings.set("value", i);
+      expect_true(fileValue(filePath, "value") == "9");
+
+      std::vector<FilePath> children;
+      expect_true(!filePath.parent().children(&children));
+      bool tempFileFound = false;
+      for (std::size_t i = 0; i < children.size(); i++)
+      {
+         if (children[i].filename().find(filePath.filename() + ".tmp") == 0)
+            tempFileFound = true;
+      }
+      expect_false(tempFileFound);
+
+      filePath.removeIfExists();
+   }
+
+#ifndef _WIN32
+   test_that("writes keep symlinks and permissions")
+   {
+      FilePath filePath = testFilePath();
+      FilePath linkPath = testFilePath();
+      expect_true(!writeStringToFile(filePath, ""));
+      expect_true(::chmod(filePath.absolutePath().c_str(), 0640) == 0);
+      expect_true(::symlink(filePath.absolutePath().c_str(),
+                            linkPath.absolutePath().c_str()) == 0);
+
+      Settings settings;
+      expect_true(!settings.initialize(linkPath));
+      settings.set("value", 1);
+
+      expect_true(linkPath.isSymlink());
+      expect_true(fileValue(filePath, "value") == "1");
+      struct stat st;
+      expect_true(::stat(filePath.absolutePath().c_str(), &st) == 0);
+      expect_true((st.st_mode & 07777) == 0640);
+
+      linkPath.removeIfExists();
+      filePath.removeIfExists();
+   }
+#endif
+}
+
+} // namespace core
+} // namespace rstudio
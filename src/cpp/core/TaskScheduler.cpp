@@ -0,0 +1,388 @@
+/*
+ * TaskScheduler.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/TaskScheduler.hpp>
+
+#include <deque>
+
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <core/Thread.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tasks {
+
+namespace {
+
+void runTask(const Task& task)
+{
+   try
+   {
+      task();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+// Each of the pool's threads has a queue of its own. A thread takes tasks
+// from the back of its own queue (so tasks which post further tasks tend
+// to have them run on the same thread, while their data is still in its
+// cache) and, when its queue is empty, steals tasks from the front of the
+// other threads' queues. Threads with nothing to do sleep until a task is
+// posted.
+struct ThreadPool::Impl
+{
+   struct Worker : boost::noncopyable
+   {
+      boost::mutex mutex;
+      std::deque<Task> tasks;
+   };
+
+   // the pool and index of the worker running on the current thread
+   struct WorkerContext
+   {
+      WorkerContext(Impl* pPool, std::size_t index)
+         : pPool(pPool), index(index)
+      {
+      }
+      Impl* pPool;
+      std::size_t index;
+   };
+
+   Impl()
+      : pending(0), active(0), sleeping(0), nextWorker(0), stopping(0)
+   {
+   }
+
+   void start(int threads)
+   {
+      for (int i = 0; i < threads; i++)
+         workers.push_back(boost::shared_ptr<Worker>(new Worker()));
+
+      try
+      {
+         for (std::size_t i = 0; i < workers.size(); i++)
+         {
+            threadGroup.create_thread(boost::bind(&Impl::run, this, i));
+         }
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         Error error(boost::thread_error::ec_from_exception(e),
+                     ERROR_LOCATION);
+         LOG_ERROR(error);
+      }
+   }
+
+   void post(const Task& task)
+   {
+      // queue on the current thread's worker if we're on one of our
+      // threads (otherwise spread tasks across the workers). tasks which
+      // are running while the pool stops can still post further tasks
+      std::size_t index;
+      WorkerContext* pContext = s_pWorkerContext.get();
+      if (pContext && pContext->pPool == this)
+      {
+         index = pContext->index;
+      }
+      else if (stopping)
+      {
+         LOG_WARNING_MESSAGE("Task posted to stopped thread pool");
+         return;
+      }
+      else
+      {
+         index = static_cast<std::size_t>(++nextWorker) % workers.size();
+      }
+
+      Worker& worker = *workers[index];
+      LOCK_MUTEX(worker.mutex)
+      {
+         worker.tasks.push_back(task);
+      }
+      END_LOCK_MUTEX
+
+      // the count of pending tasks is incremented before the count of
+      // sleeping threads is read (and sleeping threads increment their
+      // count before reading the pending count) so a thread can't go to
+      // sleep without seeing this task
+      ++pending;
+      if (sleeping > 0)
+      {
+         LOCK_MUTEX(sleepMutex)
+         {
+            sleepCondition.notify_one();
+         }
+         END_LOCK_MUTEX
+      }
+   }
+
+   bool takeTask(std::size_t index, Task* pTask)
+   {
+      // take from the back of our own queue
+      Worker& worker = *workers[index];
+      LOCK_MUTEX(worker.mutex)
+      {
+         if (!worker.tasks.empty())
+         {
+            *pTask = worker.tasks.back();
+            worker.tasks.pop_back();
+            return true;
+         }
+      }
+      END_LOCK_MUTEX
+
+      // steal from the front of another's
+      for (std::size_t i = 1; i < workers.size(); i++)
+      {
+         Worker& victim = *workers[(index + i) % workers.size()];
+         LOCK_MUTEX(victim.mutex)
+         {
+            if (!victim.tasks.empty())
+            {
+               *pTask = victim.tasks.front();
+               victim.tasks.pop_front();
+               return true;
+            }
+         }
+         END_LOCK_MUTEX
+      }
+
+      return false;
+   }
+
+   void run(std::size_t index)
+   {
+      s_pWorkerContext.reset(new WorkerContext(this, index));
+
+      while (true)
+      {
+         Task task;
+         if (takeTask(index, &task))
+         {
+            ++active;
+            --pending;
+            runTask(task);
+            --active;
+
+            // wake the other threads if they're waiting to exit
+            if (stopping && sleeping > 0)
+               notifyAll();
+            continue;
+         }
+
+         // nothing to do so sleep until a task is posted (or exit if
+         // we're stopping and there are no tasks left nor any running
+         // which might post more)
+         try
+         {
+            boost::unique_lock<boost::mutex> lock(sleepMutex);
+            ++sleeping;
+            while (pending == 0 && !(stopping && active == 0))
+               sleepCondition.wait(lock);
+            --sleeping;
+
+            if (pending == 0 && stopping && active == 0)
+               break;
+         }
+         catch(const boost::thread_resource_error& e)
+         {
+            Error error(boost::thread_error::ec_from_exception(e),
+                        ERROR_LOCATION);
+            LOG_ERROR(error);
+            break;
+         }
+      }
+   }
+
+   void notifyAll()
+   {
+      LOCK_MUTEX(sleepMutex)
+      {
+         sleepCondition.notify_all();
+      }
+      END_LOCK_MUTEX
+   }
+
+   void stop()
+   {
+      LOCK_MUTEX(sleepMutex)
+      {
+         if (stopping)
+            return;
+         ++stopping;
+         sleepCondition.notify_all();
+      }
+      END_LOCK_MUTEX
+
+      threadGroup.join_all();
+   }
+
+   std::vector<boost::shared_ptr<Worker> > workers;
+   boost::thread_group threadGroup;
+
+   boost::detail::atomic_count pending;
+   boost::detail::atomic_count active;
+   boost::detail::atomic_count sleeping;
+   boost::detail::atomic_count nextWorker;
+
+   // set (under the sleep mutex) when the pool stops
+   boost::detail::atomic_count stopping;
+
+   boost::mutex sleepMutex;
+   boost::condition_variable sleepCondition;
+
+   static boost::thread_specific_ptr<WorkerContext> s_pWorkerContext;
+};
+
+boost::thread_specific_ptr<ThreadPool::Impl::WorkerContext>
+                                    ThreadPool::Impl::s_pWorkerContext;
+
+ThreadPool::ThreadPool(int threads)
+   : pImpl_(new Impl())
+{
+   if (threads <= 0)
+      threads = std::max<int>(boost::thread::hardware_concurrency(), 1);
+   pImpl_->start(threads);
+}
+
+ThreadPool::~ThreadPool()
+{
+   try
+   {
+      stop();
+   }
+   catch(...)
+   {
+   }
+}
+
+void ThreadPool::post(const Task& task)
+{
+   pImpl_->post(task);
+}
+
+int ThreadPool::threads() const
+{
+   return static_cast<int>(pImpl_->workers.size());
+}
+
+void ThreadPool::stop()
+{
+   pImpl_->stop();
+}
+
+ThreadPool& backgroundPool()
+{
+   static ThreadPool* pInstance = new ThreadPool();
+   return *pInstance;
+}
+
+struct MainThreadExecutor::Impl
+{
+   boost::mutex mutex;
+   std::vector<Task> tasks;
+};
+
+MainThreadExecutor::MainThreadExecutor()
+   : pImpl_(new Impl())
+{
+}
+
+MainThreadExecutor::~MainThreadExecutor()
+{
+}
+
+void MainThreadExecutor::post(const Task& task)
+{
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      pImpl_->tasks.push_back(task);
+   }
+   END_LOCK_MUTEX
+}
+
+std::size_t MainThreadExecutor::runPending()
+{
+   // take the tasks posted so far (tasks they post run next time)
+   std::vector<Task> tasks;
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      tasks.swap(pImpl_->tasks);
+   }
+   END_LOCK_MUTEX
+
+   for (std::size_t i = 0; i < tasks.size(); i++)
+      runTask(tasks[i]);
+
+   return tasks.size();
+}
+
+MainThreadExecutor& mainThreadExecutor()
+{
+   static MainThreadExecutor instance;
+   return instance;
+}
+
+struct CancellationToken::State
+{
+   State() : cancelled(false) {}
+
+   mutable boost::mutex mutex;
+   bool cancelled;
+};
+
+CancellationToken::CancellationToken()
+   : pState_(new State())
+{
+}
+
+void CancellationToken::cancel()
+{
+   LOCK_MUTEX(pState_->mutex)
+   {
+      pState_->cancelled = true;
+   }
+   END_LOCK_MUTEX
+}
+
+bool CancellationToken::isCancelled() const
+{
+   LOCK_MUTEX(pState_->mutex)
+   {
+      return pState_->cancelled;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
+namespace detail {
+
+Error canceledError(const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::operation_canceled, location);
+}
+
+} // namespace detail
+
+} // namespace tasks
+} // namespace core
+} // namespace rstudio
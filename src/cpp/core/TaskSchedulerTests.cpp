@@ -0,0 +1,235 @@
+/*
+ * TaskSchedulerTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <set>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/detail/atomic_count.hpp>
+
+#include <core/Thread.hpp>
+#include <core/TaskScheduler.hpp>
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tasks {
+
+namespace {
+
+int square(int value)
+{
+   return value * value;
+}
+
+int throwError()
+{
+   throw std::runtime_error("task failed");
+   return 0;
+}
+
+int valuePlusOne(const Future<int>& future)
+{
+   return future.value() + 1;
+}
+
+void increment(boost::detail::atomic_count* pCount)
+{
+   ++(*pCount);
+}
+
+// post further tasks from within a task (these are queued on the posting
+// thread so the other threads must steal them to share the work)
+void fanOut(ThreadPool* pPool, int depth, boost::detail::atomic_count* pCount)
+{
+   ++(*pCount);
+   if (depth > 0)
+   {
+      pPool->post(boost::bind(fanOut, pPool, depth - 1, pCount));
+      pPool->post(boost::bind(fanOut, pPool, depth - 1, pCount));
+   }
+}
+
+void recordThread(boost::mutex* pMutex, std::set<boost::thread::id>* pIds)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+   LOCK_MUTEX(*pMutex)
+   {
+      pIds->insert(boost::this_thread::get_id());
+   }
+   END_LOCK_MUTEX
+}
+
+void waitForToken(CancellationToken token)
+{
+   while (!token.isCancelled())
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+}
+
+} // anonymous namespace
+
+context("TaskScheduler")
+{
+   test_that("scheduled tasks deliver their results")
+   {
+      ThreadPool pool(2);
+      Future<int> future = schedule<int>(&pool, boost::bind(square, 7));
+      expect_true(future.value() == 49);
+      expect_true(!future.error());
+      expect_true(future.ready());
+   }
+
+   test_that("exceptions become errors")
+   {
+      ThreadPool pool(2);
+      Future<int> future = schedule<int>(&pool, throwError);
+      expect_true(future.error());
+   }
+
+   test_that("continuations run on the main thread executor")
+   {
+      ThreadPool pool(2);
+      MainThreadExecutor mainThread;
+
+      Future<int> future = schedule<int>(&pool, boost::bind(square, 3));
+      Future<int> result = future.then<int>(&mainThread, valuePlusOne);
+      future.wait();
+
+      // nothing runs until the main thread asks
+      expect_false(result.waitFor(boost::posix_time::milliseconds(10)));
+      expect_true(mainThread.runPending() == 1);
+      expect_true(result.ready());
+      expect_true(result.value() == 10);
+
+      // continuations attached to a completed future are posted directly
+      Future<int> chained = result.then<int>(&pool, valuePlusOne)
+                                  .then<int>(&mainThread, valuePlusOne);
+      while (!chained.ready())
+         mainThread.runPending();
+      expect_true(chained.value() == 12);
+   }
+
+   test_that("cancelled tasks don't run")
+   {
+      ThreadPool pool(1);
+
+      // keep the pool's thread busy until the task has been cancelled
+      CancellationToken blocker;
+      pool.post(boost::bind(waitForToken, blocker));
+
+      CancellationToken token;
+      Future<int> future = schedule<int>(&pool, boost::bind(square, 2), token);
+      token.cancel();
+      blocker.cancel();
+
+      Error error = future.error();
+      expect_true(error);
+      expect_true(error.code() == boost::system::errc::operation_canceled);
+   }
+
+   test_that("tasks posted by tasks are shared between threads")
+   {
+      ThreadPool pool(4);
+      boost::detail::atomic_count count(0);
+      pool.post(boost::bind(fanOut, &pool, 10, &count));
+
+      boost::mutex mutex;
+      std::set<boost::thread::id> ids;
+      for (int i = 0; i < 16; i++)
+         pool.post(boost::bind(recordThread, &mutex, &ids));
+
+      pool.stop();
+      expect_true(count == 2047);
+      expect_true(ids.size() > 1);
+   }
+
+   test_that("stopping waits for queued tasks")
+   {
+      ThreadPool pool(2);
+      boost::detail::atomic_count count(0);
+      for (int i = 0; i < 1000; i++)
+         pool.post(boost::bind(increment, &count));
+      pool.stop();
+      expect_true(count == 1000);
+   }
+
+   test_that("benchmark: small tasks")
+   {
+      if (tests::benchmarksEnabled())
+      {
+         const int kTasks = 1000000;
+         ThreadPool pool;
+         boost::detail::atomic_count count(0);
+         {
+            PerformanceTimer timer("post " +
+               boost::lexical_cast<std::string>(kTasks) + " tasks to " +
+               boost::lexical_cast<std::string>(pool.threads()) +
+               " thread(s)");
+            for (int i = 0; i < kTasks; i++)
+               pool.post(boost::bind(increment, &count));
+            pool.stop();
+         }
+         expect_true(count == kTasks);
+      }
+   }
+
+   test_that("benchmark: fan out")
+   {
+      if (tests::benchmarksEnabled())
+      {
+         ThreadPool pool;
+         boost::detail::atomic_count count(0);
+         {
+            PerformanceTimer timer("fan out 2^20 tasks");
+            pool.post(boost::bind(fanOut, &pool, 19, &count));
+            pool.stop();
+         }
+         expect_true(count == (1 << 20) - 1);
+      }
+   }
+
+   test_that("benchmark: futures and continuations")
+   {
+      if (tests::benchmarksEnabled())
+      {
+         const int kTasks = 100000;
+         ThreadPool pool;
+         MainThreadExecutor mainThread;
+         std::vector<Future<int> > results;
+         results.reserve(kTasks);
+         {
+            PerformanceTimer timer("schedule " +
+               boost::lexical_cast<std::string>(kTasks) +
+               " tasks with main thread continuations");
+            for (int i = 0; i < kTasks; i++)
+            {
+               results.push_back(
+                  schedule<int>(&pool, boost::bind(square, i))
+                        .then<int>(&mainThread, valuePlusOne));
+            }
+            while (!results.back().ready())
+               mainThread.runPending();
+            mainThread.runPending();
+         }
+         expect_true(results[10].value() == 101);
+      }
+   }
+}
+
+} // namespace tasks
+} // namespace core
+} // namespace rstudio
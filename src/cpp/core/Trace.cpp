@@ -17,10 +17,20 @@
 #include <core/Trace.hpp>
 
 #include <map>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 
 #include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Thread.hpp>
+#include <core/system/System.hpp>
 
 namespace rstudio {
 namespace core {
@@ -30,6 +40,185 @@ namespace {
 
 boost::mutex s_traceMutex ;
 
+// the most recent spans recorded on each thread are kept
+const std::size_t kThreadSpanCapacity = 4096;
+
+// as are the spans of threads which have exited (up to a point)
+const std::size_t kMaxExitedThreads = 16;
+
+// histogram buckets count durations of up to 2^n microseconds
+const int kHistogramBuckets = 32;
+
+// each category has histograms for at most this many distinct names
+// (others are counted as "other" since names may come from clients)
+const std::size_t kMaxHistogramNames = 64;
+
+boost::detail::atomic_count s_enabled(0);
+
+boost::int64_t nowMicros()
+{
+   using namespace boost::posix_time;
+   static const ptime epoch = microsec_clock::universal_time();
+   return (microsec_clock::universal_time() - epoch).total_microseconds();
+}
+
+struct RecordedSpan
+{
+   const char* category;
+   std::string name;
+   boost::int64_t startMicros;
+   boost::int64_t durationMicros;
+};
+
+struct ThreadSpans : boost::noncopyable
+{
+   explicit ThreadSpans(int threadId)
+      : threadId(threadId), spans(kThreadSpanCapacity)
+   {
+   }
+
+   boost::mutex mutex;
+   int threadId;
+   boost::circular_buffer_space_optimized<RecordedSpan> spans;
+};
+
+// spans of the threads which have recorded them
+struct Threads
+{
+   Threads() : nextThreadId(1) {}
+
+   boost::mutex mutex;
+   std::vector<boost::shared_ptr<ThreadSpans> > active;
+   std::deque<boost::shared_ptr<ThreadSpans> > exited;
+   int nextThreadId;
+};
+
+// (this and the latency histograms are never freed since spans may end on
+// other threads while the process exits)
+Threads& threads()
+{
+   static Threads* pThreads = new Threads();
+   return *pThreads;
+}
+
+// owned by the thread (moves the thread's spans to the exited threads when
+// the thread exits)
+struct ThreadSpansOwner
+{
+   explicit ThreadSpansOwner(boost::shared_ptr<ThreadSpans> pSpans)
+      : pSpans(pSpans)
+   {
+   }
+
+   ~ThreadSpansOwner()
+   {
+      try
+      {
+         Threads& allThreads = threads();
+         boost::lock_guard<boost::mutex> lock(allThreads.mutex);
+         allThreads.active.erase(std::remove(allThreads.active.begin(),
+                                             allThreads.active.end(),
+                                             pSpans),
+                                 allThreads.active.end());
+         allThreads.exited.push_back(pSpans);
+         if (allThreads.exited.size() > kMaxExitedThreads)
+            allThreads.exited.pop_front();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   boost::shared_ptr<ThreadSpans> pSpans;
+};
+
+boost::thread_specific_ptr<ThreadSpansOwner> s_pThreadSpansOwner;
+
+ThreadSpans& threadSpans()
+{
+   ThreadSpansOwner* pOwner = s_pThreadSpansOwner.get();
+   if (pOwner == NULL)
+   {
+      Threads& allThreads = threads();
+      boost::shared_ptr<ThreadSpans> pSpans;
+      LOCK_MUTEX(allThreads.mutex)
+      {
+         pSpans.reset(new ThreadSpans(allThreads.nextThreadId++));
+         allThreads.active.push_back(pSpans);
+      }
+      END_LOCK_MUTEX
+
+      pOwner = new ThreadSpansOwner(pSpans);
+      s_pThreadSpansOwner.reset(pOwner);
+   }
+   return *pOwner->pSpans;
+}
+
+struct Histogram
+{
+   Histogram()
+      : count(0), totalMicros(0), maxMicros(0)
+   {
+      std::fill(buckets, buckets + kHistogramBuckets, 0);
+   }
+
+   void add(boost::int64_t micros)
+   {
+      int bucket = 0;
+      while (bucket < kHistogramBuckets - 1 && (1LL << bucket) < micros)
+         bucket++;
+      buckets[bucket]++;
+
+      count++;
+      totalMicros += micros;
+      maxMicros = std::max(maxMicros, micros);
+   }
+
+   // the upper bound of the bucket containing the percentile
+   boost::int64_t percentile(double percent) const
+   {
+      boost::uint64_t target = static_cast<boost::uint64_t>(
+                                          count * percent / 100.0 + 0.5);
+      boost::uint64_t seen = 0;
+      for (int i = 0; i < kHistogramBuckets; i++)
+      {
+         seen += buckets[i];
+         if (seen >= target && seen > 0)
+            return std::min(1LL << i, static_cast<long long>(maxMicros));
+      }
+      return maxMicros;
+   }
+
+   boost::uint64_t buckets[kHistogramBuckets];
+   boost::uint64_t count;
+   boost::int64_t totalMicros;
+   boost::int64_t maxMicros;
+};
+
+struct CStringLess
+{
+   bool operator()(const char* lhs, const char* rhs) const
+   {
+      return std::strcmp(lhs, rhs) < 0;
+   }
+};
+
+typedef std::map<std::string,Histogram> NamedHistograms;
+typedef std::map<const char*,NamedHistograms,CStringLess> Histograms;
+
+// latency histograms of the spans which have ended
+struct LatencyHistograms
+{
+   boost::mutex mutex;
+   Histograms histograms;
+};
+
+LatencyHistograms& latencies()
+{
+   static LatencyHistograms* pLatencies = new LatencyHistograms();
+   return *pLatencies;
+}
+
 } // anonymous namespace
 
 
@@ -42,6 +231,188 @@ void add(void* key, const std::string& functionName)
    END_LOCK_MUTEX
 }
 
+Span::Span(const char* category, const std::string& name)
+   : category_(category), name_(name), startMicros_(nowMicros())
+{
+}
+
+Span::~Span()
+{
+   try
+   {
+      boost::int64_t durationMicros = nowMicros() - startMicros_;
+
+      LatencyHistograms& allLatencies = latencies();
+      LOCK_MUTEX(allLatencies.mutex)
+      {
+         NamedHistograms& named = allLatencies.histograms[category_];
+         NamedHistograms::iterator it = named.find(name_);
+         if (it == named.end())
+         {
+            const std::string& name = named.size() < kMaxHistogramNames ?
+                                          name_ : std::string("other");
+            it = named.insert(std::make_pair(name, Histogram())).first;
+         }
+         it->second.add(durationMicros);
+      }
+      END_LOCK_MUTEX
+
+      if (enabled())
+      {
+         ThreadSpans& spans = threadSpans();
+         LOCK_MUTEX(spans.mutex)
+         {
+            spans.spans.push_back(RecordedSpan());
+            RecordedSpan& span = spans.spans.back();
+            span.category = category_;
+            span.name.swap(name_);
+            span.startMicros = startMicros_;
+            span.durationMicros = durationMicros;
+         }
+         END_LOCK_MUTEX
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
+void setEnabled(bool enabled)
+{
+   if (enabled && !trace::enabled())
+      ++s_enabled;
+   else if (!enabled && trace::enabled())
+      --s_enabled;
+}
+
+bool enabled()
+{
+   return s_enabled > 0;
+}
+
+json::Object traceEvents()
+{
+   // collect the threads with spans
+   std::vector<boost::shared_ptr<ThreadSpans> > allSpans;
+   Threads& allThreads = threads();
+   LOCK_MUTEX(allThreads.mutex)
+   {
+      allSpans = allThreads.active;
+      allSpans.insert(allSpans.end(),
+                      allThreads.exited.begin(),
+                      allThreads.exited.end());
+   }
+   END_LOCK_MUTEX
+
+   int pid = static_cast<int>(core::system::currentProcessId());
+
+   json::Array eventsJson;
+   for (std::size_t i = 0; i < allSpans.size(); i++)
+   {
+      ThreadSpans& spans = *allSpans[i];
+      LOCK_MUTEX(spans.mutex)
+      {
+         for (boost::circular_buffer_space_optimized<RecordedSpan>::
+                                    const_iterator it = spans.spans.begin();
+              it != spans.spans.end();
+              ++it)
+         {
+            json::Object eventJson;
+            eventJson["name"] = it->name;
+            eventJson["cat"] = it->category;
+            eventJson["ph"] = "X";
+            eventJson["ts"] = it->startMicros;
+            eventJson["dur"] = it->durationMicros;
+            eventJson["pid"] = pid;
+            eventJson["tid"] = spans.threadId;
+            eventsJson.push_back(eventJson);
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   json::Object traceJson;
+   traceJson["traceEvents"] = eventsJson;
+   traceJson["displayTimeUnit"] = "ms";
+   return traceJson;
+}
+
+json::Object latencyHistograms()
+{
+   Histograms histograms;
+   LatencyHistograms& allLatencies = latencies();
+   LOCK_MUTEX(allLatencies.mutex)
+   {
+      histograms = allLatencies.histograms;
+   }
+   END_LOCK_MUTEX
+
+   json::Object histogramsJson;
+   for (Histograms::const_iterator it = histograms.begin();
+        it != histograms.end();
+        ++it)
+   {
+      json::Object categoryJson;
+      for (NamedHistograms::const_iterator namedIt = it->second.begin();
+           namedIt != it->second.end();
+           ++namedIt)
+      {
+         const Histogram& histogram = namedIt->second;
+
+         // counts of durations up to 1, 2, 4, ... microseconds (omitting
+         // the empty buckets past the longest duration)
+         int lastBucket = kHistogramBuckets - 1;
+         while (lastBucket > 0 && histogram.buckets[lastBucket] == 0)
+            lastBucket--;
+         json::Array bucketsJson;
+         for (int i = 0; i <= lastBucket; i++)
+            bucketsJson.push_back(histogram.buckets[i]);
+
+         json::Object histogramJson;
+         histogramJson["count"] = histogram.count;
+         histogramJson["mean"] = histogram.count > 0 ?
+            static_cast<double>(histogram.totalMicros) / histogram.count : 0.0;
+         histogramJson["p50"] = histogram.percentile(50);
+         histogramJson["p90"] = histogram.percentile(90);
+         histogramJson["p99"] = histogram.percentile(99);
+         histogramJson["max"] = histogram.maxMicros;
+         histogramJson["buckets"] = bucketsJson;
+         categoryJson[namedIt->first] = histogramJson;
+      }
+      histogramsJson[it->first] = categoryJson;
+   }
+
+   return histogramsJson;
+}
+
+void clear()
+{
+   LatencyHistograms& allLatencies = latencies();
+   LOCK_MUTEX(allLatencies.mutex)
+   {
+      allLatencies.histograms.clear();
+   }
+   END_LOCK_MUTEX
+
+   std::vector<boost::shared_ptr<ThreadSpans> > activeSpans;
+   Threads& allThreads = threads();
+   LOCK_MUTEX(allThreads.mutex)
+   {
+      activeSpans = allThreads.active;
+      allThreads.exited.clear();
+   }
+   END_LOCK_MUTEX
+
+   for (std::size_t i = 0; i < activeSpans.size(); i++)
+   {
+      LOCK_MUTEX(activeSpans[i]->mutex)
+      {
+         activeSpans[i]->spans.clear();
+      }
+      END_LOCK_MUTEX
+   }
+}
+
 } // namespace trace
 } // namespace core
 } // namespace rstudio
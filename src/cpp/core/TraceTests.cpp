@@ -0,0 +1,141 @@
+/*
+ * TraceTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <core/Trace.hpp>
+#include <core/PerformanceTimer.hpp>
+
+namespace rstudio {
+namespace core {
+namespace trace {
+
+namespace {
+
+void runSpans(int count)
+{
+   for (int i = 0; i < count; i++)
+      Span span("test", "thread");
+}
+
+std::size_t eventCount()
+{
+   return traceEvents()["traceEvents"].get_array().size();
+}
+
+} // anonymous namespace
+
+context("Trace")
+{
+   test_that("spans are recorded only when tracing is enabled")
+   {
+      clear();
+      setEnabled(false);
+      {
+         Span span("test", "disabled");
+      }
+      expect_true(eventCount() == 0);
+
+      setEnabled(true);
+      {
+         Span span("test", "enabled");
+      }
+      setEnabled(false);
+
+      json::Array events = traceEvents()["traceEvents"].get_array();
+      expect_true(events.size() == 1);
+      if (events.size() == 1)
+      {
+         json::Object event = events[0].get_obj();
+         expect_true(event["name"].get_str() == "enabled");
+         expect_true(event["cat"].get_str() == "test");
+         expect_true(event["ph"].get_str() == "X");
+      }
+   }
+
+   test_that("latencies are counted whether or not tracing is enabled")
+   {
+      clear();
+      for (int i = 0; i < 10; i++)
+         Span span("test", "counted");
+      {
+         Span span("test", "slow");
+         boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+      }
+
+      json::Object histograms = latencyHistograms();
+      json::Object testHistograms = histograms["test"].get_obj();
+      json::Object counted = testHistograms["counted"].get_obj();
+      expect_true(counted["count"].get_uint64() == 10);
+      json::Object slow = testHistograms["slow"].get_obj();
+      expect_true(slow["max"].get_int64() >= 20000);
+      expect_true(slow["p99"].get_int64() >= 16384);
+   }
+
+   test_that("histograms are kept for a bounded number of names")
+   {
+      clear();
+      for (int i = 0; i < 100; i++)
+         Span span("test", "name" + boost::lexical_cast<std::string>(i));
+      {
+         Span span("test", "name0");
+      }
+
+      json::Object testHistograms = latencyHistograms()["test"].get_obj();
+      expect_true(testHistograms.size() == 65);
+      expect_true(testHistograms.find("name64") == testHistograms.end());
+      json::Object first = testHistograms["name0"].get_obj();
+      expect_true(first["count"].get_uint64() == 2);
+      json::Object other = testHistograms["other"].get_obj();
+      expect_true(other["count"].get_uint64() == 36);
+   }
+
+   test_that("spans of exited threads are kept")
+   {
+      clear();
+      setEnabled(true);
+      boost::thread thread(boost::bind(runSpans, 5));
+      thread.join();
+      setEnabled(false);
+      expect_true(eventCount() == 5);
+   }
+
+   test_that("benchmark: span overhead")
+   {
+      if (tests::benchmarksEnabled())
+      {
+         const int kSpans = 1000000;
+         clear();
+         {
+            PerformanceTimer timer("1M spans (tracing disabled)");
+            runSpans(kSpans);
+         }
+         setEnabled(true);
+         {
+            PerformanceTimer timer("1M spans (tracing enabled)");
+            runSpans(kSpans);
+         }
+         setEnabled(false);
+         clear();
+      }
+   }
+}
+
+} // namespace trace
+} // namespace core
+} // namespace rstudio
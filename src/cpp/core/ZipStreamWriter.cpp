@@ -0,0 +1,640 @@
+/*
+ * ZipStreamWriter.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ZipStreamWriter.hpp>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <ctime>
+#include <istream>
+#include <vector>
+
+#include <zlib.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/c_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+// size of the chunks we produce (and of our file reads)
+const std::size_t kChunkSize = 64 * 1024;
+
+// records (see the PKWARE APPNOTE)
+const uint32_t kLocalFileHeaderSignature = 0x04034b50;
+const uint32_t kDataDescriptorSignature = 0x08074b50;
+const uint32_t kCentralFileHeaderSignature = 0x02014b50;
+const uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+const uint32_t kZip64EndOfCentralDirLocatorSignature = 0x07064b50;
+const uint32_t kEndOfCentralDirSignature = 0x06054b50;
+const uint16_t kZip64ExtraField = 0x0001;
+
+const uint16_t kVersionDefault = 20;
+const uint16_t kVersionZip64 = 45;
+const uint16_t kVersionMadeBy = (3 << 8) | kVersionZip64; // unix
+
+const uint16_t kFlagDataDescriptor = 0x0008;
+const uint16_t kFlagUtf8 = 0x0800;
+
+const uint16_t kMethodStore = 0;
+const uint16_t kMethodDeflate = 8;
+
+const uint16_t kMax16 = 0xFFFF;
+const uint32_t kMax32 = 0xFFFFFFFF;
+
+// files this large get zip64 sizes in their local headers (the margin
+// allows for deflate expanding incompressible data)
+const uint64_t kZip64Threshold = kMax32 - (16 * 1024 * 1024);
+
+void put16(uint16_t value, std::string* pBuffer)
+{
+   pBuffer->push_back(static_cast<char>(value & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+void put32(uint32_t value, std::string* pBuffer)
+{
+   put16(static_cast<uint16_t>(value & 0xFFFF), pBuffer);
+   put16(static_cast<uint16_t>(value >> 16), pBuffer);
+}
+
+void put64(uint64_t value, std::string* pBuffer)
+{
+   put32(static_cast<uint32_t>(value & 0xFFFFFFFF), pBuffer);
+   put32(static_cast<uint32_t>(value >> 32), pBuffer);
+}
+
+uint16_t limit16(uint64_t value)
+{
+   return value < kMax16 ? static_cast<uint16_t>(value) : kMax16;
+}
+
+uint32_t limit32(uint64_t value)
+{
+   return value < kMax32 ? static_cast<uint32_t>(value) : kMax32;
+}
+
+void dosDateTime(std::time_t time, uint16_t* pDate, uint16_t* pTime)
+{
+   std::tm tm;
+   try
+   {
+      boost::date_time::c_time::localtime(&time, &tm);
+   }
+   catch(const std::exception&)
+   {
+      tm.tm_year = 0;
+   }
+
+   // dos dates start at 1980
+   if (tm.tm_year < 80)
+   {
+      *pDate = (1 << 5) | 1;
+      *pTime = 0;
+      return;
+   }
+
+   *pDate = static_cast<uint16_t>(((tm.tm_year - 80) << 9) |
+                                  ((tm.tm_mon + 1) << 5) |
+                                  tm.tm_mday);
+   *pTime = static_cast<uint16_t>((tm.tm_hour << 11) |
+                                  (tm.tm_min << 5) |
+                                  (tm.tm_sec / 2));
+}
+
+uint32_t fileMode(const FilePath& path, bool isDirectory)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(path.absolutePath().c_str(), &st) == 0)
+      return st.st_mode;
+#endif
+   return isDirectory ? 040755 : 0100644;
+}
+
+// files which don't benefit from (further) compression
+bool isCompressed(const FilePath& path)
+{
+   static const char * const kCompressedExtensions[] = {
+      ".zip", ".gz", ".tgz", ".bz2", ".xz", ".7z", ".rar", ".jar",
+      ".rds", ".rda", ".rdata",
+      ".png", ".jpg", ".jpeg", ".gif", ".mp3", ".mp4", ".mov",
+      ".docx", ".xlsx", ".pptx"
+   };
+
+   std::string ext = path.extensionLowerCase();
+   for (std::size_t i = 0;
+        i < sizeof(kCompressedExtensions) / sizeof(const char*);
+        i++)
+   {
+      if (ext == kCompressedExtensions[i])
+         return true;
+   }
+   return false;
+}
+
+Error zlibError(int result, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::io_error,
+                      "zlib error " + safe_convert::numberToString(result),
+                      location);
+}
+
+struct Entry
+{
+   Entry()
+      : isDirectory(false), size(0), mode(0), dosDate(0), dosTime(0),
+        zip64(false), method(kMethodStore), crc(0), compressedSize(0),
+        uncompressedSize(0), offset(0), skipped(false)
+   {
+   }
+
+   FilePath path;
+   std::string name;
+   bool isDirectory;
+   uint64_t size;
+   uint32_t mode;
+   uint16_t dosDate;
+   uint16_t dosTime;
+
+   // established as the entry is written
+   bool zip64;
+   uint16_t method;
+   uint32_t crc;
+   uint64_t compressedSize;
+   uint64_t uncompressedSize;
+   uint64_t offset;
+   bool skipped;
+};
+
+uint16_t entryFlags(const Entry& entry)
+{
+   // directories have no data so we know their crc and sizes up front
+   return kFlagUtf8 | (entry.isDirectory ? 0 : kFlagDataDescriptor);
+}
+
+void writeLocalFileHeader(const Entry& entry, std::string* pBuffer)
+{
+   put32(kLocalFileHeaderSignature, pBuffer);
+   put16(entry.zip64 ? kVersionZip64 : kVersionDefault, pBuffer);
+   put16(entryFlags(entry), pBuffer);
+   put16(entry.method, pBuffer);
+   put16(entry.dosTime, pBuffer);
+   put16(entry.dosDate, pBuffer);
+
+   // crc and sizes follow the data (in its descriptor)
+   put32(0, pBuffer);
+   put32(entry.zip64 ? kMax32 : 0, pBuffer);
+   put32(entry.zip64 ? kMax32 : 0, pBuffer);
+
+   put16(static_cast<uint16_t>(entry.name.size()), pBuffer);
+   put16(entry.zip64 ? 20 : 0, pBuffer);
+   pBuffer->append(entry.name);
+
+   if (entry.zip64)
+   {
+      put16(kZip64ExtraField, pBuffer);
+      put16(16, pBuffer);
+      put64(0, pBuffer);
+      put64(0, pBuffer);
+   }
+}
+
+void writeDataDescriptor(const Entry& entry, std::string* pBuffer)
+{
+   put32(kDataDescriptorSignature, pBuffer);
+   put32(entry.crc, pBuffer);
+   if (entry.zip64)
+   {
+      put64(entry.compressedSize, pBuffer);
+      put64(entry.uncompressedSize, pBuffer);
+   }
+   else
+   {
+      put32(static_cast<uint32_t>(entry.compressedSize), pBuffer);
+      put32(static_cast<uint32_t>(entry.uncompressedSize), pBuffer);
+   }
+}
+
+void writeCentralFileHeader(const Entry& entry, std::string* pBuffer)
+{
+   bool zip64 = entry.zip64 || entry.offset >= kMax32;
+
+   put32(kCentralFileHeaderSignature, pBuffer);
+   put16(kVersionMadeBy, pBuffer);
+   put16(zip64 ? kVersionZip64 : kVersionDefault, pBuffer);
+   put16(entryFlags(entry), pBuffer);
+   put16(entry.method, pBuffer);
+   put16(entry.dosTime, pBuffer);
+   put16(entry.dosDate, pBuffer);
+   put32(entry.crc, pBuffer);
+   put32(zip64 ? kMax32 : static_cast<uint32_t>(entry.compressedSize),
+         pBuffer);
+   put32(zip64 ? kMax32 : static_cast<uint32_t>(entry.uncompressedSize),
+         pBuffer);
+   put16(static_cast<uint16_t>(entry.name.size()), pBuffer);
+   put16(zip64 ? 28 : 0, pBuffer);
+   put16(0, pBuffer); // comment length
+   put16(0, pBuffer); // disk number
+   put16(0, pBuffer); // internal attributes
+
+   // unix mode along with the ms-dos directory attribute
+   put32((entry.mode << 16) | (entry.isDirectory ? 0x10 : 0), pBuffer);
+
+   put32(zip64 ? kMax32 : static_cast<uint32_t>(entry.offset), pBuffer);
+   pBuffer->append(entry.name);
+
+   if (zip64)
+   {
+      put16(kZip64ExtraField, pBuffer);
+      put16(24, pBuffer);
+      put64(entry.uncompressedSize, pBuffer);
+      put64(entry.compressedSize, pBuffer);
+      put64(entry.offset, pBuffer);
+   }
+}
+
+enum State
+{
+   StateEntryHeader,
+   StateEntryData,
+   StateCentralDirectory,
+   StateEndOfCentralDirectory,
+   StateDone
+};
+
+} // anonymous namespace
+
+struct ZipStreamWriter::Impl
+{
+   Impl(const FilePath& parentPath, int compressionLevel)
+      : parentPath(parentPath),
+        compressionLevel(compressionLevel),
+        state(StateEntryHeader),
+        index(0),
+        remaining(0),
+        deflating(false),
+        inBuffer(kChunkSize),
+        outBuffer(kChunkSize),
+        bytesRead(0),
+        centralDirectoryOffset(0),
+        entryCount(0)
+   {
+   }
+
+   ~Impl()
+   {
+      if (deflating)
+         ::deflateEnd(&stream);
+   }
+
+   Error addEntry(const FilePath& path,
+                  const std::string& name,
+                  bool followSymlinks);
+
+   Error beginEntry(uint64_t position, std::string* pBuffer);
+   Error writeEntryData(std::string* pBuffer);
+   void writeEndOfCentralDirectory(uint64_t position, std::string* pBuffer);
+
+   FilePath parentPath;
+   int compressionLevel;
+   std::vector<Entry> entries;
+
+   State state;
+   std::size_t index;
+
+   // current file
+   boost::shared_ptr<std::istream> pInput;
+   uint64_t remaining;
+   z_stream stream;
+   bool deflating;
+   std::vector<char> inBuffer;
+   std::vector<char> outBuffer;
+
+   uint64_t bytesRead;
+   uint64_t centralDirectoryOffset;
+   uint64_t entryCount;
+};
+
+Error ZipStreamWriter::Impl::addEntry(const FilePath& path,
+                                      const std::string& name,
+                                      bool followSymlinks)
+{
+   Entry entry;
+   entry.path = path;
+   entry.name = name;
+   entry.isDirectory = path.isDirectory();
+   if (entry.isDirectory)
+      entry.name += "/";
+   else
+      entry.size = path.size();
+   entry.mode = fileMode(path, entry.isDirectory);
+   dosDateTime(path.lastWriteTime(), &entry.dosDate, &entry.dosTime);
+   entries.push_back(entry);
+
+   // add the contents of directories (following only those symlinks which
+   // were explicitly added, so that links can't form cycles)
+   if (entry.isDirectory && (followSymlinks || !path.isSymlink()))
+   {
+      std::vector<FilePath> children;
+      Error error = path.children(&children);
+      if (error)
+         return error;
+
+      for (std::size_t i = 0; i < children.size(); i++)
+      {
+         error = addEntry(children[i],
+                          entry.name + children[i].filename(),
+                          false);
+         if (error)
+            return error;
+      }
+   }
+
+   return Success();
+}
+
+Error ZipStreamWriter::Impl::beginEntry(uint64_t position,
+                                        std::string* pBuffer)
+{
+   Entry& entry = entries[index];
+   entry.offset = position;
+
+   if (entry.isDirectory)
+   {
+      writeLocalFileHeader(entry, pBuffer);
+      entryCount++;
+      index++;
+      return Success();
+   }
+
+   // files removed (or otherwise made unreadable) since they were added
+   // are skipped rather than failing the whole archive
+   Error error = entry.path.open_r(&pInput);
+   if (error)
+   {
+      LOG_ERROR(error);
+      entry.skipped = true;
+      index++;
+      return Success();
+   }
+
+   // we read no more than the size of the file when it was added (so a
+   // file which is growing can't outgrow its header)
+   remaining = entry.size;
+   entry.zip64 = entry.size >= kZip64Threshold;
+
+   if (compressionLevel != 0 && entry.size > 0 && !isCompressed(entry.path))
+   {
+      entry.method = kMethodDeflate;
+
+      // raw deflate (no zlib header or trailer)
+      stream.zalloc = Z_NULL;
+      stream.zfree = Z_NULL;
+      stream.opaque = Z_NULL;
+      int result = ::deflateInit2(&stream,
+                                  compressionLevel,
+                                  Z_DEFLATED,
+                                  -MAX_WBITS,
+                                  8,
+                                  Z_DEFAULT_STRATEGY);
+      if (result != Z_OK)
+         return zlibError(result, ERROR_LOCATION);
+      deflating = true;
+   }
+
+   writeLocalFileHeader(entry, pBuffer);
+   entry.crc = ::crc32(0L, Z_NULL, 0);
+   entryCount++;
+   state = StateEntryData;
+   return Success();
+}
+
+Error ZipStreamWriter::Impl::writeEntryData(std::string* pBuffer)
+{
+   Entry& entry = entries[index];
+
+   // read the next block of the file
+   std::size_t size = static_cast<std::size_t>(
+            std::min(remaining, static_cast<uint64_t>(inBuffer.size())));
+   std::size_t bytes = 0;
+   if (size > 0)
+   {
+      pInput->read(&(inBuffer[0]), size);
+      bytes = static_cast<std::size_t>(pInput->gcount());
+      if (pInput->bad())
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", entry.path);
+         return error;
+      }
+   }
+
+   // a short read means the file was truncated since it was added
+   bool finished = (bytes < size) || (bytes == remaining);
+   remaining -= bytes;
+
+   entry.crc = ::crc32(entry.crc,
+                       reinterpret_cast<const Bytef*>(&(inBuffer[0])),
+                       static_cast<uInt>(bytes));
+   entry.uncompressedSize += bytes;
+
+   if (entry.method == kMethodStore)
+   {
+      pBuffer->append(&(inBuffer[0]), bytes);
+      entry.compressedSize += bytes;
+   }
+   else
+   {
+      stream.next_in = reinterpret_cast<Bytef*>(&(inBuffer[0]));
+      stream.avail_in = static_cast<uInt>(bytes);
+      int flush = finished ? Z_FINISH : Z_NO_FLUSH;
+      int result;
+      do
+      {
+         stream.next_out = reinterpret_cast<Bytef*>(&(outBuffer[0]));
+         stream.avail_out = static_cast<uInt>(outBuffer.size());
+         result = ::deflate(&stream, flush);
+         if (result == Z_STREAM_ERROR)
+            return zlibError(result, ERROR_LOCATION);
+
+         std::size_t produced = outBuffer.size() - stream.avail_out;
+         pBuffer->append(&(outBuffer[0]), produced);
+         entry.compressedSize += produced;
+      }
+      while (stream.avail_out == 0 ||
+             (flush == Z_FINISH && result != Z_STREAM_END));
+   }
+
+   if (finished)
+   {
+      if (deflating)
+      {
+         ::deflateEnd(&stream);
+         deflating = false;
+      }
+      pInput.reset();
+
+      writeDataDescriptor(entry, pBuffer);
+      index++;
+      state = StateEntryHeader;
+   }
+
+   return Success();
+}
+
+void ZipStreamWriter::Impl::writeEndOfCentralDirectory(uint64_t position,
+                                                       std::string* pBuffer)
+{
+   uint64_t centralDirectorySize = position - centralDirectoryOffset;
+
+   if (entryCount >= kMax16 ||
+       centralDirectorySize >= kMax32 ||
+       centralDirectoryOffset >= kMax32)
+   {
+      put32(kZip64EndOfCentralDirSignature, pBuffer);
+      put64(44, pBuffer); // size of the remainder of the record
+      put16(kVersionMadeBy, pBuffer);
+      put16(kVersionZip64, pBuffer);
+      put32(0, pBuffer); // disk number
+      put32(0, pBuffer); // disk with central directory
+      put64(entryCount, pBuffer);
+      put64(entryCount, pBuffer);
+      put64(centralDirectorySize, pBuffer);
+      put64(centralDirectoryOffset, pBuffer);
+
+      put32(kZip64EndOfCentralDirLocatorSignature, pBuffer);
+      put32(0, pBuffer);
+      put64(position, pBuffer);
+      put32(1, pBuffer); // total disks
+   }
+
+   put32(kEndOfCentralDirSignature, pBuffer);
+   put16(0, pBuffer);
+   put16(0, pBuffer);
+   put16(limit16(entryCount), pBuffer);
+   put16(limit16(entryCount), pBuffer);
+   put32(limit32(centralDirectorySize), pBuffer);
+   put32(limit32(centralDirectoryOffset), pBuffer);
+   put16(0, pBuffer); // comment length
+}
+
+ZipStreamWriter::ZipStreamWriter(const FilePath& parentPath,
+                                 int compressionLevel)
+   : pImpl_(new Impl(parentPath, compressionLevel))
+{
+}
+
+ZipStreamWriter::~ZipStreamWriter()
+{
+}
+
+Error ZipStreamWriter::add(const FilePath& path)
+{
+   if (!path.exists())
+      return fileNotFoundError(path, ERROR_LOCATION);
+
+   std::string name = path.relativePath(pImpl_->parentPath);
+   if (name.empty())
+      name = path.filename();
+
+   return pImpl_->addEntry(path, name, true);
+}
+
+Error ZipStreamWriter::nextChunk(std::string* pChunk)
+{
+   Impl& impl = *pImpl_;
+
+   pChunk->clear();
+   while (pChunk->size() < kChunkSize && impl.state != StateDone)
+   {
+      uint64_t position = impl.bytesRead + pChunk->size();
+      Error error;
+
+      switch (impl.state)
+      {
+         case StateEntryHeader:
+         {
+            if (impl.index < impl.entries.size())
+            {
+               error = impl.beginEntry(position, pChunk);
+            }
+            else
+            {
+               impl.centralDirectoryOffset = position;
+               impl.index = 0;
+               impl.state = StateCentralDirectory;
+            }
+            break;
+         }
+
+         case StateEntryData:
+         {
+            error = impl.writeEntryData(pChunk);
+            break;
+         }
+
+         case StateCentralDirectory:
+         {
+            if (impl.index < impl.entries.size())
+            {
+               const Entry& entry = impl.entries[impl.index++];
+               if (!entry.skipped)
+                  writeCentralFileHeader(entry, pChunk);
+            }
+            else
+            {
+               impl.state = StateEndOfCentralDirectory;
+            }
+            break;
+         }
+
+         case StateEndOfCentralDirectory:
+         {
+            impl.writeEndOfCentralDirectory(position, pChunk);
+            impl.state = StateDone;
+            break;
+         }
+
+         case StateDone:
+            break;
+      }
+
+      if (error)
+         return error;
+   }
+
+   impl.bytesRead += pChunk->size();
+   return Success();
+}
+
+uintmax_t ZipStreamWriter::bytesRead() const
+{
+   return pImpl_->bytesRead;
+}
+
+} // namespace core
+} // namespace rstudio
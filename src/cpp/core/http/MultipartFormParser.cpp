@@ -0,0 +1,367 @@
+/*
+ * MultipartFormParser.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/MultipartFormParser.hpp>
+
+#include <sstream>
+
+#include <boost/regex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/http/Header.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+namespace http {
+
+namespace {
+
+// limits on the portions of the body we hold in memory
+const std::size_t kMaxHeadersSize = 16 * 1024;
+const std::size_t kMaxFieldSize = 1024 * 1024;
+
+Error formError(const std::string& description, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::protocol_error,
+                      description,
+                      location);
+}
+
+std::string boundaryFromContentType(const std::string& contentType)
+{
+   std::string boundaryPrefix("boundary=");
+   size_t prefixLoc = contentType.find(boundaryPrefix);
+   if (prefixLoc == std::string::npos)
+      return std::string();
+
+   std::string boundary = contentType.substr(prefixLoc + boundaryPrefix.size());
+   size_t endLoc = boundary.find(';');
+   if (endLoc != std::string::npos)
+      boundary = boundary.substr(0, endLoc);
+   boost::algorithm::trim(boundary);
+
+   // the boundary may be quoted
+   if (boundary.size() >= 2 &&
+       boundary[0] == '"' && boundary[boundary.size() - 1] == '"')
+   {
+      boundary = boundary.substr(1, boundary.size() - 2);
+   }
+
+   return boundary;
+}
+
+} // anonymous namespace
+
+MultipartFormParser::MultipartFormParser(const std::string& contentType,
+                                         const FilePath& uploadPath)
+   : uploadPath_(uploadPath),
+     state_(StatePreamble),
+     partIsFile_(false),
+     completed_(false)
+{
+   std::string boundary = boundaryFromContentType(contentType);
+   if (!boundary.empty())
+      delimiter_ = "\r\n--" + boundary;
+
+   // every delimiter but the first is preceded by a CRLF; prefixing one to
+   // the body lets us search for the first in the same way as the rest
+   buffer_ = "\r\n";
+}
+
+MultipartFormParser::~MultipartFormParser()
+{
+   try
+   {
+      pPartStream_.reset();
+
+      if (!completed_)
+      {
+         BOOST_FOREACH(const FilePath& file, createdFiles_)
+         {
+            Error error = file.removeIfExists();
+            if (error)
+               LOG_ERROR(error);
+         }
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
+Error MultipartFormParser::parse(const char* begin, const char* end)
+{
+   if (delimiter_.empty())
+      return formError("No boundary specified for multipart form",
+                       ERROR_LOCATION);
+
+   buffer_.append(begin, end);
+
+   // process as much of the buffer as we can
+   bool progress = true;
+   while (progress)
+   {
+      progress = false;
+      switch (state_)
+      {
+         case StatePreamble:
+         {
+            std::size_t pos = buffer_.find(delimiter_);
+            if (pos != std::string::npos)
+            {
+               buffer_.erase(0, pos + delimiter_.size());
+               state_ = StateBoundary;
+               progress = true;
+            }
+            else if (buffer_.size() >= delimiter_.size())
+            {
+               // discard the preamble (retaining enough to match a
+               // delimiter which spans chunks)
+               buffer_.erase(0, buffer_.size() - delimiter_.size() + 1);
+            }
+            break;
+         }
+
+         case StateBoundary:
+         {
+            // the final delimiter is followed by "--"
+            if (buffer_.size() < 2)
+               break;
+
+            if (buffer_.compare(0, 2, "--") == 0)
+            {
+               buffer_.clear();
+               state_ = StateEpilogue;
+               break;
+            }
+
+            // otherwise the delimiter line ends with a CRLF (possibly after
+            // some padding)
+            std::size_t pos = buffer_.find("\r\n");
+            if (pos != std::string::npos)
+            {
+               buffer_.erase(0, pos + 2);
+               state_ = StateHeaders;
+               progress = true;
+            }
+            else if (buffer_.size() > kMaxHeadersSize)
+            {
+               return formError("Invalid multipart form boundary",
+                                ERROR_LOCATION);
+            }
+            break;
+         }
+
+         case StateHeaders:
+         {
+            std::size_t headersEnd = std::string::npos;
+            std::size_t contentBegin = std::string::npos;
+            if (buffer_.compare(0, 2, "\r\n") == 0)
+            {
+               headersEnd = 0;
+               contentBegin = 2;
+            }
+            else
+            {
+               std::size_t pos = buffer_.find("\r\n\r\n");
+               if (pos != std::string::npos)
+               {
+                  headersEnd = pos + 2;
+                  contentBegin = pos + 4;
+               }
+            }
+
+            if (headersEnd != std::string::npos)
+            {
+               Error error = beginPart(buffer_.substr(0, headersEnd));
+               if (error)
+                  return error;
+               buffer_.erase(0, contentBegin);
+               state_ = StateContent;
+               progress = true;
+            }
+            else if (buffer_.size() > kMaxHeadersSize)
+            {
+               return formError("Multipart form headers too large",
+                                ERROR_LOCATION);
+            }
+            break;
+         }
+
+         case StateContent:
+         {
+            std::size_t pos = buffer_.find(delimiter_);
+            if (pos != std::string::npos)
+            {
+               Error error = appendContent(buffer_.data(), pos);
+               if (!error)
+                  error = endPart();
+               if (error)
+                  return error;
+
+               buffer_.erase(0, pos + delimiter_.size());
+               state_ = StateBoundary;
+               progress = true;
+            }
+            else if (buffer_.size() >= delimiter_.size())
+            {
+               // write all but what could be the start of a delimiter which
+               // spans chunks
+               std::size_t length = buffer_.size() - delimiter_.size() + 1;
+               Error error = appendContent(buffer_.data(), length);
+               if (error)
+                  return error;
+               buffer_.erase(0, length);
+            }
+            break;
+         }
+
+         case StateEpilogue:
+         {
+            buffer_.clear();
+            break;
+         }
+      }
+   }
+
+   return Success();
+}
+
+Error MultipartFormParser::complete()
+{
+   if (state_ != StateEpilogue)
+      return formError("Incomplete multipart form", ERROR_LOCATION);
+
+   completed_ = true;
+   return Success();
+}
+
+Error MultipartFormParser::beginPart(const std::string& headerText)
+{
+   // read the headers
+   std::istringstream headerStream(headerText);
+   headerStream.unsetf(std::ios::skipws);
+   Headers headers;
+   http::parseHeaders(headerStream, &headers);
+
+   partName_.clear();
+   partIsFile_ = false;
+   partFile_ = File();
+   partValue_.clear();
+
+   // parts without a name are skipped
+   std::string cDisp = http::headerValue(headers, "Content-Disposition");
+   std::string nameRegex("form-data; name=\"(.*)\"");
+   boost::smatch nameMatch;
+   if (!regex_match(cDisp, nameMatch, boost::regex(nameRegex)))
+      return Success();
+
+   std::string filenameRegex(nameRegex + "; filename=\"(.*)\"");
+   boost::smatch fileMatch;
+   if (regex_match(cDisp, fileMatch, boost::regex(filenameRegex)))
+   {
+      partName_ = fileMatch[1];
+      partIsFile_ = true;
+      partFile_.name = fileMatch[2];
+      partFile_.contentType = http::headerValue(headers, "Content-Type");
+      if (partFile_.contentType.empty())
+         partFile_.contentType = "application/octet-stream";
+
+      // write the contents to a file (retaining the extension of the
+      // uploaded file so consumers can recognize its type)
+      Error error = uploadPath_.ensureDirectory();
+      if (error)
+         return error;
+
+      std::string extension = FilePath(partFile_.name).extension();
+      partFile_.contentsPath = uploadPath_.complete(
+                                 core::system::generateUuid(false) + extension);
+      error = partFile_.contentsPath.open_w(&pPartStream_);
+      if (error)
+         return error;
+      createdFiles_.push_back(partFile_.contentsPath);
+   }
+   else
+   {
+      partName_ = nameMatch[1];
+   }
+
+   return Success();
+}
+
+Error MultipartFormParser::appendContent(const char* begin,
+                                         std::size_t length)
+{
+   if (partName_.empty() || length == 0)
+      return Success();
+
+   if (partIsFile_)
+   {
+      pPartStream_->write(begin, length);
+      if (!pPartStream_->good())
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", partFile_.contentsPath);
+         return error;
+      }
+   }
+   else
+   {
+      if (partValue_.size() + length > kMaxFieldSize)
+         return formError("Multipart form field too large", ERROR_LOCATION);
+      partValue_.append(begin, length);
+   }
+
+   return Success();
+}
+
+Error MultipartFormParser::endPart()
+{
+   if (partName_.empty())
+      return Success();
+
+   if (partIsFile_)
+   {
+      pPartStream_->flush();
+      bool good = pPartStream_->good();
+      pPartStream_.reset();
+      if (!good)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", partFile_.contentsPath);
+         return error;
+      }
+
+      files_.insert(std::make_pair(partName_, partFile_));
+   }
+   else
+   {
+      boost::algorithm::trim(partValue_);
+      fields_.push_back(std::make_pair(partName_, partValue_));
+   }
+
+   partName_.clear();
+   return Success();
+}
+
+} // namespace http
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,232 @@
+/*
+ * MultipartFormParserTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <algorithm>
+#include <string>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/http/MultipartFormParser.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/RequestParser.hpp>
+
+namespace rstudio {
+namespace core {
+namespace http {
+
+namespace {
+
+const char * const kContentType =
+                        "multipart/form-data; boundary=----FormBoundary7MA4";
+
+std::string formBody(const std::string& fileContents)
+{
+   return "------FormBoundary7MA4\r\n"
+          "Content-Disposition: form-data; name=\"targetDirectory\"\r\n"
+          "\r\n"
+          "~/uploads\r\n"
+          "------FormBoundary7MA4\r\n"
+          "Content-Disposition: form-data; name=\"file\"; filename=\"data.csv\"\r\n"
+          "Content-Type: text/csv\r\n"
+          "\r\n" +
+          fileContents +
+          "\r\n------FormBoundary7MA4--\r\n";
+}
+
+FilePath uploadPath()
+{
+   FilePath tempPath;
+   Error error = FilePath::tempFilePath(&tempPath);
+   if (error)
+      LOG_ERROR(error);
+   return tempPath;
+}
+
+// parse the body in chunks of the specified size
+Error parseInChunks(const std::string& body,
+                    std::size_t chunkSize,
+                    MultipartFormParser* pParser)
+{
+   for (std::size_t i = 0; i < body.size(); i += chunkSize)
+   {
+      std::size_t length = std::min(chunkSize, body.size() - i);
+      Error error = pParser->parse(body.data() + i, body.data() + i + length);
+      if (error)
+         return error;
+   }
+   return pParser->complete();
+}
+
+std::string uploadedContents(const MultipartFormParser& parser)
+{
+   std::string contents;
+   Files::const_iterator it = parser.files().find("file");
+   if (it != parser.files().end())
+   {
+      Error error = readStringFromFile(it->second.contentsPath, &contents);
+      if (error)
+         LOG_ERROR(error);
+   }
+   return contents;
+}
+
+bool streamAllBodies(const Request&)
+{
+   return true;
+}
+
+} // anonymous namespace
+
+context("MultipartFormParser")
+{
+   test_that("fields and files are parsed regardless of chunk size")
+   {
+      // contents which resemble (but aren't) a delimiter
+      std::string contents("a,b\r\n1,2\r\n--\r\n------FormBoundary\r\n3,4");
+      std::string body = formBody(contents);
+
+      std::size_t chunkSizes[] = { 1, 2, 7, 31, body.size() };
+      for (std::size_t i = 0; i < sizeof(chunkSizes)/sizeof(std::size_t); i++)
+      {
+         FilePath path = uploadPath();
+         {
+            MultipartFormParser parser(kContentType, path);
+            expect_true(!parseInChunks(body, chunkSizes[i], &parser));
+
+            expect_true(parser.fields().size() == 1);
+            expect_true(parser.fields()[0].first == "targetDirectory");
+            expect_true(parser.fields()[0].second == "~/uploads");
+
+            expect_true(parser.files().size() == 1);
+            const File& file = parser.files().find("file")->second;
+            expect_true(file.name == "data.csv");
+            expect_true(file.contentType == "text/csv");
+            expect_true(file.contents.empty());
+            expect_true(file.contentsPath.extension() == ".csv");
+            expect_true(uploadedContents(parser) == contents);
+         }
+         path.removeIfExists();
+      }
+   }
+
+   test_that("incomplete forms are an error and leave no files behind")
+   {
+      FilePath path = uploadPath();
+      std::string body = formBody("a,b\r\n1,2");
+      body.resize(body.size() - 10);
+      {
+         MultipartFormParser parser(kContentType, path);
+         expect_true(!parser.parse(body.data(), body.data() + body.size()));
+         expect_false(!parser.complete());
+      }
+
+      std::vector<FilePath> children;
+      path.children(&children);
+      expect_true(children.empty());
+      path.removeIfExists();
+   }
+
+   test_that("memory use is bounded for large files")
+   {
+      // 64MB file received in 8K reads
+      std::string contents(64 * 1024 * 1024, 'x');
+      for (std::size_t i = 0; i < contents.size(); i += 1000)
+         contents[i] = '\n';
+      std::string body = formBody(contents);
+
+      FilePath path = uploadPath();
+      {
+         MultipartFormParser parser(kContentType, path);
+         const std::size_t kChunkSize = 8192;
+         std::size_t maxBuffered = 0;
+         for (std::size_t i = 0; i < body.size(); i += kChunkSize)
+         {
+            std::size_t length = std::min(kChunkSize, body.size() - i);
+            expect_true(!parser.parse(body.data() + i,
+                                      body.data() + i + length));
+            maxBuffered = std::max(maxBuffered, parser.bufferedSize());
+         }
+         expect_true(!parser.complete());
+         expect_true(maxBuffered < 1024);
+
+         const File& file = parser.files().find("file")->second;
+         expect_true(file.contentsPath.size() == contents.size());
+      }
+      path.removeIfExists();
+   }
+
+   test_that("request parser streams form bodies to disk")
+   {
+      std::string body = formBody("a,b\r\n1,2");
+      std::string message =
+            "POST /upload HTTP/1.1\r\n"
+            "Content-Type: " + std::string(kContentType) + "\r\n"
+            "Content-Length: " + safe_convert::numberToString(body.size()) +
+            "\r\n\r\n" + body;
+
+      FilePath path = uploadPath();
+      {
+         RequestParser parser;
+         parser.setFormUploadPath(path);
+         Request request;
+         RequestParser::status status = RequestParser::incomplete;
+         for (std::size_t i = 0; i < message.size(); i += 13)
+         {
+            std::size_t length = std::min<std::size_t>(13, message.size() - i);
+            status = parser.parse(request,
+                                  message.data() + i,
+                                  message.data() + i + length);
+         }
+
+         expect_true(status == RequestParser::complete);
+         expect_true(request.body().empty());
+         expect_true(request.formFieldValue("targetDirectory") == "~/uploads");
+
+         const File& file = request.uploadedFile("file");
+         expect_true(file.name == "data.csv");
+         std::string contents;
+         readStringFromFile(file.contentsPath, &contents);
+         expect_true(contents == "a,b\r\n1,2");
+      }
+      path.removeIfExists();
+   }
+
+   test_that("request parser returns headers of streamed requests")
+   {
+      std::string message =
+            "POST /upload HTTP/1.1\r\n"
+            "Content-Length: 10\r\n"
+            "\r\n"
+            "0123";
+
+      RequestParser parser;
+      parser.setStreamBodyFilter(streamAllBodies);
+      Request request;
+      RequestParser::status status =
+            parser.parse(request, message.data(), message.data() + message.size());
+
+      expect_true(status == RequestParser::headers_complete);
+      expect_true(request.contentLength() == 10);
+      expect_true(request.body() == "0123");
+   }
+}
+
+} // namespace http
+} // namespace core
+} // namespace rstudio
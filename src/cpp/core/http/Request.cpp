@@ -153,6 +153,13 @@ const File& Request::uploadedFile(const std::string& name) const
    // not found
    return emptyFile_;
 }
+
+const Files& Request::uploadedFiles() const
+{
+   ensureFormFieldsParsed();
+
+   return files_;
+}
    
 std::string Request::queryParamValue(const std::string& name) const
 {
@@ -184,6 +191,7 @@ void Request::resetMembers()
    cookies_.clear() ;
    parsedFormFields_ = false ;
    formFields_.clear() ;
+   files_.clear() ;
    parsedQueryParams_ = false;
    queryParams_.clear();
 }
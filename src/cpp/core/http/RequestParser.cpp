@@ -18,6 +18,10 @@
 
 #include <boost/lexical_cast.hpp>
 
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/http/MultipartFormParser.hpp>
+
 namespace rstudio {
 namespace core {
 namespace http {
@@ -26,7 +30,8 @@ RequestParser::RequestParser()
   : state_(method_start), 
     content_length_(0), 
     parsing_content_length_(false), 
-    parsing_body_(false)
+    parsing_body_(false),
+    body_received_(0)
 {
 }
 
@@ -36,6 +41,58 @@ void RequestParser::reset()
   content_length_ = 0 ;
   parsing_content_length_ = false ;
   parsing_body_ = false ;
+  pFormParser_.reset() ;
+  body_received_ = 0 ;
+}
+
+RequestParser::status RequestParser::beginBody(Request& req)
+{
+  if (streamBodyFilter_ && streamBodyFilter_(req))
+     return headers_complete ;
+
+  std::string contentType = req.headerValue("Content-Type") ;
+  if (!formUploadPath_.empty() &&
+      contentType.find("multipart/form-data") == 0)
+  {
+     pFormParser_.reset(new MultipartFormParser(contentType,
+                                                formUploadPath_)) ;
+     body_received_ = 0 ;
+  }
+
+  return incomplete ;
+}
+
+RequestParser::status RequestParser::consumeFormBody(Request& req,
+                                                     const std::string& chunk)
+{
+  Error error = pFormParser_->parse(chunk.data(), chunk.data() + chunk.size()) ;
+  if (error)
+  {
+     LOG_ERROR(error) ;
+     pFormParser_.reset() ;
+     return RequestParser::error ;
+  }
+
+  body_received_ += chunk.size() ;
+  if (body_received_ < content_length_)
+     return incomplete ;
+
+  error = pFormParser_->complete() ;
+  if (error)
+  {
+     LOG_ERROR(error) ;
+     pFormParser_.reset() ;
+     return RequestParser::error ;
+  }
+
+  // the form is already parsed so the request needn't (and can't, as
+  // it has no body) parse it on demand
+  req.formFields_ = pFormParser_->fields() ;
+  req.files_ = pFormParser_->files() ;
+  req.parsedFormFields_ = true ;
+  pFormParser_.reset() ;
+
+  return complete ;
 }
 
 RequestParser::status RequestParser::consume(Request& req, char input)
@@ -288,7 +345,7 @@ RequestParser::status RequestParser::consume(Request& req, char input)
       // if this header was Content-Length then save it
       if (parsing_content_length_)
       {
-         content_length_ = boost::lexical_cast<int>(req.headers_.back().value);
+         content_length_ = boost::lexical_cast<std::size_t>(req.headers_.back().value);
          parsing_content_length_ = false ;
       }
 
@@ -226,11 +226,20 @@ void Response::setRangeableFile(const std::string& contents,
    }
 }
    
+void Response::setStreamBody(const StreamBodySource& source)
+{
+   removeHeader("Content-Encoding");
+   removeHeader("Content-Length");
+   body_.clear();
+   streamBody_ = source;
+}
+
 void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
    body_ = body;
    setContentLength(body_.length());
+   streamBody_.clear();
 }
    
    
@@ -290,6 +299,7 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+	streamBody_.clear() ;
 }
    
 void Response::removeCachingHeaders()
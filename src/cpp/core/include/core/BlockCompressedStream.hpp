@@ -0,0 +1,90 @@
+/*
+ * BlockCompressedStream.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_BLOCK_COMPRESSED_STREAM_HPP
+#define CORE_BLOCK_COMPRESSED_STREAM_HPP
+
+#include <stdint.h>
+
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+// Block compressed files hold a stream of data as a sequence of blocks
+// which are each compressed (deflated) independently of one another. This
+// allows several blocks to be compressed (or decompressed) at once on a
+// pool of threads while the stream is being written (or read), so that
+// large streams (e.g. serialized R objects) aren't limited by the speed of
+// a single threaded compressor. Each block carries a checksum of its
+// contents which is verified as it's read.
+
+// is the file a block compressed file?
+bool isBlockCompressedFile(const FilePath& filePath);
+
+class BlockCompressedWriter : boost::noncopyable
+{
+public:
+   // compression level is per zlib (0 stores blocks without compressing
+   // them)
+   explicit BlockCompressedWriter(int threads, int compressionLevel = 1);
+   virtual ~BlockCompressedWriter();
+
+   // COPYING: boost::noncopyable
+
+public:
+   Error open(const FilePath& filePath);
+
+   Error write(const char* data, std::size_t length);
+
+   // write any remaining blocks and close the file (files which aren't
+   // closed are incomplete and can't be read)
+   Error close();
+
+   // total (uncompressed) size of the data written so far
+   uintmax_t bytesWritten() const;
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+class BlockCompressedReader : boost::noncopyable
+{
+public:
+   explicit BlockCompressedReader(int threads);
+   virtual ~BlockCompressedReader();
+
+   // COPYING: boost::noncopyable
+
+public:
+   Error open(const FilePath& filePath);
+
+   // read up to length bytes (fewer are read only at the end of the stream)
+   Error read(char* data, std::size_t length, std::size_t* pBytesRead);
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_BLOCK_COMPRESSED_STREAM_HPP
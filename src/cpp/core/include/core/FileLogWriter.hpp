@@ -16,12 +16,25 @@
 #ifndef FILE_LOG_WRITER_HPP
 #define FILE_LOG_WRITER_HPP
 
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/LogWriter.hpp>
 
 namespace rstudio {
 namespace core {
 
+// Messages are queued and written to the log file by a thread of the
+// writer's own, which keeps the file open and writes the messages queued
+// since its last write together. Consecutive repeats of a message are
+// written once (with a count of the repeats) and if messages are logged
+// faster than they can be written those which don't fit in the queue are
+// dropped (and counted) rather than holding up the threads logging them
+// (errors are dropped only once a further reserve of the queue is full).
+// Queued messages are flushed at exit and by core::system::abort so that
+// the errors leading up to an abort make it to the log.
 class FileLogWriter : public LogWriter
 {
 public:
@@ -36,14 +49,32 @@ public:
                      core::system::LogLevel level,
                      const std::string& message);
 
+    // wait (up to the timeout) for the messages logged so far to be
+    // written. returns false if they weren't written within the timeout
+    bool flush(const boost::posix_time::time_duration& timeout);
+
+    // flush every writer (waiting up to the timeout for each)
+    static void flushAll(const boost::posix_time::time_duration& timeout);
 
 private:
-    bool rotateLogFile();
+    struct Entry;
+
+    void writeQueuedEntries();
+    void writeEntries(const std::vector<Entry>& entries,
+                      std::size_t dropped,
+                      bool reportRepeats);
+    void write(const std::string& output);
+    void writeDirect(const std::string& programIdentity,
+                     const std::string& message);
+    void rotateLogFile();
 
     std::string programIdentity_;
     int logLevel_;
     FilePath logFile_;
     FilePath rotatedLogFile_;
+
+    struct Impl;
+    boost::scoped_ptr<Impl> pImpl_;
 };
 
 } // namespace core
@@ -0,0 +1,157 @@
+/*
+ * GitObjects.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_GIT_OBJECTS_HPP
+#define CORE_GIT_OBJECTS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace gitobjects {
+
+// A read-only, in-process reader for the objects of a git repository
+// (loose objects and packfiles, including deltified objects) which can page
+// through history without running git. Repositories which use features the
+// reader doesn't understand (alternates, grafts, and replace refs) and
+// revisions other than ref names and commit ids are reported as
+// errc::not_supported so that callers can fall back to running git.
+// Repositories are not thread safe.
+
+class ObjectId
+{
+public:
+   ObjectId();
+
+   static bool fromHex(const std::string& hex, ObjectId* pId);
+   static ObjectId fromBytes(const unsigned char* pBytes);
+
+   bool isNull() const;
+   std::string hex() const;
+   const unsigned char* bytes() const { return bytes_; }
+
+   bool operator==(const ObjectId& other) const;
+   bool operator!=(const ObjectId& other) const { return !(*this == other); }
+   bool operator<(const ObjectId& other) const;
+
+private:
+   unsigned char bytes_[20];
+};
+
+std::size_t hash_value(const ObjectId& id);
+
+enum ObjectType
+{
+   ObjectNone = 0,
+   ObjectCommit = 1,
+   ObjectTree = 2,
+   ObjectBlob = 3,
+   ObjectTag = 4
+};
+
+struct Commit
+{
+   Commit() : authorTime(0), commitTime(0) {}
+
+   ObjectId id;
+   ObjectId tree;
+   std::vector<ObjectId> parents;
+   std::string author;          // name <email>
+   boost::int64_t authorTime;   // seconds since epoch
+   std::string committer;
+   boost::int64_t commitTime;
+   std::string commitTimeZone;  // e.g. +0100
+   std::string encoding;        // of the message (empty for UTF-8)
+   std::string message;
+};
+
+struct HistoryEntry
+{
+   ObjectId id;
+
+   // the parents of the commit (when history is filtered by path these
+   // are the parents which history simplification followed)
+   std::vector<ObjectId> parents;
+};
+
+class Repository : boost::noncopyable
+{
+public:
+   // gitDir is the repository's .git directory
+   explicit Repository(const FilePath& gitDir);
+   virtual ~Repository();
+
+   const FilePath& gitDir() const;
+
+   // read an object (resolving deltas)
+   Error readObject(const ObjectId& id,
+                    ObjectType* pType,
+                    std::string* pData);
+
+   Error readCommit(const ObjectId& id, Commit* pCommit);
+
+   // resolve a revision to the commits it names. supported revisions are
+   // "" and HEAD, --all, ref names (e.g. master, origin/master, v1.0, or
+   // refs/heads/master), and full commit ids
+   Error resolveRevision(const std::string& rev,
+                         std::vector<ObjectId>* pCommits);
+
+   // the refs which point at each commit, named as by git log
+   // --decorate=full (e.g. HEAD, refs/heads/master, tag: refs/tags/v1.0)
+   Error decorations(std::map<ObjectId, std::vector<std::string> >* pRefs);
+
+   // the commits whose parents were cut off by a shallow clone, sorted
+   // (re-read from .git/shallow on each call)
+   Error shallowCommits(std::vector<ObjectId>* pCommits);
+
+   // the commits reachable from tips in the order of git log --date-order
+   // (children before their parents, otherwise most recently committed
+   // first). if path (relative to the working tree) isn't empty then only
+   // the commits which changed it are included, following git's default
+   // history simplification
+   Error history(const std::vector<ObjectId>& tips,
+                 const std::string& path,
+                 std::vector<HistoryEntry>* pHistory);
+
+   // the commit graph (parents, commit times, and trees) read so far is
+   // kept in memory and can be persisted so that later sessions needn't
+   // read the commits again. save only writes if there were new commits
+   Error loadCommitGraph(const FilePath& cacheFile);
+   Error saveCommitGraph(const FilePath& cacheFile);
+
+   // close the repository's pack files (they are reopened as needed) so
+   // that they can be removed (e.g. by git gc on Windows)
+   void releaseFiles();
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+} // namespace gitobjects
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_GIT_OBJECTS_HPP
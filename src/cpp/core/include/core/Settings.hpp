@@ -16,11 +16,16 @@
 #ifndef CORE_SETTINGS_HPP
 #define CORE_SETTINGS_HPP
 
+#include <set>
 #include <string>
 #include <map>
 
+#include <stdint.h>
+
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
+#include <boost/optional.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/FilePath.hpp>
 
@@ -36,6 +41,9 @@ public:
    virtual ~Settings() ;
    // COPYING: boost::noncopyable
 
+   // read the settings from the file. pending changes are kept when the
+   // same file is re-read (and written with the next write) and are
+   // written first when a different file is read
    Error initialize(const FilePath& filePath) ;
 
 public:
@@ -54,17 +62,55 @@ public:
    void forEach(const boost::function<void(const std::string&,
                                            const std::string&)>& func) const;
 
+   // generation of the settings, which increases each time a setting
+   // changes (including changes read by initialize). the generation of an
+   // individual setting is the generation in which it last changed (or
+   // zero if it isn't set)
+   uint64_t generation() const { return generation_; }
+   uint64_t generation(const std::string& name) const;
+
    void beginUpdate();
    void endUpdate();
 
+   // by default every change is written immediately. with a write delay,
+   // changes made within the delay of the last write are deferred until
+   // the next change after it (or a call to flush). pending changes are
+   // also written when the settings are destroyed
+   void setWriteDelay(const boost::posix_time::time_duration& delay);
+   bool writePending() const { return isDirty_; }
+   void flush();
+
 private:
+   struct Value
+   {
+      Value() : generation(0) {}
+      Value(const std::string& text, uint64_t generation)
+         : text(text), generation(generation)
+      {
+      }
+
+      std::string text;
+      uint64_t generation;
+
+      // typed values (parsed from the text when first requested)
+      mutable boost::optional<int> intValue;
+      mutable boost::optional<double> doubleValue;
+      mutable boost::optional<bool> boolValue;
+   };
+
+   const Value* find(const std::string& name) const;
+   bool writeDue() const;
    void writeSettings() ;
 
 private:
    FilePath settingsFile_ ;
-   std::map<std::string, std::string> settingsMap_ ;
+   std::map<std::string, Value> settingsMap_ ;
    bool updatePending_ ;
    bool isDirty_;
+   std::set<std::string> dirtyNames_;
+   uint64_t generation_;
+   boost::posix_time::time_duration writeDelay_;
+   boost::posix_time::ptime lastWrite_;
 };
 
 }
@@ -0,0 +1,349 @@
+/*
+ * TaskScheduler.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TASK_SCHEDULER_HPP
+#define CORE_TASK_SCHEDULER_HPP
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tasks {
+
+// Tasks are run by executors: either a pool of threads which share work
+// by stealing queued tasks from one another, or the main thread (tasks
+// posted to the main thread executor run whenever the owner of the main
+// thread calls runPending, which for the session is during background
+// processing). Tasks which produce a result are scheduled with schedule,
+// which returns a Future for the result; continuations can then be
+// attached to the future to run on any executor (e.g. to do CPU bound
+// work on the pool and then deliver its result on the main thread).
+
+typedef boost::function<void()> Task;
+
+class Executor
+{
+public:
+   virtual ~Executor() {}
+
+   // run the task at some later time (tasks must not throw; exceptions
+   // which escape them are logged)
+   virtual void post(const Task& task) = 0;
+};
+
+class ThreadPool : public Executor, boost::noncopyable
+{
+public:
+   // a pool with the specified number of threads (or one per processor
+   // if threads is zero)
+   explicit ThreadPool(int threads = 0);
+
+   // stops the pool (see stop)
+   virtual ~ThreadPool();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // tasks posted from within one of the pool's tasks are queued for the
+   // same thread (other threads steal them if they run out of work)
+   virtual void post(const Task& task);
+
+   int threads() const;
+
+   // wait for the tasks which have been posted to complete then stop the
+   // pool's threads (tasks can't be posted once the pool has stopped)
+   void stop();
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+// shared pool for background work (created when first used)
+ThreadPool& backgroundPool();
+
+class MainThreadExecutor : public Executor, boost::noncopyable
+{
+public:
+   MainThreadExecutor();
+   virtual ~MainThreadExecutor();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // tasks can be posted from any thread
+   virtual void post(const Task& task);
+
+   // run the tasks posted so far (must be called on the main thread).
+   // returns the number of tasks which were run
+   std::size_t runPending();
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+MainThreadExecutor& mainThreadExecutor();
+
+// Cancellation tokens are shared by copies of the token, so a task can be
+// handed a copy of the token which the code which scheduled it may later
+// cancel. Scheduled tasks which haven't started when their token is
+// cancelled don't run (their futures complete with an operation_canceled
+// error); those already running must check isCancelled themselves.
+class CancellationToken
+{
+public:
+   CancellationToken();
+
+   void cancel();
+   bool isCancelled() const;
+
+private:
+   struct State;
+   boost::shared_ptr<State> pState_;
+};
+
+namespace detail {
+
+template <typename T>
+struct FutureState : boost::noncopyable
+{
+   FutureState() : ready(false) {}
+
+   boost::mutex mutex;
+   boost::condition_variable condition;
+   bool ready;
+   T value;
+   Error error;
+   std::vector<Task> continuations;
+};
+
+Error canceledError(const ErrorLocation& location);
+
+} // namespace detail
+
+// Futures give access to the result of a scheduled task (the result type
+// must be default constructible and copyable). The result is either the
+// value returned by the task or an error (when the task is cancelled or
+// throws an exception).
+template <typename T>
+class Future
+{
+public:
+   Future() : pState_(new detail::FutureState<T>()) {}
+
+   // COPYING: via compiler (copies share the result)
+
+public:
+   bool ready() const
+   {
+      boost::lock_guard<boost::mutex> lock(pState_->mutex);
+      return pState_->ready;
+   }
+
+   void wait() const
+   {
+      boost::unique_lock<boost::mutex> lock(pState_->mutex);
+      while (!pState_->ready)
+         pState_->condition.wait(lock);
+   }
+
+   // returns false if the result isn't available within the timeout
+   bool waitFor(const boost::posix_time::time_duration& timeout) const
+   {
+      boost::system_time deadline = boost::get_system_time() + timeout;
+      boost::unique_lock<boost::mutex> lock(pState_->mutex);
+      while (!pState_->ready)
+      {
+         if (!pState_->condition.timed_wait(lock, deadline))
+            return pState_->ready;
+      }
+      return true;
+   }
+
+   // the value and error (these wait for the result if necessary)
+   T value() const
+   {
+      wait();
+      return pState_->value;
+   }
+
+   Error error() const
+   {
+      wait();
+      return pState_->error;
+   }
+
+   // run the continuation on the executor once the result is available
+   void onReady(Executor* pExecutor,
+                const boost::function<void(const Future<T>&)>& continuation)
+                                                                        const
+   {
+      Task task = boost::bind(continuation, *this);
+
+      boost::unique_lock<boost::mutex> lock(pState_->mutex);
+      if (!pState_->ready)
+      {
+         pState_->continuations.push_back(
+                  boost::bind(&Executor::post, pExecutor, task));
+         return;
+      }
+      lock.unlock();
+
+      pExecutor->post(task);
+   }
+
+   // run the continuation on the executor once the result is available,
+   // returning a future for the continuation's result
+   template <typename U>
+   Future<U> then(Executor* pExecutor,
+                  const boost::function<U(const Future<T>&)>& continuation)
+                                                                        const
+   {
+      Future<U> future;
+      onReady(pExecutor,
+              boost::bind(&Future<T>::template runContinuation<U>,
+                          _1,
+                          continuation,
+                          future));
+      return future;
+   }
+
+   void setValue(const T& value)
+   {
+      complete(value, Success());
+   }
+
+   void setError(const Error& error)
+   {
+      complete(T(), error);
+   }
+
+private:
+   template <typename U>
+   static void runContinuation(
+                  const Future<T>& future,
+                  const boost::function<U(const Future<T>&)>& continuation,
+                  Future<U> result)
+   {
+      try
+      {
+         result.setValue(continuation(future));
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::state_not_recoverable,
+                                   e.what(),
+                                   ERROR_LOCATION);
+         result.setError(error);
+      }
+      catch(...)
+      {
+         Error error = systemError(boost::system::errc::state_not_recoverable,
+                                   ERROR_LOCATION);
+         result.setError(error);
+      }
+   }
+
+   void complete(const T& value, const Error& error)
+   {
+      std::vector<Task> continuations;
+      {
+         boost::lock_guard<boost::mutex> lock(pState_->mutex);
+         if (pState_->ready)
+         {
+            LOG_WARNING_MESSAGE("Future completed more than once");
+            return;
+         }
+
+         pState_->value = value;
+         pState_->error = error;
+         pState_->ready = true;
+         continuations.swap(pState_->continuations);
+      }
+      pState_->condition.notify_all();
+
+      for (std::size_t i = 0; i < continuations.size(); i++)
+         continuations[i]();
+   }
+
+private:
+   boost::shared_ptr<detail::FutureState<T> > pState_;
+};
+
+namespace detail {
+
+template <typename T>
+void runScheduled(const boost::function<T()>& func,
+                  const CancellationToken& token,
+                  Future<T> future)
+{
+   if (token.isCancelled())
+   {
+      future.setError(canceledError(ERROR_LOCATION));
+      return;
+   }
+
+   try
+   {
+      future.setValue(func());
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::state_not_recoverable,
+                                e.what(),
+                                ERROR_LOCATION);
+      future.setError(error);
+   }
+   catch(...)
+   {
+      Error error = systemError(boost::system::errc::state_not_recoverable,
+                                ERROR_LOCATION);
+      future.setError(error);
+   }
+}
+
+} // namespace detail
+
+// run the function on the executor (unless the token is cancelled before
+// it starts), returning a future for its result
+template <typename T>
+Future<T> schedule(Executor* pExecutor,
+                   const boost::function<T()>& func,
+                   const CancellationToken& token = CancellationToken())
+{
+   Future<T> future;
+   pExecutor->post(boost::bind(detail::runScheduled<T>, func, token, future));
+   return future;
+}
+
+} // namespace tasks
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TASK_SCHEDULER_HPP
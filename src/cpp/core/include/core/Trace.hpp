@@ -19,14 +19,52 @@
 #include <iosfwd>
 #include <string>
 
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/current_function.hpp>
 
+#include <core/json/Json.hpp>
+
 namespace rstudio {
 namespace core { 
 namespace trace {
 
 void add(void* key, const std::string& functionName);
 
+// Spans time a scope (e.g. the handling of an RPC). The duration of every
+// span is counted in a latency histogram for its category and name, and
+// when tracing is enabled spans are also recorded in a ring buffer for the
+// thread they ran on (so recording them doesn't contend with other
+// threads), from which they can be exported in Chrome's trace event format
+// (for viewing in chrome://tracing).
+class Span : boost::noncopyable
+{
+public:
+   // the category must be a string literal
+   Span(const char* category, const std::string& name);
+   ~Span();
+
+   // COPYING: boost::noncopyable
+
+private:
+   const char* category_;
+   std::string name_;
+   boost::int64_t startMicros_;
+};
+
+void setEnabled(bool enabled);
+bool enabled();
+
+// the spans recorded (as a Chrome trace event object)
+json::Object traceEvents();
+
+// latency histograms by category and name (names beyond the first 64 seen
+// in a category are counted together as "other")
+json::Object latencyHistograms();
+
+// discard recorded spans and histograms
+void clear();
+
 } // namespace trace
 } // namespace core 
 } // namespace rstudio
@@ -34,5 +72,5 @@ void add(void* key, const std::string& functionName);
 #define TRACE_CURRENT_METHOD \
    core::trace::add(this, BOOST_CURRENT_FUNCTION);
 
-#endif // CORE_PERFORMANCE_TIMER_HPP
+#endif // CORE_TRACE_HPP
 
@@ -0,0 +1,70 @@
+/*
+ * ZipStreamWriter.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_ZIP_STREAM_WRITER_HPP
+#define CORE_ZIP_STREAM_WRITER_HPP
+
+#include <stdint.h>
+
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+// Generates a zip archive of files and directories as a sequence of chunks
+// produced on demand, so that an archive of any size can be sent (e.g. as
+// an http response) without writing it to a temporary file or holding it
+// in memory. Files are read as their chunks are requested; those which
+// are already compressed are stored and the rest are deflated. Archives
+// (and the files within them) may exceed 4GB (zip64 records are written
+// where required).
+class ZipStreamWriter : boost::noncopyable
+{
+public:
+   // entries are named relative to the parent path. compression level is
+   // per zlib (0 stores every file)
+   explicit ZipStreamWriter(const FilePath& parentPath,
+                            int compressionLevel = 6);
+   virtual ~ZipStreamWriter();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // add a file or a directory (along with all of its contents); must be
+   // called before reading any chunks of the archive
+   Error add(const FilePath& path);
+
+   // read the next chunk of the archive (an empty chunk indicates that the
+   // entire archive has been read)
+   Error nextChunk(std::string* pChunk);
+
+   // total size of the chunks read so far
+   uintmax_t bytesRead() const;
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_ZIP_STREAM_WRITER_HPP
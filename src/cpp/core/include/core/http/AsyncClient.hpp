@@ -16,6 +16,9 @@
 #ifndef CORE_HTTP_ASYNC_CLIENT_HPP
 #define CORE_HTTP_ASYNC_CLIENT_HPP
 
+#include <algorithm>
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -58,6 +61,9 @@ namespace http {
 
 typedef boost::function<void(const http::Response&)> ResponseHandler;
 typedef boost::function<void(const core::Error&)> ErrorHandler;
+typedef boost::function<bool(const http::Response&)> ResponseFilter;
+typedef boost::function<void(const http::Response&,
+                             boost::shared_ptr<Socket>)> StreamResponseHandler;
 
 
 template <typename SocketService>
@@ -71,7 +77,8 @@ public:
                bool logToStderr = false)
       : ioService_(ioService),
         connectionRetryContext_(ioService),
-        logToStderr_(logToStderr)
+        logToStderr_(logToStderr),
+        requestBodyRemaining_(0)
    {
    }
 
@@ -90,6 +97,34 @@ public:
       connectionRetryContext_.profile = connectionRetryProfile;
    }
 
+   // set (optional) source for the remainder of the request body (i.e. the
+   // portion of it not already within the request). the body is copied
+   // from the source to the server in chunks as the request is written
+   // rather than being read into memory first. must do this prior to
+   // calling execute
+   void setRequestBodySource(boost::shared_ptr<Socket> pSource,
+                             std::size_t remaining)
+   {
+      pRequestBodySource_ = pSource;
+      requestBodyRemaining_ = remaining;
+      requestBodyBuffer_.resize(8192);
+   }
+
+   // set (optional) handler for responses whose bodies should be streamed
+   // rather than read into memory in their entirety (the filter is called
+   // once the headers of the response have been read to determine this).
+   // the handler is passed the headers along with whatever portion of the
+   // body has already been read, and is responsible for reading the rest
+   // of the body from the passed socket (e.g. see
+   // AsyncConnection::writeStreamedResponse). must do this prior to
+   // calling execute
+   void setStreamResponseHandler(const ResponseFilter& streamResponseFilter,
+                                 const StreamResponseHandler& handler)
+   {
+      streamResponseFilter_ = streamResponseFilter;
+      streamResponseHandler_ = handler;
+   }
+
    // execute the async client
    void execute(const ResponseHandler& responseHandler,
                 const ErrorHandler& errorHandler)
@@ -114,6 +149,8 @@ public:
    {
       responseHandler_ = ResponseHandler();
       errorHandler_ = ErrorHandler();
+      streamResponseFilter_ = ResponseFilter();
+      streamResponseHandler_ = StreamResponseHandler();
    }
 
    // satisfy lower-level http::Socket interface (used when the client
@@ -302,14 +339,32 @@ private:
       {
          if (!ec)
          {
-            // initiate async read of the first line of the response
-            boost::asio::async_read_until(
-              socket(),
-              responseBuffer_,
-              "\r\n",
-              boost::bind(&AsyncClient<SocketService>::handleReadStatusLine,
-                          AsyncClient<SocketService>::shared_from_this(),
-                          boost::asio::placeholders::error));
+            // copy the next chunk of the request body if we have one,
+            // otherwise initiate async read of the first line of the
+            // response
+            if (pRequestBodySource_ && requestBodyRemaining_ > 0)
+            {
+               std::size_t size = std::min(requestBodyRemaining_,
+                                           requestBodyBuffer_.size());
+               pRequestBodySource_->asyncReadSome(
+                  boost::asio::buffer(&(requestBodyBuffer_[0]), size),
+                  boost::bind(&AsyncClient<SocketService>::handleReadRequestBody,
+                              AsyncClient<SocketService>::shared_from_this(),
+                              boost::asio::placeholders::error,
+                              boost::asio::placeholders::bytes_transferred));
+            }
+            else
+            {
+               pRequestBodySource_.reset();
+
+               boost::asio::async_read_until(
+                 socket(),
+                 responseBuffer_,
+                 "\r\n",
+                 boost::bind(&AsyncClient<SocketService>::handleReadStatusLine,
+                             AsyncClient<SocketService>::shared_from_this(),
+                             boost::asio::placeholders::error));
+            }
          }
          else
          {
@@ -319,6 +374,33 @@ private:
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
    }
 
+   void handleReadRequestBody(const boost::system::error_code& ec,
+                              std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!ec)
+         {
+            // write the chunk (handleWrite then reads the next one)
+            requestBodyRemaining_ -= bytesTransferred;
+            boost::asio::async_write(
+                socket(),
+                boost::asio::buffer(&(requestBodyBuffer_[0]), bytesTransferred),
+                boost::bind(
+                     &AsyncClient<SocketService>::handleWrite,
+                     AsyncClient<SocketService>::shared_from_this(),
+                     boost::asio::placeholders::error)
+            );
+         }
+         else
+         {
+            pRequestBodySource_.reset();
+            handleErrorCode(ec, ERROR_LOCATION);
+         }
+      }
+      CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
+   }
+
    void handleReadStatusLine(const boost::system::error_code& ec)
    {
       try
@@ -399,8 +481,12 @@ private:
             if (responseBuffer_.size() > 0)
                ResponseParser::appendToBody(&responseBuffer_, &response_);
 
-            // start reading content
-            readSomeContent();
+            // hand off responses with streamed bodies (the handler reads the
+            // remainder of the body), otherwise start reading content
+            if (streamResponseFilter_ && streamResponseFilter_(response_))
+               respondWithStream();
+            else
+               readSomeContent();
          }
          else
          {
@@ -449,6 +535,16 @@ private:
          responseHandler_(response_);
    }
 
+   void respondWithStream()
+   {
+      // release our handlers (the streaming handler may well hold a
+      // reference to us for as long as it reads the body)
+      StreamResponseHandler handler = streamResponseHandler_;
+      disableHandlers();
+
+      handler(response_, AsyncClient<SocketService>::shared_from_this());
+   }
+
    void logError(const Error& error) const
    {
       if (logToStderr_)
@@ -485,7 +581,12 @@ private:
    bool logToStderr_;
    ResponseHandler responseHandler_;
    ErrorHandler errorHandler_;
+   ResponseFilter streamResponseFilter_;
+   StreamResponseHandler streamResponseHandler_;
    http::Request request_;
+   boost::shared_ptr<Socket> pRequestBodySource_;
+   std::size_t requestBodyRemaining_;
+   std::vector<char> requestBodyBuffer_;
    boost::asio::streambuf responseBuffer_;
 };
    
@@ -51,6 +51,14 @@ public:
    virtual void writeResponse(const http::Response& response,
                               bool close = true) = 0;
    virtual void writeError(const Error& error) = 0;
+
+   // write a response whose body (beyond the portion of it which the
+   // response contains) is copied from another socket as it arrives, up to
+   // the response's Content-Length or else until the socket reaches end of
+   // file. both the connection and the socket are closed once the body
+   // has been written
+   virtual void writeStreamedResponse(const http::Response& response,
+                                      boost::shared_ptr<Socket> pBodySource) = 0;
 };
 
 } // namespace http
@@ -16,6 +16,9 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 
+#include <vector>
+#include <algorithm>
+
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
@@ -54,13 +57,17 @@ public:
 public:
    AsyncConnectionImpl(boost::asio::io_service& ioService,
                        const Handler& handler,
-                       const ResponseFilter& responseFilter =ResponseFilter())
+                       const ResponseFilter& responseFilter =ResponseFilter(),
+                       const RequestParser::RequestFilter& streamBodyFilter =
+                                               RequestParser::RequestFilter())
       : ioService_(ioService),
         socket_(ioService),
         handler_(handler),
-        responseFilter_(responseFilter)
-        
+        responseFilter_(responseFilter),
+        streamedBodyLengthKnown_(false),
+        streamedBodyRemaining_(0)
    {
+      requestParser_.setStreamBodyFilter(streamBodyFilter);
    }
    
    typename ProtocolType::socket& socket() 
@@ -123,6 +130,44 @@ public:
       writeResponse();
    }
 
+   virtual void writeStreamedResponse(const http::Response& response,
+                                      boost::shared_ptr<Socket> pBodySource)
+   {
+      response_.assign(response);
+
+      // determine how much of the body remains to be copied
+      pStreamedBodySource_ = pBodySource;
+      streamedBodyLengthKnown_ =
+                        !response_.headerValue("Content-Length").empty();
+      if (streamedBodyLengthKnown_ &&
+          response_.contentLength() > response_.body().size())
+      {
+         streamedBodyRemaining_ =
+                        response_.contentLength() - response_.body().size();
+      }
+      streamedBodyBuffer_.resize(64 * 1024);
+
+      // add extra response headers
+      response_.setHeader("Date", util::httpDate());
+      response_.setHeader("Connection", "close");
+
+      // call the response filter if we have one
+      if (responseFilter_)
+         responseFilter_(&response_);
+
+      // write the headers (and initial portion of the body), after which
+      // we alternate between reading and writing chunks of the body (so
+      // we never hold more than one chunk)
+      boost::asio::async_write(
+          socket_,
+          response_.toBuffers(),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWriteStreamedBody,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error)
+      );
+   }
+
    // satisfy lower-level http::Socket interface (used when the connection
    // is upgraded to a websocket connection and no longer conforms to the
    // request/response protocol used by the class in the ordinary course
@@ -176,7 +221,8 @@ private:
                readSome();
             }
             
-            // got valid request -- handle it 
+            // got valid request (or its headers, in which case the handler
+            // reads the remainder of the body from the connection) -- handle it
             else
             {
                handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
@@ -233,6 +279,84 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
+   void handleWriteStreamedBody(const boost::system::error_code& e)
+   {
+      try
+      {
+         if (e)
+         {
+            // log the error if it wasn't connection terminated
+            Error error(e, ERROR_LOCATION);
+            if (!http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+
+            closeStreamedResponse();
+         }
+         else if (streamedBodyLengthKnown_ && streamedBodyRemaining_ == 0)
+         {
+            closeStreamedResponse();
+         }
+         else
+         {
+            std::size_t size = streamedBodyBuffer_.size();
+            if (streamedBodyLengthKnown_)
+               size = std::min(size, streamedBodyRemaining_);
+
+            pStreamedBodySource_->asyncReadSome(
+               boost::asio::buffer(&(streamedBodyBuffer_[0]), size),
+               boost::bind(
+                  &AsyncConnectionImpl<ProtocolType>::handleReadStreamedBody,
+                  AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred));
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void handleReadStreamedBody(const boost::system::error_code& e,
+                               std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!e)
+         {
+            if (streamedBodyLengthKnown_)
+               streamedBodyRemaining_ -= bytesTransferred;
+
+            boost::asio::async_write(
+               socket_,
+               boost::asio::buffer(&(streamedBodyBuffer_[0]), bytesTransferred),
+               boost::bind(
+                  &AsyncConnectionImpl<ProtocolType>::handleWriteStreamedBody,
+                  AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  boost::asio::placeholders::error));
+         }
+         else
+         {
+            // end of file is expected for bodies of unknown length
+            Error error(e, ERROR_LOCATION);
+            bool expected = !streamedBodyLengthKnown_ &&
+                            e == boost::asio::error::eof;
+            if (!expected && !http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+
+            closeStreamedResponse();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void closeStreamedResponse()
+   {
+      pStreamedBodySource_->close();
+      pStreamedBodySource_.reset();
+
+      Error error = closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
+
    void readSome()
    {
       socket_.async_read_some(
@@ -254,6 +378,12 @@ private:
    RequestParser requestParser_ ;
    http::Request request_;
    http::Response response_;
+
+   // source of a streamed response body (see writeStreamedResponse)
+   boost::shared_ptr<Socket> pStreamedBodySource_;
+   bool streamedBodyLengthKnown_;
+   std::size_t streamedBodyRemaining_;
+   std::vector<char> streamedBodyBuffer_;
 };
    
 
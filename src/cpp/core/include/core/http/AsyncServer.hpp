@@ -26,6 +26,7 @@
 
 #include <core/http/UriHandler.hpp>
 #include <core/http/AsyncUriHandler.hpp>
+#include <core/http/RequestParser.hpp>
 
 namespace rstudio {
 namespace core {
@@ -55,6 +56,12 @@ public:
 
    virtual void setBlockingDefaultHandler(const UriHandlerFunction& handler) = 0;
 
+   // requests satisfying the filter are passed to their handler as soon
+   // as their headers are read (the handler then reads the body from the
+   // connection itself rather than it being buffered within the request)
+   virtual void setStreamRequestBodyFilter(
+                        const RequestParser::RequestFilter& filter) = 0;
+
    virtual void setScheduledCommandInterval(
                            boost::posix_time::time_duration interval) = 0;
    virtual void addScheduledCommand(boost::shared_ptr<ScheduledCommand> pCmd) = 0;
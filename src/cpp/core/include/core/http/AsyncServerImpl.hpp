@@ -109,6 +109,13 @@ public:
                                     _1));
    }
 
+   virtual void setStreamRequestBodyFilter(
+                        const RequestParser::RequestFilter& filter)
+   {
+      BOOST_ASSERT(!running_);
+      streamRequestBodyFilter_ = filter;
+   }
+
    virtual void setScheduledCommandInterval(
                                    boost::posix_time::time_duration interval)
    {
@@ -234,7 +241,10 @@ private:
 
          // response filter
          boost::bind(&AsyncServerImpl<ProtocolType>::connectionResponseFilter,
-                     this, _1)
+                     this, _1),
+
+         // stream request body filter
+         streamRequestBodyFilter_
       ));
       
       // wait for next connection
@@ -416,7 +426,7 @@ private:
       if (abortOnResourceError_)
       {
          core::log::logErrorMessage("(ABORTING SERVER): " + message, location);
-         ::abort();
+         core::system::abort();
       }
       else
       {
@@ -455,6 +465,7 @@ private:
    boost::shared_ptr<AsyncConnectionImpl<ProtocolType> > ptrNextConnection_;
    AsyncUriHandlers uriHandlers_ ;
    AsyncUriHandlerFunction defaultHandler_;
+   RequestParser::RequestFilter streamRequestBodyFilter_;
    std::vector<boost::shared_ptr<boost::thread> > threads_;
    SocketAcceptorService<ProtocolType> acceptorService_;
    boost::posix_time::time_duration scheduledCommandInterval_;
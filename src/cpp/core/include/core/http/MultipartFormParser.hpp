@@ -0,0 +1,102 @@
+/*
+ * MultipartFormParser.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_MULTIPART_FORM_PARSER_HPP
+#define CORE_HTTP_MULTIPART_FORM_PARSER_HPP
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/http/Util.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+
+namespace http {
+
+// Incremental parser for multipart/form-data bodies. The body can be
+// provided in chunks of any size as it's received; the contents of
+// uploaded files are written to disk as they're parsed (see
+// File::contentsPath) so memory use is bounded regardless of their size.
+class MultipartFormParser : boost::noncopyable
+{
+public:
+   // uploaded files are written to the specified directory
+   MultipartFormParser(const std::string& contentType,
+                       const FilePath& uploadPath);
+
+   // files written by a parser which doesn't complete are removed
+   ~MultipartFormParser();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // parse the next chunk of the body
+   Error parse(const char* begin, const char* end);
+
+   // indicate that the entire body has been parsed
+   Error complete();
+
+   const Fields& fields() const { return fields_; }
+   const Files& files() const { return files_; }
+
+   // size of the data held in memory awaiting parsing
+   std::size_t bufferedSize() const { return buffer_.size(); }
+
+private:
+   enum State
+   {
+      StatePreamble,
+      StateBoundary,
+      StateHeaders,
+      StateContent,
+      StateEpilogue
+   };
+
+   Error beginPart(const std::string& headers);
+   Error appendContent(const char* begin, std::size_t length);
+   Error endPart();
+
+private:
+   std::string delimiter_;
+   FilePath uploadPath_;
+   State state_;
+   std::string buffer_;
+
+   // current part
+   std::string partName_;
+   bool partIsFile_;
+   File partFile_;
+   std::string partValue_;
+   boost::shared_ptr<std::ostream> pPartStream_;
+
+   Fields fields_;
+   Files files_;
+   std::vector<FilePath> createdFiles_;
+   bool completed_;
+};
+
+} // namespace http
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_HTTP_MULTIPART_FORM_PARSER_HPP
@@ -113,6 +113,7 @@ public:
    }
    
    const File& uploadedFile(const std::string& name) const;
+   const Files& uploadedFiles() const;
    
    void setBody(const std::string& body);
    
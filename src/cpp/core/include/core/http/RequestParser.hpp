@@ -17,12 +17,20 @@
 #ifndef CORE_HTTP_REQUEST_PARSER_HPP
 #define CORE_HTTP_REQUEST_PARSER_HPP
 
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
 #include <core/http/Request.hpp>
 
 namespace rstudio {
 namespace core {
 namespace http {
 
+class MultipartFormParser;
+
 /// Parser for incoming requests.
 class RequestParser
 {
@@ -33,12 +41,32 @@ public:
   /// Reset to initial parser state.
   void reset();
 
+  typedef boost::function<bool(const Request&)> RequestFilter;
+
+  /// Requests satisfying the filter (evaluated once their headers have been
+  /// parsed) are returned as headers_complete along with whatever portion
+  /// of their body has already been received, leaving the caller to read
+  /// the remainder of the body itself (e.g. to stream it elsewhere).
+  void setStreamBodyFilter(const RequestFilter& filter)
+  {
+     streamBodyFilter_ = filter;
+  }
+
+  /// Parse multipart/form-data bodies as they are received, writing
+  /// uploaded files to the specified directory rather than holding the
+  /// body in memory.
+  void setFormUploadPath(const FilePath& formUploadPath)
+  {
+     formUploadPath_ = formUploadPath;
+  }
+
   // enum for parse results
   enum status
   {
      incomplete,
      complete,
-     error
+     error,
+     headers_complete
   };
 
   template <typename InputIterator>
@@ -59,6 +87,15 @@ public:
             // if we have a body then continue parsing it
             if (content_length_ > 0)
             {
+               st = beginBody(req) ;
+               if (st == headers_complete)
+               {
+                  // return the portion of the body we've already read
+                  while (begin != end && req.body_.size() < content_length_)
+                     req.body_.push_back(*begin++) ;
+                  return st ;
+               }
+
                parsing_body_ = true ;
                continue ;
             }
@@ -68,6 +105,20 @@ public:
             }
          }
       }
+      // form body parsing (in chunks)
+      else if (pFormParser_)
+      {
+         std::string chunk ;
+         while (begin != end &&
+                body_received_ + chunk.size() < content_length_)
+         {
+            chunk.push_back(*begin++) ;
+         }
+
+         status st = consumeFormBody(req, chunk) ;
+         if (st != incomplete)
+            return st ;
+      }
       // body parsing
       else
       {
@@ -83,6 +134,12 @@ private:
   /// Handle the next character of input.
   status consume(Request& req, char input);
 
+  /// Prepare to parse the body of a request whose headers are complete.
+  status beginBody(Request& req);
+
+  /// Handle the next chunk of a multipart/form-data body.
+  status consumeFormBody(Request& req, const std::string& chunk);
+
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
 
@@ -124,6 +181,11 @@ private:
   std::size_t content_length_ ;
   bool parsing_content_length_ ;
   bool parsing_body_ ;
+
+  RequestFilter streamBodyFilter_ ;
+  FilePath formUploadPath_ ;
+  boost::shared_ptr<MultipartFormParser> pFormParser_ ;
+  std::size_t body_received_ ;
 };
 
 } // namespace http
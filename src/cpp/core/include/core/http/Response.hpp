@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <boost/function.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/concepts.hpp>
@@ -48,6 +49,7 @@ enum Code {
    SwitchingProtocols = 101,
    Ok = 200,
    Created = 201,
+   NoContent = 204,
    PartialContent = 206,
    MovedPermanently = 301,
    MovedTemporarily = 302,
@@ -96,6 +98,7 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      streamBody_ = response.streamBody_;
    }
 
 public:   
@@ -320,6 +323,15 @@ public:
                          const std::string& mimeType,
                          const Request& request);
 
+   // body generated in chunks as the response is written (for bodies too
+   // large to hold in memory). the source provides each successive chunk
+   // and indicates the end of the body with an empty chunk. streamed
+   // responses have no Content-Length so the connection must be closed
+   // once they are written
+   typedef boost::function<Error(std::string*)> StreamBodySource;
+   void setStreamBody(const StreamBodySource& source);
+   const StreamBodySource& streamBody() const { return streamBody_; }
+
    // these calls do no stream io or encoding so don't return errors
    void setBodyUnencoded(const std::string& body);
    void setError(int statusCode, const std::string& message);
@@ -353,6 +365,8 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   StreamBodySource streamBody_;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
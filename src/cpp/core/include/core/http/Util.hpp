@@ -23,6 +23,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <core/FilePath.hpp>
+
 namespace rstudio {
 namespace core {
    
@@ -56,6 +58,10 @@ struct File
    std::string name;
    std::string contentType;
    std::string contents;   
+
+   // files streamed to disk as they were received (see MultipartFormParser)
+   // have their contents here rather than in contents
+   FilePath contentsPath;
 };
 
 typedef std::map<std::string,File> Files;
@@ -169,6 +169,7 @@ bool fillMap(const Object& array, std::map< std::string, std::vector<std::string
 bool parse(const std::string& input, Value* pValue);
 
 void write(const Value& value, std::ostream& os);
+void write(const Value& value, std::string* pOutput);  // appends
 void writeFormatted(const Value& value, std::ostream& os);
    
 } // namespace json
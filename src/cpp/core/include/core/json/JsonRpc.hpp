@@ -971,7 +971,9 @@ public:
    template <typename T>
    void setField(const std::string& name, const T& value) 
    { 
-      setField(name, json::Value(value));
+      // swap the converted value into place rather than copying it again
+      json::Value fieldValue(value);
+      response_[name].swap(fieldValue);
    }
    
    // low level hook to set the full response
@@ -54,6 +54,9 @@ namespace json_spirit
 
         Value_impl& operator=( const Value_impl& lhs );
 
+        // exchanges contents without copying them
+        void swap( Value_impl& other );
+
         Value_type type() const;
 
         bool is_uint64() const;
@@ -84,6 +87,8 @@ namespace json_spirit
                                 boost::recursive_wrapper< Object >, boost::recursive_wrapper< Array >, 
                                 bool, boost::int64_t, double > Variant;
 
+        static Variant empty_variant( Value_type vtype );
+
         Value_type type_;
         Variant v_;
         bool is_uint64_;
@@ -297,15 +302,51 @@ namespace json_spirit
     template< class Config >
     Value_impl< Config >& Value_impl< Config >::operator=( const Value_impl& lhs )
     {
-        Value_impl tmp( lhs );
+        Value_impl tmp( lhs );  // copy first as lhs may be contained in this value
 
-        std::swap( type_, tmp.type_ );
-        std::swap( v_, tmp.v_ );
-        std::swap( is_uint64_, tmp.is_uint64_ );
+        swap( tmp );
 
         return *this;
     }
 
+    template< class Config >
+    typename Value_impl< Config >::Variant Value_impl< Config >::empty_variant( Value_type vtype )
+    {
+        switch( vtype )
+        {
+            case obj_type:   return Variant( Object() );
+            case array_type: return Variant( Array() );
+            case bool_type:  return Variant( false );
+            case int_type:   return Variant( boost::int64_t( 0 ) );
+            case real_type:  return Variant( 0.0 );
+            default:         return Variant();  // string (also used for null)
+        }
+    }
+
+    template< class Config >
+    void Value_impl< Config >::swap( Value_impl& other )
+    {
+        if( v_.which() == other.v_.which() )
+        {
+            v_.swap( other.v_ );
+        }
+        else
+        {
+            // boost::variant copies the contents of variants holding
+            // different types when swapping them, so instead exchange the
+            // contents through same-typed swaps with empty values
+            Variant tmp( empty_variant( type_ ) );
+            tmp.swap( v_ );
+            v_ = empty_variant( other.type_ );
+            v_.swap( other.v_ );
+            other.v_ = empty_variant( type_ );
+            other.v_.swap( tmp );
+        }
+
+        std::swap( type_, other.type_ );
+        std::swap( is_uint64_, other.is_uint64_ );
+    }
+
     template< class Config >
     bool Value_impl< Config >::operator==( const Value_impl& lhs ) const
     {
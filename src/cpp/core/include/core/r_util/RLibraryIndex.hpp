@@ -0,0 +1,77 @@
+/*
+ * RLibraryIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_LIBRARY_INDEX_HPP
+#define CORE_R_UTIL_R_LIBRARY_INDEX_HPP
+
+#include <string>
+#include <vector>
+
+#include <core/FilePath.hpp>
+
+// location of the library indexes maintained by rserver for the site
+// libraries it shares with all sessions (beneath the server's data
+// directory, which only root can write, since sessions trust the indexes)
+#define kLibraryIndexPath "/var/lib/rstudio-server/library-index"
+
+namespace rstudio {
+namespace core {
+
+class Error;
+
+namespace r_util {
+
+struct LibraryPackage
+{
+   std::string name;
+   std::string version;
+   std::string title;
+};
+
+// the packages installed within a library along with the signature of the
+// library at the time it was scanned (a mismatch indicates that the index
+// is stale)
+struct LibraryIndex
+{
+   FilePath library;
+   std::string signature;
+   std::vector<LibraryPackage> packages;
+};
+
+// a signature of the packages installed within a library: the name of each
+// package directory along with the size, modification time, and (where
+// available) inode of its DESCRIPTION. installing, updating, or removing a
+// package changes the signature even within the second the library was
+// scanned (which the library directory's modification time can't detect)
+Error librarySignature(const FilePath& library, std::string* pSignature);
+
+// read the DESCRIPTION of every package installed within the library
+Error scanLibrary(const FilePath& library, LibraryIndex* pIndex);
+
+// write the index to the store (atomically, so readers never see a
+// partially written index)
+Error writeLibraryIndex(const FilePath& storePath, const LibraryIndex& index);
+
+// read the index for a library from the store, returning false if there
+// is no index for the library or it is out of date
+bool readLibraryIndex(const FilePath& storePath,
+                      const FilePath& library,
+                      LibraryIndex* pIndex);
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_R_UTIL_R_LIBRARY_INDEX_HPP
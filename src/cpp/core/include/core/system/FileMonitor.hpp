@@ -127,6 +127,9 @@ void registerMonitor(const core::FilePath& filePath,
 // if the handle has already been unregistered)
 void unregisterMonitor(Handle handle);
 
+// the number of file monitors which are currently registered
+std::size_t activeMonitorCount();
+
 
 // check for changes (will cause onRegistered, onRegistrationError,
 // onMonitoringError, onFilesChanged, and onUnregistered calls to occur
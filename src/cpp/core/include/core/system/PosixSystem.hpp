@@ -154,13 +154,14 @@ void setProcessLimits(ProcessLimits limits);
 struct ProcessConfig
 {
    ProcessConfig()
-      : stdStreamBehavior(StdStreamInherit)
+      : stdStreamBehavior(StdStreamInherit), stdInputFd(-1)
    {
    }
    core::system::Options args;
    core::system::Options environment;
    std::string stdInput;
    StdStreamBehavior stdStreamBehavior;
+   int stdInputFd; // attached to stdin (used with StdStreamInherit)
    ProcessLimits limits;
 };
 
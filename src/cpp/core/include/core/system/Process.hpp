@@ -257,9 +257,11 @@ public:
 
    // Run a child asynchronously, invoking callbacks as the process starts,
    // produces output, and exits. Output callbacks are streamed/interleaved,
-   // but note that output is collected at a polling interval so it is
+   // but note that output is delivered at a polling interval so it is
    // possible that e.g. two writes to standard output which had an
-   // intervening write to standard input might still be concatenated. See
+   // intervening write to standard input might still be concatenated (on
+   // linux output is read as it arrives by a background thread and then
+   // delivered by poll; elsewhere poll reads it directly). See
    // comment on runProgram above for the semantics of the "executable"
    // argument.
    Error runProgram(const std::string& executable,
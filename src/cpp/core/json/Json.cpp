@@ -15,14 +15,20 @@
 
 #include <core/json/Json.hpp>
 
+#include <algorithm>
+#include <clocale>
+#include <deque>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <sstream>
 
 #include <boost/format.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/scoped_array.hpp>
 
 #include <core/Log.hpp>
-#include <core/Thread.hpp>
 
 #include "spirit/json_spirit.h"
 
@@ -87,34 +93,606 @@ bool fillMap(const Object& object, std::map< std::string, std::vector<std::strin
    return true;
 }
 
-bool parse(const std::string& input, Value* pValue)
+namespace {
+
+// hand-written recursive descent parser which builds json::Value objects in
+// place (rather than assembling them via semantic actions and copying them
+// into their parents). it accepts the same documents as the json_spirit
+// reader it replaced: leading whitespace is skipped and any input following
+// the first complete value is ignored. unlike the spirit reader it keeps no
+// shared state so it may be used from several threads at once.
+class Parser : boost::noncopyable
 {
-   // two threads simultaneously using the json parser has been observed
-   // to crash the process. protect it globally with a mutex. note this was
-   // probably a result of not defining BOOST_SPIRIT_THREADSAFE (which we
-   // have subsequently defined) however since there isn't much documentation 
-   // on the behavior of boost spirit w/ threads and the specific behavior
-   // of this constant we leave in mutex just to be sure   
-      
-   static boost::mutex s_spiritMutex ;
-   LOCK_MUTEX(s_spiritMutex)
+public:
+   Parser(const char* begin, const char* end)
+      : pos_(begin), end_(end)
    {
-      return json_spirit::read(input, *pValue);
    }
-   END_LOCK_MUTEX
-   
-   // mutex related error
-   return false;
+
+   bool parseValue(Value* pValue)
+   {
+      skipWhitespace();
+      if (pos_ == end_)
+         return false;
+
+      switch (*pos_)
+      {
+         case '{':
+            return parseObject(pValue);
+         case '[':
+            return parseArray(pValue);
+         case '"':
+         {
+            std::string str;
+            if (!parseString(&str))
+               return false;
+            setValue(Value(str), pValue);
+            return true;
+         }
+         case 't':
+            return parseLiteral("true", Value(true), pValue);
+         case 'f':
+            return parseLiteral("false", Value(false), pValue);
+         case 'n':
+            return parseLiteral("null", Value(), pValue);
+         default:
+            return parseNumber(pValue);
+      }
+   }
+
+private:
+
+   // values are swapped into place rather than assigned (assignment
+   // copies the value)
+   static void setValue(Value value, Value* pValue)
+   {
+      pValue->swap(value);
+   }
+
+   static bool isWhitespace(char ch)
+   {
+      return ch == ' ' || ch == '\n' || ch == '\r' ||
+             ch == '\t' || ch == '\f' || ch == '\v';
+   }
+
+   static bool isDigit(char ch)
+   {
+      return ch >= '0' && ch <= '9';
+   }
+
+   void skipWhitespace()
+   {
+      while (pos_ != end_ && isWhitespace(*pos_))
+         ++pos_;
+   }
+
+   bool consume(char ch)
+   {
+      skipWhitespace();
+      if (pos_ != end_ && *pos_ == ch)
+      {
+         ++pos_;
+         return true;
+      }
+      return false;
+   }
+
+   bool parseObject(Value* pValue)
+   {
+      ++pos_; // '{'
+      setValue(Value(Object()), pValue);
+      Object& object = pValue->get_obj();
+
+      if (consume('}'))
+         return true;
+
+      std::string name;
+      do
+      {
+         skipWhitespace();
+         if (pos_ == end_ || *pos_ != '"')
+            return false;
+
+         name.clear();
+         if (!parseString(&name))
+            return false;
+
+         if (!consume(':'))
+            return false;
+
+         // parse directly into the member (later duplicates replace
+         // earlier ones, as they did with json_spirit)
+         if (!parseValue(&object[name]))
+            return false;
+      }
+      while (consume(','));
+
+      return consume('}');
+   }
+
+   bool parseArray(Value* pValue)
+   {
+      ++pos_; // '['
+      setValue(Value(Array()), pValue);
+
+      if (consume(']'))
+         return true;
+
+      // parse into a deque (so that elements aren't copied as it grows)
+      // and then move the elements into the array
+      std::deque<Value> elements;
+      do
+      {
+         elements.push_back(Value());
+         if (!parseValue(&elements.back()))
+            return false;
+      }
+      while (consume(','));
+
+      if (!consume(']'))
+         return false;
+
+      Array& array = pValue->get_array();
+      array.resize(elements.size());
+      for (std::size_t i = 0; i < elements.size(); i++)
+         array[i].swap(elements[i]);
+
+      return true;
+   }
+
+   bool parseLiteral(const char* literal, const Value& value, Value* pValue)
+   {
+      std::size_t len = std::strlen(literal);
+      if (static_cast<std::size_t>(end_ - pos_) < len ||
+          std::strncmp(pos_, literal, len) != 0)
+      {
+         return false;
+      }
+
+      pos_ += len;
+      setValue(value, pValue);
+      return true;
+   }
+
+   static int hexDigit(char ch)
+   {
+      if (ch >= '0' && ch <= '9')
+         return ch - '0';
+      else if (ch >= 'a' && ch <= 'f')
+         return ch - 'a' + 10;
+      else if (ch >= 'A' && ch <= 'F')
+         return ch - 'A' + 10;
+      else
+         return -1;
+   }
+
+   bool parseHex(std::size_t digits, unsigned int* pValue)
+   {
+      if (static_cast<std::size_t>(end_ - pos_) < digits)
+         return false;
+
+      unsigned int value = 0;
+      for (std::size_t i = 0; i < digits; i++)
+      {
+         int digit = hexDigit(*pos_++);
+         if (digit < 0)
+            return false;
+         value = (value << 4) | digit;
+      }
+
+      *pValue = value;
+      return true;
+   }
+
+   static void appendUtf8(unsigned int codepoint, std::string* pStr)
+   {
+      if (codepoint < 0x80)
+      {
+         pStr->push_back(static_cast<char>(codepoint));
+      }
+      else if (codepoint < 0x800)
+      {
+         pStr->push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+         pStr->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+      }
+      else if (codepoint < 0x10000)
+      {
+         pStr->push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+         pStr->push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+         pStr->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+      }
+      else
+      {
+         pStr->push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+         pStr->push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+         pStr->push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+         pStr->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+      }
+   }
+
+   bool parseUnicodeEscape(std::string* pStr)
+   {
+      unsigned int codepoint;
+      if (!parseHex(4, &codepoint))
+         return false;
+
+      // combine surrogate pairs
+      if (codepoint >= 0xD800 && codepoint <= 0xDBFF &&
+          (end_ - pos_) >= 6 && pos_[0] == '\\' && pos_[1] == 'u')
+      {
+         const char* pairPos = pos_;
+         pos_ += 2;
+         unsigned int low;
+         if (parseHex(4, &low) && low >= 0xDC00 && low <= 0xDFFF)
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+         else
+            pos_ = pairPos;
+      }
+
+      appendUtf8(codepoint, pStr);
+      return true;
+   }
+
+   bool parseString(std::string* pStr)
+   {
+      ++pos_; // opening quote
+
+      while (pos_ != end_)
+      {
+         // copy runs of unescaped characters in one go
+         const char* runStart = pos_;
+         while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\')
+            ++pos_;
+         pStr->append(runStart, pos_);
+
+         if (pos_ == end_)
+            return false;
+
+         if (*pos_ == '"')
+         {
+            ++pos_;
+            return true;
+         }
+
+         // escape sequence
+         if (++pos_ == end_)
+            return false;
+         char ch = *pos_++;
+         switch (ch)
+         {
+            case '"':  pStr->push_back('"');  break;
+            case '\\': pStr->push_back('\\'); break;
+            case '/':  pStr->push_back('/');  break;
+            case 'b':  pStr->push_back('\b'); break;
+            case 'f':  pStr->push_back('\f'); break;
+            case 'n':  pStr->push_back('\n'); break;
+            case 'r':  pStr->push_back('\r'); break;
+            case 't':  pStr->push_back('\t'); break;
+            case 'u':
+            {
+               // json_spirit dropped malformed unicode escapes
+               const char* escapePos = pos_;
+               if (!parseUnicodeEscape(pStr))
+                  pos_ = escapePos;
+               break;
+            }
+            case 'x':
+            {
+               unsigned int value;
+               if (!parseHex(2, &value))
+                  return false;
+               pStr->push_back(static_cast<char>(value));
+               break;
+            }
+            default:
+               // json_spirit silently dropped unknown escapes
+               break;
+         }
+      }
+
+      return false;
+   }
+
+   bool parseNumber(Value* pValue)
+   {
+      const char* start = pos_;
+      bool negative = false;
+      if (pos_ != end_ && (*pos_ == '-' || *pos_ == '+'))
+         negative = (*pos_++ == '-');
+
+      // accumulate the integer part (noting overflow)
+      const char* digitsStart = pos_;
+      boost::uint64_t value = 0;
+      bool overflow = false;
+      while (pos_ != end_ && isDigit(*pos_))
+      {
+         unsigned int digit = *pos_++ - '0';
+         if (value > (std::numeric_limits<boost::uint64_t>::max() - digit) / 10)
+            overflow = true;
+         else
+            value = value * 10 + digit;
+      }
+      bool haveDigits = pos_ != digitsStart;
+
+      // fraction and exponent make this a real
+      bool isReal = false;
+      if (pos_ != end_ && *pos_ == '.')
+      {
+         const char* fractionStart = ++pos_;
+         while (pos_ != end_ && isDigit(*pos_))
+            ++pos_;
+         haveDigits = haveDigits || (pos_ != fractionStart);
+         isReal = true;
+      }
+      if (!haveDigits)
+         return false;
+
+      if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E'))
+      {
+         const char* exponentPos = pos_++;
+         if (pos_ != end_ && (*pos_ == '-' || *pos_ == '+'))
+            ++pos_;
+         const char* exponentStart = pos_;
+         while (pos_ != end_ && isDigit(*pos_))
+            ++pos_;
+         if (pos_ == exponentStart)
+            pos_ = exponentPos;
+         else
+            isReal = true;
+      }
+
+      if (isReal)
+         return parseReal(start, pValue);
+
+      if (overflow)
+         return false;
+
+      if (negative)
+      {
+         boost::uint64_t limit =
+            static_cast<boost::uint64_t>(
+                  std::numeric_limits<boost::int64_t>::max()) + 1;
+         if (value > limit)
+            return false;
+         setValue(Value(static_cast<boost::int64_t>(0 - value)), pValue);
+      }
+      else if (value > static_cast<boost::uint64_t>(
+                            std::numeric_limits<boost::int64_t>::max()))
+      {
+         setValue(Value(value), pValue);
+      }
+      else
+      {
+         setValue(Value(static_cast<boost::int64_t>(value)), pValue);
+      }
+
+      return true;
+   }
+
+   bool parseReal(const char* start, Value* pValue)
+   {
+      // copy into a buffer so strtod sees a terminated string (translating
+      // the decimal point if the C locale doesn't use '.')
+      std::string number(start, pos_);
+      char decimalPoint = *std::localeconv()->decimal_point;
+      if (decimalPoint != '.')
+         std::replace(number.begin(), number.end(), '.', decimalPoint);
+
+      char* pEnd = NULL;
+      double real = std::strtod(number.c_str(), &pEnd);
+      if (pEnd != number.c_str() + number.size())
+         return false;
+
+      setValue(Value(real), pValue);
+      return true;
+   }
+
+private:
+   const char* pos_;
+   const char* end_;
+};
+
+// writes json directly into a string buffer. output is identical to that
+// of the json_spirit generator it replaced (which also copied every object
+// member as it was written)
+class Writer : boost::noncopyable
+{
+public:
+   Writer(bool pretty, std::string* pOutput)
+      : pretty_(pretty), indentLevel_(0), output_(*pOutput)
+   {
+   }
+
+   void write(const Value& value)
+   {
+      switch (value.type())
+      {
+         case json_spirit::obj_type:
+            writeObject(value.get_obj());
+            break;
+         case json_spirit::array_type:
+            writeArray(value.get_array());
+            break;
+         case json_spirit::str_type:
+            writeString(value.get_str());
+            break;
+         case json_spirit::bool_type:
+            output_.append(value.get_bool() ? "true" : "false");
+            break;
+         case json_spirit::int_type:
+            if (value.is_uint64())
+               writeInteger(value.get_uint64(), false);
+            else if (value.get_int64() < 0)
+               writeInteger(0 - static_cast<boost::uint64_t>(value.get_int64()),
+                            true);
+            else
+               writeInteger(value.get_int64(), false);
+            break;
+         case json_spirit::real_type:
+            writeReal(value.get_real());
+            break;
+         case json_spirit::null_type:
+            output_.append("null");
+            break;
+      }
+   }
+
+private:
+
+   void writeObject(const Object& object)
+   {
+      output_.push_back('{');
+      newLine();
+      ++indentLevel_;
+      for (Object::const_iterator it = object.begin(); it != object.end(); )
+      {
+         indent();
+         writeString(it->first);
+         space();
+         output_.push_back(':');
+         space();
+         write(it->second);
+         if (++it != object.end())
+            output_.push_back(',');
+         newLine();
+      }
+      --indentLevel_;
+      indent();
+      output_.push_back('}');
+   }
+
+   void writeArray(const Array& array)
+   {
+      output_.push_back('[');
+      newLine();
+      ++indentLevel_;
+      for (Array::const_iterator it = array.begin(); it != array.end(); )
+      {
+         indent();
+         write(*it);
+         if (++it != array.end())
+            output_.push_back(',');
+         newLine();
+      }
+      --indentLevel_;
+      indent();
+      output_.push_back(']');
+   }
+
+   void writeString(const std::string& str)
+   {
+      output_.push_back('"');
+
+      // copy runs of characters which don't need escaping in one go
+      std::string::const_iterator runStart = str.begin();
+      for (std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+      {
+         const char* escaped = NULL;
+         switch (*it)
+         {
+            case '"':  escaped = "\\\""; break;
+            case '\\': escaped = "\\\\"; break;
+            case '\b': escaped = "\\b";  break;
+            case '\f': escaped = "\\f";  break;
+            case '\n': escaped = "\\n";  break;
+            case '\r': escaped = "\\r";  break;
+            case '\t': escaped = "\\t";  break;
+            default: continue;
+         }
+
+         output_.append(runStart, it);
+         output_.append(escaped);
+         runStart = it + 1;
+      }
+      output_.append(runStart, str.end());
+
+      output_.push_back('"');
+   }
+
+   void writeInteger(boost::uint64_t value, bool negative)
+   {
+      char buffer[24];
+      char* pos = buffer + sizeof(buffer);
+      do
+      {
+         *--pos = static_cast<char>('0' + (value % 10));
+         value /= 10;
+      }
+      while (value != 0);
+
+      if (negative)
+         *--pos = '-';
+
+      output_.append(pos, buffer + sizeof(buffer));
+   }
+
+   void writeReal(double value)
+   {
+      // equivalent to std::showpoint with a precision of 16
+      char buffer[64];
+      int len = ::snprintf(buffer, sizeof(buffer), "%#.16g", value);
+      if (len < 0 || static_cast<std::size_t>(len) >= sizeof(buffer))
+         return;
+
+      char decimalPoint = *std::localeconv()->decimal_point;
+      if (decimalPoint != '.')
+         std::replace(buffer, buffer + len, decimalPoint, '.');
+
+      output_.append(buffer, len);
+   }
+
+   void indent()
+   {
+      if (pretty_)
+         output_.append(indentLevel_ * 4, ' ');
+   }
+
+   void space()
+   {
+      if (pretty_)
+         output_.push_back(' ');
+   }
+
+   void newLine()
+   {
+      if (pretty_)
+         output_.push_back('\n');
+   }
+
+private:
+   bool pretty_;
+   int indentLevel_;
+   std::string& output_;
+};
+
+void writeToStream(const Value& value, bool pretty, std::ostream& os)
+{
+   std::string output;
+   Writer(pretty, &output).write(value);
+   os.write(output.data(), output.size());
+}
+
+} // anonymous namespace
+
+bool parse(const std::string& input, Value* pValue)
+{
+   const char* begin = input.data();
+   return Parser(begin, begin + input.size()).parseValue(pValue);
 }
 
 void write(const Value& value, std::ostream& os)
 {
-   json_spirit::write(value, os);
+   writeToStream(value, false, os);
+}
+
+void write(const Value& value, std::string* pOutput)
+{
+   Writer(false, pOutput).write(value);
 }
 
 void writeFormatted(const Value& value, std::ostream& os)
 {
-   json_spirit::write_formatted(value, os);
+   writeToStream(value, true, os);
 }   
    
 } // namespace json
@@ -0,0 +1,133 @@
+/*
+ * JsonTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <sstream>
+
+#include <core/json/Json.hpp>
+
+namespace rstudio {
+namespace core {
+namespace json {
+
+namespace {
+
+std::string writeValue(const Value& value)
+{
+   std::ostringstream ostr;
+   write(value, ostr);
+   return ostr.str();
+}
+
+std::string roundTrip(const std::string& input)
+{
+   Value value;
+   if (!parse(input, &value))
+      return "<error>";
+   return writeValue(value);
+}
+
+} // anonymous namespace
+
+context("Json")
+{
+   test_that("structures round trip")
+   {
+      expect_true(roundTrip("{}") == "{}");
+      expect_true(roundTrip(" [ ] ") == "[]");
+      expect_true(roundTrip("[1, true, false, null, \"a\"]") ==
+                  "[1,true,false,null,\"a\"]");
+      expect_true(roundTrip("{\"b\": {\"c\": [[], {}]}, \"a\": 1}") ==
+                  "{\"a\":1,\"b\":{\"c\":[[],{}]}}");
+   }
+
+   test_that("numbers are parsed and written")
+   {
+      expect_true(roundTrip("-42") == "-42");
+      expect_true(roundTrip("9223372036854775807") == "9223372036854775807");
+      expect_true(roundTrip("18446744073709551615") == "18446744073709551615");
+      expect_true(roundTrip("18446744073709551616") == "<error>");
+      expect_true(roundTrip("1.5") == "1.500000000000000");
+      expect_true(roundTrip("1e3") == "1000.000000000000");
+
+      Value value;
+      expect_true(parse("[2, 2.0]", &value));
+      expect_true(value.get_array()[0].type() == IntegerType);
+      expect_true(value.get_array()[1].type() == RealType);
+   }
+
+   test_that("strings are escaped and unescaped")
+   {
+      Value value;
+      expect_true(parse("\"a\\\"b\\\\c\\/d\\n\\t\\u0041\"", &value));
+      expect_true(value.get_str() == "a\"b\\c/d\n\tA");
+      expect_true(writeValue(value) == "\"a\\\"b\\\\c/d\\n\\tA\"");
+
+      expect_true(parse("\"\\u00e9\\ud83d\\ude00\"", &value));
+      expect_true(value.get_str() == "\xc3\xa9\xf0\x9f\x98\x80");
+   }
+
+   test_that("malformed input is rejected")
+   {
+      Value value;
+      expect_false(parse("", &value));
+      expect_false(parse("[1,]", &value));
+      expect_false(parse("{\"a\" 1}", &value));
+      expect_false(parse("{a: 1}", &value));
+      expect_false(parse("\"unterminated", &value));
+      expect_false(parse("tru", &value));
+   }
+
+   test_that("values of different types are swapped")
+   {
+      Object object;
+      object["a"] = 1;
+      Value objectValue(object);
+      Value stringValue("text");
+      objectValue.swap(stringValue);
+      expect_true(objectValue.get_str() == "text");
+      expect_true(stringValue.get_obj().find("a")->second.get_int() == 1);
+
+      Value nullValue;
+      nullValue.swap(objectValue);
+      expect_true(objectValue.is_null());
+      expect_true(nullValue.get_str() == "text");
+   }
+
+   test_that("values can be assigned from their own children")
+   {
+      Value value;
+      expect_true(parse("{\"a\":{\"b\":[1,2]}}", &value));
+      value = value.get_obj()["a"];
+      expect_true(writeValue(value) == "{\"b\":[1,2]}");
+      value = value.get_obj()["b"].get_array()[1];
+      expect_true(value.get_int() == 2);
+   }
+
+   test_that("formatted output is indented")
+   {
+      Value value;
+      expect_true(parse("{\"a\":[1,2]}", &value));
+      std::ostringstream ostr;
+      writeFormatted(value, ostr);
+      expect_true(ostr.str() ==
+                  "{\n    \"a\" : [\n        1,\n        2\n    ]\n}");
+   }
+}
+
+} // namespace json
+} // namespace core
+} // namespace rstudio
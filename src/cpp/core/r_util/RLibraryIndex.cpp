@@ -0,0 +1,293 @@
+/*
+ * RLibraryIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RLibraryIndex.hpp>
+
+#include <cctype>
+#include <map>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Hash.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/json/Json.hpp>
+#include <core/json/JsonRpc.hpp>
+#include <core/text/DcfParser.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+FilePath libraryIndexFile(const FilePath& storePath, const FilePath& library)
+{
+   // derive a file name from the library path (the path is also recorded
+   // within the index so a collision just reads as a missing index)
+   std::string name = library.absolutePath();
+   for (std::string::iterator it = name.begin(); it != name.end(); ++it)
+   {
+      if (!std::isalnum(static_cast<unsigned char>(*it)))
+         *it = '_';
+   }
+   return storePath.complete(name + ".json");
+}
+
+// collapse the line continuations of multi-line DESCRIPTION fields
+std::string normalizeField(const std::string& value)
+{
+   std::string normalized;
+   normalized.reserve(value.size());
+   bool inSpace = false;
+   BOOST_FOREACH(char ch, value)
+   {
+      if (std::isspace(static_cast<unsigned char>(ch)))
+      {
+         inSpace = true;
+      }
+      else
+      {
+         if (inSpace && !normalized.empty())
+            normalized.push_back(' ');
+         normalized.push_back(ch);
+         inSpace = false;
+      }
+   }
+   return normalized;
+}
+
+bool compareFilenames(const FilePath& lhs, const FilePath& rhs)
+{
+   return lhs.filename() < rhs.filename();
+}
+
+// identifies a version of a file (a reinstalled package's DESCRIPTION is a
+// new file, so has a new inode, even if its size and time are unchanged)
+std::string fileVersion(const FilePath& filePath)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(filePath.absolutePath().c_str(), &st) == -1)
+      return std::string();
+
+#ifdef __APPLE__
+   const struct timespec& mtime = st.st_mtimespec;
+#else
+   const struct timespec& mtime = st.st_mtim;
+#endif
+   return boost::lexical_cast<std::string>(st.st_size) + ":" +
+          boost::lexical_cast<std::string>(mtime.tv_sec) + "." +
+          boost::lexical_cast<std::string>(mtime.tv_nsec) + ":" +
+          boost::lexical_cast<std::string>(st.st_ino);
+#else
+   return boost::lexical_cast<std::string>(filePath.size()) + ":" +
+          boost::lexical_cast<std::string>(filePath.lastWriteTime());
+#endif
+}
+
+} // anonymous namespace
+
+Error librarySignature(const FilePath& library, std::string* pSignature)
+{
+   std::vector<FilePath> children;
+   Error error = library.children(&children);
+   if (error)
+      return error;
+   std::sort(children.begin(), children.end(), compareFilenames);
+
+   std::string listing;
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      listing.append(child.filename());
+      listing.push_back(' ');
+      listing.append(fileVersion(child.childPath("DESCRIPTION")));
+      listing.push_back('\n');
+   }
+
+   *pSignature = hash::crc32HexHash(listing) + "-" +
+                 boost::lexical_cast<std::string>(children.size());
+   return Success();
+}
+
+Error scanLibrary(const FilePath& library, LibraryIndex* pIndex)
+{
+   pIndex->library = library;
+   pIndex->packages.clear();
+
+   // note the signature before reading the packages (so that a package
+   // installed during the scan leaves the index stale)
+   Error error = librarySignature(library, &pIndex->signature);
+   if (error)
+      return error;
+
+   std::vector<FilePath> children;
+   error = library.children(&children);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      FilePath descFile = child.childPath("DESCRIPTION");
+      if (!child.isDirectory() || !descFile.exists())
+         continue;
+
+      std::map<std::string,std::string> fields;
+      std::string errMsg;
+      error = text::parseDcfFile(descFile, true, &fields, &errMsg);
+      if (error)
+      {
+         LOG_ERROR(error);
+         continue;
+      }
+
+      // only installed packages (not source packages) have been built
+      if (fields.find("Built") == fields.end())
+         continue;
+
+      LibraryPackage package;
+      package.name = fields["Package"];
+      package.version = fields["Version"];
+      package.title = normalizeField(fields["Title"]);
+      if (!package.name.empty())
+         pIndex->packages.push_back(package);
+   }
+
+   return Success();
+}
+
+Error writeLibraryIndex(const FilePath& storePath, const LibraryIndex& index)
+{
+   Error error = storePath.ensureDirectory();
+   if (error)
+      return error;
+
+   json::Array packagesJson;
+   BOOST_FOREACH(const LibraryPackage& package, index.packages)
+   {
+      json::Array packageJson;
+      packageJson.push_back(package.name);
+      packageJson.push_back(package.version);
+      packageJson.push_back(package.title);
+      packagesJson.push_back(packageJson);
+   }
+
+   json::Object indexJson;
+   indexJson["library"] = index.library.absolutePath();
+   indexJson["signature"] = index.signature;
+   indexJson["packages"] = packagesJson;
+
+   std::string contents;
+   json::write(indexJson, &contents);
+
+   // write to a temporary file then move it into place
+   FilePath indexFile = libraryIndexFile(storePath, index.library);
+   FilePath tempFile = indexFile.parent().complete(indexFile.filename() + ".tmp");
+   error = writeStringToFile(tempFile, contents);
+   if (error)
+      return error;
+
+   return tempFile.move(indexFile);
+}
+
+bool readLibraryIndex(const FilePath& storePath,
+                      const FilePath& library,
+                      LibraryIndex* pIndex)
+{
+   FilePath indexFile = libraryIndexFile(storePath, library);
+   if (!indexFile.exists())
+      return false;
+
+   std::string contents;
+   Error error = readStringFromFile(indexFile, &contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   json::Value indexJson;
+   if (!json::parse(contents, &indexJson) ||
+       !json::isType<json::Object>(indexJson))
+   {
+      LOG_ERROR_MESSAGE("Invalid library index: " + indexFile.absolutePath());
+      return false;
+   }
+
+   // (an index written before signatures were recorded is simply stale)
+   const json::Object& indexObject = indexJson.get_obj();
+   if (indexObject.find("signature") == indexObject.end())
+      return false;
+
+   std::string libraryPath, signature;
+   json::Array packagesJson;
+   error = json::readObject(indexObject,
+                            "library", &libraryPath,
+                            "signature", &signature,
+                            "packages", &packagesJson);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   if (libraryPath != library.absolutePath())
+      return false;
+
+   std::string currentSignature;
+   error = librarySignature(library, &currentSignature);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+   if (signature != currentSignature)
+      return false;
+
+   // (an empty library has an index with no packages, which is distinct
+   // from there being no index)
+   pIndex->library = library;
+   pIndex->signature = signature;
+   pIndex->packages.clear();
+   pIndex->packages.reserve(packagesJson.size());
+   BOOST_FOREACH(const json::Value& packageJson, packagesJson)
+   {
+      std::vector<std::string> fields;
+      if (!json::isType<json::Array>(packageJson) ||
+          !json::fillVectorString(packageJson.get_array(), &fields) ||
+          fields.size() != 3)
+      {
+         LOG_ERROR_MESSAGE("Invalid library index: " + indexFile.absolutePath());
+         return false;
+      }
+
+      LibraryPackage package;
+      package.name = fields[0];
+      package.version = fields[1];
+      package.title = fields[2];
+      pIndex->packages.push_back(package);
+   }
+
+   return true;
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
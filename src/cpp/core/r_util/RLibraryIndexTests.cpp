@@ -0,0 +1,110 @@
+/*
+ * RLibraryIndexTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RLibraryIndex.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace r_util {
+
+namespace {
+
+FilePath testDir()
+{
+   FilePath dir;
+   Error error = FilePath::tempFilePath(&dir);
+   if (error)
+      LOG_ERROR(error);
+   dir.ensureDirectory();
+   return dir;
+}
+
+void installPackage(const FilePath& library,
+                    const std::string& name,
+                    const std::string& version)
+{
+   FilePath packageDir = library.childPath(name);
+   packageDir.removeIfExists();
+   packageDir.ensureDirectory();
+   Error error = writeStringToFile(packageDir.childPath("DESCRIPTION"),
+                                   "Package: " + name + "\n"
+                                   "Version: " + version + "\n"
+                                   "Title: A\n  Package\n"
+                                   "Built: R 3.2.0; ; 2015-01-01; unix\n");
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // anonymous namespace
+
+context("RLibraryIndex")
+{
+   test_that("indexes are read until the library changes")
+   {
+      FilePath dir = testDir();
+      FilePath store = dir.childPath("store");
+      FilePath library = dir.childPath("library");
+      library.ensureDirectory();
+      installPackage(library, "alpha", "1.0");
+
+      LibraryIndex index;
+      expect_true(!scanLibrary(library, &index));
+      expect_true(!writeLibraryIndex(store, index));
+
+      LibraryIndex readIndex;
+      expect_true(readLibraryIndex(store, library, &readIndex));
+      expect_true(readIndex.packages.size() == 1);
+      if (readIndex.packages.size() == 1)
+      {
+         expect_true(readIndex.packages[0].name == "alpha");
+         expect_true(readIndex.packages[0].version == "1.0");
+         expect_true(readIndex.packages[0].title == "A Package");
+      }
+
+      // reinstalling a package (with a DESCRIPTION of the same size,
+      // within the same second) leaves the index stale
+      installPackage(library, "alpha", "1.1");
+      expect_false(readLibraryIndex(store, library, &readIndex));
+
+      dir.remove();
+   }
+
+   test_that("an empty library has an empty index")
+   {
+      FilePath dir = testDir();
+      FilePath store = dir.childPath("store");
+      FilePath library = dir.childPath("library");
+      library.ensureDirectory();
+
+      LibraryIndex index;
+      expect_true(!scanLibrary(library, &index));
+      expect_true(!writeLibraryIndex(store, index));
+
+      LibraryIndex readIndex;
+      expect_true(readLibraryIndex(store, library, &readIndex));
+      expect_true(readIndex.packages.empty());
+
+      dir.remove();
+   }
+}
+
+} // namespace r_util
+} // namespace core
+} // namespace rstudio
@@ -197,8 +197,20 @@ public:
    // override of terminate (allow special handling for unix pty termination)
    virtual Error terminate();
 
+   // wait until any async child produces output or exits (or until the
+   // timeout elapses). on platforms where output isn't collected in the
+   // background this simply waits for the timeout
+   static void waitForActivity(const boost::posix_time::time_duration& timeout);
+
 private:
 
+#ifndef _WIN32
+#ifdef __linux__
+   void pollOutputMonitor();
+#endif
+   void onExited(pid_t result, int status, int waitErrno);
+#endif
+
    void reportError(const Error& error)
    {
       if (callbacks_.onError)
@@ -31,10 +31,20 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
+
+#include <map>
+
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
 #include <core/system/System.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <core/system/ShellUtils.hpp>
@@ -85,7 +95,7 @@ Error readPipe(int pipeFd, std::string* pOutput, bool *pEOF = NULL)
       *pEOF = false;
 
    // setup and read into buffer
-   const std::size_t kBufferSize = 512;
+   const std::size_t kBufferSize = 64 * 1024;
    char buffer[kBufferSize];
    std::size_t bytesRead = posixCall<std::size_t>(
                      boost::bind(::read, pipeFd, buffer, kBufferSize));
@@ -131,6 +141,484 @@ Error readPipe(int pipeFd, std::string* pOutput, bool *pEOF = NULL)
    return Success();
 }
 
+#ifdef __linux__
+
+// Output of an async child as collected by the output monitor. The monitor
+// reads from duplicates of the child's output descriptors (which it closes
+// when the last reference to this object goes away) so that they remain
+// valid while it reads from them, regardless of when the child process
+// closes its own.
+struct ChildOutput : boost::noncopyable
+{
+   ChildOutput(int fdStdout, int fdStderr, int fdPid)
+      : fdStdout(fdStdout), fdStderr(fdStderr), fdPid(fdPid),
+        paused(false), stdoutEOF(false), stderrEOF(false), exited(false)
+   {
+   }
+
+   ~ChildOutput()
+   {
+      try
+      {
+         int fds[] = { fdStdout, fdStderr, fdPid };
+         for (std::size_t i = 0; i < sizeof(fds)/sizeof(int); i++)
+         {
+            if (fds[i] != -1)
+               closePipe(fds[i], ERROR_LOCATION);
+         }
+      }
+      catch(...)
+      {
+      }
+   }
+
+   // descriptors (fdPid is -1 if pidfds aren't supported)
+   const int fdStdout;
+   const int fdStderr;
+   const int fdPid;
+
+   // members below are protected by the mutex
+   boost::mutex mutex;
+
+   // output collected but not yet taken by the main thread
+   std::string stdOut;
+   std::string stdErr;
+   Error error;
+
+   // reading suspended because too much output is buffered
+   bool paused;
+
+   // pipes which have reached end of file (and are no longer watched)
+   bool stdoutEOF;
+   bool stderrEOF;
+
+   // the process has exited and all of its output has been collected
+   bool exited;
+};
+
+// Thread which waits (using epoll) for output from async children and for
+// their exit (using pidfds), collecting their output as it arrives so that
+// AsyncChildProcess::poll need only dispatch it. This keeps the children's
+// pipes drained between polls and spares the main thread from reading
+// pipes and calling waitpid on every poll.
+class OutputMonitor : boost::noncopyable
+{
+public:
+   static OutputMonitor& instance()
+   {
+      static OutputMonitor* pInstance = new OutputMonitor();
+      return *pInstance;
+   }
+
+private:
+   OutputMonitor() : epollFd_(-1), activity_(false) {}
+
+public:
+   // start monitoring a child (takes ownership of the descriptors)
+   Error add(const boost::shared_ptr<ChildOutput>& pOutput)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (epollFd_ == -1)
+         {
+            Error error = posixCall<int>(boost::bind(::epoll_create, 16),
+                                         ERROR_LOCATION,
+                                         &epollFd_);
+            if (error)
+               return error;
+
+            core::thread::safeLaunchThread(
+                              boost::bind(&OutputMonitor::run, this));
+         }
+
+         int fds[] = { pOutput->fdStdout, pOutput->fdStderr, pOutput->fdPid };
+         for (std::size_t i = 0; i < sizeof(fds)/sizeof(int); i++)
+         {
+            if (fds[i] == -1)
+               continue;
+
+            Error error = control(EPOLL_CTL_ADD, fds[i], EPOLLIN);
+            if (error)
+            {
+               removeDescriptors(pOutput);
+               return error;
+            }
+            outputs_[fds[i]] = pOutput;
+         }
+      }
+      END_LOCK_MUTEX
+
+      return Success();
+   }
+
+   // stop monitoring a child
+   void remove(const boost::shared_ptr<ChildOutput>& pOutput)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         removeDescriptors(pOutput);
+      }
+      END_LOCK_MUTEX
+   }
+
+   // take the output collected for a child, indicating whether the child
+   // has exited (and all of its output has been taken)
+   Error take(const boost::shared_ptr<ChildOutput>& pOutput,
+              std::string* pStdOut,
+              std::string* pStdErr,
+              bool* pExited)
+   {
+      Error error;
+      LOCK_MUTEX(pOutput->mutex)
+      {
+         pStdOut->swap(pOutput->stdOut);
+         pStdErr->swap(pOutput->stdErr);
+         error = pOutput->error;
+         pOutput->error = Success();
+         *pExited = pOutput->exited;
+
+         // now that the buffered output has been taken we can resume
+         // reading from a child's pipes if we had stopped
+         if (pOutput->paused)
+            resume(pOutput.get());
+      }
+      END_LOCK_MUTEX
+
+      return error;
+   }
+
+   // read whatever output remains in a child's pipes (used to collect all
+   // output after an exit detected without a pidfd)
+   void drain(const boost::shared_ptr<ChildOutput>& pOutput)
+   {
+      LOCK_MUTEX(pOutput->mutex)
+      {
+         drainPipe(pOutput->fdStdout, &pOutput->stdOut, pOutput.get());
+         drainPipe(pOutput->fdStderr, &pOutput->stdErr, pOutput.get());
+      }
+      END_LOCK_MUTEX
+   }
+
+   // wait for output or exit of any monitored child (or timeout)
+   void waitForActivity(const boost::posix_time::time_duration& timeout)
+   {
+      boost::system_time timeoutTime = boost::get_system_time() + timeout;
+      try
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (!activity_)
+         {
+            if (!activityCondition_.timed_wait(lock, timeoutTime))
+               break;
+         }
+         activity_ = false;
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                         ERROR_LOCATION));
+      }
+   }
+
+private:
+   void run()
+   {
+      try
+      {
+         const int kMaxEvents = 64;
+         struct epoll_event events[kMaxEvents];
+         while (true)
+         {
+            int count = ::epoll_wait(epollFd_, events, kMaxEvents, -1);
+            if (count == -1)
+            {
+               if (errno != EINTR)
+               {
+                  LOG_ERROR(systemError(errno, ERROR_LOCATION));
+                  ::sleep(1);
+               }
+               continue;
+            }
+
+            for (int i = 0; i < count; i++)
+               onReadable(events[i].data.fd);
+
+            LOCK_MUTEX(mutex_)
+            {
+               activity_ = true;
+               activityCondition_.notify_all();
+            }
+            END_LOCK_MUTEX
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void onReadable(int fd)
+   {
+      // find the child (which may have been removed since the event
+      // was queued)
+      boost::shared_ptr<ChildOutput> pOutput;
+      LOCK_MUTEX(mutex_)
+      {
+         std::map<int, boost::shared_ptr<ChildOutput> >::const_iterator it =
+                                                            outputs_.find(fd);
+         if (it != outputs_.end())
+            pOutput = it->second;
+      }
+      END_LOCK_MUTEX
+
+      if (!pOutput)
+         return;
+
+      bool finished = false;
+      bool eof = false;
+      LOCK_MUTEX(pOutput->mutex)
+      {
+         if (fd == pOutput->fdPid)
+         {
+            // the process exited; collect whatever output remains
+            drainPipe(pOutput->fdStdout, &pOutput->stdOut, pOutput.get());
+            drainPipe(pOutput->fdStderr, &pOutput->stdErr, pOutput.get());
+            pOutput->exited = true;
+            finished = true;
+         }
+         else
+         {
+            std::string* pBuffer = (fd == pOutput->fdStdout) ?
+                                       &pOutput->stdOut : &pOutput->stdErr;
+            Error error = readPipeChunk(fd, pBuffer, &eof);
+            if (error)
+            {
+               pOutput->error = error;
+               eof = true;
+            }
+
+            if (eof)
+            {
+               // (so that resuming doesn't watch the pipe again)
+               if (fd == pOutput->fdStdout)
+                  pOutput->stdoutEOF = true;
+               else
+                  pOutput->stderrEOF = true;
+            }
+            else if (!pOutput->paused &&
+                     (pOutput->stdOut.size() + pOutput->stdErr.size() >
+                      kMaxBufferedOutput))
+            {
+               // the main thread isn't keeping up; stop reading (which will
+               // block the child once its pipe fills) until it does
+               pause(pOutput.get());
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      if (finished)
+      {
+         remove(pOutput);
+      }
+      else if (eof)
+      {
+         // stop watching this pipe (we'll learn of the exit via the
+         // pidfd, or via waitpid in the absence of one)
+         LOCK_MUTEX(mutex_)
+         {
+            control(EPOLL_CTL_DEL, fd, 0);
+            outputs_.erase(fd);
+         }
+         END_LOCK_MUTEX
+      }
+   }
+
+   // read at most one chunk from a pipe
+   static Error readPipeChunk(int fd, std::string* pBuffer, bool* pEOF)
+   {
+      *pEOF = false;
+
+      std::size_t size = pBuffer->size();
+      pBuffer->resize(size + kReadChunkSize);
+      ssize_t bytesRead = ::read(fd, &(*pBuffer)[size], kReadChunkSize);
+      while (bytesRead == -1 && errno == EINTR)
+         bytesRead = ::read(fd, &(*pBuffer)[size], kReadChunkSize);
+      pBuffer->resize(size + std::max<ssize_t>(bytesRead, 0));
+
+      if (bytesRead == -1)
+      {
+         if (errno == EAGAIN)
+            return Success();
+
+         // on linux slave terminals return EIO rather than bytesRead == 0
+         // to indicate end of file
+         else if ((errno == EIO) && ::isatty(fd))
+            *pEOF = true;
+         else
+            return systemError(errno, ERROR_LOCATION);
+      }
+      else if (bytesRead == 0)
+      {
+         *pEOF = true;
+      }
+
+      return Success();
+   }
+
+   // read until a pipe has no more output available (must be called
+   // with the output's mutex held)
+   static void drainPipe(int fd, std::string* pBuffer, ChildOutput* pOutput)
+   {
+      if (fd == -1)
+         return;
+
+      std::size_t size;
+      bool eof = false;
+      do
+      {
+         size = pBuffer->size();
+         Error error = readPipeChunk(fd, pBuffer, &eof);
+         if (error)
+         {
+            pOutput->error = error;
+            break;
+         }
+      }
+      while (!eof && pBuffer->size() > size);
+   }
+
+   Error control(int op, int fd, uint32_t events)
+   {
+      struct epoll_event event;
+      event.events = events;
+      event.data.u64 = 0;
+      event.data.fd = fd;
+      return posixCall<int>(
+               boost::bind(::epoll_ctl, epollFd_, op, fd, &event),
+               ERROR_LOCATION);
+   }
+
+   // stop and restart watching a child's open pipes (must be called with
+   // the child's mutex held). paused pipes are removed from the epoll set
+   // rather than watched for no events since epoll reports hangups
+   // regardless of the events requested (which would spin the monitor
+   // thread once a paused child exits)
+   void pause(ChildOutput* pOutput)
+   {
+      pOutput->paused = true;
+      if (!pOutput->stdoutEOF)
+         unwatchPipe(pOutput->fdStdout);
+      if (!pOutput->stderrEOF)
+         unwatchPipe(pOutput->fdStderr);
+   }
+
+   void resume(ChildOutput* pOutput)
+   {
+      pOutput->paused = false;
+
+      // (a child whose exit was seen is no longer monitored)
+      if (pOutput->exited)
+         return;
+
+      if (!pOutput->stdoutEOF)
+         watchPipe(pOutput->fdStdout);
+      if (!pOutput->stderrEOF)
+         watchPipe(pOutput->fdStderr);
+   }
+
+   void watchPipe(int fd)
+   {
+      if (fd != -1)
+      {
+         Error error = control(EPOLL_CTL_ADD, fd, EPOLLIN);
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   void unwatchPipe(int fd)
+   {
+      if (fd != -1)
+      {
+         Error error = control(EPOLL_CTL_DEL, fd, 0);
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   // must be called with mutex_ held
+   void removeDescriptors(const boost::shared_ptr<ChildOutput>& pOutput)
+   {
+      int fds[] = { pOutput->fdStdout, pOutput->fdStderr, pOutput->fdPid };
+      for (std::size_t i = 0; i < sizeof(fds)/sizeof(int); i++)
+      {
+         std::map<int, boost::shared_ptr<ChildOutput> >::iterator it =
+                                                         outputs_.find(fds[i]);
+         if (fds[i] != -1 && it != outputs_.end() && it->second == pOutput)
+         {
+            control(EPOLL_CTL_DEL, fds[i], 0);
+            outputs_.erase(it);
+         }
+      }
+   }
+
+private:
+   // size of the reads we perform (the pipe buffer size on linux)
+   static const std::size_t kReadChunkSize = 64 * 1024;
+
+   // output we'll buffer for a child before we wait for it to be taken
+   static const std::size_t kMaxBufferedOutput = 4 * 1024 * 1024;
+
+   int epollFd_;
+   boost::mutex mutex_;
+   boost::condition_variable activityCondition_;
+   bool activity_;
+   std::map<int, boost::shared_ptr<ChildOutput> > outputs_;
+};
+
+// start monitoring the output of a child, returning a null pointer if
+// the child should instead be polled directly
+boost::shared_ptr<ChildOutput> monitorChildOutput(pid_t pid,
+                                                  int fdStdout,
+                                                  int fdStderr)
+{
+   int fdOut = ::dup(fdStdout);
+   if (fdOut == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return boost::shared_ptr<ChildOutput>();
+   }
+
+   int fdErr = -1;
+   if (fdStderr != -1)
+   {
+      fdErr = ::dup(fdStderr);
+      if (fdErr == -1)
+      {
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         closePipe(fdOut, ERROR_LOCATION);
+         return boost::shared_ptr<ChildOutput>();
+      }
+   }
+
+   // pidfds require linux 5.3 (without them we check for exit using
+   // waitpid on each poll)
+   int fdPid = -1;
+#ifdef SYS_pidfd_open
+   fdPid = ::syscall(SYS_pidfd_open, pid, 0);
+#endif
+
+   boost::shared_ptr<ChildOutput> pOutput(new ChildOutput(fdOut, fdErr, fdPid));
+   Error error = OutputMonitor::instance().add(pOutput);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return boost::shared_ptr<ChildOutput>();
+   }
+
+   return pOutput;
+}
+
+#endif // __linux__
+
 } // anonymous namespace
 
 
@@ -657,10 +1145,30 @@ struct AsyncChildProcess::AsyncImpl
    {
    }
 
+   ~AsyncImpl()
+   {
+#ifdef __linux__
+      try
+      {
+         if (pOutput_)
+            OutputMonitor::instance().remove(pOutput_);
+      }
+      catch(...)
+      {
+      }
+#endif
+   }
+
    bool calledOnStarted_;
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+
+#ifdef __linux__
+   // output collected by the output monitor (null if we're reading the
+   // pipes directly)
+   boost::shared_ptr<ChildOutput> pOutput_;
+#endif
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -716,6 +1224,14 @@ void AsyncChildProcess::poll()
       else
          setPipeNonBlocking(pImpl_->fdStderr);         
 
+#ifdef __linux__
+      // have the output monitor collect output as it arrives
+      pAsyncImpl_->pOutput_ = monitorChildOutput(
+               pImpl_->pid,
+               pImpl_->fdStdout,
+               options().pseudoterminal ? -1 : pImpl_->fdStderr);
+#endif
+
       if (callbacks_.onStarted)
          callbacks_.onStarted(*this);
       pAsyncImpl_->calledOnStarted_ = true;
@@ -733,6 +1249,14 @@ void AsyncChildProcess::poll()
       }
    }
 
+#ifdef __linux__
+   if (pAsyncImpl_->pOutput_)
+   {
+      pollOutputMonitor();
+      return;
+   }
+#endif
+
    // check stdout and fire event if we got output
    if (!pAsyncImpl_->finishedStdout_)
    {
@@ -787,33 +1311,103 @@ void AsyncChildProcess::poll()
 
    // either a normal exit or an error while waiting
    if (result != 0)
-   {
-      // close all of our pipes
-      pImpl_->closeAll(ERROR_LOCATION);
+      onExited(result, status, errno);
+}
 
-      // fire exit event
-      if (callbacks_.onExit)
+#ifdef __linux__
+void AsyncChildProcess::pollOutputMonitor()
+{
+   boost::shared_ptr<ChildOutput> pOutput = pAsyncImpl_->pOutput_;
+
+   // without a pidfd the monitor can't tell us when the process exits so
+   // check for that here, collecting any output that remains if it has
+   bool exited = false;
+   pid_t result = 0;
+   int status = 0;
+   int waitErrno = 0;
+   if (pOutput->fdPid == -1)
+   {
+      result = posixCall<pid_t>(
+               boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+      waitErrno = errno;
+      if (result != 0)
       {
-         // resolve exit status
-         if (result > 0)
-            status = resolveExitStatus(status);
-         else
-            status = -1;
-
-         // call onExit
-         callbacks_.onExit(status);
+         OutputMonitor::instance().drain(pOutput);
+         exited = true;
       }
+   }
+
+   // fire events for any output that has been collected
+   std::string out, err;
+   bool outputComplete = false;
+   Error error = OutputMonitor::instance().take(pOutput,
+                                                &out,
+                                                &err,
+                                                &outputComplete);
+   if (error)
+      reportError(error);
 
-      // set exited_ flag so that our exited function always
-      // returns the right value
-      pAsyncImpl_->exited_ = true;
+   if (!out.empty() && callbacks_.onStdout)
+      callbacks_.onStdout(*this, out);
 
-      // if this is an error that isn't ECHILD then log it (we never
-      // expect this to occur as the only documented error codes are
-      // EINTR and ECHILD, and EINTR is handled internally by posixCall)
-      if (result == -1 && errno != ECHILD && errno != ENOENT)
-         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   if (!err.empty() && callbacks_.onStderr)
+      callbacks_.onStderr(*this, err);
+
+   // if the pidfd indicated that the process exited then reap it
+   if (pOutput->fdPid != -1 && outputComplete)
+   {
+      result = posixCall<pid_t>(
+               boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+      waitErrno = errno;
+      exited = true;
+   }
+
+   if (exited)
+   {
+      OutputMonitor::instance().remove(pOutput);
+      pAsyncImpl_->pOutput_.reset();
+      onExited(result, status, waitErrno);
+   }
+}
+#endif
+
+void AsyncChildProcess::onExited(pid_t result, int status, int waitErrno)
+{
+   // close all of our pipes
+   pImpl_->closeAll(ERROR_LOCATION);
+
+   // fire exit event
+   if (callbacks_.onExit)
+   {
+      // resolve exit status
+      if (result > 0)
+         status = resolveExitStatus(status);
+      else
+         status = -1;
+
+      // call onExit
+      callbacks_.onExit(status);
    }
+
+   // set exited_ flag so that our exited function always
+   // returns the right value
+   pAsyncImpl_->exited_ = true;
+
+   // if this is an error that isn't ECHILD then log it (we never
+   // expect this to occur as the only documented error codes are
+   // EINTR and ECHILD, and EINTR is handled internally by posixCall)
+   if (result == -1 && waitErrno != ECHILD && waitErrno != ENOENT)
+      LOG_ERROR(systemError(waitErrno, ERROR_LOCATION));
+}
+
+void AsyncChildProcess::waitForActivity(
+                           const boost::posix_time::time_duration& timeout)
+{
+#ifdef __linux__
+   OutputMonitor::instance().waitForActivity(timeout);
+#else
+   boost::this_thread::sleep(timeout);
+#endif
 }
 
 bool AsyncChildProcess::exited()
@@ -695,6 +695,10 @@ void fixupExecutablePath(FilePath* pExePath)
 
 void abort()
 {
+   // write the messages (and most importantly errors) still queued for
+   // the log files before we go
+   FileLogWriter::flushAll(boost::posix_time::seconds(1));
+
 	::abort();
 }
 
@@ -1328,6 +1332,16 @@ Error launchChildProcess(std::string path,
          ::exit(EXIT_FAILURE);
       }
 
+      // attach the specified descriptor to standard input
+      if (config.stdInputFd != -1)
+      {
+         if (::dup2(config.stdInputFd, STDIN_FILENO) == -1)
+         {
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+            ::exit(EXIT_FAILURE);
+         }
+      }
+
       // close all open file descriptors other than std streams
       error = closeNonStdFileDescriptors();
       if (error)
@@ -327,8 +327,9 @@ bool ProcessSupervisor::wait(
 
    while (poll())
    {
-      // wait the specified polling interval
-      boost::this_thread::sleep(pollingInterval);
+      // wait for output from (or exit of) a child, polling at least as
+      // often as the specified polling interval
+      AsyncChildProcess::waitForActivity(pollingInterval);
 
       // check for timeout if appropriate
       if (!timeoutTime.is_not_a_date_time())
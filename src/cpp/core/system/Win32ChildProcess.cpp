@@ -28,6 +28,7 @@
 #include <core/system/ShellUtils.hpp>
 #include <core/FilePath.hpp>
 #include <core/StringUtils.hpp>
+#include <core/BoostThread.hpp>
 
 #include "CriticalSection.hpp"
 
@@ -642,6 +643,12 @@ bool AsyncChildProcess::exited()
    return pImpl_->hProcess == NULL;
 }
 
+void AsyncChildProcess::waitForActivity(
+                           const boost::posix_time::time_duration& timeout)
+{
+   boost::this_thread::sleep(timeout);
+}
+
 } // namespace system
 } // namespace core
 } // namespace rstudio
@@ -20,6 +20,7 @@
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <core/Log.hpp>
@@ -52,6 +53,9 @@ namespace {
 // we don't want it to ever be destructed)
 std::list<Handle>* s_pActiveHandles;
 
+// the number of active handles (read from other threads)
+boost::detail::atomic_count s_activeMonitorCount(0);
+
 void addEvent(FileChangeEvent::Type type,
               const FileInfo& fileInfo,
               std::vector<FileChangeEvent>* pEvents)
@@ -504,7 +508,10 @@ void checkForInput()
                                                  command.filter(),
                                                  command.callbacks());
          if (!handle.empty())
+         {
             s_pActiveHandles->push_back(handle);
+            ++s_activeMonitorCount;
+         }
          break;
       }
 
@@ -520,6 +527,7 @@ void checkForInput()
          {
             detail::unregisterMonitor(*it);
             s_pActiveHandles->erase(it);
+            --s_activeMonitorCount;
          }
          break;
       }
@@ -560,6 +568,8 @@ void fileMonitorThreadMain()
                     detail::unregisterMonitor);
 
       // clear the list
+      for (std::size_t i = 0; i < s_pActiveHandles->size(); i++)
+         --s_activeMonitorCount;
       s_pActiveHandles->clear();
 
       // allow the implementation a chance to stop completely (e.g. may
@@ -671,6 +681,11 @@ void unregisterMonitor(Handle handle)
    registrationCommandQueue().enque(RegistrationCommand(handle));
 }
 
+std::size_t activeMonitorCount()
+{
+   return static_cast<std::size_t>(static_cast<long>(s_activeMonitorCount));
+}
+
 void checkForChanges()
 {
    boost::function<void()> callback;
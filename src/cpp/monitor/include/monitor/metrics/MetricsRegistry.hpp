@@ -0,0 +1,110 @@
+/*
+ * MetricsRegistry.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef MONITOR_METRICS_METRICS_REGISTRY_HPP
+#define MONITOR_METRICS_METRICS_REGISTRY_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <monitor/metrics/Metric.hpp>
+
+// Counters and histograms are cheap enough to update from hot paths: each
+// thread accumulates into a shard of its own (whose mutex is contended only
+// while metrics are being collected) and the shards are summed by collect.
+// Gauges are sampled by collect. Names follow the Prometheus conventions
+// and labels are given in the Prometheus form, e.g. uri="rpc"
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+class Counter
+{
+public:
+   Counter();
+
+   bool isEmpty() const;
+
+   void increment() const { add(1.0); }
+   void add(double amount) const;
+
+private:
+   friend Counter counter(const std::string&, const std::string&);
+   explicit Counter(std::size_t slot) : slot_(slot) {}
+   std::size_t slot_;
+};
+
+class Histogram
+{
+public:
+   Histogram();
+
+   bool isEmpty() const;
+
+   void observe(double value) const;
+
+private:
+   friend Histogram histogram(const std::string&,
+                              const std::string&,
+                              const std::vector<double>&);
+   Histogram(std::size_t slot,
+             boost::shared_ptr<const std::vector<double> > pBounds)
+      : slot_(slot), pBounds_(pBounds)
+   {
+   }
+   std::size_t slot_;
+   boost::shared_ptr<const std::vector<double> > pBounds_;
+};
+
+// get the counter with the given name and labels (creating it if necessary)
+Counter counter(const std::string& name,
+                const std::string& labels = std::string());
+
+// get the histogram with the given name and labels (creating it with the
+// given bucket upper bounds if necessary)
+Histogram histogram(const std::string& name,
+                    const std::string& labels,
+                    const std::vector<double>& bounds);
+
+// escape a label value for use within the quotes of a label (backslash,
+// double quote, and newline are escaped as Prometheus requires)
+std::string escapeLabelValue(const std::string& value);
+
+// bucket upper bounds suited to latencies measured in milliseconds
+std::vector<double> latencyMsBuckets();
+
+// register a gauge (replacing any existing gauge with the same name and
+// labels). gauges are sampled on the thread which collects the metrics
+void registerGauge(const std::string& name,
+                   const std::string& labels,
+                   const boost::function<double()>& sampleFunction);
+
+// the current values of all metrics (one multi-metric per type of metric)
+std::vector<MultiMetric> collect(const std::string& scope,
+                                 int intervalSeconds);
+
+// metrics in the Prometheus text exposition format (metric names are
+// prefixed with rstudio_<scope>_)
+std::string prometheusText(const std::vector<MultiMetric>& metrics);
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
+
+#endif // MONITOR_METRICS_METRICS_REGISTRY_HPP
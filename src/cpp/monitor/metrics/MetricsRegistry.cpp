@@ -0,0 +1,473 @@
+/*
+ * MetricsRegistry.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <monitor/metrics/MetricsRegistry.hpp>
+
+#include <map>
+#include <set>
+#include <limits>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/utility.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+namespace {
+
+const std::size_t kNoSlot = std::numeric_limits<std::size_t>::max();
+
+typedef std::pair<std::string,std::string> NameAndLabels;
+
+// the values a thread has accumulated (indexed by slot)
+struct Shard : boost::noncopyable
+{
+   boost::mutex mutex;
+   std::vector<double> values;
+};
+
+struct Definition
+{
+   Definition() : slot(kNoSlot) {}
+
+   // first slot of the metric (histograms have a slot for each of their
+   // buckets followed by the overflow bucket and the sum of the values)
+   std::size_t slot;
+   boost::shared_ptr<const std::vector<double> > pBounds;
+};
+
+typedef std::map<NameAndLabels,Definition> Definitions;
+typedef std::map<NameAndLabels,boost::function<double()> > Gauges;
+
+struct Registry
+{
+   Registry() : nextSlot(0) {}
+
+   boost::mutex mutex;
+   Definitions counters;
+   Definitions histograms;
+   Gauges gauges;
+   std::size_t nextSlot;
+   std::vector<boost::shared_ptr<Shard> > shards;
+
+   // the values accumulated by threads which have exited
+   std::vector<double> exitedValues;
+};
+
+// (never freed since metrics may be updated while the process exits)
+Registry& registry()
+{
+   static Registry* pRegistry = new Registry();
+   return *pRegistry;
+}
+
+void addValues(const std::vector<double>& values, std::vector<double>* pTotals)
+{
+   if (pTotals->size() < values.size())
+      pTotals->resize(values.size(), 0.0);
+   for (std::size_t i = 0; i < values.size(); i++)
+      (*pTotals)[i] += values[i];
+}
+
+// owned by the thread (folds the thread's values into those of the exited
+// threads when the thread exits)
+struct ShardOwner
+{
+   explicit ShardOwner(boost::shared_ptr<Shard> pShard) : pShard(pShard) {}
+
+   ~ShardOwner()
+   {
+      try
+      {
+         Registry& metrics = registry();
+         boost::lock_guard<boost::mutex> registryLock(metrics.mutex);
+         boost::lock_guard<boost::mutex> shardLock(pShard->mutex);
+         addValues(pShard->values, &metrics.exitedValues);
+         metrics.shards.erase(std::remove(metrics.shards.begin(),
+                                          metrics.shards.end(),
+                                          pShard),
+                              metrics.shards.end());
+      }
+      catch(...)
+      {
+      }
+   }
+
+   boost::shared_ptr<Shard> pShard;
+};
+
+boost::thread_specific_ptr<ShardOwner> s_pShardOwner;
+
+Shard& threadShard()
+{
+   ShardOwner* pOwner = s_pShardOwner.get();
+   if (pOwner == NULL)
+   {
+      boost::shared_ptr<Shard> pShard(new Shard());
+      Registry& metrics = registry();
+      LOCK_MUTEX(metrics.mutex)
+      {
+         metrics.shards.push_back(pShard);
+      }
+      END_LOCK_MUTEX
+
+      pOwner = new ShardOwner(pShard);
+      s_pShardOwner.reset(pOwner);
+   }
+   return *pOwner->pShard;
+}
+
+void addToSlots(std::size_t slot, double amount,
+                std::size_t sumSlot = kNoSlot, double sum = 0.0)
+{
+   Shard& shard = threadShard();
+   LOCK_MUTEX(shard.mutex)
+   {
+      std::size_t lastSlot = sumSlot != kNoSlot ? sumSlot : slot;
+      if (shard.values.size() <= lastSlot)
+         shard.values.resize(lastSlot + 1, 0.0);
+      shard.values[slot] += amount;
+      if (sumSlot != kNoSlot)
+         shard.values[sumSlot] += sum;
+   }
+   END_LOCK_MUTEX
+}
+
+Definition& definition(Definitions* pDefinitions,
+                       const std::string& name,
+                       const std::string& labels,
+                       std::size_t slots,
+                       std::size_t* pNextSlot)
+{
+   Definition& def = (*pDefinitions)[std::make_pair(name, labels)];
+   if (def.slot == kNoSlot)
+   {
+      def.slot = *pNextSlot;
+      *pNextSlot += slots;
+   }
+   return def;
+}
+
+std::string labelledName(const std::string& name,
+                         const std::string& labels,
+                         const std::string& extraLabel = std::string())
+{
+   std::string allLabels = labels;
+   if (!extraLabel.empty())
+      allLabels += (allLabels.empty() ? "" : ",") + extraLabel;
+
+   if (allLabels.empty())
+      return name;
+   else
+      return name + "{" + allLabels + "}";
+}
+
+std::string formatValue(double value)
+{
+   std::ostringstream ostr;
+   ostr.precision(15);
+   ostr << value;
+   return ostr.str();
+}
+
+double slotValue(const std::vector<double>& values, std::size_t slot)
+{
+   return slot < values.size() ? values[slot] : 0.0;
+}
+
+// the name of the family a metric belongs to (i.e. without labels or the
+// suffixes given to the series of a histogram)
+std::string familyName(const std::string& name, const std::string& type)
+{
+   std::string family = name.substr(0, name.find('{'));
+   if (type == "histogram")
+   {
+      const char* suffixes[] = { "_bucket", "_sum", "_count" };
+      for (std::size_t i = 0; i < 3; i++)
+      {
+         if (boost::algorithm::ends_with(family, suffixes[i]))
+         {
+            family.erase(family.size() - std::strlen(suffixes[i]));
+            break;
+         }
+      }
+   }
+   return family;
+}
+
+} // anonymous namespace
+
+Counter::Counter()
+   : slot_(kNoSlot)
+{
+}
+
+bool Counter::isEmpty() const
+{
+   return slot_ == kNoSlot;
+}
+
+void Counter::add(double amount) const
+{
+   if (!isEmpty())
+      addToSlots(slot_, amount);
+}
+
+Histogram::Histogram()
+   : slot_(kNoSlot)
+{
+}
+
+bool Histogram::isEmpty() const
+{
+   return slot_ == kNoSlot;
+}
+
+void Histogram::observe(double value) const
+{
+   if (isEmpty())
+      return;
+
+   const std::vector<double>& bounds = *pBounds_;
+   std::size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), value) -
+                        bounds.begin();
+   addToSlots(slot_ + bucket, 1.0, slot_ + bounds.size() + 1, value);
+}
+
+Counter counter(const std::string& name, const std::string& labels)
+{
+   Registry& metrics = registry();
+   LOCK_MUTEX(metrics.mutex)
+   {
+      return Counter(definition(&metrics.counters,
+                                name,
+                                labels,
+                                1,
+                                &metrics.nextSlot).slot);
+   }
+   END_LOCK_MUTEX
+
+   return Counter();
+}
+
+Histogram histogram(const std::string& name,
+                    const std::string& labels,
+                    const std::vector<double>& bounds)
+{
+   std::vector<double> sortedBounds = bounds;
+   std::sort(sortedBounds.begin(), sortedBounds.end());
+
+   Registry& metrics = registry();
+   LOCK_MUTEX(metrics.mutex)
+   {
+      Definition& def = definition(&metrics.histograms,
+                                   name,
+                                   labels,
+                                   sortedBounds.size() + 2,
+                                   &metrics.nextSlot);
+      if (!def.pBounds)
+         def.pBounds.reset(new std::vector<double>(sortedBounds));
+      return Histogram(def.slot, def.pBounds);
+   }
+   END_LOCK_MUTEX
+
+   return Histogram();
+}
+
+std::string escapeLabelValue(const std::string& value)
+{
+   std::string escaped;
+   escaped.reserve(value.size());
+   for (std::string::const_iterator it = value.begin(); it != value.end(); ++it)
+   {
+      switch (*it)
+      {
+      case '\\':
+         escaped += "\\\\";
+         break;
+      case '"':
+         escaped += "\\\"";
+         break;
+      case '\n':
+         escaped += "\\n";
+         break;
+      default:
+         escaped += *it;
+      }
+   }
+   return escaped;
+}
+
+std::vector<double> latencyMsBuckets()
+{
+   const double bounds[] = { 1, 5, 10, 25, 50, 100, 250, 500,
+                             1000, 2500, 5000, 10000, 30000, 60000 };
+   return std::vector<double>(bounds,
+                              bounds + sizeof(bounds) / sizeof(double));
+}
+
+void registerGauge(const std::string& name,
+                   const std::string& labels,
+                   const boost::function<double()>& sampleFunction)
+{
+   Registry& metrics = registry();
+   LOCK_MUTEX(metrics.mutex)
+   {
+      metrics.gauges[std::make_pair(name, labels)] = sampleFunction;
+   }
+   END_LOCK_MUTEX
+}
+
+std::vector<MultiMetric> collect(const std::string& scope,
+                                 int intervalSeconds)
+{
+   // sum the values of all threads (taking copies of the definitions so
+   // that gauges are sampled without holding the registry's mutex)
+   std::vector<double> values;
+   Definitions counters, histograms;
+   Gauges gauges;
+   Registry& metrics = registry();
+   LOCK_MUTEX(metrics.mutex)
+   {
+      values = metrics.exitedValues;
+      for (std::size_t i = 0; i < metrics.shards.size(); i++)
+      {
+         Shard& shard = *metrics.shards[i];
+         LOCK_MUTEX(shard.mutex)
+         {
+            addValues(shard.values, &values);
+         }
+         END_LOCK_MUTEX
+      }
+
+      counters = metrics.counters;
+      histograms = metrics.histograms;
+      gauges = metrics.gauges;
+   }
+   END_LOCK_MUTEX
+
+   std::vector<MetricData> counterData;
+   for (Definitions::const_iterator it = counters.begin();
+        it != counters.end();
+        ++it)
+   {
+      counterData.push_back(MetricData(
+                     labelledName(it->first.first, it->first.second),
+                     slotValue(values, it->second.slot)));
+   }
+
+   std::vector<MetricData> gaugeData;
+   for (Gauges::const_iterator it = gauges.begin(); it != gauges.end(); ++it)
+   {
+      double value = 0;
+      try
+      {
+         value = it->second();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      gaugeData.push_back(MetricData(
+                     labelledName(it->first.first, it->first.second),
+                     value));
+   }
+
+   // histograms are reported as cumulative bucket counts followed by the
+   // sum and count of the values observed
+   std::vector<MetricData> histogramData;
+   for (Definitions::const_iterator it = histograms.begin();
+        it != histograms.end();
+        ++it)
+   {
+      const std::string& name = it->first.first;
+      const std::string& labels = it->first.second;
+      const std::vector<double>& bounds = *it->second.pBounds;
+      std::size_t slot = it->second.slot;
+
+      double count = 0;
+      for (std::size_t i = 0; i <= bounds.size(); i++)
+      {
+         count += slotValue(values, slot + i);
+         std::string bound = i < bounds.size() ? formatValue(bounds[i]) :
+                                                 std::string("+Inf");
+         histogramData.push_back(MetricData(
+                     labelledName(name + "_bucket",
+                                  labels,
+                                  "le=\"" + bound + "\""),
+                     count));
+      }
+      histogramData.push_back(MetricData(
+                     labelledName(name + "_sum", labels),
+                     slotValue(values, slot + bounds.size() + 1)));
+      histogramData.push_back(MetricData(
+                     labelledName(name + "_count", labels),
+                     count));
+   }
+
+   std::vector<MultiMetric> multiMetrics;
+   if (!counterData.empty())
+   {
+      multiMetrics.push_back(
+               MultiMetric(scope, intervalSeconds, counterData, "counter"));
+   }
+   if (!gaugeData.empty())
+   {
+      multiMetrics.push_back(
+               MultiMetric(scope, intervalSeconds, gaugeData, "gauge"));
+   }
+   if (!histogramData.empty())
+   {
+      multiMetrics.push_back(
+               MultiMetric(scope, intervalSeconds, histogramData, "histogram"));
+   }
+   return multiMetrics;
+}
+
+std::string prometheusText(const std::vector<MultiMetric>& metrics)
+{
+   std::ostringstream ostr;
+   std::set<std::string> typedFamilies;
+   for (std::size_t i = 0; i < metrics.size(); i++)
+   {
+      const MultiMetric& metric = metrics[i];
+      std::string prefix = "rstudio_" + metric.scope() + "_";
+      const std::vector<MetricData>& data = metric.data();
+      for (std::size_t j = 0; j < data.size(); j++)
+      {
+         // the type of each family precedes its first series
+         std::string family = prefix + familyName(data[j].name, metric.type());
+         if (typedFamilies.insert(family).second)
+            ostr << "# TYPE " << family << " " << metric.type() << "\n";
+
+         ostr << prefix << data[j].name << " "
+              << formatValue(data[j].value) << "\n";
+      }
+   }
+   return ostr.str();
+}
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
@@ -0,0 +1,206 @@
+/*
+ * MetricsRegistryTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <monitor/metrics/MetricsRegistry.hpp>
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+namespace {
+
+// the collected value of the named series (-1 if there is no such series)
+double collectedValue(const std::string& name)
+{
+   std::vector<MultiMetric> metrics = collect("test", 60);
+   for (std::size_t i = 0; i < metrics.size(); i++)
+   {
+      const std::vector<MetricData>& data = metrics[i].data();
+      for (std::size_t j = 0; j < data.size(); j++)
+      {
+         if (data[j].name == name)
+            return data[j].value;
+      }
+   }
+   return -1;
+}
+
+void addToCounter(const std::string& name, int times)
+{
+   Counter count = counter(name);
+   for (int i = 0; i < times; i++)
+      count.increment();
+}
+
+// a thread which adds to a counter and then waits to be released (so that
+// its shard is still live when metrics are collected)
+struct LiveThread
+{
+   LiveThread() : added(false), released(false) {}
+
+   void run(const std::string& name, int times)
+   {
+      addToCounter(name, times);
+      boost::unique_lock<boost::mutex> lock(mutex);
+      added = true;
+      addedCondition.notify_all();
+      while (!released)
+         releasedCondition.wait(lock);
+   }
+
+   void waitForAdded()
+   {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      while (!added)
+         addedCondition.wait(lock);
+   }
+
+   void release()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      released = true;
+      releasedCondition.notify_all();
+   }
+
+   boost::mutex mutex;
+   boost::condition_variable addedCondition;
+   boost::condition_variable releasedCondition;
+   bool added;
+   bool released;
+};
+
+std::size_t countOccurrences(const std::string& text,
+                             const std::string& substring)
+{
+   std::size_t count = 0;
+   for (std::size_t pos = text.find(substring);
+        pos != std::string::npos;
+        pos = text.find(substring, pos + substring.size()))
+   {
+      count++;
+   }
+   return count;
+}
+
+} // anonymous namespace
+
+context("MetricsRegistry")
+{
+   test_that("counters sum the values of live and exited threads")
+   {
+      counter("shard_test_total").add(2);
+
+      // threads which have exited fold their values into the registry
+      boost::thread_group exited;
+      for (int i = 0; i < 4; i++)
+      {
+         exited.create_thread(
+                  boost::bind(addToCounter, "shard_test_total", 100));
+      }
+      exited.join_all();
+
+      LiveThread live;
+      boost::thread liveThread(boost::bind(&LiveThread::run,
+                                           &live,
+                                           "shard_test_total",
+                                           10));
+      live.waitForAdded();
+      expect_true(collectedValue("shard_test_total") == 412);
+
+      live.release();
+      liveThread.join();
+      expect_true(collectedValue("shard_test_total") == 412);
+
+      // (and counters with the same name and labels share their value)
+      counter("shard_test_total").increment();
+      expect_true(collectedValue("shard_test_total") == 413);
+   }
+
+   test_that("counters are distinguished by their labels")
+   {
+      counter("labelled_test_total", "uri=\"a\"").add(3);
+      counter("labelled_test_total", "uri=\"b\"").add(5);
+      expect_true(collectedValue("labelled_test_total{uri=\"a\"}") == 3);
+      expect_true(collectedValue("labelled_test_total{uri=\"b\"}") == 5);
+   }
+
+   test_that("histogram buckets are cumulative and include their bound")
+   {
+      std::vector<double> bounds;
+      bounds.push_back(10);
+      bounds.push_back(1);
+      Histogram latency = histogram("bucket_test_ms", "uri=\"x\"", bounds);
+      latency.observe(0.5);
+      latency.observe(1);     // (le is inclusive, so this is in the 1 bucket)
+      latency.observe(5);
+      latency.observe(10);
+      latency.observe(11);
+
+      // (bounds are sorted)
+      expect_true(collectedValue(
+                     "bucket_test_ms_bucket{uri=\"x\",le=\"1\"}") == 2);
+      expect_true(collectedValue(
+                     "bucket_test_ms_bucket{uri=\"x\",le=\"10\"}") == 4);
+      expect_true(collectedValue(
+                     "bucket_test_ms_bucket{uri=\"x\",le=\"+Inf\"}") == 5);
+      expect_true(collectedValue("bucket_test_ms_count{uri=\"x\"}") == 5);
+      expect_true(collectedValue("bucket_test_ms_sum{uri=\"x\"}") == 27.5);
+   }
+
+   test_that("each family is preceded by a single type line")
+   {
+      counter("family_test_total", "uri=\"a\"").increment();
+      counter("family_test_total", "uri=\"b\"").increment();
+      histogram("family_test_ms", "uri=\"a\"", latencyMsBuckets()).observe(1);
+      histogram("family_test_ms", "uri=\"b\"", latencyMsBuckets()).observe(2);
+
+      std::string text = prometheusText(collect("test", 60));
+      expect_true(countOccurrences(
+            text, "# TYPE rstudio_test_family_test_total counter\n") == 1);
+      expect_true(countOccurrences(
+            text, "# TYPE rstudio_test_family_test_ms histogram\n") == 1);
+      expect_true(countOccurrences(text, "# TYPE rstudio_test_family_test_ms_")
+                  == 0);
+
+      // the type line comes before the family's first series
+      std::size_t typePos =
+                  text.find("# TYPE rstudio_test_family_test_ms histogram");
+      std::size_t seriesPos = text.find("rstudio_test_family_test_ms_");
+      expect_true(typePos < seriesPos);
+      expect_true(text.find(
+            "rstudio_test_family_test_ms_bucket{uri=\"b\",le=\"+Inf\"} 1\n")
+                  != std::string::npos);
+   }
+
+   test_that("label values are escaped")
+   {
+      expect_true(escapeLabelValue("plain") == "plain");
+      expect_true(escapeLabelValue("a\\b") == "a\\\\b");
+      expect_true(escapeLabelValue("say \"hi\"") == "say \\\"hi\\\"");
+      expect_true(escapeLabelValue("two\nlines") == "two\\nlines");
+   }
+}
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
@@ -16,6 +16,11 @@
 #ifndef R_SESSION_CONSOLE_ACTIONS_HPP
 #define R_SESSION_CONSOLE_ACTIONS_HPP
 
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
 #include <boost/utility.hpp>
 #include <boost/circular_buffer.hpp>
 
@@ -42,6 +47,12 @@ ConsoleActions& consoleActions();
 #define kConsoleActionOutput        2
 #define kConsoleActionOutputError   3
 
+// Console actions are kept in a fixed size byte arena (a ring buffer which
+// holds the data of each action contiguously) along with a ring of the
+// actions themselves. Appending to the console (including combining output
+// with the previous output action) copies only the new data, and the
+// oldest actions are dropped as needed to stay within both the action and
+// byte capacities.
 class ConsoleActions : boost::noncopyable
 {
 private:
@@ -49,9 +60,14 @@ private:
    friend ConsoleActions& consoleActions();
    
 public:
+   // maximum number of actions
    int capacity() const ;
    void setCapacity(int capacity);
 
+   // maximum number of bytes of action data
+   std::size_t byteCapacity() const;
+   void setByteCapacity(std::size_t byteCapacity);
+
    void add(int type, const std::string& data);
    void notifyInterrupt();
    
@@ -67,13 +83,38 @@ public:
    core::Error loadFromFile(const core::FilePath& filePath);
    core::Error saveToFile(const core::FilePath& filePath) const;
 
+private:
+   struct Action
+   {
+      Action() : type(0), offset(0), length(0) {}
+      Action(int type, uint64_t offset)
+         : type(type), offset(offset), length(0)
+      {
+      }
+
+      int type;
+
+      // position of the action's data within the stream of data written
+      // to the arena (the arena holds the last byteCapacity bytes of it)
+      uint64_t offset;
+      std::size_t length;
+   };
+
+   void append(int type, const char* data, std::size_t length, bool combine);
+   std::string actionData(const Action& action) const;
+   bool isDefaultPrompt(const std::string& prompt);
+
 private:
    // protect data using a mutex because background threads (e.g.
    // console output capture threads) can interact with console actions
    mutable boost::mutex mutex_;
-   boost::circular_buffer<core::json::Value> actionsType_;
-   boost::circular_buffer<core::json::Value> actionsData_;
+   boost::circular_buffer<Action> actions_;
+   std::vector<char> arena_;
+   uint64_t end_;
    std::vector<std::string> pendingInput_;
+
+   // the default prompt (as of the last time we read the prompt option)
+   std::string defaultPrompt_;
 };
 
    
@@ -59,7 +59,9 @@ struct ROptions
          autoReloadSource(false),
          restoreWorkspace(true),
          saveWorkspace(SA_SAVEASK),
-         rProfileOnResume(false)
+         rProfileOnResume(false),
+         snapshotThreads(0),
+         lazyRestoreSize(0)
    {
    }
    core::FilePath userHomePath;
@@ -82,6 +84,8 @@ struct ROptions
    bool restoreWorkspace;
    SA_TYPE saveWorkspace;
    bool rProfileOnResume;
+   int snapshotThreads;
+   int lazyRestoreSize;
 };
       
 struct RInitInfo
@@ -36,6 +36,11 @@ namespace session {
 namespace {   
 const char * const kActionType = "type";
 const char * const kActionData = "data";
+
+// output actions are combined with the previous output action until it
+// holds this many bytes (so that actions are removed from the arena in
+// reasonably fine grained pieces)
+const std::size_t kMaxCombinedOutput = 512;
 }
    
 ConsoleActions& consoleActions()
@@ -45,15 +50,17 @@ ConsoleActions& consoleActions()
 }
    
 ConsoleActions::ConsoleActions()
+   : end_(0)
 {
    setCapacity(1000);
+   setByteCapacity(1024 * 1024);
 }
    
 int ConsoleActions::capacity() const
 {
    LOCK_MUTEX(mutex_)
    {
-      return actionsType_.capacity();
+      return actions_.capacity();
    }
    END_LOCK_MUTEX
 
@@ -65,19 +72,62 @@ void ConsoleActions::setCapacity(int capacity)
 {
    LOCK_MUTEX(mutex_)
    {
-      actionsType_.set_capacity(capacity);
-      actionsData_.set_capacity(capacity);
+      // keep the most recent actions
+      actions_.rset_capacity(capacity);
+   }
+   END_LOCK_MUTEX
+}
+
+std::size_t ConsoleActions::byteCapacity() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return arena_.size();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
+void ConsoleActions::setByteCapacity(std::size_t byteCapacity)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      // copy out the existing actions then add them back to the new arena
+      // (dropping the oldest of them if they no longer fit)
+      std::vector<std::pair<int,std::string> > actions;
+      actions.reserve(actions_.size());
+      for (boost::circular_buffer<Action>::const_iterator it =
+            actions_.begin(); it != actions_.end(); ++it)
+      {
+         actions.push_back(std::make_pair(it->type, actionData(*it)));
+      }
+
+      actions_.clear();
+      arena_.assign(byteCapacity, '\0');
+      end_ = 0;
+      for (std::size_t i = 0; i < actions.size(); i++)
+      {
+         append(actions[i].first,
+                actions[i].second.data(),
+                actions[i].second.size(),
+                false);
+      }
    }
    END_LOCK_MUTEX
 }
    
 void ConsoleActions::add(int type, const std::string& data)
 {
+   // check for the default prompt before acquiring the lock (prompts are
+   // only added on the main thread)
+   bool defaultPrompt = type == kConsoleActionPrompt && isDefaultPrompt(data);
+
    LOCK_MUTEX(mutex_)
    {
       // manage pending input buffer
-      if (type == kConsoleActionPrompt &&
-          data == r::options::getOption<std::string>("prompt"))
+      if (defaultPrompt)
       {
          pendingInput_.clear();
       }
@@ -90,24 +140,8 @@ void ConsoleActions::add(int type, const std::string& data)
          pendingInput_.insert(pendingInput_.end(), input.begin(), input.end());
       }
 
-
-      // automatically combine consecutive output actions (up to 512 bytes)
-      // we enforce a limit so that the limit defined for our circular buffer
-      // (see setCapacity above) implies a content size limit as well (if we
-      // didn't cap the size of combined output then the output actions could
-      // grow to arbitrary size)
-      if (type == kConsoleActionOutput &&
-          actionsType_.size() > 0      &&
-          actionsType_.back().get_value<int>() == kConsoleActionOutput &&
-          actionsData_.back().get_str().size() < 512)
-      {
-         actionsData_.back() = actionsData_.back().get_str() + data;
-      }
-      else
-      {
-         actionsType_.push_back(type);
-         actionsData_.push_back(data);
-      }
+      // automatically combine consecutive output actions
+      append(type, data.data(), data.size(), type == kConsoleActionOutput);
    }
    END_LOCK_MUTEX
 }
@@ -126,8 +160,7 @@ void ConsoleActions::reset()
    LOCK_MUTEX(mutex_)
    {
       // clear the existing actions
-      actionsType_.clear();
-      actionsData_.clear();
+      actions_.clear();
    }
    END_LOCK_MUTEX
 }
@@ -139,19 +172,21 @@ void ConsoleActions::asJson(json::Object* pActions) const
       // clear inbound
       pActions->clear();
 
-      // copy actions and insert into destination
-      json::Array actionsType;
-      std::copy(actionsType_.begin(),
-                actionsType_.end(),
-                std::back_inserter(actionsType));
-      pActions->operator[](kActionType) = actionsType;
-
-      // copy data and insert into destination
-      json::Array actionsData;
-      std::copy(actionsData_.begin(),
-                actionsData_.end(),
-                std::back_inserter(actionsData));
-      pActions->operator[](kActionData) = actionsData;
+      // write the actions directly into the destination arrays
+      pActions->operator[](kActionType) = json::Array();
+      json::Array& actionsType = pActions->operator[](kActionType).get_array();
+      actionsType.reserve(actions_.size());
+
+      pActions->operator[](kActionData) = json::Array();
+      json::Array& actionsData = pActions->operator[](kActionData).get_array();
+      actionsData.reserve(actions_.size());
+
+      for (boost::circular_buffer<Action>::const_iterator it =
+            actions_.begin(); it != actions_.end(); ++it)
+      {
+         actionsType.push_back(it->type);
+         actionsData.push_back(actionData(*it));
+      }
    }
    END_LOCK_MUTEX
 }
@@ -160,8 +195,7 @@ Error ConsoleActions::loadFromFile(const FilePath& filePath)
 {
    LOCK_MUTEX(mutex_)
    {
-      actionsType_.clear();
-      actionsData_.clear();
+      actions_.clear();
 
       if (filePath.exists())
       {
@@ -179,25 +213,28 @@ Error ConsoleActions::loadFromFile(const FilePath& filePath)
             json::Object& actions = value.get_obj();
 
             const json::Value& typeValue = actions[kActionType] ;
-            if (typeValue.type() == json::ArrayType)
+            const json::Value& dataValue = actions[kActionData] ;
+            if (typeValue.type() == json::ArrayType &&
+                dataValue.type() == json::ArrayType)
             {
                const json::Array& actionsType = typeValue.get_array();
-               std::copy(actionsType.begin(),
-                         actionsType.end(),
-                         std::back_inserter(actionsType_));
-            }
-            else
-            {
-               LOG_WARNING_MESSAGE("unexpected json type in: " + actionsJson);
-            }
-
-            json::Value& dataValue = actions[kActionData] ;
-            if ( dataValue.type() == json::ArrayType )
-            {
                const json::Array& actionsData = dataValue.get_array();
-               std::copy(actionsData.begin(),
-                         actionsData.end(),
-                         std::back_inserter(actionsData_));
+               std::size_t count = std::min(actionsType.size(),
+                                            actionsData.size());
+               for (std::size_t i = 0; i < count; i++)
+               {
+                  if (actionsType[i].type() != json::IntegerType ||
+                      actionsData[i].type() != json::StringType)
+                  {
+                     continue;
+                  }
+
+                  const std::string& data = actionsData[i].get_str();
+                  append(actionsType[i].get_int(),
+                         data.data(),
+                         data.size(),
+                         false);
+               }
             }
             else
             {
@@ -226,6 +263,88 @@ Error ConsoleActions::saveToFile(const core::FilePath& filePath) const
    // write to file
    return writeStringToFile(filePath, ostr.str());
 }
+
+void ConsoleActions::append(int type,
+                            const char* data,
+                            std::size_t length,
+                            bool combine)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   if (arena_.empty() || actions_.capacity() == 0)
+      return;
+
+   // only the end of data which is larger than the arena can be kept
+   if (length > arena_.size())
+   {
+      data += length - arena_.size();
+      length = arena_.size();
+   }
+
+   // add a new action unless we're combining with the previous one
+   if (!combine ||
+       actions_.empty() ||
+       actions_.back().type != type ||
+       actions_.back().length >= kMaxCombinedOutput)
+   {
+      actions_.push_back(Action(type, end_));
+   }
+
+   // make room for the data by removing the oldest actions (or if only one
+   // action remains, the oldest part of its data)
+   while (end_ + length - actions_.front().offset > arena_.size())
+   {
+      if (actions_.size() > 1)
+      {
+         actions_.pop_front();
+      }
+      else
+      {
+         Action& action = actions_.front();
+         std::size_t excess = static_cast<std::size_t>(
+                     end_ + length - action.offset - arena_.size());
+         action.offset += excess;
+         action.length -= excess;
+      }
+   }
+
+   // copy the data into the arena (wrapping around its end if necessary)
+   std::size_t pos = static_cast<std::size_t>(end_ % arena_.size());
+   std::size_t firstLength = std::min(length, arena_.size() - pos);
+   std::copy(data, data + firstLength, arena_.begin() + pos);
+   std::copy(data + firstLength, data + length, arena_.begin());
+
+   end_ += length;
+   actions_.back().length += length;
+}
+
+std::string ConsoleActions::actionData(const Action& action) const
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   if (action.length == 0)
+      return std::string();
+
+   std::size_t pos = static_cast<std::size_t>(action.offset % arena_.size());
+   std::size_t firstLength = std::min(action.length, arena_.size() - pos);
+
+   std::string data;
+   data.reserve(action.length);
+   data.append(&arena_[pos], firstLength);
+   data.append(&arena_[0], action.length - firstLength);
+   return data;
+}
+
+bool ConsoleActions::isDefaultPrompt(const std::string& prompt)
+{
+   // the prompt option rarely changes so we only read it again when we see
+   // a prompt other than the last default prompt we read
+   if (!defaultPrompt_.empty() && prompt == defaultPrompt_)
+      return true;
+
+   defaultPrompt_ = r::options::getOption<std::string>("prompt");
+   return prompt == defaultPrompt_;
+}
    
 } // namespace session
 } // namespace r
@@ -0,0 +1,605 @@
+/*
+ * REnvironmentSnapshot.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "REnvironmentSnapshot.hpp"
+
+#include <set>
+#include <vector>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/BlockCompressedStream.hpp>
+
+#define R_INTERNAL_FUNCTIONS
+#include <r/RInternal.hpp>
+#include <r/RSexp.hpp>
+#include <r/RExec.hpp>
+#include <r/RRoutines.hpp>
+#include <r/RErrorCategory.hpp>
+
+using namespace rstudio::core ;
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace snapshot {
+
+namespace {
+
+const char * const kFingerprintsFile = "snapshot_fingerprints";
+
+// objects saved apart from a snapshot are kept in a directory alongside it
+const char * const kObjectsDirSuffix = "_objects";
+
+// call method which reads objects restored lazily
+const char * const kReadObjectMethod = "rs_readSnapshotObject";
+
+// most threads we use to decompress snapshots
+const int kMaxRestoreThreads = 8;
+
+// sink for R serialization which fingerprints the serialized data and
+// (optionally) writes it to a snapshot
+struct OutputStreamData
+{
+   explicit OutputStreamData(BlockCompressedWriter* pWriter = NULL)
+      : pWriter(pWriter),
+        crc(::crc32(0L, Z_NULL, 0)),
+        adler(::adler32(0L, Z_NULL, 0)),
+        length(0)
+   {
+   }
+
+   std::string fingerprint() const
+   {
+      boost::format fmt("%1$08x%2$08x-%3%");
+      return boost::str(fmt % crc % adler % length);
+   }
+
+   BlockCompressedWriter* pWriter;
+   uLong crc;
+   uLong adler;
+   uintmax_t length;
+   Error error;
+};
+
+void outBytes(R_outpstream_t stream, void* buffer, int length)
+{
+   OutputStreamData* pData = static_cast<OutputStreamData*>(stream->data);
+
+   const Bytef* bytes = static_cast<const Bytef*>(buffer);
+   pData->crc = ::crc32(pData->crc, bytes, length);
+   pData->adler = ::adler32(pData->adler, bytes, length);
+   pData->length += length;
+
+   if (pData->pWriter && !pData->error)
+   {
+      pData->error = pData->pWriter->write(static_cast<const char*>(buffer),
+                                           length);
+   }
+}
+
+void outChar(R_outpstream_t stream, int c)
+{
+   char ch = static_cast<char>(c);
+   outBytes(stream, &ch, 1);
+}
+
+void serializeBindings(SEXP bindingsSEXP, OutputStreamData* pData)
+{
+   struct R_outpstream_st stream;
+   R_InitOutPStream(&stream,
+                    static_cast<R_pstream_data_t>(pData),
+                    R_pstream_binary_format,
+                    2,
+                    outChar,
+                    outBytes,
+                    NULL,
+                    R_NilValue);
+   R_Serialize(bindingsSEXP, &stream);
+}
+
+Error serialize(SEXP bindingsSEXP, OutputStreamData* pData)
+{
+   Error error = r::exec::executeSafely(
+                        boost::bind(serializeBindings, bindingsSEXP, pData));
+
+   // prefer the more specific error from the writer
+   if (pData->error)
+      return pData->error;
+   else
+      return error;
+}
+
+// source for R unserialization which reads from a snapshot
+struct InputStreamData
+{
+   explicit InputStreamData(BlockCompressedReader* pReader)
+      : pReader(pReader)
+   {
+   }
+
+   BlockCompressedReader* pReader;
+   Error error;
+};
+
+bool readBytes(InputStreamData* pData, void* buffer, int length)
+{
+   if (pData->error)
+      return false;
+
+   std::size_t bytesRead = 0;
+   pData->error = pData->pReader->read(static_cast<char*>(buffer),
+                                       length,
+                                       &bytesRead);
+   if (!pData->error && bytesRead < static_cast<std::size_t>(length))
+   {
+      pData->error = systemError(boost::system::errc::illegal_byte_sequence,
+                                 "Unexpected end of session snapshot",
+                                 ERROR_LOCATION);
+   }
+
+   return !pData->error;
+}
+
+void inBytes(R_inpstream_t stream, void* buffer, int length)
+{
+   // NOTE: no objects with destructors may be in scope when we call
+   // Rf_error (it longjmps back to executeSafely)
+   if (!readBytes(static_cast<InputStreamData*>(stream->data), buffer, length))
+      Rf_error("Error reading session snapshot");
+}
+
+int inChar(R_inpstream_t stream)
+{
+   unsigned char ch = 0;
+   inBytes(stream, &ch, 1);
+   return ch;
+}
+
+SEXP unserializeBindings(InputStreamData* pData)
+{
+   struct R_inpstream_st stream;
+   R_InitInPStream(&stream,
+                   static_cast<R_pstream_data_t>(pData),
+                   R_pstream_any_format,
+                   inChar,
+                   inBytes,
+                   NULL,
+                   R_NilValue);
+   return R_Unserialize(&stream);
+}
+
+FilePath objectsPath(const FilePath& filePath)
+{
+   return filePath.parent().complete(filePath.filename() + kObjectsDirSuffix);
+}
+
+Error saveObject(SEXP objectSEXP,
+                 const FilePath& filePath,
+                 const Options& options,
+                 Fingerprints* pFingerprints,
+                 bool* pUnchanged)
+{
+   *pUnchanged = false;
+
+   // if we have a fingerprint for the existing snapshot then check whether
+   // the snapshot would change (fingerprinting is much cheaper than
+   // compressing and writing a snapshot)
+   std::string previousFingerprint = pFingerprints->get(filePath);
+   if (!previousFingerprint.empty() && filePath.exists())
+   {
+      OutputStreamData data;
+      Error error = serialize(objectSEXP, &data);
+      if (error)
+         return error;
+
+      if (data.fingerprint() == previousFingerprint)
+      {
+         *pUnchanged = true;
+         return Success();
+      }
+   }
+
+   // write the snapshot alongside the file and then move it into place
+   pFingerprints->erase(filePath);
+   FilePath partialPath = filePath.parent().complete(filePath.filename() +
+                                                     ".partial");
+   BlockCompressedWriter writer(options.threads, options.compressionLevel);
+   OutputStreamData data(&writer);
+   Error error = writer.open(partialPath);
+   if (!error)
+      error = serialize(objectSEXP, &data);
+   if (!error)
+      error = writer.close();
+   if (!error)
+      error = partialPath.move(filePath);
+   if (error)
+   {
+      Error removeError = partialPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   pFingerprints->set(filePath, data.fingerprint());
+   return Success();
+}
+
+Error readObject(const FilePath& filePath,
+                 SEXP* pObjectSEXP,
+                 sexp::Protect* pProtect)
+{
+   int threads = std::min<int>(
+            std::max<int>(boost::thread::hardware_concurrency(), 1),
+            kMaxRestoreThreads);
+   BlockCompressedReader reader(threads);
+   Error error = reader.open(filePath);
+   if (error)
+      return error;
+
+   InputStreamData data(&reader);
+   SEXP objectSEXP = R_NilValue;
+   error = r::exec::executeSafely<SEXP>(
+                        boost::bind(unserializeBindings, &data),
+                        &objectSEXP);
+   if (data.error)
+      return data.error;
+   else if (error)
+      return error;
+
+   pProtect->add(objectSEXP);
+   *pObjectSEXP = objectSEXP;
+   return Success();
+}
+
+// if the value is a promise bound by restore which hasn't yet been forced
+// then get the path of the file it would read the object from
+bool lazyObjectPath(SEXP valueSEXP, std::string* pPath)
+{
+   if (TYPEOF(valueSEXP) != PROMSXP || PRVALUE(valueSEXP) != R_UnboundValue)
+      return false;
+
+   // the promise's code is .Call("rs_readSnapshotObject", path)
+   SEXP codeSEXP = PRCODE(valueSEXP);
+   if (TYPEOF(codeSEXP) != LANGSXP ||
+       Rf_length(codeSEXP) != 3 ||
+       CAR(codeSEXP) != Rf_install(".Call"))
+   {
+      return false;
+   }
+
+   SEXP methodSEXP = CADR(codeSEXP);
+   SEXP pathSEXP = CADDR(codeSEXP);
+   if (TYPEOF(methodSEXP) != STRSXP ||
+       r::sexp::asString(methodSEXP) != kReadObjectMethod ||
+       TYPEOF(pathSEXP) != STRSXP)
+   {
+      return false;
+   }
+
+   *pPath = r::sexp::asString(pathSEXP);
+   return true;
+}
+
+// name for the file of an object (these are derived from the object's name
+// so that an object is saved to the same file, and its fingerprint can be
+// checked, each time the environment is saved)
+std::string objectFilename(const std::string& name,
+                           std::set<std::string>* pUsedFilenames)
+{
+   uLong crc = ::crc32(0L, Z_NULL, 0);
+   crc = ::crc32(crc,
+                 reinterpret_cast<const Bytef*>(name.data()),
+                 name.size());
+   std::string base = boost::str(boost::format("%1$08x") % crc);
+
+   std::string filename = base;
+   for (int i = 1; pUsedFilenames->count(filename) > 0; i++)
+      filename = base + "-" + boost::lexical_cast<std::string>(i);
+
+   pUsedFilenames->insert(filename);
+   return filename;
+}
+
+// save the large objects of the environment to files of their own and get
+// an index of the snapshot (the remaining bindings along with the files of
+// the objects saved apart from them)
+Error saveObjects(SEXP envSEXP,
+                  const FilePath& filePath,
+                  const Options& options,
+                  Fingerprints* pFingerprints,
+                  SEXP* pIndexSEXP,
+                  sexp::Protect* pProtect)
+{
+   FilePath objectsDir = objectsPath(filePath);
+   Error error = objectsDir.ensureDirectory();
+   if (error)
+      return error;
+
+   std::vector<std::string> names;
+   r::exec::RFunction ls("ls");
+   ls.addParam("envir", envSEXP);
+   ls.addParam("all.names", true);
+   error = ls.call(&names);
+   if (error)
+      return error;
+
+   // objects which haven't been used since they were restored are still
+   // promises which would read them from their files. rather than force
+   // them (reading the objects only to write them out again) we keep the
+   // files they'd read
+   std::vector<std::string> objectNames, objectFilenames;
+   std::set<std::string> usedFilenames;
+   BOOST_FOREACH(const std::string& name, names)
+   {
+      SEXP valueSEXP = Rf_findVarInFrame(envSEXP, Rf_install(name.c_str()));
+      std::string path;
+      if (!lazyObjectPath(valueSEXP, &path))
+         continue;
+
+      FilePath objectPath(path);
+      if (objectPath.isWithin(objectsDir) && objectPath.exists())
+      {
+         objectNames.push_back(name);
+         objectFilenames.push_back(objectPath.filename());
+         usedFilenames.insert(objectPath.filename());
+      }
+   }
+
+   // get the remaining bindings (with the large objects apart from them)
+   SEXP bindingsSEXP = R_NilValue;
+   error = r::exec::RFunction(".rs.environmentSnapshotBindings",
+                              envSEXP,
+                              objectNames,
+                              static_cast<double>(options.lazyObjectSize))
+                                          .call(&bindingsSEXP, pProtect);
+   if (error)
+      return error;
+
+   SEXP objectsSEXP = R_NilValue;
+   error = r::sexp::getNamedListSEXP(bindingsSEXP, "objects", &objectsSEXP);
+   if (error)
+      return error;
+
+   std::vector<std::string> largeObjectNames;
+   error = r::sexp::getNames(objectsSEXP, &largeObjectNames);
+   if (error)
+      return error;
+
+   for (std::size_t i = 0; i < largeObjectNames.size(); i++)
+   {
+      std::string filename = objectFilename(largeObjectNames[i],
+                                            &usedFilenames);
+      bool unchanged = false;
+      error = saveObject(VECTOR_ELT(objectsSEXP, i),
+                         objectsDir.complete(filename),
+                         options,
+                         pFingerprints,
+                         &unchanged);
+      if (error)
+         return error;
+
+      objectNames.push_back(largeObjectNames[i]);
+      objectFilenames.push_back(filename);
+   }
+
+   // remove the files of objects which are no longer in the environment
+   std::vector<FilePath> objectFiles;
+   error = objectsDir.children(&objectFiles);
+   if (error)
+      return error;
+   BOOST_FOREACH(const FilePath& objectFile, objectFiles)
+   {
+      if (usedFilenames.count(objectFile.filename()) == 0)
+      {
+         pFingerprints->erase(objectFile);
+         error = objectFile.remove();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   SEXP smallBindingsSEXP = R_NilValue;
+   error = r::sexp::getNamedListSEXP(bindingsSEXP,
+                                     "bindings",
+                                     &smallBindingsSEXP);
+   if (error)
+      return error;
+
+   return r::exec::RFunction(".rs.environmentSnapshotIndex",
+                             smallBindingsSEXP,
+                             objectNames,
+                             objectFilenames).call(pIndexSEXP, pProtect);
+}
+
+SEXP rs_readSnapshotObject(SEXP pathSEXP)
+{
+   try
+   {
+      FilePath objectPath(r::sexp::asString(pathSEXP));
+
+      sexp::Protect rProtect;
+      SEXP objectSEXP = R_NilValue;
+      Error error = readObject(objectPath, &objectSEXP, &rProtect);
+      if (error)
+      {
+         LOG_ERROR(error);
+         throw r::exec::RErrorException(
+                  "Unable to restore object from " +
+                  objectPath.absolutePath() + ": " + error.summary());
+      }
+
+      return objectSEXP;
+   }
+   catch(r::exec::RErrorException& e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   // keep compiler happy
+   return R_NilValue;
+}
+
+} // anonymous namespace
+
+Fingerprints::Fingerprints(const FilePath& directory)
+   : directory_(directory)
+{
+}
+
+Error Fingerprints::read()
+{
+   fingerprints_.clear();
+
+   FilePath fingerprintsPath = directory_.complete(kFingerprintsFile);
+   if (!fingerprintsPath.exists())
+      return Success();
+
+   return readStringMapFromFile(fingerprintsPath, &fingerprints_);
+}
+
+Error Fingerprints::write() const
+{
+   return writeStringMapToFile(directory_.complete(kFingerprintsFile),
+                               fingerprints_);
+}
+
+Error Fingerprints::remove() const
+{
+   return directory_.complete(kFingerprintsFile).removeIfExists();
+}
+
+std::string Fingerprints::get(const FilePath& filePath) const
+{
+   std::map<std::string,std::string>::const_iterator it =
+                        fingerprints_.find(filePath.relativePath(directory_));
+   if (it != fingerprints_.end())
+      return it->second;
+   else
+      return std::string();
+}
+
+void Fingerprints::set(const FilePath& filePath, const std::string& fingerprint)
+{
+   fingerprints_[filePath.relativePath(directory_)] = fingerprint;
+}
+
+void Fingerprints::erase(const FilePath& filePath)
+{
+   fingerprints_.erase(filePath.relativePath(directory_));
+}
+
+bool isSnapshot(const FilePath& filePath)
+{
+   return isBlockCompressedFile(filePath);
+}
+
+Error save(SEXP envSEXP,
+           const FilePath& filePath,
+           const Options& options,
+           Fingerprints* pFingerprints,
+           bool* pUnchanged)
+{
+   // get the bindings of the environment (as would be saved by save) or,
+   // if large objects are being saved apart from them, an index of them
+   sexp::Protect rProtect;
+   SEXP snapshotSEXP = R_NilValue;
+   Error error;
+   if (options.lazyObjectSize > 0)
+   {
+      error = saveObjects(envSEXP,
+                          filePath,
+                          options,
+                          pFingerprints,
+                          &snapshotSEXP,
+                          &rProtect);
+   }
+   else
+   {
+      error = r::exec::RFunction(".rs.environmentBindings", envSEXP)
+                                          .call(&snapshotSEXP, &rProtect);
+   }
+   if (error)
+      return error;
+
+   error = saveObject(snapshotSEXP,
+                      filePath,
+                      options,
+                      pFingerprints,
+                      pUnchanged);
+   if (error)
+      return error;
+
+   // remove objects saved apart from a previous snapshot (any promises
+   // which would have read them were forced to save this snapshot)
+   if (options.lazyObjectSize == 0)
+   {
+      FilePath objectsDir = objectsPath(filePath);
+      if (objectsDir.exists())
+      {
+         error = objectsDir.remove();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   return Success();
+}
+
+Error readBindings(const FilePath& filePath,
+                   SEXP* pBindingsSEXP,
+                   sexp::Protect* pProtect)
+{
+   return readObject(filePath, pBindingsSEXP, pProtect);
+}
+
+Error restore(const FilePath& filePath, SEXP envSEXP)
+{
+   sexp::Protect rProtect;
+   SEXP snapshotSEXP = R_NilValue;
+   Error error = readObject(filePath, &snapshotSEXP, &rProtect);
+   if (error)
+      return error;
+
+   return r::exec::RFunction(".rs.restoreEnvironmentSnapshot",
+                             snapshotSEXP,
+                             envSEXP,
+                             objectsPath(filePath).absolutePath()).call();
+}
+
+void initialize()
+{
+   R_CallMethodDef readObjectMethodDef;
+   readObjectMethodDef.name = kReadObjectMethod;
+   readObjectMethodDef.fun = (DL_FUNC) rs_readSnapshotObject;
+   readObjectMethodDef.numArgs = 1;
+   r::routines::addCallMethod(readObjectMethodDef);
+}
+
+} // namespace snapshot
+} // namespace session
+} // namespace r
+} // namespace rstudio
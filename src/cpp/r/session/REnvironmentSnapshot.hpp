@@ -0,0 +1,123 @@
+/*
+ * REnvironmentSnapshot.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_ENVIRONMENT_SNAPSHOT_HPP
+#define R_SESSION_ENVIRONMENT_SNAPSHOT_HPP
+
+#include <map>
+#include <string>
+
+#include <stdint.h>
+
+#include <core/FilePath.hpp>
+
+typedef struct SEXPREC *SEXP;
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+namespace r {
+namespace sexp {
+   class Protect;
+}
+}
+}
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace snapshot {
+
+// Snapshots are an alternative to R's save format for the environments
+// saved when a session is suspended: the bindings of the environment are
+// serialized by R and written as a block compressed file (see
+// core::BlockCompressedWriter), which is compressed (and when restored,
+// decompressed) on several threads at once. A fingerprint of each
+// snapshot is also recorded so that environments which haven't changed
+// since they were last saved needn't be written again.
+//
+// Large objects can also be saved apart from the rest of the environment
+// (each in a file of its own) and restored lazily: they're bound as
+// promises which read the object's file the first time they're used, so
+// that resuming a session with a large workspace needn't wait for all of
+// it to be read.
+struct Options
+{
+   Options() : threads(0), compressionLevel(1), lazyObjectSize(0) {}
+
+   // environments are saved in R's format when threads is zero
+   bool enabled() const { return threads > 0; }
+
+   int threads;
+   int compressionLevel;
+
+   // objects of at least this many bytes are saved apart from the rest of
+   // the environment and restored lazily (zero to restore all objects
+   // when the snapshot is restored)
+   uintmax_t lazyObjectSize;
+};
+
+// fingerprints of the snapshots within a directory (keyed by their path
+// relative to it)
+class Fingerprints
+{
+public:
+   explicit Fingerprints(const core::FilePath& directory);
+
+   core::Error read();
+   core::Error write() const;
+
+   // remove the file where fingerprints are kept
+   core::Error remove() const;
+
+   std::string get(const core::FilePath& filePath) const;
+   void set(const core::FilePath& filePath, const std::string& fingerprint);
+   void erase(const core::FilePath& filePath);
+
+private:
+   core::FilePath directory_;
+   std::map<std::string,std::string> fingerprints_;
+};
+
+bool isSnapshot(const core::FilePath& filePath);
+
+// save a snapshot of the environment to the file (unless the fingerprint
+// recorded for the file shows that its contents wouldn't change, in which
+// case pUnchanged is set to true)
+core::Error save(SEXP envSEXP,
+                 const core::FilePath& filePath,
+                 const Options& options,
+                 Fingerprints* pFingerprints,
+                 bool* pUnchanged);
+
+// read the bindings saved in a snapshot (as a named list)
+core::Error readBindings(const core::FilePath& filePath,
+                         SEXP* pBindingsSEXP,
+                         sexp::Protect* pProtect);
+
+// restore the bindings saved in a snapshot to the environment (objects
+// which were saved apart from it are bound as promises which read them)
+core::Error restore(const core::FilePath& filePath, SEXP envSEXP);
+
+// register the call method used to read objects restored lazily
+void initialize();
+
+} // namespace snapshot
+} // namespace session
+} // namespace r
+} // namespace rstudio
+
+#endif // R_SESSION_ENVIRONMENT_SNAPSHOT_HPP
@@ -26,6 +26,7 @@
 #include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
@@ -36,12 +37,15 @@
 #include <core/FilePath.hpp>
 #include <core/SafeConvert.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/PerformanceTimer.hpp>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RInternal.hpp>
 #include <r/RExec.hpp>
 #include <r/RInterface.hpp>
 
+#include "REnvironmentSnapshot.hpp"
+
 using namespace rstudio::core ;
 
 namespace rstudio {
@@ -87,12 +91,72 @@ Error saveGlobalEnvironmentToFile(const FilePath& environmentFile)
    return executeSafely(boost::bind(R_SaveGlobalEnvToFile, envPath.c_str()));
 }
    
+// save an environment either as a snapshot or in R's save format
+Error saveEnvironmentToFile(SEXP envSEXP,
+                            const FilePath& environmentFile,
+                            const snapshot::Options& options,
+                            snapshot::Fingerprints* pFingerprints)
+{
+   if (options.enabled())
+   {
+      bool unchanged = false;
+      return snapshot::save(envSEXP,
+                            environmentFile,
+                            options,
+                            pFingerprints,
+                            &unchanged);
+   }
+
+   pFingerprints->erase(environmentFile);
+   if (envSEXP == R_GlobalEnv)
+   {
+      return saveGlobalEnvironmentToFile(environmentFile);
+   }
+   else
+   {
+      return r::exec::RFunction(".rs.saveEnvironment",
+                                envSEXP,
+                                environmentFile.absolutePath()).call();
+   }
+}
+
+// read the fingerprints of snapshots saved previously (these are only of
+// use if we're writing snapshots). we remove them from disk until the
+// save is complete so an interrupted save can't leave fingerprints
+// which don't match their snapshots
+void initFingerprints(const snapshot::Options& options,
+                      snapshot::Fingerprints* pFingerprints)
+{
+   if (options.enabled())
+   {
+      Error error = pFingerprints->read();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   Error error = pFingerprints->remove();
+   if (error)
+      LOG_ERROR(error);
+}
+
+Error commitFingerprints(const snapshot::Options& options,
+                         const snapshot::Fingerprints& fingerprints)
+{
+   if (options.enabled())
+      return fingerprints.write();
+   else
+      return Success();
+}
+
 Error restoreGlobalEnvironment(const core::FilePath& environmentFile)
 {
    // tolerate no environment saved
    if (!environmentFile.exists())
       return Success();
    
+   if (snapshot::isSnapshot(environmentFile))
+      return snapshot::restore(environmentFile, R_GlobalEnv);
+
    return RFunction("load", environmentFile.absolutePath()).call();
 }
 
@@ -204,9 +268,25 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 {
    if (dataFilePath.exists())
    {
-      Error error = r::exec::RFunction(".rs.attachDataFile",
-                                       dataFilePath.absolutePath(),
+      Error error;
+      if (snapshot::isSnapshot(dataFilePath))
+      {
+         sexp::Protect rProtect;
+         SEXP bindingsSEXP = R_NilValue;
+         error = snapshot::readBindings(dataFilePath, &bindingsSEXP, &rProtect);
+         if (!error)
+         {
+            error = r::exec::RFunction(".rs.attachBindings",
+                                       bindingsSEXP,
                                        name).call();
+         }
+      }
+      else
+      {
+         error = r::exec::RFunction(".rs.attachDataFile",
+                                    dataFilePath.absolutePath(),
+                                    name).call();
+      }
       
       if (error)
       {
@@ -226,25 +306,51 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 } // anonymous namespace
    
 
-Error save(const FilePath& statePath)
+Error save(const FilePath& statePath,
+           const snapshot::Options& options,
+           PerformanceTimer* pTimer)
 {
+   snapshot::Fingerprints fingerprints(statePath);
+   initFingerprints(options, &fingerprints);
+
    // save the global environment
+   pTimer->advance("global environment");
    FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = saveGlobalEnvironmentToFile(environmentFile);
+   Error error = saveEnvironmentToFile(R_GlobalEnv,
+                                       environmentFile,
+                                       options,
+                                       &fingerprints);
    if (error)
       return error;
    
-   // reset the contents of the search path dir
+   // reset the contents of the search path dir (snapshots of environment
+   // data are retained so that unchanged environments aren't rewritten;
+   // those which are no longer needed are removed below)
+   pTimer->advance("search path");
    FilePath searchPathDir = statePath.complete(kSearchPathDir);
-   error = searchPathDir.resetDirectory();
-   if (error)
-      return error ;
-   
-   // create environment data subdirectory
    FilePath environmentDataPath = searchPathDir.complete(kEnvDataDir);
-   error = environmentDataPath.ensureDirectory();
-   if (error)
-      return error;
+   if (options.enabled())
+   {
+      error = environmentDataPath.ensureDirectory();
+      if (error)
+         return error;
+   }
+   else
+   {
+      error = searchPathDir.resetDirectory();
+      if (error)
+         return error ;
+
+      // create environment data subdirectory
+      error = environmentDataPath.ensureDirectory();
+      if (error)
+         return error;
+   }
+   std::vector<FilePath> dataFiles;
+
+   // only objects in the global environment are restored lazily
+   snapshot::Options dataOptions = options;
+   dataOptions.lazyObjectSize = 0;
    
    // iterate throught the search path (build a list as we go). set 
    // .GlobalEnv and package:base as bookends of the list (note this code
@@ -299,14 +405,35 @@ Error save(const FilePath& statePath)
          FilePath dataFilePath = environmentDataPath.complete(itemIndex);
          
          // save the environment
-         Error error = r::exec::RFunction(".rs.saveEnvironment",
-                                          envSEXP,
-                                          dataFilePath.absolutePath()).call();
+         pTimer->advance("search path element " + elementName);
+         Error error = saveEnvironmentToFile(envSEXP,
+                                             dataFilePath,
+                                             dataOptions,
+                                             &fingerprints);
          if (error)
             return error;
+         dataFiles.push_back(dataFilePath);
       }
    }
    searchPathElements.push_back("package:base");
+   pTimer->advance("search path list");
+
+   // remove environment data which is no longer on the search path
+   std::vector<FilePath> existingDataFiles;
+   error = environmentDataPath.children(&existingDataFiles);
+   if (error)
+      return error;
+   BOOST_FOREACH(const FilePath& dataFile, existingDataFiles)
+   {
+      if (std::find(dataFiles.begin(), dataFiles.end(), dataFile) ==
+          dataFiles.end())
+      {
+         fingerprints.erase(dataFile);
+         error = dataFile.remove();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
    
    // save the search path list
    FilePath elementsPath = searchPathDir.complete(kSearchPathElementsDir);
@@ -316,14 +443,29 @@ Error save(const FilePath& statePath)
 
    // save the package paths list
    FilePath packagePathsFile = searchPathDir.complete(kPackagePaths);
-   return writeStringMapToFile(packagePathsFile, packagePaths);
+   error = writeStringMapToFile(packagePathsFile, packagePaths);
+   if (error)
+      return error;
+
+   return commitFingerprints(options, fingerprints);
 }
 
 
-Error saveGlobalEnvironment(const FilePath& statePath)
+Error saveGlobalEnvironment(const FilePath& statePath,
+                            const snapshot::Options& options)
 {
+   snapshot::Fingerprints fingerprints(statePath);
+   initFingerprints(options, &fingerprints);
+
    FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   return saveGlobalEnvironmentToFile(environmentFile);
+   Error error = saveEnvironmentToFile(R_GlobalEnv,
+                                       environmentFile,
+                                       options,
+                                       &fingerprints);
+   if (error)
+      return error;
+
+   return commitFingerprints(options, fingerprints);
 }
 
 Error restore(const FilePath& statePath)
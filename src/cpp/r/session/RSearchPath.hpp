@@ -16,10 +16,13 @@
 #ifndef R_SESSION_SEARCH_PATH_HPP
 #define R_SESSION_SEARCH_PATH_HPP
 
+#include "REnvironmentSnapshot.hpp"
+
 namespace rstudio {
 namespace core {
    class Error;
    class FilePath;
+   class PerformanceTimer;
 }
 }
 
@@ -28,8 +31,14 @@ namespace r {
 namespace session {
 namespace search_path {
 
-core::Error save(const core::FilePath& statePath);
-core::Error saveGlobalEnvironment(const core::FilePath& statePath);
+// environments are saved as snapshots if enabled by the options (the
+// format of each is detected when restoring). the steps of the save are
+// recorded by the timer
+core::Error save(const core::FilePath& statePath,
+                 const snapshot::Options& options,
+                 core::PerformanceTimer* pTimer);
+core::Error saveGlobalEnvironment(const core::FilePath& statePath,
+                                  const snapshot::Options& options);
 core::Error restore(const core::FilePath& statePath);
    
 } // namespace search_path
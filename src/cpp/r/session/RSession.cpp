@@ -48,6 +48,7 @@
 
 #include "RClientMetrics.hpp"
 #include "RSessionState.hpp"
+#include "REnvironmentSnapshot.hpp"
 #include "RRestartContext.hpp"
 #include "REmbedded.hpp"
 
@@ -200,15 +201,24 @@ bool saveSessionState(const RSuspendOptions& options,
    {
       // save minimal
       return r::session::state::saveMinimal(suspendedSessionPath,
-                                            options.saveWorkspace);
+                                            options.saveWorkspace,
+                                            s_options.snapshotThreads);
 
    }
    else
    {
+      // restart contexts are removed as soon as they've been restored so
+      // objects can only be restored lazily from a suspended session
+      int lazyRestoreSize = 0;
+      if (suspendedSessionPath == s_suspendedSessionPath)
+         lazyRestoreSize = s_options.lazyRestoreSize;
+
       return r::session::state::save(suspendedSessionPath,
                                      s_options.serverMode,
                                      options.excludePackages,
-                                     disableSaveCompression);
+                                     disableSaveCompression,
+                                     s_options.snapshotThreads,
+                                     lazyRestoreSize);
    }
 }
    
@@ -1391,6 +1401,9 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
    saveHistoryMethodDef.numArgs = 1;
    r::routines::addCallMethod(saveHistoryMethodDef);
 
+   // register methods used to restore snapshots
+   r::session::snapshot::initialize();
+
 
    // run R
 
@@ -16,6 +16,7 @@
 #include "RSessionState.hpp"
 
 #include <algorithm>
+#include <sstream>
 
 #include <boost/function.hpp>
 #include <boost/foreach.hpp>
@@ -25,6 +26,7 @@
 #include <core/Settings.hpp>
 #include <core/Log.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/PerformanceTimer.hpp>
 #include <core/system/Environment.hpp>
 
 #include <r/RExec.hpp>
@@ -265,6 +267,22 @@ void saveWorkingContext(const FilePath& statePath,
    }
 }
 
+snapshot::Options snapshotOptions(int threads, bool disableSaveCompression)
+{
+   snapshot::Options options;
+   options.threads = threads;
+   options.compressionLevel = disableSaveCompression ? 0 : 1;
+   return options;
+}
+
+void logSaveTimings(PerformanceTimer* pTimer)
+{
+   pTimer->stop();
+   std::ostringstream ostr;
+   ostr << *pTimer;
+   LOG_INFO_MESSAGE("Session state saved: " + ostr.str());
+}
+
 } // anonymous namespace
  
    
@@ -272,8 +290,13 @@ void saveWorkingContext(const FilePath& statePath,
 bool save(const FilePath& statePath,
           bool serverMode,
           bool excludePackages,
-          bool disableSaveCompression)
+          bool disableSaveCompression,
+          int snapshotThreads,
+          int lazyRestoreSize)
 {
+   // time each step of the save
+   PerformanceTimer timer("settings");
+
    // initialize context
    Settings settings;
    bool saved = true;
@@ -287,6 +310,7 @@ bool save(const FilePath& statePath,
    settings.set(kRProfileOnRestore, !excludePackages || packratModeOn);
 
    // save environment variables
+   timer.advance(kEnvironmentVars);
    Error error = saveEnvironmentVars(statePath.complete(kEnvironmentVars));
    if (error)
    {
@@ -296,6 +320,7 @@ bool save(const FilePath& statePath,
 
    // if we are in server mode then we just need to write the plot
    // state index (because the location of the graphics directory is stable)
+   timer.advance(kPlotsDir);
    if (serverMode)
    {
       error = graphics::plotManager().savePlotsState();
@@ -321,6 +346,7 @@ bool save(const FilePath& statePath,
    saveDevMode(&settings);
 
    // save libpaths
+   timer.advance(kLibPathsFile);
    error = saveLibPaths(statePath.complete(kLibPathsFile));
    if (error)
    {
@@ -329,6 +355,7 @@ bool save(const FilePath& statePath,
    }
 
    // save options 
+   timer.advance(kOptionsFile);
    error = r::options::saveOptions(statePath.complete(kOptionsFile));
    if (error)
    {
@@ -337,6 +364,7 @@ bool save(const FilePath& statePath,
    }
    
    // save working context
+   timer.advance("working_context");
    saveWorkingContext(statePath, &settings, &saved);
 
    // save search path (disable save compression if requested)
@@ -347,9 +375,13 @@ bool save(const FilePath& statePath,
          LOG_ERROR(error);
    }
 
+   snapshot::Options options = snapshotOptions(snapshotThreads,
+                                               disableSaveCompression);
+   options.lazyObjectSize = static_cast<uintmax_t>(lazyRestoreSize) *
+                            1024 * 1024;
    if (!excludePackages)
    {
-      error = search_path::save(statePath);
+      error = search_path::save(statePath, options, &timer);
       if (error)
       {
          reportError(kSaving, kSearchPath, error, ERROR_LOCATION);
@@ -358,7 +390,8 @@ bool save(const FilePath& statePath,
    }
    else
    {
-      error = search_path::saveGlobalEnvironment(statePath);
+      timer.advance(kGlobalEnvironment);
+      error = search_path::saveGlobalEnvironment(statePath, options);
       if (error)
       {
          reportError(kSaving, kGlobalEnvironment, error, ERROR_LOCATION);
@@ -366,13 +399,16 @@ bool save(const FilePath& statePath,
       }
    }
 
+   logSaveTimings(&timer);
+
    // return status
    return saved;
 }
 
 
 bool saveMinimal(const core::FilePath& statePath,
-                 bool saveGlobalEnvironment)
+                 bool saveGlobalEnvironment,
+                 int snapshotThreads)
 {
    // initialize context
    Settings settings;
@@ -399,7 +435,9 @@ bool saveMinimal(const core::FilePath& statePath,
       if (error)
          LOG_ERROR(error);
 
-      error = search_path::saveGlobalEnvironment(statePath);
+      error = search_path::saveGlobalEnvironment(
+                                    statePath,
+                                    snapshotOptions(snapshotThreads, true));
       if (error)
       {
          reportError(kSaving, kGlobalEnvironment, error, ERROR_LOCATION);
@@ -407,8 +445,6 @@ bool saveMinimal(const core::FilePath& statePath,
       }
    }
 
-
-
    // return status
    return saved;
 }
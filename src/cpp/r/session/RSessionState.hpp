@@ -33,13 +33,20 @@ namespace r {
 namespace session {
 namespace state {
         
+// environments are saved as snapshots using the specified number of
+// threads (or in R's save format if this is zero). objects in the global
+// environment of at least lazyRestoreSize megabytes are saved apart from
+// its snapshot and restored lazily (zero to restore them all eagerly)
 bool save(const core::FilePath& statePath,
           bool serverMode,
           bool excludePackages,
-          bool disableSaveCompression);
+          bool disableSaveCompression,
+          int snapshotThreads,
+          int lazyRestoreSize);
 
 bool saveMinimal(const core::FilePath& statePath,
-                 bool saveGlobalEnvironment);
+                 bool saveGlobalEnvironment,
+                 int snapshotThreads);
    
 
 bool rProfileOnRestore(const core::FilePath& statePath);
@@ -170,6 +170,18 @@ FilePath tempFile(const std::string& extension)
 }
 
 
+// when the rstudio device is recording a display list there is no need
+// to forward drawing primitives to the shadow device as they are issued:
+// writeToPNG replays the display list onto the shadow device before the
+// file is written, so the primitives are rasterized once per render
+// rather than once as they are drawn and then again for each render.
+// (if the display list has been inhibited we fall back to forwarding)
+bool deferToDisplayList(pDevDesc dev)
+{
+   pGEDevDesc geDev = desc2GEDesc(dev);
+   return geDev != NULL && geDev->displayListOn;
+}
+
 void shadowDevSync(DeviceContext* pDC)
 {
    // get the rstudio device number
@@ -338,8 +350,10 @@ Error writeToPNG(const FilePath& targetPath, DeviceContext* pDC)
    // now update the device structure
    handler::setSize(dev);
 
-   // replay the rstudio graphics device context onto the png
-   shadowDevSync(pDC);
+   // replay the rstudio graphics device context onto the png (not
+   // required if drawing is deferred since the next write will sync)
+   if (!deferToDisplayList(dev))
+      shadowDevSync(pDC);
 
    // return status
    return error;
@@ -352,6 +366,9 @@ void circle(double x,
             const pGEcontext gc,
             pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -366,6 +383,9 @@ void line(double x1,
           const pGEcontext gc,
           pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -379,6 +399,9 @@ void polygon(int n,
              const pGEcontext gc,
              pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -392,6 +415,9 @@ void polyline(int n,
               const pGEcontext gc,
               pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -406,6 +432,9 @@ void rect(double x0,
           const pGEcontext gc,
           pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -421,6 +450,9 @@ void path(double *x,
           const pGEcontext gc,
           pDevDesc dd)
 {
+   if (deferToDisplayList(dd))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dd);
    dev_desc::path(x, y, npoly, nper, winding, gc, pngDevDesc);
 }
@@ -437,6 +469,9 @@ void raster(unsigned int *raster,
             const pGEcontext gc,
             pDevDesc dd)
 {
+   if (deferToDisplayList(dd))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dd);
    dev_desc::raster(raster,
                     w,
@@ -486,12 +521,18 @@ void text(double x,
           const pGEcontext gc,
           pDevDesc dev)
 {   
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    dev_desc::text(x, y, str, rot, hadj, gc, pngDevDesc);
 }
    
 void clip(double x0, double x1, double y0, double y1, pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -501,6 +542,9 @@ void clip(double x0, double x1, double y0, double y1, pDevDesc dev)
    
 void newPage(const pGEcontext gc, pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -510,6 +554,9 @@ void newPage(const pGEcontext gc, pDevDesc dev)
 
 void mode(int mode, pDevDesc dev)
 {
+   if (deferToDisplayList(dev))
+      return;
+
    pDevDesc pngDevDesc = shadowDevDesc(dev);
    if (pngDevDesc == NULL)
       return;
@@ -0,0 +1,239 @@
+/*
+ * ServerLibraryIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerLibraryIndex.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/PeriodicCommand.hpp>
+#include <core/r_util/RLibraryIndex.hpp>
+#include <core/system/PosixSystem.hpp>
+#include <core/system/PosixUser.hpp>
+
+#include <server/ServerOptions.hpp>
+#include <server/ServerScheduler.hpp>
+
+#include "ServerREnvironment.hpp"
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace server {
+namespace library_index {
+
+namespace {
+
+// sessions of every user read the indexes written here rather than each
+// re-reading the DESCRIPTION files of the (often very large) site libraries
+
+std::vector<FilePath> s_libraries;
+
+// signature of each library at the time it was last indexed
+std::map<std::string, std::string> s_indexedSignatures;
+
+std::vector<FilePath> sharedLibraries()
+{
+   std::vector<FilePath> libraries;
+
+   std::string option = server::options().rsessionSharedLibraries();
+   if (!option.empty())
+   {
+      std::vector<std::string> paths;
+      boost::algorithm::split(paths, option, boost::algorithm::is_any_of(":"));
+      BOOST_FOREACH(const std::string& path, paths)
+      {
+         if (!path.empty())
+            libraries.push_back(FilePath(path));
+      }
+      return libraries;
+   }
+
+   // default to the libraries within R home
+   std::vector<std::pair<std::string,std::string> > vars =
+                                                r_environment::variables();
+   for (std::size_t i = 0; i < vars.size(); ++i)
+   {
+      if (vars[i].first == "R_HOME")
+      {
+         FilePath rHome(vars[i].second);
+         libraries.push_back(rHome.childPath("library"));
+         libraries.push_back(rHome.childPath("site-library"));
+         break;
+      }
+   }
+
+   return libraries;
+}
+
+// create a directory of the store (or accept an existing one) and give it
+// to the specified owner with mode 0755. the directory is opened without following links
+// and checked via the descriptor so that it can't be swapped for a link
+// to some other directory (which we would then hand to the owner), and an
+// existing directory must already belong to root or the owner and be
+// writable only by its owner
+Error ensureStoreDirectory(const FilePath& dir, uid_t owner, gid_t group)
+{
+   std::string path = dir.absolutePath();
+   Error error;
+   int fd = -1;
+   struct stat st;
+   if (::mkdir(path.c_str(), 0755) == -1 && errno != EEXIST)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+   }
+   else if ((fd = ::open(path.c_str(),
+                         O_RDONLY | O_DIRECTORY | O_NOFOLLOW)) == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+   }
+   else if (::fstat(fd, &st) == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+   }
+   else if (st.st_uid != 0 && st.st_uid != owner)
+   {
+      error = systemError(EPERM, "Unexpected owner", ERROR_LOCATION);
+   }
+   else if (st.st_mode & (S_IWGRP | S_IWOTH))
+   {
+      error = systemError(EPERM, "Writable by others", ERROR_LOCATION);
+   }
+   else if ((st.st_uid != owner || st.st_gid != group) &&
+            ::fchown(fd, owner, group) == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+   }
+   else if (::fchmod(fd, 0755) == -1)
+   {
+      // (sessions of every user read the store)
+      error = systemError(errno, ERROR_LOCATION);
+   }
+
+   if (fd != -1)
+      ::close(fd);
+
+   if (error)
+      error.addProperty("path", dir);
+   return error;
+}
+
+Error ensureStore(const FilePath& storePath)
+{
+   // the store is created while we are still root but is written by the
+   // periodic refresh after we have dropped privilege (its parent, the
+   // server's data directory, belongs to root)
+   uid_t owner = ::geteuid();
+   gid_t group = ::getegid();
+   std::string serverUser = server::options().serverUser();
+   if (core::system::realUserIsRoot() && !serverUser.empty())
+   {
+      core::system::user::User user;
+      Error error = core::system::user::userFromUsername(serverUser, &user);
+      if (error)
+         return error;
+      owner = user.userId;
+      group = user.groupId;
+   }
+
+   Error error = ensureStoreDirectory(storePath.parent(),
+                                      ::geteuid(),
+                                      ::getegid());
+   if (error)
+      return error;
+
+   return ensureStoreDirectory(storePath, owner, group);
+}
+
+bool refreshIndexes()
+{
+   FilePath storePath(kLibraryIndexPath);
+   BOOST_FOREACH(const FilePath& library, s_libraries)
+   {
+      if (!library.exists())
+         continue;
+
+      // only re-index libraries which have changed
+      std::string signature;
+      Error error = r_util::librarySignature(library, &signature);
+      if (error)
+      {
+         LOG_ERROR(error);
+         continue;
+      }
+      std::map<std::string, std::string>::const_iterator it =
+                        s_indexedSignatures.find(library.absolutePath());
+      if (it != s_indexedSignatures.end() && it->second == signature)
+         continue;
+
+      r_util::LibraryIndex index;
+      error = r_util::scanLibrary(library, &index);
+      if (!error)
+         error = r_util::writeLibraryIndex(storePath, index);
+      if (error)
+      {
+         LOG_ERROR(error);
+         continue;
+      }
+
+      s_indexedSignatures[library.absolutePath()] = index.signature;
+   }
+
+   // keep refreshing
+   return true;
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   s_libraries = sharedLibraries();
+   if (s_libraries.empty())
+      return Success();
+
+   // failure to create the store isn't fatal (sessions simply read the
+   // site libraries themselves)
+   Error error = ensureStore(FilePath(kLibraryIndexPath));
+   if (error)
+   {
+      LOG_ERROR(error);
+      return Success();
+   }
+
+   // index now (so the indexes are ready for the first sessions) and then
+   // check for changes to the libraries periodically
+   refreshIndexes();
+   scheduler::addCommand(
+      boost::shared_ptr<ScheduledCommand>(new PeriodicCommand(
+         boost::posix_time::seconds(30), refreshIndexes, false))
+   );
+
+   return Success();
+}
+
+} // namespace library_index
+} // namespace server
+} // namespace rstudio
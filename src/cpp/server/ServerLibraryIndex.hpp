@@ -0,0 +1,37 @@
+/*
+ * ServerLibraryIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_LIBRARY_INDEX_HPP
+#define SERVER_LIBRARY_INDEX_HPP
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace server {
+namespace library_index {
+
+// maintain indexes of the site libraries shared by all sessions (must be
+// called prior to dropping privilege so the index store can be created)
+core::Error initialize();
+
+} // namespace library_index
+} // namespace server
+} // namespace rstudio
+
+#endif // SERVER_LIBRARY_INDEX_HPP
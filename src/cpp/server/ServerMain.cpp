@@ -17,6 +17,8 @@
 #include <pthread.h>
 #include <signal.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/Error.hpp>
 #include <core/LogWriter.hpp>
 #include <core/ProgramStatus.hpp>
@@ -56,7 +58,9 @@
 #include "ServerBrowser.hpp"
 #include "ServerEval.hpp"
 #include "ServerInit.hpp"
+#include "ServerLibraryIndex.hpp"
 #include "ServerMeta.hpp"
+#include "ServerMetrics.hpp"
 #include "ServerOffline.hpp"
 #include "ServerPAMAuth.hpp"
 #include "ServerREnvironment.hpp"
@@ -89,6 +93,18 @@ bool mainPageFilter(const core::http::Request& request,
 }
 
 
+// large file uploads are streamed through to the session as they are
+// received rather than being read into memory first
+bool streamRequestBodyFilter(const core::http::Request& request)
+{
+   const std::size_t kStreamBodyThreshold = 1024 * 1024;
+
+   return boost::algorithm::starts_with(request.uri(), "/upload") &&
+          boost::algorithm::starts_with(request.headerValue("Content-Type"),
+                                        "multipart/form-data") &&
+          request.contentLength() > kStreamBodyThreshold;
+}
+
 http::UriHandlerFunction blockingFileHandler()
 {
    Options& options = server::options();
@@ -145,6 +161,7 @@ Error httpServerInit()
    s_pHttpServer->setAbortOnResourceError(true);
    s_pHttpServer->setScheduledCommandInterval(
                                     boost::posix_time::milliseconds(500));
+   s_pHttpServer->setStreamRequestBodyFilter(streamRequestBodyFilter);
 
    // initialize
    return server::httpServerInit(s_pHttpServer.get());
@@ -435,12 +452,24 @@ int main(int argc, char * const argv[])
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
+      // initialize the metrics exporter (needs to happen prior to dropping
+      // privilege in case the metrics port is privileged)
+      error = metrics_exporter::initialize();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
       // initialize the process supervisor (needs to happen post http server
       // init for access to the scheduled command list)
       error = process_supervisor::initialize();
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
+      // initialize the shared library index (needs to happen post http
+      // server init for access to the scheduled command list)
+      error = library_index::initialize();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
       // initialize monitor (needs to happen post http server init for access
       // to the server's io service)
       monitor::initializeMonitorClient(kMonitorSocketPath,
@@ -514,6 +543,12 @@ int main(int argc, char * const argv[])
          return EXIT_SUCCESS;
       }
 
+      // launch sessions ahead of time for users who sign in (happens post
+      // overlay and addin init so we know how sessions will be launched)
+      error = sessionManager().startSessionPool();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
       // call overlay startup
       error = overlay::startup();
       if (error)
@@ -524,6 +559,11 @@ int main(int argc, char * const argv[])
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
+      // serve metrics
+      error = metrics_exporter::startup();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
       // wait for signals
       error = waitForSignals();
       if (error)
@@ -0,0 +1,81 @@
+/*
+ * ServerMetrics.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerMetrics.hpp"
+
+#include <boost/scoped_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/TcpIpAsyncServer.hpp>
+
+#include <monitor/metrics/MetricsRegistry.hpp>
+
+#include <server/ServerOptions.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace server {
+namespace metrics_exporter {
+
+namespace {
+
+// metrics are only served to local clients (e.g. a Prometheus agent
+// running on the same host)
+const char * const kMetricsAddress = "127.0.0.1";
+
+boost::scoped_ptr<http::TcpIpAsyncServer> s_pMetricsServer;
+
+void handleMetricsRequest(const http::Request& request,
+                          http::Response* pResponse)
+{
+   std::vector<monitor::metrics::MultiMetric> metrics =
+                     monitor::metrics::collect("rserver", 0);
+
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("text/plain; version=0.0.4");
+   Error error = pResponse->setBody(monitor::metrics::prometheusText(metrics));
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   std::string port = server::options().wwwMetricsPort();
+   if (port.empty())
+      return Success();
+
+   s_pMetricsServer.reset(new http::TcpIpAsyncServer("RStudio Metrics"));
+   s_pMetricsServer->addBlockingHandler("/metrics", handleMetricsRequest);
+   return s_pMetricsServer->init(kMetricsAddress, port);
+}
+
+Error startup()
+{
+   if (s_pMetricsServer)
+      return s_pMetricsServer->run();
+   else
+      return Success();
+}
+
+} // namespace metrics_exporter
+} // namespace server
+} // namespace rstudio
@@ -0,0 +1,41 @@
+/*
+ * ServerMetrics.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_METRICS_HPP
+#define SERVER_METRICS_HPP
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace server {
+namespace metrics_exporter {
+
+// serve the server's metrics (in the Prometheus text format) on localhost
+// if a metrics port was specified (must be called prior to dropping
+// privilege in case the port is privileged)
+core::Error initialize();
+
+// start serving metrics
+core::Error startup();
+
+} // namespace metrics_exporter
+} // namespace server
+} // namespace rstudio
+
+#endif // SERVER_METRICS_HPP
@@ -169,7 +169,10 @@ ProgramStatus Options::read(int argc,
          "thread pool size")
       ("www-proxy-localhost",
          value<bool>(&wwwProxyLocalhost_)->default_value(true),
-         "proxy requests to localhost ports over main server port");
+         "proxy requests to localhost ports over main server port")
+      ("www-metrics-port",
+         value<std::string>(&wwwMetricsPort_)->default_value(""),
+         "localhost port on which to serve metrics (Prometheus format)");
 
    // rsession
    Deprecated dep;
@@ -190,6 +193,14 @@ ProgramStatus Options::read(int argc,
       ("rsession-config-file",
          value<std::string>(&rsessionConfigFile_)->default_value(""),
          "path to rsession config file")
+      ("rsession-shared-libraries",
+         value<std::string>(&rsessionSharedLibraries_)->default_value(""),
+         "site libraries indexed for all sessions (colon separated)")
+      ("rsession-pool-size",
+         value<int>(&rsessionPoolSize_)->default_value(0),
+         "number of sessions to launch ahead of time for users who sign in "
+         "(these wait as root until assigned a user and save process start "
+         "up but not R initialization, so the pool is off by default)")
       ("rsession-memory-limit-mb",
          value<int>(&dep.memoryLimitMb)->default_value(dep.memoryLimitMb),
          "rsession memory limit (mb) - DEPRECATED")
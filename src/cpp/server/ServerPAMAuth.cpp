@@ -287,6 +287,7 @@ void doSignIn(const http::Request& request,
    username = auth::handler::userIdentifierToLocalUsername(username);
 
    onUserUnauthenticated(username);
+   server::auth::invalidateValidatedUser(username);
 
    if ( pamLogin(username, password) && server::auth::validateUser(username))
    {
@@ -331,6 +332,7 @@ void signOut(const http::Request& request,
                               username));
 
       onUserUnauthenticated(username);
+      server::auth::invalidateValidatedUser(username);
    }
 
    auth::secure_cookie::remove(request, kUserId, "", pResponse);
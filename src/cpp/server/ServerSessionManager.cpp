@@ -15,6 +15,8 @@
 
 #include <server/ServerSessionManager.hpp>
 
+#include <fcntl.h>
+
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -60,9 +62,10 @@ core::system::ProcessConfig sessionProcessConfig(
    if (!rsessionConfigFile.empty())
       args.push_back(std::make_pair("--config-file", rsessionConfigFile));
 
-   // pass the user-identity
-   args.push_back(std::make_pair("-" kUserIdentitySessionOptionShort,
-                                 username));
+   // pass the user-identity (pooled sessions learn it when assigned)
+   if (!username.empty())
+      args.push_back(std::make_pair("-" kUserIdentitySessionOptionShort,
+                                    username));
 
    // allow session timeout to be overridden via environment variable
    std::string timeout = core::system::getenv("RSTUDIO_SESSION_TIMEOUT");
@@ -99,6 +102,49 @@ void onProcessExit(const std::string& username, PidType pid)
 {
 }
 
+// upper bounds (in milliseconds) of the launch latency histogram buckets
+// (a final bucket holds everything slower)
+const long kLaunchLatencyBuckets[] = { 100, 250, 500, 1000, 2500, 5000, 10000 };
+const std::size_t kLaunchLatencyBucketCount =
+      (sizeof(kLaunchLatencyBuckets) / sizeof(long)) + 1;
+
+// log a latency summary after every this many launches
+const std::size_t kLaunchLatencyLogInterval = 100;
+
+// pooled sessions which exit sooner than this after being launched
+// aren't replaced (this likely indicates a problem which relaunching
+// won't fix)
+const long kMinPooledSessionLifetimeSeconds = 30;
+
+std::size_t launchLatencyBucket(const boost::posix_time::time_duration& latency)
+{
+   std::size_t bucket = 0;
+   while (bucket < (kLaunchLatencyBucketCount - 1) &&
+          latency.total_milliseconds() > kLaunchLatencyBuckets[bucket])
+   {
+      bucket++;
+   }
+   return bucket;
+}
+
+std::string formatLaunchLatencies(const std::vector<std::size_t>& counts)
+{
+   std::string summary;
+   for (std::size_t i = 0; i < counts.size(); i++)
+   {
+      if (!summary.empty())
+         summary += ", ";
+
+      if (i < (kLaunchLatencyBucketCount - 1))
+         summary += "<=" + safe_convert::numberToString(kLaunchLatencyBuckets[i]);
+      else
+         summary += ">" + safe_convert::numberToString(kLaunchLatencyBuckets[i-1]);
+
+      summary += "ms: " + safe_convert::numberToString(counts[i]);
+   }
+   return summary;
+}
+
 } // anonymous namespace
 
 SessionManager& sessionManager()
@@ -108,6 +154,10 @@ SessionManager& sessionManager()
 }
 
 SessionManager::SessionManager()
+   : pooledLaunchLatencies_(kLaunchLatencyBucketCount, 0),
+     launchLatencies_(kLaunchLatencyBucketCount, 0),
+     completedLaunches_(0),
+     customSessionLaunchFunction_(false)
 {
    // set default session launcher
    sessionLaunchFunction_ = boost::bind(&SessionManager::launchAndTrackSession,
@@ -124,7 +174,7 @@ Error SessionManager::launchSession(const std::string& username)
       if (pos != pendingLaunches_.end())
       {
          // if the launch is less than one minute old then return success
-         if ( (pos->second + boost::posix_time::minutes(1))
+         if ( (pos->second.time + boost::posix_time::minutes(1))
                > microsec_clock::universal_time() )
          {
             return Success();
@@ -142,10 +192,24 @@ Error SessionManager::launchSession(const std::string& username)
       }
 
       // record the launch
-      pendingLaunches_[username] =  microsec_clock::universal_time();
+      pendingLaunches_[username].time = microsec_clock::universal_time();
    }
    END_LOCK_MUTEX
 
+   // hand the user a session from the pool if we can
+   if (canUseSessionPool() && assignPooledSession(username))
+   {
+      LOCK_MUTEX(launchesMutex_)
+      {
+         LaunchMap::iterator pos = pendingLaunches_.find(username);
+         if (pos != pendingLaunches_.end())
+            pos->second.pooled = true;
+      }
+      END_LOCK_MUTEX
+
+      return Success();
+   }
+
    // determine launch options
    r_util::SessionLaunchProfile profile;
    profile.username = username;
@@ -201,6 +265,7 @@ void SessionManager::setSessionLaunchFunction(
                            const SessionLaunchFunction& launchFunction)
 {
    sessionLaunchFunction_ = launchFunction;
+   customSessionLaunchFunction_ = true;
 }
 
 void SessionManager::addSessionLaunchProfileFilter(
@@ -218,6 +283,211 @@ void SessionManager::removePendingLaunch(const std::string& username)
    END_LOCK_MUTEX
 }
 
+void SessionManager::completePendingLaunch(const std::string& username)
+{
+   using namespace boost::posix_time;
+
+   std::string summary;
+   LOCK_MUTEX(launchesMutex_)
+   {
+      LaunchMap::iterator pos = pendingLaunches_.find(username);
+      if (pos == pendingLaunches_.end())
+         return;
+
+      // record the latency of the launch
+      time_duration latency = microsec_clock::universal_time() -
+                              pos->second.time;
+      std::vector<std::size_t>& latencies = pos->second.pooled ?
+                                    pooledLaunchLatencies_ : launchLatencies_;
+      latencies.at(launchLatencyBucket(latency))++;
+      pendingLaunches_.erase(pos);
+
+      if ((++completedLaunches_ % kLaunchLatencyLogInterval) == 0)
+      {
+         summary = "Session launch latencies (pooled: " +
+                   formatLaunchLatencies(pooledLaunchLatencies_) +
+                   "; launched: " +
+                   formatLaunchLatencies(launchLatencies_) + ")";
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (!summary.empty())
+      LOG_INFO_MESSAGE(summary);
+}
+
+std::string SessionManager::launchLatencySummary()
+{
+   LOCK_MUTEX(launchesMutex_)
+   {
+      return "pooled: " + formatLaunchLatencies(pooledLaunchLatencies_) +
+             "; launched: " + formatLaunchLatencies(launchLatencies_);
+   }
+   END_LOCK_MUTEX
+
+   return std::string();
+}
+
+Error SessionManager::startSessionPool()
+{
+   int poolSize = server::options().rsessionPoolSize();
+   if (poolSize <= 0)
+      return Success();
+
+   if (!canUseSessionPool())
+   {
+      LOG_WARNING_MESSAGE("Session pool not started (pooled sessions require "
+                          "that the server run as root and use the default "
+                          "session launcher)");
+      return Success();
+   }
+
+   for (int i = 0; i < poolSize; i++)
+   {
+      Error error = launchPooledSession();
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+bool SessionManager::canUseSessionPool()
+{
+   // pooled sessions are launched as root and assume the identity of their
+   // user once assigned; profile filters and custom launchers need to see
+   // every launch so can't be bypassed
+   return core::system::realUserIsRoot() &&
+          !customSessionLaunchFunction_ &&
+          sessionLaunchProfileFilters_.empty();
+}
+
+bool SessionManager::assignPooledSession(const std::string& username)
+{
+   while (true)
+   {
+      PooledSession session;
+      LOCK_MUTEX(poolMutex_)
+      {
+         if (pooledSessions_.empty())
+            return false;
+
+         session = pooledSessions_.front();
+         pooledSessions_.pop_front();
+      }
+      END_LOCK_MUTEX
+
+      // write the username to the session (a write this small is atomic)
+      std::string assignment = username + "\n";
+      Error error;
+      if (::write(session.assignFd, assignment.data(), assignment.size()) == -1)
+         error = systemError(errno, ERROR_LOCATION);
+      ::close(session.assignFd);
+
+      // replace the session in the pool
+      Error launchError = launchPooledSession();
+      if (launchError)
+         LOG_ERROR(launchError);
+
+      if (!error)
+         return true;
+
+      // a broken pipe indicates that the session has exited (it will be
+      // reaped by the process tracker); otherwise log and try the next one
+      if (error.code() != boost::system::errc::broken_pipe)
+         LOG_ERROR(error);
+   }
+}
+
+Error SessionManager::launchPooledSession()
+{
+   // the session reads the name of its user from this pipe
+   int fds[2];
+   if (::pipe(fds) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   // don't leak the write end to other children
+   if (::fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+
+   core::system::ProcessConfig config = sessionProcessConfig("");
+   config.environment.push_back(std::make_pair(kRStudioSessionPoolMember, "1"));
+   config.stdInputFd = fds[0];
+
+   PidType pid = 0;
+   Error error = core::system::launchChildProcess(
+                                       server::options().rsessionPath(),
+                                       "root",
+                                       config,
+                                       &pid);
+   ::close(fds[0]);
+   if (error)
+   {
+      ::close(fds[1]);
+      return error;
+   }
+
+   PooledSession session;
+   session.pid = pid;
+   session.assignFd = fds[1];
+   session.launchTime = boost::posix_time::microsec_clock::universal_time();
+   LOCK_MUTEX(poolMutex_)
+   {
+      pooledSessions_.push_back(session);
+   }
+   END_LOCK_MUTEX
+
+   // track it for subsequent reaping
+   processTracker_.addProcess(pid, boost::bind(
+                           &SessionManager::onPooledSessionExit, this, pid));
+
+   return Success();
+}
+
+void SessionManager::onPooledSessionExit(PidType pid)
+{
+   using namespace boost::posix_time;
+
+   // check whether the session exited while still in the pool
+   bool wasPooled = false;
+   ptime launchTime;
+   LOCK_MUTEX(poolMutex_)
+   {
+      for (std::deque<PooledSession>::iterator it = pooledSessions_.begin();
+           it != pooledSessions_.end();
+           ++it)
+      {
+         if (it->pid == pid)
+         {
+            ::close(it->assignFd);
+            launchTime = it->launchTime;
+            pooledSessions_.erase(it);
+            wasPooled = true;
+            break;
+         }
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (!wasPooled)
+      return;
+
+   // replace it (unless it exited soon after launch)
+   if ((launchTime + seconds(kMinPooledSessionLifetimeSeconds)) <
+       microsec_clock::universal_time())
+   {
+      Error error = launchPooledSession();
+      if (error)
+         LOG_ERROR(error);
+   }
+   else
+   {
+      LOG_WARNING_MESSAGE("Pooled session " +
+                          safe_convert::numberToString(pid) +
+                          " exited shortly after launch (not replacing it)");
+   }
+}
+
 void SessionManager::notifySIGCHLD()
 {
    processTracker_.notifySIGCHILD();
@@ -47,6 +47,8 @@
 
 #include <core/json/JsonRpc.hpp>
 
+#include <monitor/metrics/MetricsRegistry.hpp>
+
 #include <session/SessionConstants.hpp>
 #include <session/SessionLocalStreams.hpp>
 
@@ -105,18 +107,109 @@ bool applyProxyFilter(
       return false;
 }
 
+// metrics of the requests proxied to sessions (kept for each kind of
+// request since e.g. events requests wait for events to occur)
+struct ProxyMetrics
+{
+   monitor::metrics::Counter requests;
+   monitor::metrics::Counter errors;
+   monitor::metrics::Histogram latency;
+};
+
+ProxyMetrics proxyMetrics(const std::string& uriClass)
+{
+   using namespace monitor::metrics;
+   std::string labels = "uri=\"" + escapeLabelValue(uriClass) + "\"";
+   ProxyMetrics metrics;
+   metrics.requests = counter("proxy_requests_total", labels);
+   metrics.errors = counter("proxy_errors_total", labels);
+   metrics.latency = histogram("proxy_latency_ms", labels, latencyMsBuckets());
+   return metrics;
+}
+
+ProxyMetrics s_contentMetrics;
+ProxyMetrics s_rpcMetrics;
+ProxyMetrics s_eventsMetrics;
+
+void observeLatency(const ProxyMetrics& metrics,
+                    const boost::posix_time::ptime& startTime)
+{
+   using namespace boost::posix_time;
+   boost::int64_t micros =
+         (microsec_clock::universal_time() - startTime).total_microseconds();
+   metrics.latency.observe(micros / 1000.0);
+}
+
 void handleProxyResponse(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       std::string username,
+      ProxyMetrics metrics,
+      boost::posix_time::ptime startTime,
       const http::Response& response)
 {
-   // if there was a launch pending then remove it
-   sessionManager().removePendingLaunch(username);
+   // record how long the session took to respond
+   observeLatency(metrics, startTime);
+
+   // if there was a launch pending then it's now complete
+   sessionManager().completePendingLaunch(username);
 
    // write the response
    ptrConnection->writeResponse(response);
 }
 
+// responses larger than this (e.g. downloads, exports, and large html
+// documents) are streamed through to the browser as they arrive rather
+// than being held in memory until they're complete
+const std::size_t kStreamResponseThreshold = 1024 * 1024;
+
+// responses which never have a body whatever their headers say (those to
+// HEAD requests and informational, 204, and 304 responses). these mustn't
+// be streamed since we'd wait for a body which never arrives
+bool isBodilessResponse(const std::string& method,
+                        const http::Response& response)
+{
+   int status = response.statusCode();
+   return boost::algorithm::iequals(method, "HEAD") ||
+          (status >= 100 && status < 200) ||
+          status == http::status::NoContent ||
+          status == http::status::NotModified;
+}
+
+bool isLargeResponse(const std::string& method, const http::Response& response)
+{
+   return !isBodilessResponse(method, response) &&
+          response.contentLength() > kStreamResponseThreshold;
+}
+
+bool streamProxyResponse(const std::string& method,
+                         const http::Response& response)
+{
+   // the session also streams responses whose length isn't known up front
+   // (these are delimited by closing the connection)
+   if (isBodilessResponse(method, response))
+      return false;
+   return isLargeResponse(method, response) ||
+          response.headerValue("Content-Length").empty();
+}
+
+void handleStreamedProxyResponse(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      std::string username,
+      ProxyMetrics metrics,
+      boost::posix_time::ptime startTime,
+      const http::Response& response,
+      boost::shared_ptr<http::Socket> ptrBodySource)
+{
+   // record how long the session took to start responding
+   observeLatency(metrics, startTime);
+
+   // if there was a launch pending then it's now complete
+   sessionManager().completePendingLaunch(username);
+
+   // write the response
+   ptrConnection->writeStreamedResponse(response, ptrBodySource);
+}
+
 class LocalhostAsyncClient : public http::TcpIpAsyncClient
 {
 public:
@@ -178,6 +271,38 @@ void rewriteLocalhostAddressHeader(const std::string& headerName,
    pResponse->replaceHeader(headerName, address);
 }
 
+const char * const kLocation = "Location";
+const char * const kRefresh = "Refresh";
+
+bool isLocalhostRedirect(const http::Response& response)
+{
+   return !response.headerValue(kLocation).empty() ||
+          !response.headerValue(kRefresh).empty();
+}
+
+void rewriteLocalhostRedirect(const http::Request& originalRequest,
+                              const std::string& port,
+                              http::Response* pResponse)
+{
+   // handle Location
+   if (!pResponse->headerValue(kLocation).empty())
+   {
+      rewriteLocalhostAddressHeader(kLocation,
+                                    originalRequest,
+                                    port,
+                                    pResponse);
+   }
+
+   // handle Refresh
+   if (!pResponse->headerValue(kRefresh).empty())
+   {
+      rewriteLocalhostAddressHeader(kRefresh,
+                                    originalRequest,
+                                    port,
+                                    pResponse);
+   }
+}
+
 void handleLocalhostResponse(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       boost::shared_ptr<LocalhostAsyncClient> ptrLocalhost,
@@ -203,33 +328,14 @@ void handleLocalhostResponse(
    else
    {   
       // re-write location headers if necessary
-      const char * const kLocation = "Location";
-      const char * const kRefresh = "Refresh";
-      std::string location = response.headerValue(kLocation);
-      std::string refresh = response.headerValue(kRefresh);
-      if (!location.empty() || !refresh.empty())
+      if (isLocalhostRedirect(response))
       {
          // make a copy of the response to rewrite the headers into
          http::Response redirectResponse;
          redirectResponse.assign(response);
-
-         // handle Location
-         if (!location.empty())
-         {
-            rewriteLocalhostAddressHeader(kLocation,
-                                          ptrConnection->request(),
-                                          port,
-                                          &redirectResponse);
-         }
-
-         // handle Refresh
-         if (!refresh.empty())
-         {
-            rewriteLocalhostAddressHeader(kRefresh,
-                                          ptrConnection->request(),
-                                          port,
-                                          &redirectResponse);
-         }
+         rewriteLocalhostRedirect(ptrConnection->request(),
+                                  port,
+                                  &redirectResponse);
 
          // write the copy
          ptrConnection->writeResponse(redirectResponse);
@@ -241,6 +347,27 @@ void handleLocalhostResponse(
    }
 }
 
+void handleLocalhostStreamedResponse(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const std::string& port,
+      const http::Response& response,
+      boost::shared_ptr<http::Socket> ptrBodySource)
+{
+   if (isLocalhostRedirect(response))
+   {
+      http::Response redirectResponse;
+      redirectResponse.assign(response);
+      rewriteLocalhostRedirect(ptrConnection->request(),
+                               port,
+                               &redirectResponse);
+      ptrConnection->writeStreamedResponse(redirectResponse, ptrBodySource);
+   }
+   else
+   {
+      ptrConnection->writeStreamedResponse(response, ptrBodySource);
+   }
+}
+
 void handleLocalhostError(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       const Error& error)
@@ -394,16 +521,30 @@ void handleEventsError(
    ptrConnection->writeResponse();
 }
 
+void handleProxyError(const ProxyMetrics& metrics,
+                      const http::ErrorHandler& errorHandler,
+                      const Error& error)
+{
+   metrics.errors.increment();
+   errorHandler(error);
+}
+
 void proxyRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       const http::ErrorHandler& errorHandler,
-      const http::ConnectionRetryProfile& connectionRetryProfile)
+      const http::ConnectionRetryProfile& connectionRetryProfile,
+      const ProxyMetrics& metrics)
 {
    // apply optional proxy filter
    if (applyProxyFilter(username, ptrConnection))
       return;
 
+   // count the request and note when it started
+   metrics.requests.increment();
+   boost::posix_time::ptime startTime =
+                     boost::posix_time::microsec_clock::universal_time();
+
    // create async client
    FilePath streamPath = session::local_streams::streamPath(username);
    boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
@@ -416,10 +557,27 @@ void proxyRequest(
    // assign request
    pClient->request().assign(ptrConnection->request());
 
+   // if the connection has only read part of the body (see
+   // setStreamRequestBodyFilter) then copy the rest as we write the request
+   const http::Request& request = ptrConnection->request();
+   if (request.contentLength() > request.body().size())
+   {
+      pClient->setRequestBodySource(
+                           ptrConnection,
+                           request.contentLength() - request.body().size());
+   }
+
+   // stream large responses through as they arrive
+   pClient->setStreamResponseHandler(
+         boost::bind(streamProxyResponse, request.method(), _1),
+         boost::bind(handleStreamedProxyResponse,
+                     ptrConnection, username, metrics, startTime, _1, _2));
+
    // execute
    pClient->execute(
-         boost::bind(handleProxyResponse, ptrConnection, username, _1),
-         errorHandler);
+         boost::bind(handleProxyResponse,
+                     ptrConnection, username, metrics, startTime, _1),
+         boost::bind(handleProxyError, metrics, errorHandler, _1));
 }
 
 // function used to periodically validate that the user is valid (has an
@@ -456,6 +614,10 @@ bool validateUser(boost::shared_ptr<http::AsyncConnection> ptrConnection,
 
 Error initialize()
 { 
+   s_contentMetrics = proxyMetrics("content");
+   s_rpcMetrics = proxyMetrics("rpc");
+   s_eventsMetrics = proxyMetrics("events");
+
    return session::local_streams::ensureStreamsDir();
 }
 
@@ -486,7 +648,8 @@ void proxyContentRequest(
    proxyRequest(username,
                 ptrConnection,
                 boost::bind(handleContentError, ptrConnection, username, _1),
-                sessionRetryProfile(username));
+                sessionRetryProfile(username),
+                s_contentMetrics);
 }
 
 void proxyRpcRequest(
@@ -504,7 +667,8 @@ void proxyRpcRequest(
    proxyRequest(username,
                 ptrConnection,
                 boost::bind(handleRpcError, ptrConnection, username, _1),
-                sessionRetryProfile(username));
+                sessionRetryProfile(username),
+                s_rpcMetrics);
 }
    
 void proxyEventsRequest(
@@ -518,7 +682,8 @@ void proxyEventsRequest(
    proxyRequest(username,
                 ptrConnection,
                 boost::bind(handleEventsError, ptrConnection, _1),
-                http::ConnectionRetryProfile());
+                http::ConnectionRetryProfile(),
+                s_eventsMetrics);
 }
 
 void proxyLocalhostRequest(
@@ -572,6 +737,13 @@ void proxyLocalhostRequest(
       new LocalhostAsyncClient(ptrConnection->ioService(), "localhost", port));
    pClient->request().assign(request);
 
+   // stream large responses through as they arrive (only those whose
+   // length is known since the server may keep the connection open)
+   pClient->setStreamResponseHandler(
+         boost::bind(isLargeResponse, request.method(), _1),
+         boost::bind(handleLocalhostStreamedResponse,
+                     ptrConnection, port, _1, _2));
+
    // execute request
    pClient->execute(
          boost::bind(handleLocalhostResponse, ptrConnection, pClient, port, _1),
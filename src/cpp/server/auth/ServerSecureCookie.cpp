@@ -17,6 +17,9 @@
 
 #include <sys/stat.h>
 
+#include <map>
+
+#include <boost/format.hpp>
 #include <boost/optional.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -24,6 +27,7 @@
 #include <boost/date_time/gregorian/gregorian.hpp>
 
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
 #include <core/FileSerializer.hpp>
 
 #include <core/http/URL.hpp>
@@ -51,6 +55,85 @@ const char * const kDelim = "|";
 // secure cookie key
 std::string s_secureCookieKey ;
 
+// signed cookie values which we have already verified (along with their
+// decoded value and expiration) so that requests from signed in users
+// don't each require the cookie to be decoded and its HMAC recomputed
+struct VerifiedCookie
+{
+   std::string value;
+   boost::posix_time::ptime expires;
+};
+typedef std::map<std::string,VerifiedCookie> VerifiedCookies;
+VerifiedCookies s_verifiedCookies;
+boost::mutex s_verifiedCookiesMutex;
+const std::size_t kVerifiedCookiesMaxEntries = 1024;
+
+// cache hit rate (logged periodically)
+std::size_t s_verifiedCookieLookups = 0;
+std::size_t s_verifiedCookieHits = 0;
+const std::size_t kVerifiedCookieMetricsInterval = 1000;
+
+bool lookupVerifiedCookie(const std::string& signedCookieValue,
+                          std::string* pValue)
+{
+   using namespace boost::posix_time;
+
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      if ((++s_verifiedCookieLookups % kVerifiedCookieMetricsInterval) == 0)
+      {
+         boost::format fmt("Secure cookie cache: %1% lookups, %2% hits");
+         LOG_DEBUG_MESSAGE(boost::str(fmt %
+                                      s_verifiedCookieLookups %
+                                      s_verifiedCookieHits));
+      }
+
+      VerifiedCookies::iterator it = s_verifiedCookies.find(signedCookieValue);
+      if (it != s_verifiedCookies.end())
+      {
+         if (it->second.expires > second_clock::universal_time())
+         {
+            s_verifiedCookieHits++;
+            *pValue = it->second.value;
+            return true;
+         }
+
+         // expired (verify again so it is handled as before)
+         s_verifiedCookies.erase(it);
+      }
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void addVerifiedCookie(const std::string& signedCookieValue,
+                       const std::string& value,
+                       const boost::posix_time::ptime& expires)
+{
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      // keep the cache bounded
+      if (s_verifiedCookies.size() >= kVerifiedCookiesMaxEntries)
+         s_verifiedCookies.clear();
+
+      VerifiedCookie verified;
+      verified.value = value;
+      verified.expires = expires;
+      s_verifiedCookies[signedCookieValue] = verified;
+   }
+   END_LOCK_MUTEX
+}
+
+void removeVerifiedCookie(const std::string& signedCookieValue)
+{
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      s_verifiedCookies.erase(signedCookieValue);
+   }
+   END_LOCK_MUTEX
+}
+
 
 Error base64HMAC(const std::string& value,
                  const std::string& expires,
@@ -124,6 +207,11 @@ std::string readSecureCookie(const core::http::Request& request,
    if (signedCookieValue.empty())
       return std::string();
 
+   // check whether we've already verified this cookie
+   std::string verifiedValue;
+   if (lookupVerifiedCookie(signedCookieValue, &verifiedValue))
+      return verifiedValue;
+
    // split it into its parts (url decode them as well)
    std::string value, expires, hmac;
    using namespace boost;
@@ -174,6 +262,9 @@ std::string readSecureCookie(const core::http::Request& request,
    else if (expiresTime <= second_clock::universal_time())
       return std::string();
 
+   // remember that we've verified it
+   addVerifiedCookie(signedCookieValue, value, expiresTime);
+
    // ok to return the value
    return value;
 }
@@ -222,6 +313,11 @@ void remove(const http::Request& request,
             const std::string& path,
             core::http::Response* pResponse)
 {
+   // forget that we verified the cookie being removed
+   std::string signedCookieValue = request.cookieValue(name);
+   if (!signedCookieValue.empty())
+      removeVerifiedCookie(signedCookieValue);
+
    // create vanilla cookie (no need for secure cookie since we are removing)
    http::Cookie cookie(request, name, std::string(), path);
 
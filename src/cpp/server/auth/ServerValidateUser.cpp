@@ -15,9 +15,15 @@
 
 #include <server/auth/ServerValidateUser.hpp>
 
+#include <map>
+
+#include <boost/format.hpp>
+
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/DateTime.hpp>
 
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
@@ -30,14 +36,142 @@ namespace rstudio {
 namespace server {
 namespace auth {
 
-bool validateUser(const std::string& username,
-                  const std::string& requiredGroup,
-                  bool groupFailureWarning)
+namespace {
+
+// successful validations are cached so that requests from signed in users
+// don't each require directory (NSS) lookups, which can be slow when
+// users come from LDAP. failures aren't cached so that newly added users
+// and group members are recognized immediately
+const double kValidationCacheMs = 60 * 1000;
+const std::size_t kValidationCacheMaxEntries = 1024;
+
+// log cache metrics after this many validations
+const std::size_t kValidationMetricsInterval = 1000;
+
+class ValidationCache : boost::noncopyable
+{
+public:
+   ValidationCache()
+      : lookups_(0), hits_(0), nssLookups_(0), nssMs_(0)
+   {
+   }
+
+   bool lookup(const std::string& username, const std::string& requiredGroup)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if ((++lookups_ % kValidationMetricsInterval) == 0)
+            logMetrics();
+
+         Entries::iterator it = entries_.find(key(username, requiredGroup));
+         if (it != entries_.end())
+         {
+            if (date_time::millisecondsSinceEpoch() < it->second)
+            {
+               hits_++;
+               return true;
+            }
+            entries_.erase(it);
+         }
+      }
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+   void add(const std::string& username, const std::string& requiredGroup)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         double now = date_time::millisecondsSinceEpoch();
+
+         // keep the cache bounded (drop expired entries, then everything)
+         if (entries_.size() >= kValidationCacheMaxEntries)
+         {
+            for (Entries::iterator it = entries_.begin(); it != entries_.end(); )
+            {
+               if (it->second <= now)
+                  entries_.erase(it++);
+               else
+                  ++it;
+            }
+
+            if (entries_.size() >= kValidationCacheMaxEntries)
+               entries_.clear();
+         }
+
+         entries_[key(username, requiredGroup)] = now + kValidationCacheMs;
+      }
+      END_LOCK_MUTEX
+   }
+
+   void remove(const std::string& username)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         for (Entries::iterator it = entries_.begin(); it != entries_.end(); )
+         {
+            if (it->first.first == username)
+               entries_.erase(it++);
+            else
+               ++it;
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   void recordLookup(double elapsedMs)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         nssLookups_++;
+         nssMs_ += elapsedMs;
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   void logMetrics()
+   {
+      boost::format fmt("User validation cache: %1% validations, "
+                        "%2% cache hits, %3% directory lookups "
+                        "(%4% ms average)");
+      LOG_DEBUG_MESSAGE(boost::str(fmt %
+                                   lookups_ %
+                                   hits_ %
+                                   nssLookups_ %
+                                   (nssLookups_ > 0 ? nssMs_ / nssLookups_ : 0)));
+   }
+
+
+   typedef std::pair<std::string,std::string> Key;
+   static Key key(const std::string& username, const std::string& group)
+   {
+      return std::make_pair(username, group);
+   }
+
+   // expiration time (ms since epoch) of each validated user/group
+   typedef std::map<Key,double> Entries;
+   Entries entries_;
+
+   std::size_t lookups_;
+   std::size_t hits_;
+   std::size_t nssLookups_;
+   double nssMs_;
+
+   boost::mutex mutex_;
+};
+
+ValidationCache& validationCache()
+{
+   static ValidationCache instance;
+   return instance;
+}
+
+bool lookupUser(const std::string& username,
+                const std::string& requiredGroup,
+                bool groupFailureWarning)
 {
-   // short circuit if we aren't validating users
-   if (!server::options().authValidateUsers())
-      return true;
-   
    // get the user
    core::system::user::User user;
    Error error = userFromUsername(username, &user);
@@ -87,6 +221,36 @@ bool validateUser(const std::string& username,
    }
 }
 
+} // anonymous namespace
+
+bool validateUser(const std::string& username,
+                  const std::string& requiredGroup,
+                  bool groupFailureWarning)
+{
+   // short circuit if we aren't validating users
+   if (!server::options().authValidateUsers())
+      return true;
+
+   // check for a recent successful validation
+   if (validationCache().lookup(username, requiredGroup))
+      return true;
+
+   // perform the lookup (timed for cache metrics)
+   double startMs = date_time::millisecondsSinceEpoch();
+   bool valid = lookupUser(username, requiredGroup, groupFailureWarning);
+   validationCache().recordLookup(date_time::millisecondsSinceEpoch() - startMs);
+
+   if (valid)
+      validationCache().add(username, requiredGroup);
+
+   return valid;
+}
+
+void invalidateValidatedUser(const std::string& username)
+{
+   validationCache().remove(username);
+}
+
 } // namespace auth
 } // namespace server
 } // namespace rstudio
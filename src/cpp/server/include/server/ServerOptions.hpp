@@ -124,6 +124,11 @@ public:
       return wwwProxyLocalhost_;
    }
 
+   std::string wwwMetricsPort() const
+   {
+      return std::string(wwwMetricsPort_.c_str());
+   }
+
    // auth
    bool authNone()
    {
@@ -176,6 +181,16 @@ public:
       return std::string(rsessionConfigFile_.c_str()); 
    }
 
+   std::string rsessionSharedLibraries() const
+   {
+      return std::string(rsessionSharedLibraries_.c_str());
+   }
+
+   int rsessionPoolSize() const
+   {
+      return rsessionPoolSize_;
+   }
+
    std::string monitorSharedSecret() const
    {
       return std::string(monitorSharedSecret_.c_str());
@@ -238,6 +253,7 @@ private:
    bool wwwUseEmulatedStack_;
    int wwwThreadPoolSize_;
    bool wwwProxyLocalhost_;
+   std::string wwwMetricsPort_;
    bool authNone_;
    bool authValidateUsers_;
    bool authEncryptPassword_;
@@ -248,6 +264,8 @@ private:
    std::string rldpathPath_;
    std::string rsessionConfigFile_;
    std::string rsessionLdLibraryPath_;
+   std::string rsessionSharedLibraries_;
+   int rsessionPoolSize_;
    std::string monitorSharedSecret_;
    int monitorIntervalSeconds_;
    std::map<std::string,std::string> overlayOptions_;
@@ -19,6 +19,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
 
 #include <boost/signals.hpp>
 
@@ -58,6 +59,18 @@ public:
    core::Error launchSession(const std::string& username);
    void removePendingLaunch(const std::string& username);
 
+   // notification that a launched session has responded (records the
+   // latency of the launch and then removes it)
+   void completePendingLaunch(const std::string& username);
+
+   // summary of launch latencies (pooled and otherwise) observed so far
+   std::string launchLatencySummary();
+
+   // launch sessions ahead of time which wait to be assigned to users
+   // (only applicable when sessions are launched in the default manner
+   // and the server is running as root; see --rsession-pool-size)
+   core::Error startSessionPool();
+
    // set a custom session launcher
    typedef boost::function<core::Error(
                            const core::r_util::SessionLaunchProfile&)>
@@ -79,14 +92,43 @@ private:
    core::Error launchAndTrackSession(
                         const core::r_util::SessionLaunchProfile& profile);
 
+   // session pool
+   bool canUseSessionPool();
+   bool assignPooledSession(const std::string& username);
+   core::Error launchPooledSession();
+   void onPooledSessionExit(PidType pid);
+
 private:
    // pending launches
    boost::mutex launchesMutex_;
-   typedef std::map<std::string,boost::posix_time::ptime> LaunchMap;
+   struct PendingLaunch
+   {
+      PendingLaunch() : pooled(false) {}
+      boost::posix_time::ptime time;
+      bool pooled;
+   };
+   typedef std::map<std::string,PendingLaunch> LaunchMap;
    LaunchMap pendingLaunches_;
 
+   // launch latency histograms (counts per latency bucket)
+   std::vector<std::size_t> pooledLaunchLatencies_;
+   std::vector<std::size_t> launchLatencies_;
+   std::size_t completedLaunches_;
+
    // session launch function
    SessionLaunchFunction sessionLaunchFunction_;
+   bool customSessionLaunchFunction_;
+
+   // pooled sessions awaiting assignment (each reads the name of its user
+   // from the write end of a pipe we hold)
+   struct PooledSession
+   {
+      PidType pid;
+      int assignFd;
+      boost::posix_time::ptime launchTime;
+   };
+   boost::mutex poolMutex_;
+   std::deque<PooledSession> pooledSessions_;
 
    // session launch profile filters
    std::vector<SessionLaunchProfileFilter> sessionLaunchProfileFilters_;
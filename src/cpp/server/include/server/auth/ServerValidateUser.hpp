@@ -36,6 +36,10 @@ inline bool validateUser(const std::string& username)
                        true);
 }
 
+// successful validations are cached briefly, call this to discard them
+// for a user (e.g. when they sign in or out)
+void invalidateValidatedUser(const std::string& username);
+
 
 } // namespace auth
 } // namespace server
@@ -91,6 +91,18 @@ bool ClientEventQueue::hasEvents()
    // keep compiler happy
    return false ;
 }
+
+std::size_t ClientEventQueue::size()
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      return pendingEvents_.size() + (pendingConsoleOutput_.empty() ? 0 : 1);
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
   
 void ClientEventQueue::remove(std::vector<ClientEvent>* pEvents)
 {
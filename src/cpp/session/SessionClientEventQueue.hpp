@@ -54,6 +54,9 @@ public:
    
    // are there any events pending?
    bool hasEvents();
+
+   // how many events are pending? (pending console output counts as one)
+   std::size_t size();
    
    // clear the event queue
    void clear();
@@ -24,6 +24,7 @@
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/system/System.hpp>
 
 
@@ -320,6 +321,8 @@ void ClientEventService::run()
          // events on the next iteration of the accept loop
          if (request.clientId == clientId())
          {
+            core::trace::Span span("events", "batch");
+
             // deque the events
             std::vector<ClientEvent> events;
             clientEventQueue.remove(&events);
@@ -44,7 +44,9 @@
 #include <core/Exec.hpp>
 #include <core/Scope.hpp>
 #include <core/Settings.hpp>
+#include <core/TaskScheduler.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/Log.hpp>
 #include <core/LogWriter.hpp>
 #include <core/system/System.hpp>
@@ -61,10 +63,20 @@
 #include <core/system/Crypto.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/Environment.hpp>
+#include <core/system/ProcessArgs.hpp>
 #include <core/system/ParentProcessMonitor.hpp>
 #include <core/system/FileMonitor.hpp>
 #include <core/text/TemplateFilter.hpp>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <core/system/PosixSystem.hpp>
+#include <core/system/PosixUser.hpp>
+#endif
+
 #include <r/RJsonRpc.hpp>
 #include <r/RExec.hpp>
 #include <r/ROptions.hpp>
@@ -117,6 +129,8 @@ extern "C" const char *locale2charset(const char *);
 #include "modules/SessionPackages.hpp"
 #include "modules/SessionPackrat.hpp"
 #include "modules/SessionProfiler.hpp"
+#include "modules/SessionTrace.hpp"
+#include "modules/SessionMetrics.hpp"
 #include "modules/SessionRCompletions.hpp"
 #include "modules/SessionRPubs.hpp"
 #include "modules/SessionRHooks.hpp"
@@ -745,6 +759,8 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
                       boost::shared_ptr<HttpConnection> ptrConnection,
                       ConnectionType connectionType)
 {
+   core::trace::Span span("rpc", request.method);
+
    // record the time just prior to execution of the event
    // (so we can determine if any events were added during execution)
    using namespace boost::posix_time; 
@@ -861,11 +877,77 @@ bool parseAndValidateJsonRpcConnection(
    return true;
 }
 
+// streamed responses are written by a pool of threads of their own (they
+// are written at the pace of the client so they'd otherwise tie up the
+// threads of the background pool)
+const int kStreamResponseThreads = 4;
+
+core::tasks::ThreadPool& streamResponsePool()
+{
+   static core::tasks::ThreadPool* pPool =
+                     new core::tasks::ThreadPool(kStreamResponseThreads);
+   return *pPool;
+}
+
+// yields the chunk which was read ahead and then the rest of the source
+Error nextStreamChunk(boost::shared_ptr<std::string> pFirstChunk,
+                      const http::Response::StreamBodySource& source,
+                      std::string* pChunk)
+{
+   if (!pFirstChunk->empty())
+   {
+      pChunk->swap(*pFirstChunk);
+      pFirstChunk->clear();
+      return Success();
+   }
+   return source(pChunk);
+}
+
+void sendStreamResponse(boost::shared_ptr<HttpConnection> ptrConnection,
+                        boost::shared_ptr<http::Response> pResponse)
+{
+   // read the first chunk before sending the headers so that a failure to
+   // produce any of the body is reported as an error response (failures
+   // after that abort the connection)
+   http::Response::StreamBodySource source = pResponse->streamBody();
+   boost::shared_ptr<std::string> pFirstChunk(new std::string());
+   Error error = source(pFirstChunk.get());
+   if (error)
+   {
+      error.addProperty("request-uri", ptrConnection->request().uri());
+      LOG_ERROR(error);
+      http::Response errorResponse;
+      errorResponse.setError(error);
+      ptrConnection->sendResponse(errorResponse);
+      return;
+   }
+
+   pResponse->setStreamBody(boost::bind(nextStreamChunk,
+                                        pFirstChunk,
+                                        source,
+                                        _1));
+   ptrConnection->sendResponse(*pResponse);
+}
+
 void endHandleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                          ConnectionType connectionType,
                          http::Response* pResponse)
 {
-   ptrConnection->sendResponse(*pResponse);
+   // streamed responses can be arbitrarily large (and are written at the
+   // pace of the client) so write them in the background
+   if (pResponse->streamBody())
+   {
+      boost::shared_ptr<http::Response> pStreamResponse(new http::Response());
+      pStreamResponse->assign(*pResponse);
+      streamResponsePool().post(boost::bind(sendStreamResponse,
+                                            ptrConnection,
+                                            pStreamResponse));
+   }
+   else
+   {
+      ptrConnection->sendResponse(*pResponse);
+   }
+
    if (!s_rProcessingInput)
       detectChanges(module_context::ChangeSourceURI);
 }
@@ -876,6 +958,11 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
    // check for a uri handler registered by a module
    const http::Request& request = ptrConnection->request();
    std::string uri = request.uri();
+
+   // trace and count by the uri's first path component (e.g. /rpc or /help)
+   std::string uriClass = uri.substr(0, uri.find_first_of("/?", 1));
+   core::trace::Span span("http", uriClass);
+   modules::metrics::recordRequest(uriClass);
    http::UriAsyncHandlerFunction uriHandler = s_uriHandlers.handlerFor(uri);
 
    if (uriHandler) // uri handler
@@ -1640,6 +1727,8 @@ Error rInit(const rstudio::r::session::RInitInfo& rInitInfo)
       (modules::plots::initialize)
       (modules::packages::initialize)
       (modules::profiler::initialize)
+      (modules::trace::initialize)
+      (modules::metrics::initialize)
       (modules::viewer::initialize)
       (modules::rmarkdown::initialize)
       (modules::rpubs::initialize)
@@ -2894,6 +2983,110 @@ bool ensureUtf8Charset()
 #endif
 }
 
+#ifndef _WIN32
+
+// read R's default packages so they're in the page cache by the time
+// the session starts R
+void preloadRPackages()
+{
+   FilePath rHomePath(core::system::getenv("R_HOME"));
+   if (rHomePath.empty())
+      return;
+
+   const char* packages[] = { "base", "methods", "utils", "grDevices",
+                              "graphics", "stats" };
+   std::vector<char> buffer(64 * 1024);
+   for (std::size_t i = 0; i < sizeof(packages)/sizeof(char*); i++)
+   {
+      std::string package(packages[i]);
+      FilePath dbPath = rHomePath.childPath(
+                           "library/" + package + "/R/" + package + ".rdb");
+      int fd = ::open(dbPath.absolutePath().c_str(), O_RDONLY);
+      if (fd == -1)
+         continue;
+      while (::read(fd, &buffer[0], buffer.size()) > 0)
+      {
+      }
+      ::close(fd);
+   }
+}
+
+// sessions pre-launched into rserver's session pool start as root and wait
+// for rserver to write the name of the user they've been assigned to on
+// standard input. they then assume that user's identity and carry on with
+// startup exactly as if they had been launched for the user. an empty
+// username indicates that the pool was shut down before assignment
+Error waitForPoolAssignment(std::string* pUsername)
+{
+   core::system::unsetenv(kRStudioSessionPoolMember);
+
+   preloadRPackages();
+
+   // read the username
+   std::string username;
+   while (true)
+   {
+      char ch;
+      ssize_t bytesRead = ::read(STDIN_FILENO, &ch, 1);
+      if (bytesRead == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return systemError(errno, ERROR_LOCATION);
+      }
+      else if (bytesRead == 0)
+      {
+         return Success();
+      }
+      else if (ch == '\n')
+      {
+         break;
+      }
+      username.push_back(ch);
+   }
+
+   // detach standard input from rserver
+   int fdNull = ::open("/dev/null", O_RDONLY);
+   if (fdNull != -1)
+   {
+      ::dup2(fdNull, STDIN_FILENO);
+      ::close(fdNull);
+   }
+
+   // assume the identity of the user (never root)
+   core::system::user::User user;
+   Error error = core::system::user::userFromUsername(username, &user);
+   if (error)
+      return error;
+   if (user.userId == 0)
+   {
+      error = systemError(boost::system::errc::permission_denied,
+                          ERROR_LOCATION);
+      error.addProperty("user", username);
+      return error;
+   }
+
+   error = core::system::permanentlyDropPriv(username);
+   if (error)
+      return error;
+
+#ifdef __linux__
+   // a process which drops privilege after exec is made non-dumpable (no
+   // ptrace, no core dumps, and a root owned /proc/<pid>). sessions which
+   // are launched directly drop privilege before exec, so restore that
+   if (::prctl(PR_SET_DUMPABLE, 1) == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+#endif
+
+   core::system::setenv("USER", user.username);
+   core::system::setenv("LOGNAME", user.username);
+   core::system::setenv("HOME", user.homeDirectory);
+
+   *pUsername = username;
+   return Success();
+}
+
+#endif
 
 } // anonymous namespace
 
@@ -2902,6 +3095,32 @@ int main (int argc, char * const argv[])
 { 
    try
    {      
+      // sessions pre-launched into rserver's session pool wait until
+      // they are assigned to a user (identifying them on the command line)
+      std::vector<std::string> args(argv, argv + argc);
+#ifndef _WIN32
+      if (!core::system::getenv(kRStudioSessionPoolMember).empty())
+      {
+         std::string username;
+         Error error = waitForPoolAssignment(&username);
+         if (error)
+         {
+            initializeSystemLog("rsession-pool",
+                                core::system::kLogLevelWarning);
+            LOG_ERROR(error);
+            return EXIT_FAILURE;
+         }
+         else if (username.empty())
+         {
+            return EXIT_SUCCESS;
+         }
+
+         args.push_back("-" kUserIdentitySessionOptionShort);
+         args.push_back(username);
+      }
+#endif
+      core::system::ProcessArgs sessionArgs(args);
+
       // initialize log so we capture all errors including ones which occur
       // reading the config file (if we are in desktop mode then the log
       // will get re-initialized below)
@@ -2923,7 +3142,8 @@ int main (int argc, char * const argv[])
       
       // read program options
       Options& options = rsession::options();
-      ProgramStatus status = options.read(argc, argv) ;
+      ProgramStatus status = options.read(sessionArgs.argCount(),
+                                          sessionArgs.args());
       if (status.exit())
          return status.exitCode() ;
 
@@ -3119,6 +3339,8 @@ int main (int argc, char * const argv[])
       rOptions.saveWorkspace = saveWorkspaceOption();
       rOptions.rProfileOnResume = serverMode &&
                                   userSettings().rProfileOnResume();
+      rOptions.snapshotThreads = options.snapshotThreads();
+      rOptions.lazyRestoreSize = options.lazyRestoreSize();
       
       // r callbacks
       rstudio::r::session::RCallbacks rCallbacks;
@@ -35,6 +35,8 @@
 #include <core/system/FileScanner.hpp>
 #include <core/IncrementalCommand.hpp>
 #include <core/PeriodicCommand.hpp>
+#include <core/TaskScheduler.hpp>
+#include <core/Trace.hpp>
 #include <core/collection/Tree.hpp>
 
 #include <core/http/Util.hpp>
@@ -526,6 +528,12 @@ void addScheduledCommand(boost::shared_ptr<ScheduledCommand> pCommand,
       s_scheduledCommands.push_back(pCommand);
 }
 
+bool executeTracedWork(const boost::function<bool()>& execute)
+{
+   core::trace::Span span("work", "incremental");
+   return execute();
+}
+
 void executeScheduledCommands(ScheduledCommands* pCommands)
 {
    // make a copy of scheduled commands before executing them
@@ -559,7 +567,8 @@ void scheduleIncrementalWork(
 {
    addScheduledCommand(boost::shared_ptr<ScheduledCommand>(
                            new IncrementalCommand(incrementalDuration,
-                                                  execute)),
+                                                  boost::bind(executeTracedWork,
+                                                              execute))),
                          idleOnly);
 }
 
@@ -572,7 +581,8 @@ void scheduleIncrementalWork(
    addScheduledCommand(boost::shared_ptr<ScheduledCommand>(
                            new IncrementalCommand(initialDuration,
                                                   incrementalDuration,
-                                                  execute)),
+                                                  boost::bind(executeTracedWork,
+                                                              execute))),
                            idleOnly);
 }
 
@@ -626,6 +636,9 @@ void onBackgroundProcessing(bool isIdle)
    // check for file monitor changes
    core::system::file_monitor::checkForChanges();
 
+   // run continuations posted back to the main thread by background tasks
+   core::tasks::mainThreadExecutor().runPending();
+
    // fire event
    events().onBackgroundProcessing(isIdle);
 
@@ -1323,7 +1336,8 @@ void enqueFileChangedEvent(const core::system::FileChangeEvent &event)
 
    using namespace session::modules::source_control;
    boost::shared_ptr<FileDecorationContext> pCtx =
-                                       fileDecorationContext(filePath);
+               fileDecorationContext(filePath,
+                                     std::vector<FilePath>(1, filePath));
 
    enqueFileChangedEvent(event, pCtx);
 }
@@ -1338,19 +1352,20 @@ void enqueFileChangedEvents(const core::FilePath& vcsStatusRoot,
 
    // try to find the common parent of the events
    FilePath commonParentPath = FilePath(events.front().fileInfo().absolutePath()).parent();
+   std::vector<FilePath> changedFiles;
    BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
    {
+      FilePath filePath(event.fileInfo().absolutePath());
+      changedFiles.push_back(filePath);
+
       // if not within the common parent then revert to the vcs status root
-      if (!FilePath(event.fileInfo().absolutePath()).isWithin(commonParentPath))
-      {
+      if (!filePath.isWithin(commonParentPath))
          commonParentPath = vcsStatusRoot;
-         break;
-      }
    }
 
    using namespace session::modules::source_control;
    boost::shared_ptr<FileDecorationContext> pCtx =
-                                  fileDecorationContext(commonParentPath);
+                   fileDecorationContext(commonParentPath, changedFiles);
 
    // fire client events as necessary
    BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
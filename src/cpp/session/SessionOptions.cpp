@@ -170,6 +170,14 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
       ("session-save-action-default",
        value<std::string>(&saveActionDefault)->default_value(""),
          "default save action (yes, no, or ask)")
+      ("session-snapshot-threads",
+       value<int>(&snapshotThreads_)->default_value(0),
+         "threads used to compress environments saved when suspending "
+         "(0 to save them in R's format)")
+      ("session-lazy-restore-size",
+       value<int>(&lazyRestoreSize_)->default_value(0),
+         "size (in MB) of objects which are restored lazily when resuming "
+         "(0 to restore all objects when resuming)")
       ("show-help-home",
        value<bool>(&showHelpHome_)->default_value(false),
          "show help home page at startup");
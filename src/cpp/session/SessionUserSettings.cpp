@@ -113,6 +113,14 @@ Error UserSettings::initialize()
    if (error)
       return error;
 
+   // changes made in quick succession are written together (changes
+   // deferred this way are written by the periodic flush below)
+   settings_.setWriteDelay(boost::posix_time::seconds(1));
+   module_context::schedulePeriodicWork(
+            boost::posix_time::seconds(1),
+            boost::bind(&UserSettings::flushSettings, this),
+            false);
+
    // make sure we have a context id
    if (contextId().empty())
       setContextId(core::system::generateShortenedUuid());
@@ -120,6 +128,12 @@ Error UserSettings::initialize()
    return Success();
 }
 
+bool UserSettings::flushSettings()
+{
+   settings_.flush();
+   return true;
+}
+
 void UserSettings::onSettingsFileChanged(
                      const core::system::FileChangeEvent& changeEvent)
 {
@@ -131,6 +145,8 @@ void UserSettings::onSettingsFileChanged(
    }
 
    // re-read the settings from disk
+   uint64_t generation = settings_.generation();
+   uint64_t uiPrefsGeneration = settings_.generation(kUiPrefs);
    Error error = settings_.initialize(settingsFilePath_);
    if (error)
    {
@@ -138,8 +154,14 @@ void UserSettings::onSettingsFileChanged(
       return;
    }
 
-   // update prefs cache
-   updatePrefsCache(uiPrefs());
+   // nothing to do if the file didn't change any settings (e.g. when the
+   // change was our own write)
+   if (settings_.generation() == generation)
+      return;
+
+   // update prefs cache (if they changed)
+   if (settings_.generation(kUiPrefs) != uiPrefsGeneration)
+      updatePrefsCache(uiPrefs());
 
    // set underlying R repos options
    std::string cranMirrorURL = cranMirror().url;
@@ -37,6 +37,7 @@
 #include <core/json/JsonRpc.hpp>
 
 #include <session/SessionHttpConnection.hpp>
+#include <session/SessionOptions.hpp>
 
 #include "SessionHttpConnectionUtils.hpp"
 
@@ -59,6 +60,8 @@ public:
                       const Handler& handler)
       : socket_(ioService), handler_(handler)
    {
+      // write uploaded files to disk as they are received
+      requestParser_.setFormUploadPath(connection::uploadsPath());
    }
 
    virtual ~HttpConnectionImpl()
@@ -71,6 +74,15 @@ public:
       catch(...)
       {
       }
+
+      // remove uploaded files the handler didn't keep
+      try
+      {
+         connection::removeUploads(request_);
+      }
+      catch(...)
+      {
+      }
    }
 
 public:
@@ -86,6 +98,28 @@ public:
          boost::asio::write(socket_,
                             response.toBuffers(
                                   core::http::Header::connectionClose()));
+
+         // write the streamed body (if any)
+         if (response.streamBody())
+         {
+            std::string chunk;
+            while (true)
+            {
+               core::Error error = response.streamBody()(&chunk);
+               if (error)
+               {
+                  error.addProperty("request-uri", request_.uri());
+                  LOG_ERROR(error);
+                  abort();
+                  break;
+               }
+
+               if (chunk.empty())
+                  break;
+
+               boost::asio::write(socket_, boost::asio::buffer(chunk));
+            }
+         }
       }
       catch(const boost::system::system_error& e)
       {
@@ -117,6 +151,18 @@ public:
          LOG_ERROR(error);
    }
 
+   // close the connection without completing the response (so that the
+   // client sees the response fail rather than end early). lingering is
+   // disabled so that a TCP connection is reset rather than shut down
+   void abort()
+   {
+      boost::system::error_code ec;
+      socket_.set_option(boost::asio::socket_base::linger(true, 0), ec);
+      socket_.close(ec);
+      if (ec)
+         LOG_ERROR(core::Error(ec, ERROR_LOCATION));
+   }
+
    // other useful introspection methods
    virtual std::string requestId() const { return requestId_; }
 
@@ -23,6 +23,7 @@
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
 
 
 #include <core/http/Response.hpp>
@@ -164,7 +165,7 @@ bool checkForAbort(boost::shared_ptr<HttpConnection> ptrConnection,
       }
 
       // abort
-      ::abort();
+      core::system::abort();
       return true;
    }
    else
@@ -231,6 +232,63 @@ bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
    return secret == ptrConnection->request().headerValue("X-Shared-Secret");
 }
 
+core::FilePath uploadsPath()
+{
+   return session::options().userScratchPath().complete("uploads");
+}
+
+void removeUploads(const core::http::Request& request)
+{
+   using namespace rstudio::core;
+
+   FilePath uploadsDir = uploadsPath();
+   const http::Files& files = request.uploadedFiles();
+   for (http::Files::const_iterator it = files.begin(); it != files.end(); ++it)
+   {
+      const FilePath& contentsPath = it->second.contentsPath;
+      if (!contentsPath.empty() && contentsPath.isWithin(uploadsDir))
+      {
+         Error error = contentsPath.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+}
+
+void removeStaleUploads()
+{
+   using namespace rstudio::core;
+
+   // (the directory is shared by the user's sessions so only files which
+   // are too old to belong to a request in progress are removed)
+   const std::time_t kStaleSeconds = 24 * 60 * 60;
+
+   FilePath uploadsDir = uploadsPath();
+   if (!uploadsDir.exists())
+      return;
+
+   std::vector<FilePath> children;
+   Error error = uploadsDir.children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::time_t now = std::time(NULL);
+   for (std::vector<FilePath>::const_iterator it = children.begin();
+        it != children.end();
+        ++it)
+   {
+      if (now - it->lastWriteTime() > kStaleSeconds)
+      {
+         error = it->removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+}
+
 } // namespace connection
 } // namespace session
 } // namespace rstudio
@@ -24,6 +24,7 @@
 
 namespace rstudio {
 namespace core {
+   class FilePath;
 namespace http {
    class Request;
 }
@@ -53,6 +54,16 @@ bool checkForSuspend(boost::shared_ptr<HttpConnection> ptrConnection);
 bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
                   const std::string& secret);
 
+// directory uploaded files are written to as they are received (handlers
+// which keep an upload must move it out before the connection is destroyed)
+core::FilePath uploadsPath();
+
+// remove the files of a request which are still in the uploads directory
+void removeUploads(const core::http::Request& request);
+
+// remove uploads left behind by sessions which exited while handling them
+void removeStaleUploads();
+
 
 } // namespace connection
 } // namespace session
@@ -160,30 +160,31 @@ public:
                                         core::http::Header::connectionClose());
 
       // write them
-      DWORD bytesWritten;
-      for (std::size_t i=0; i<buffers.size(); i++)
-      {
-         DWORD bytesToWrite = boost::asio::buffer_size(buffers[i]);
-         BOOL success = ::WriteFile(
-                  hPipe_,
-                  boost::asio::buffer_cast<const unsigned char*>(buffers[i]),
-                  bytesToWrite,
-                  &bytesWritten,
-                  NULL);
+      if (!writeBuffers(buffers))
+         return;
 
-         if (!success || (bytesWritten != bytesToWrite))
+      // write the streamed body (if any)
+      if (response.streamBody())
+      {
+         std::string chunk;
+         while (true)
          {
-            // establish error
-            Error error = systemError(::GetLastError(), ERROR_LOCATION);
-            error.addProperty("request-uri", request_.uri());
-
-            // log the error if it wasn't connection terminated
-            if (!core::http::isConnectionTerminatedError(error))
+            Error error = response.streamBody()(&chunk);
+            if (error)
+            {
+               error.addProperty("request-uri", request_.uri());
                LOG_ERROR(error);
+               close();
+               break;
+            }
 
-            // close and terminate
-            close();
-            break;
+            if (chunk.empty())
+               break;
+
+            buffers.clear();
+            buffers.push_back(boost::asio::buffer(chunk));
+            if (!writeBuffers(buffers))
+               break;
          }
       }
    }
@@ -211,6 +212,40 @@ public:
    virtual std::string requestId() const { return requestId_; }
 
 
+private:
+
+   bool writeBuffers(const std::vector<boost::asio::const_buffer>& buffers)
+   {
+      DWORD bytesWritten;
+      for (std::size_t i=0; i<buffers.size(); i++)
+      {
+         DWORD bytesToWrite = boost::asio::buffer_size(buffers[i]);
+         BOOL success = ::WriteFile(
+                  hPipe_,
+                  boost::asio::buffer_cast<const unsigned char*>(buffers[i]),
+                  bytesToWrite,
+                  &bytesWritten,
+                  NULL);
+
+         if (!success || (bytesWritten != bytesToWrite))
+         {
+            // establish error
+            Error error = systemError(::GetLastError(), ERROR_LOCATION);
+            error.addProperty("request-uri", request_.uri());
+
+            // log the error if it wasn't connection terminated
+            if (!core::http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+
+            // close and terminate
+            close();
+            return false;
+         }
+      }
+
+      return true;
+   }
+
 private:
    HANDLE hPipe_;
    core::http::Request request_;
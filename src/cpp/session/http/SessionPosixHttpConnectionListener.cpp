@@ -22,6 +22,7 @@
 #include <session/SessionOptions.hpp>
 #include <session/SessionLocalStreams.hpp>
 
+#include "SessionHttpConnectionUtils.hpp"
 #include "SessionTcpIpHttpConnectionListener.hpp"
 #include "SessionLocalStreamHttpConnectionListener.hpp"
 
@@ -43,6 +44,9 @@ void initializeHttpConnectionListener()
    // alias options
    session::Options& options = session::options();
 
+   // remove uploads left behind by previous sessions
+   connection::removeStaleUploads();
+
    if (options.programMode() == kSessionProgramModeDesktop)
    {
       std::string localPeer = core::system::getenv("RS_LOCAL_PEER");
@@ -22,6 +22,7 @@
 
 #include <core/system/System.hpp>
 
+#include "SessionHttpConnectionUtils.hpp"
 #include "SessionNamedPipeHttpConnectionListener.hpp"
 
 using namespace rstudio::core ;
@@ -40,6 +41,10 @@ HttpConnectionListener* s_pHttpConnectionListener = NULL ;
 void initializeHttpConnectionListener()
 {
    session::Options& options = session::options();
+
+   // remove uploads left behind by previous sessions
+   connection::removeStaleUploads();
+
    std::string pipeName = core::system::getenv("RS_LOCAL_PEER");
    std::string secret = options.sharedSecret();
    s_pHttpConnectionListener = new NamedPipeHttpConnectionListener(pipeName,
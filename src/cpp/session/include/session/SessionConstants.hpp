@@ -20,6 +20,7 @@
 
 #define kRStudioUserIdentity              "RSTUDIO_USER_IDENTITY"
 #define kRStudioLimitRpcClientUid         "RSTUDIO_LIMIT_RPC_CLIENT_UID"
+#define kRStudioSessionPoolMember         "RSTUDIO_SESSION_POOL_MEMBER"
 #define kRSessionPortNumber               "RSTUDIO_SESSION_PORT"
 #define kRSessionStandalonePortNumber     "RSTUDIO_STANDALONE_PORT"
 
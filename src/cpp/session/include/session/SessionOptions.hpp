@@ -150,6 +150,10 @@ public:
 
    int saveActionDefault() const { return saveActionDefault_; }
 
+   int snapshotThreads() const { return snapshotThreads_; }
+
+   int lazyRestoreSize() const { return lazyRestoreSize_; }
+
    unsigned int minimumUserId() const { return 100; }
 
    bool showHelpHome() const { return showHelpHome_; }
@@ -460,6 +464,8 @@ private:
    bool createPublicFolder_;
    bool rProfileOnResumeDefault_;
    int saveActionDefault_;
+   int snapshotThreads_;
+   int lazyRestoreSize_;
    bool standalone_;
    bool showHelpHome_;
 
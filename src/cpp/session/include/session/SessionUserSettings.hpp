@@ -191,6 +191,8 @@ private:
    void onSettingsFileChanged(
                         const core::system::FileChangeEvent& changeEvent);
 
+   bool flushSettings();
+
    core::FilePath getWorkingDirectoryValue(const std::string& key) const;
    void setWorkingDirectoryValue(const std::string& key,
                                  const core::FilePath& filePath) ;
@@ -23,11 +23,16 @@
 #include <sstream>
 
 #include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/DateTime.hpp>
 #include <core/json/Json.hpp>
 #include <core/json/JsonRpc.hpp>
 #include <core/Error.hpp>
 
+#include <r/RExec.hpp>
+
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <session/SessionModuleContext.hpp>
@@ -142,6 +147,157 @@ bool fillFunctionInfo(const json::Object& functionObjectJson,
    
 }
 
+bool packageInformationFromJson(const json::Object& infoJson,
+                                PackageInformation* pInfo)
+{
+   json::Array exportsJson;
+   json::Array typesJson;
+   json::Object functionInfoJson;
+
+   Error error = json::readObject(infoJson,
+                                  "package", &pInfo->package,
+                                  "exports", &exportsJson,
+                                  "types", &typesJson,
+                                  "function_info", &functionInfoJson);
+
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   if (!json::fillVectorString(exportsJson, &(pInfo->exports)))
+      LOG_ERROR_MESSAGE("Failed to read JSON 'objects' array to vector");
+
+   if (!json::fillVectorInt(typesJson, &(pInfo->types)))
+      LOG_ERROR_MESSAGE("Failed to read JSON 'types' array to vector");
+
+   if (!fillFunctionInfo(functionInfoJson, pInfo->package, &(pInfo->functionInfo)))
+      LOG_ERROR_MESSAGE("Failed to read JSON 'functions' object to map");
+
+   return true;
+}
+
+// package information is cached on disk (shared by all of the user's
+// sessions) keyed by the location and modification time of the package's
+// DESCRIPTION file, so that packages only need to be introspected by R
+// when they are first seen or after they are re-installed
+
+FilePath packageInformationCachePath()
+{
+   return module_context::userScratchPath().complete("package-information");
+}
+
+FilePath packageInformationCacheFile(const std::string& package)
+{
+   return packageInformationCachePath().complete(package + ".json");
+}
+
+// resolve the DESCRIPTION file for each package (following the library
+// search order that R would use to load it)
+std::map<std::string, FilePath> packageDescriptionFiles(
+                                 const std::vector<std::string>& packages)
+{
+   std::map<std::string, FilePath> descriptions;
+
+   std::vector<std::string> libPaths;
+   Error error = r::exec::RFunction("base:::.libPaths").call(&libPaths);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return descriptions;
+   }
+
+   BOOST_FOREACH(const std::string& package, packages)
+   {
+      BOOST_FOREACH(const std::string& libPath, libPaths)
+      {
+         FilePath descFile = FilePath(libPath).complete(package)
+                                              .complete("DESCRIPTION");
+         if (descFile.exists())
+         {
+            descriptions[package] = descFile;
+            break;
+         }
+      }
+   }
+
+   return descriptions;
+}
+
+bool readCachedPackageInformation(const std::string& package,
+                                  const FilePath& descFile,
+                                  PackageInformation* pInfo)
+{
+   FilePath cacheFile = packageInformationCacheFile(package);
+   if (!cacheFile.exists())
+      return false;
+
+   std::string contents;
+   Error error = readStringFromFile(cacheFile, &contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   json::Value cacheJson;
+   if (!json::parse(contents, &cacheJson) ||
+       !json::isType<json::Object>(cacheJson))
+   {
+      LOG_ERROR_MESSAGE("Invalid package information cache: " +
+                        cacheFile.absolutePath());
+      return false;
+   }
+
+   std::string description;
+   double lastWrite;
+   json::Object infoJson;
+   error = json::readObject(cacheJson.get_obj(),
+                            "description", &description,
+                            "description_last_write", &lastWrite,
+                            "information", &infoJson);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   // ensure the entry is for the package we'd load (and that it hasn't
+   // been re-installed since we cached it)
+   if (description != descFile.absolutePath() ||
+       lastWrite != static_cast<double>(descFile.lastWriteTime()))
+   {
+      return false;
+   }
+
+   return packageInformationFromJson(infoJson, pInfo);
+}
+
+void writeCachedPackageInformation(const std::string& package,
+                                   const FilePath& descFile,
+                                   const json::Object& infoJson)
+{
+   Error error = packageInformationCachePath().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   json::Object cacheJson;
+   cacheJson["description"] = descFile.absolutePath();
+   cacheJson["description_last_write"] =
+         static_cast<double>(descFile.lastWriteTime());
+   cacheJson["information"] = infoJson;
+
+   std::string contents;
+   json::write(cacheJson, &contents);
+   error = writeStringToFile(packageInformationCacheFile(package), contents);
+   if (error)
+      LOG_ERROR(error);
+}
+
 } // anonymous namespace
 
 void AsyncPackageInformationProcess::onCompleted(int exitStatus)
@@ -177,10 +333,6 @@ void AsyncPackageInformationProcess::onCompleted(int exitStatus)
    // }
    for (std::size_t i = 0; i < n; ++i)
    {
-      json::Array exportsJson;
-      json::Array typesJson;
-      json::Object functionInfoJson;
-      
       core::r_util::PackageInformation pkgInfo;
 
       if (splat[i].empty())
@@ -200,33 +352,26 @@ void AsyncPackageInformationProcess::onCompleted(int exitStatus)
          continue;
       }
 
-      Error error = json::readObject(value.get_obj(),
-                                     "package", &pkgInfo.package,
-                                     "exports", &exportsJson,
-                                     "types", &typesJson,
-                                     "function_info", &functionInfoJson);
-
-      if (error)
+      if (!json::isType<json::Object>(value) ||
+          !packageInformationFromJson(value.get_obj(), &pkgInfo))
       {
-         LOG_ERROR(error);
          continue;
       }
 
       DEBUG("Adding entry for package: '" << pkgInfo.package << "'");
 
-      if (!json::fillVectorString(exportsJson, &(pkgInfo.exports)))
-         LOG_ERROR_MESSAGE("Failed to read JSON 'objects' array to vector");
-
-      if (!json::fillVectorInt(typesJson, &(pkgInfo.types)))
-         LOG_ERROR_MESSAGE("Failed to read JSON 'types' array to vector");
-
-      if (!fillFunctionInfo(functionInfoJson, pkgInfo.package, &(pkgInfo.functionInfo)))
-         LOG_ERROR_MESSAGE("Failed to read JSON 'functions' object to map");
-      
       // Update the index
       core::r_util::RSourceIndex::addPackageInformation(pkgInfo.package, pkgInfo);
+
+      // Save it for other sessions
+      std::map<std::string, FilePath>::const_iterator it =
+                                    descriptionFiles_.find(pkgInfo.package);
+      if (it != descriptionFiles_.end())
+         writeCachedPackageInformation(pkgInfo.package, it->second, value.get_obj());
    }
 
+   DEBUG("Package information ready in " <<
+         (date_time::millisecondsSinceEpoch() - startTime_) << "ms");
 }
 
 void AsyncPackageInformationProcess::update()
@@ -269,6 +414,40 @@ void AsyncPackageInformationProcess::update()
       s_isUpdating_ = false;
       return;
    }
+
+   double startTime = date_time::millisecondsSinceEpoch();
+
+   // satisfy what we can from the on-disk cache
+   std::map<std::string, FilePath> descriptionFiles =
+                                          packageDescriptionFiles(pkgs);
+   std::vector<std::string> uncachedPkgs;
+   BOOST_FOREACH(const std::string& pkg, pkgs)
+   {
+      PackageInformation pkgInfo;
+      std::map<std::string, FilePath>::const_iterator it =
+                                             descriptionFiles.find(pkg);
+      if (it != descriptionFiles.end() &&
+          readCachedPackageInformation(pkg, it->second, &pkgInfo))
+      {
+         RSourceIndex::addPackageInformation(pkg, pkgInfo);
+      }
+      else
+      {
+         uncachedPkgs.push_back(pkg);
+      }
+   }
+
+   DEBUG("Read " << (pkgs.size() - uncachedPkgs.size()) <<
+         " packages from cache in " <<
+         (date_time::millisecondsSinceEpoch() - startTime) << "ms");
+
+   // only packages we couldn't read from the cache need an R process
+   s_pkgsToUpdate_ = uncachedPkgs;
+   if (pkgs.empty())
+   {
+      s_isUpdating_ = false;
+      return;
+   }
    
    std::stringstream ss;
    ss << ".rs.getPackageInformation(";
@@ -290,6 +469,8 @@ void AsyncPackageInformationProcess::update()
    
    boost::shared_ptr<AsyncPackageInformationProcess> pProcess(
          new AsyncPackageInformationProcess());
+   pProcess->descriptionFiles_ = descriptionFiles;
+   pProcess->startTime_ = startTime;
    
    pProcess->start(
             finalCmd.c_str(),
@@ -16,6 +16,10 @@
 #ifndef SESSION_ASYNC_PACKAGE_INFORMATION_HPP
 #define SESSION_ASYNC_PACKAGE_INFORMATION_HPP
 
+#include <map>
+#include <string>
+
+#include <core/FilePath.hpp>
 #include <core/r_util/RSourceIndex.hpp>
 #include <session/SessionAsyncRProcess.hpp>
 
@@ -27,6 +31,11 @@ namespace r_packages {
 class AsyncPackageInformationProcess : public async_r::AsyncRProcess
 {
 public:
+   AsyncPackageInformationProcess()
+      : startTime_(0)
+   {
+   }
+
    static void update();
    
    friend class CompleteUpdateOnExit;
@@ -53,6 +62,13 @@ private:
 
    std::stringstream stdOut_;
 
+   // DESCRIPTION files of the packages being introspected (used to key
+   // the on-disk cache of package information)
+   std::map<std::string, core::FilePath> descriptionFiles_;
+
+   // time the update started (ms since epoch)
+   double startTime_;
+
 };
 
 } // end namespace r_completions
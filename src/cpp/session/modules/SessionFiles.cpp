@@ -35,6 +35,7 @@
 #include <core/Settings.hpp>
 #include <core/Exec.hpp>
 #include <core/DateTime.hpp>
+#include <core/ZipStreamWriter.hpp>
 
 #include <core/http/Util.hpp>
 #include <core/http/Request.hpp>
@@ -619,6 +620,16 @@ Error detectZipFileOverwrites(const FilePath& uploadedZipFile,
    return Success();
 }
    
+void removeUploadedFile(const http::File& file)
+{
+   if (!file.contentsPath.empty())
+   {
+      Error error = file.contentsPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
 bool validateUploadedFile(const http::File& file, http::Response* pResponse)
 {
    // get limit
@@ -631,8 +642,11 @@ bool validateUploadedFile(const http::File& file, http::Response* pResponse)
    // convert limit to bytes
    size_t byteLimit = mbLimit * 1024 * 1024;
    
-   // compare to file size
-   if (file.contents.size() > byteLimit)
+   // compare to file size (large files are written to disk as they are
+   // received rather than being held in memory)
+   uintmax_t size = file.contentsPath.empty() ? file.contents.size() :
+                                                file.contentsPath.size();
+   if (size > byteLimit)
    {
       Error fileTooLargeError = systemError(boost::system::errc::file_too_large,
                                             ERROR_LOCATION);
@@ -661,13 +675,17 @@ void handleFileUploadRequest(const http::Request& request,
    // first validate that we got the required fields
    if (file.name.empty() || targetDirectory.empty())
    {
+      removeUploadedFile(file);
       json::setJsonRpcError(json::errc::ParamInvalid, pResponse);
       return;
    }
    
    // now validate the file
    if ( !validateUploadedFile(file, pResponse) )
+   {
+      removeUploadedFile(file);
       return ;
+   }
    
    // form destination path
    FilePath destDir = module_context::resolveAliasedPath(targetDirectory);
@@ -678,13 +696,36 @@ void handleFileUploadRequest(const http::Request& request,
    FilePath tempFilePath = module_context::tempFile("upload", 
                                                     isZip ? "zip" : "bin");
    
-   // attempt to write the temp file
-   Error saveError = core::writeStringToFile(tempFilePath, file.contents);
-   if (saveError)
+   // if the contents were already written to disk then move that file out
+   // of the uploads directory (files left there are removed along with the
+   // connection) otherwise attempt to write the temp file
+   if (!file.contentsPath.empty())
    {
-      LOG_ERROR(saveError);
-      json::setJsonRpcError(saveError, pResponse);
-      return;
+      Error moveError = file.contentsPath.move(tempFilePath);
+      if (moveError)
+      {
+         // (the temp directory may be on another device)
+         moveError = file.contentsPath.copy(tempFilePath);
+         if (!moveError)
+            removeUploadedFile(file);
+      }
+      if (moveError)
+      {
+         LOG_ERROR(moveError);
+         removeUploadedFile(file);
+         json::setJsonRpcError(moveError, pResponse);
+         return;
+      }
+   }
+   else
+   {
+      Error saveError = core::writeStringToFile(tempFilePath, file.contents);
+      if (saveError)
+      {
+         LOG_ERROR(saveError);
+         json::setJsonRpcError(saveError, pResponse);
+         return;
+      }
    }
    
    // detect any potential overwrites 
@@ -697,6 +738,9 @@ void handleFileUploadRequest(const http::Request& request,
       if (error)
       {
          LOG_ERROR(error);
+         Error removeError = tempFilePath.removeIfExists();
+         if (removeError)
+            LOG_ERROR(removeError);
          json::setJsonRpcError(error, pResponse);
          return;
       }
@@ -718,10 +762,9 @@ void handleFileUploadRequest(const http::Request& request,
    json::setJsonRpcResult(uploadJson, pResponse);   
 }
    
-void setAttachmentResponse(const http::Request& request,
-                           const std::string& filename,
-                           const FilePath& attachmentPath,
-                           http::Response* pResponse)
+void setAttachmentHeaders(const http::Request& request,
+                          const std::string& filename,
+                          http::Response* pResponse)
 {
    if (request.headerValue("User-Agent").find("MSIE") == std::string::npos)
    {
@@ -741,6 +784,14 @@ void setAttachmentResponse(const http::Request& request,
                         "attachment; filename*=UTF-8''"
                         + http::util::urlEncode(filename, false));
    pResponse->setHeader("Content-Type", "application/octet-stream");
+}
+
+void setAttachmentResponse(const http::Request& request,
+                           const std::string& filename,
+                           const FilePath& attachmentPath,
+                           http::Response* pResponse)
+{
+   setAttachmentHeaders(request, filename, pResponse);
    pResponse->setBody(attachmentPath);
 }
    
@@ -770,7 +821,8 @@ void handleMultipleFileExportRequest(const http::Request& request,
    }
    
    // files parameters (paths relative to parent)
-   std::vector<std::string> files;
+   boost::shared_ptr<ZipStreamWriter> pZipWriter(
+                                          new ZipStreamWriter(parentPath));
    for (int i=0; ;i++)
    {
       // get next file (terminate when we stop finding files)
@@ -788,25 +840,22 @@ void handleMultipleFileExportRequest(const http::Request& request,
          return;
       }
       
-      // add it
-      files.push_back(file);
-   }
-   
-   // create the zip file
-   FilePath tempZipFilePath = module_context::tempFile("export", "zip");
-   Error error = r::exec::RFunction(".rs.createZipFile",
-                                    tempZipFilePath.absolutePath(),
-                                    parentPath.absolutePath(),
-                                    files).call();
-   if (error)
-   {
-      LOG_ERROR(error);
-      pResponse->setError(error);
-      return;
+      // add it (along with its contents if it's a directory)
+      Error error = pZipWriter->add(filePath);
+      if (error)
+      {
+         LOG_ERROR(error);
+         pResponse->setError(error);
+         return;
+      }
    }
    
-   // return attachment
-   setAttachmentResponse(request, name, tempZipFilePath, pResponse);
+   // return attachment (the archive is generated as it's written rather
+   // than being created in a temp file and read into memory)
+   setAttachmentHeaders(request, name, pResponse);
+   pResponse->setStreamBody(boost::bind(&ZipStreamWriter::nextChunk,
+                                        pZipWriter,
+                                        _1));
 }
    
 void handleFileExportRequest(const http::Request& request, 
@@ -16,10 +16,16 @@
 
 #include <signal.h>
 
+#include <map>
+#include <set>
+#include <sstream>
+
 #ifdef _WIN32
 #include <windows.h>
 #include <shlobj.h>
 #include <shlwapi.h>
+#else
+#include <sys/stat.h>
 #endif
 
 #include <boost/algorithm/string.hpp>
@@ -32,7 +38,9 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 #include <boost/regex.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <core/BoostLamda.hpp>
+#include <core/DateTime.hpp>
 
 #include <core/json/JsonRpc.hpp>
 #include <core/system/Crypto.hpp>
@@ -43,6 +51,7 @@
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/GitGraph.hpp>
+#include <core/GitObjects.hpp>
 #include <core/Scope.hpp>
 #include <core/StringUtils.hpp>
 
@@ -261,10 +270,450 @@ bool isUntracked(const source_control::StatusResult& statusResult,
    return statusResult.getStatus(filePath).status() == "??";
 }
 
+// maximum number of changed paths which we will re-query individually
+// (beyond this we just re-run status for the whole working tree)
+const std::size_t kMaxIncrementalStatusPaths = 64;
+
+// Status of the working tree, refreshed incrementally. Paths reported as
+// changed by the file monitor are marked dirty and re-queried on the next
+// lookup. Anything which can change the status of arbitrary files (a change
+// to the index, HEAD, or .gitignore, or a git command run on behalf of the
+// user) invalidates the entire cache.
+class StatusCache : boost::noncopyable
+{
+public:
+   StatusCache()
+      : valid_(false),
+        resultStale_(true),
+        fullRefreshes_(0),
+        incrementalRefreshes_(0),
+        lookups_(0),
+        refreshMs_(0),
+        lookupMs_(0)
+   {
+   }
+
+   bool valid() const { return valid_; }
+   const std::string& gitState() const { return gitState_; }
+   const std::set<std::string>& dirtyPaths() const { return dirtyPaths_; }
+
+   void invalidate()
+   {
+      valid_ = false;
+      resultStale_ = true;
+      gitState_.clear();
+      files_.clear();
+      dirtyPaths_.clear();
+   }
+
+   void markDirty(const FilePath& path)
+   {
+      if (!valid_)
+         return;
+
+      // if the path is within an untracked directory then it's the
+      // directory which needs to be re-queried (as it could now be empty)
+      FilePath dirtyPath = path;
+      for (FilePath parent = path.parent();
+           !parent.empty() && parent != parent.parent();
+           parent = parent.parent())
+      {
+         Files::const_iterator it = files_.find(parent.absolutePath());
+         if (it != files_.end() && it->second.status.status() == "??")
+            dirtyPath = parent;
+      }
+
+      dirtyPaths_.insert(dirtyPath.absolutePath());
+   }
+
+   void reset(const std::vector<FileWithStatus>& files,
+              const std::string& gitState)
+   {
+      files_.clear();
+      dirtyPaths_.clear();
+      BOOST_FOREACH(const FileWithStatus& file, files)
+      {
+         files_[file.path.absolutePath()] = file;
+      }
+      gitState_ = gitState;
+      valid_ = true;
+      resultStale_ = true;
+   }
+
+   // apply the status of the current dirty paths
+   void update(const std::vector<FileWithStatus>& files)
+   {
+      // remove any existing status for dirty paths and their children
+      BOOST_FOREACH(const std::string& path, dirtyPaths_)
+      {
+         files_.erase(path);
+
+         std::string prefix = path + "/";
+         Files::iterator it = files_.lower_bound(prefix);
+         while (it != files_.end() &&
+                boost::algorithm::starts_with(it->first, prefix))
+         {
+            files_.erase(it++);
+         }
+      }
+
+      BOOST_FOREACH(const FileWithStatus& file, files)
+      {
+         files_[file.path.absolutePath()] = file;
+      }
+
+      dirtyPaths_.clear();
+      resultStale_ = true;
+   }
+
+   // status of the files within dir (returns false if dir is within an
+   // untracked directory, since git reports only the directory itself)
+   bool result(const FilePath& dir,
+               const FilePath& root,
+               StatusResult* pResult)
+   {
+      // the status of the whole working tree is built once per change
+      if (dir == root)
+      {
+         if (resultStale_)
+         {
+            std::vector<FileWithStatus> files;
+            files.reserve(files_.size());
+            for (Files::const_iterator it = files_.begin();
+                 it != files_.end();
+                 ++it)
+            {
+               files.push_back(it->second);
+            }
+            rootResult_ = StatusResult(files);
+            resultStale_ = false;
+         }
+         *pResult = rootResult_;
+         return true;
+      }
+
+      std::size_t rootLength = root.absolutePath().size();
+      for (FilePath parent = dir.parent();
+           parent.absolutePath().size() > rootLength;
+           parent = parent.parent())
+      {
+         Files::const_iterator it = files_.find(parent.absolutePath());
+         if (it != files_.end() && it->second.status.status() == "??")
+            return false;
+      }
+
+      // the directory itself (if e.g. it's untracked) and its contents
+      std::vector<FileWithStatus> files;
+      std::string path = dir.absolutePath();
+      Files::const_iterator it = files_.find(path);
+      if (it != files_.end())
+         files.push_back(it->second);
+
+      std::string prefix = path + "/";
+      for (it = files_.lower_bound(prefix);
+           it != files_.end() &&
+              boost::algorithm::starts_with(it->first, prefix);
+           ++it)
+      {
+         files.push_back(it->second);
+      }
+
+      *pResult = StatusResult(files);
+      return true;
+   }
+
+   void recordRefresh(bool full, std::size_t paths, double elapsedMs)
+   {
+      if (full)
+         fullRefreshes_++;
+      else
+         incrementalRefreshes_++;
+      refreshMs_ += elapsedMs;
+
+      boost::format fmt("git status cache: %1% refresh of %2% path(s) in "
+                        "%3%ms (%4% full, %5% incremental, %6%ms total)");
+      LOG_DEBUG_MESSAGE(boost::str(fmt %
+                                   (full ? "full" : "incremental") %
+                                   paths %
+                                   elapsedMs %
+                                   fullRefreshes_ %
+                                   incrementalRefreshes_ %
+                                   refreshMs_));
+   }
+
+   void recordLookup(double elapsedMs)
+   {
+      lookups_++;
+      lookupMs_ += elapsedMs;
+
+      if ((lookups_ % 100) == 0)
+      {
+         boost::format fmt("git status cache: %1% lookups averaging %2%ms");
+         LOG_DEBUG_MESSAGE(boost::str(fmt % lookups_ % (lookupMs_ / lookups_)));
+      }
+   }
+
+private:
+   typedef std::map<std::string, FileWithStatus> Files;
+
+   bool valid_;
+   std::string gitState_;
+   Files files_;
+   bool resultStale_;
+   StatusResult rootResult_;
+   std::set<std::string> dirtyPaths_;
+
+   // timing metrics
+   int fullRefreshes_;
+   int incrementalRefreshes_;
+   int lookups_;
+   double refreshMs_;
+   double lookupMs_;
+};
+
+// Lines of the commit graph for a revision. The graph is built from
+// 'git rev-list --date-order --parents' output, the order of which is
+// stable for a given tip commit, so paging further into the history only
+// requires feeding the additional commits into the (stateful) graph rather
+// than recomputing it from the first commit for every page.
+class GraphCache : boost::noncopyable
+{
+public:
+   GraphCache() : complete_(false), pGraph_(new gitgraph::GitGraph()) {}
+
+   void clear()
+   {
+      rev_.clear();
+      tip_.clear();
+      lines_.clear();
+      complete_ = false;
+      pGraph_.reset(new gitgraph::GitGraph());
+   }
+
+   // discard the cached graph unless it was computed for rev at tip
+   void ensure(const std::string& rev, const std::string& tip)
+   {
+      if (rev != rev_ || tip != tip_)
+      {
+         clear();
+         rev_ = rev;
+         tip_ = tip;
+      }
+   }
+
+   bool complete() const { return complete_; }
+   std::size_t size() const { return lines_.size(); }
+   const std::string& line(std::size_t i) const { return lines_[i]; }
+
+   // add the graph lines for rev-list output (which begins with the
+   // commits we've already seen)
+   void update(const std::vector<std::string>& revListLines,
+                      std::size_t maxCount)
+   {
+      std::size_t commits = 0;
+      BOOST_FOREACH(const std::string& revListLine, revListLines)
+      {
+         if (revListLine.empty())
+            continue;
+
+         if (commits++ < lines_.size())
+            continue;
+
+         std::vector<std::string> parents;
+         boost::algorithm::split(parents, revListLine,
+                                 boost::algorithm::is_any_of(" "));
+         std::string commit = parents.front();
+         parents.erase(parents.begin());
+
+         lines_.push_back(pGraph_->addCommit(commit, parents).string());
+      }
+
+      // if rev-list returned fewer commits than requested we have them all
+      complete_ = (maxCount == 0) || (commits < maxCount);
+   }
+
+   // add the graph lines for the first count commits of history
+   void update(const std::vector<gitobjects::HistoryEntry>& history,
+               std::size_t count)
+   {
+      count = std::min(count, history.size());
+      for (std::size_t i = lines_.size(); i < count; i++)
+      {
+         std::vector<std::string> parents;
+         BOOST_FOREACH(const gitobjects::ObjectId& parent, history[i].parents)
+         {
+            parents.push_back(parent.hex());
+         }
+         lines_.push_back(
+               pGraph_->addCommit(history[i].id.hex(), parents).string());
+      }
+      complete_ = lines_.size() == history.size();
+   }
+
+private:
+   std::string rev_;
+   std::string tip_;
+   std::vector<std::string> lines_;
+   bool complete_;
+   boost::scoped_ptr<gitgraph::GitGraph> pGraph_;
+};
+
+// History read directly from the repository's objects rather than by
+// running git log and rev-list for every page. The history of the last
+// revision (and path) is kept until its tips (or shallow commits) move, and
+// the commit graph is persisted in the scratch path so that later sessions
+// needn't read every commit again (commit ids are content hashes so entries
+// never go stale). The repository is kept open across the requests for a
+// page of history and released once history hasn't been requested for a
+// while. Errors (including errc::not_supported for repositories and
+// revisions the reader doesn't handle) mean the caller should fall back to
+// running git.
+class NativeHistory : boost::noncopyable
+{
+public:
+   NativeHistory() : commitGraphLoaded_(false), releaseGeneration_(0) {}
+
+   void reset(const FilePath& root)
+   {
+      release();
+      pRepo_.reset();
+      key_.clear();
+      history_.clear();
+      commitGraphLoaded_ = false;
+
+      FilePath gitDir = root.empty() ? FilePath() : root.childPath(".git");
+      if (!gitDir.empty() && gitDir.isDirectory())
+         pRepo_.reset(new gitobjects::Repository(gitDir));
+   }
+
+   // the history of rev (limited to path if it isn't empty) and a key which
+   // identifies it (the revision, path, and tip commits)
+   core::Error history(const std::string& rev,
+                       const std::string& path,
+                       const std::vector<gitobjects::HistoryEntry>** ppHistory,
+                       std::string* pKey)
+   {
+      if (!pRepo_)
+         return systemError(boost::system::errc::not_supported,
+                            ERROR_LOCATION);
+
+      if (!commitGraphLoaded_)
+      {
+         commitGraphLoaded_ = true;
+         Error error = pRepo_->loadCommitGraph(commitGraphFile());
+         if (error)
+            LOG_ERROR(error);
+      }
+
+      std::vector<gitobjects::ObjectId> tips;
+      Error error = pRepo_->resolveRevision(rev, &tips);
+      if (error)
+         return error;
+
+      // (deepening a shallow clone changes history without moving its tips)
+      std::vector<gitobjects::ObjectId> shallow;
+      error = pRepo_->shallowCommits(&shallow);
+      if (error)
+         return error;
+
+      std::string key = rev + "\n" + path;
+      BOOST_FOREACH(const gitobjects::ObjectId& tip, tips)
+      {
+         key += "\n" + tip.hex();
+      }
+      BOOST_FOREACH(const gitobjects::ObjectId& commit, shallow)
+      {
+         key += "\nshallow " + commit.hex();
+      }
+
+      if (key != key_)
+      {
+         key_.clear();
+         history_.clear();
+         error = pRepo_->history(tips, path, &history_);
+         if (error)
+         {
+            history_.clear();
+            return error;
+         }
+         key_ = key;
+      }
+
+      *ppHistory = &history_;
+      *pKey = key;
+      return Success();
+   }
+
+   core::Error readCommit(const gitobjects::ObjectId& id,
+                          gitobjects::Commit* pCommit)
+   {
+      return pRepo_->readCommit(id, pCommit);
+   }
+
+   core::Error decorations(
+         std::map<gitobjects::ObjectId, std::vector<std::string> >* pRefs)
+   {
+      return pRepo_->decorations(pRefs);
+   }
+
+   // release the repository once history hasn't been requested for a while
+   void scheduleRelease()
+   {
+      if (!pRepo_)
+         return;
+
+      module_context::scheduleDelayedWork(
+               boost::posix_time::seconds(kReleaseDelaySeconds),
+               boost::bind(&NativeHistory::releaseIfIdle,
+                           this,
+                           ++releaseGeneration_));
+   }
+
+   // persist new commits (if there are any) and close the pack files until
+   // the next request
+   void release()
+   {
+      if (!pRepo_)
+         return;
+
+      if (commitGraphLoaded_)
+      {
+         Error error = pRepo_->saveCommitGraph(commitGraphFile());
+         if (error)
+            LOG_ERROR(error);
+      }
+      pRepo_->releaseFiles();
+   }
+
+private:
+   static const int kReleaseDelaySeconds = 30;
+
+   static FilePath commitGraphFile()
+   {
+      return module_context::scopedScratchPath().childPath("git-commit-graph");
+   }
+
+   void releaseIfIdle(int generation)
+   {
+      // (history was requested again since this release was scheduled)
+      if (generation == releaseGeneration_)
+         release();
+   }
+
+   boost::scoped_ptr<gitobjects::Repository> pRepo_;
+   bool commitGraphLoaded_;
+   int releaseGeneration_;
+   std::string key_;
+   std::vector<gitobjects::HistoryEntry> history_;
+};
+
 class Git : public boost::noncopyable
 {
 private:
    FilePath root_;
+   StatusCache statusCache_;
+   GraphCache graphCache_;
+   NativeHistory nativeHistory_;
 
 protected:
    core::Error runGit(const ShellArgs& args,
@@ -328,6 +777,10 @@ protected:
                                      console_process::kDefaultMaxOutputLines);
 #endif
 
+      // the process may change the status of any file in the working tree
+      statusCache_.invalidate();
+      (*ppCP)->onExit().connect(boost::bind(&Git::invalidateStatusCache,
+                                            this));
       (*ppCP)->onExit().connect(boost::bind(&enqueueRefreshEvent));
 
       return Success();
@@ -372,6 +825,7 @@ public:
 
    Git(const FilePath& root) : root_(root)
    {
+      nativeHistory_.reset(root_);
    }
 
    std::string name() { return kVcsId; }
@@ -384,18 +838,32 @@ public:
    void setRoot(const FilePath& path)
    {
       root_ = path;
+      statusCache_.invalidate();
+      graphCache_.clear();
+      nativeHistory_.reset(root_);
    }
 
    core::Error status(const FilePath& dir,
                       StatusResult* pStatusResult)
    {
-      using namespace boost;
-
       std::vector<FileWithStatus> files;
+      Error error = status(std::vector<FilePath>(1, dir), &files);
+      if (error)
+         return error;
+
+      *pStatusResult = StatusResult(files);
+
+      return Success();
+   }
+
+   core::Error status(const std::vector<FilePath>& paths,
+                      std::vector<FileWithStatus>* pFiles)
+   {
+      using namespace boost;
 
       std::vector<std::string> lines;
       std::string output;
-      Error error = runGit(ShellArgs() << "status" << "--porcelain" << "--" << dir,
+      Error error = runGit(ShellArgs() << "status" << "--porcelain" << "--" << paths,
                            &output);
       if (error)
          return error;
@@ -417,21 +885,73 @@ public:
             filePath = filePath.substr(0, filePath.size() - 1);
          file.path = root_.childPath(string_utils::systemToUtf8(filePath));
 
-         files.push_back(file);
+         pFiles->push_back(file);
       }
 
-      *pStatusResult = StatusResult(files);
+      return Success();
+   }
+
+   // status of all files within dir. when the project file monitor is
+   // watching the working tree this is served from the status cache
+   core::Error cachedStatus(const FilePath& dir,
+                            StatusResult* pStatusResult)
+   {
+      if (!statusCacheEnabled() || !dir.isWithin(root_))
+      {
+         statusCache_.invalidate();
+         return status(dir, pStatusResult);
+      }
+
+      Error error = refreshStatusCache();
+      if (error)
+         return error;
+
+      double startMs = date_time::millisecondsSinceEpoch();
+      if (!statusCache_.result(dir, root_, pStatusResult))
+         return status(dir, pStatusResult);
+      statusCache_.recordLookup(date_time::millisecondsSinceEpoch() - startMs);
 
       return Success();
    }
 
+   void releaseHistory()
+   {
+      nativeHistory_.release();
+   }
+
+   void markStatusDirty(const std::vector<FilePath>& paths)
+   {
+      BOOST_FOREACH(const FilePath& path, paths)
+      {
+         if (!path.isWithin(root_))
+            continue;
+
+         if (path.filename() == ".gitignore")
+         {
+            statusCache_.invalidate();
+            break;
+         }
+
+         statusCache_.markDirty(path);
+      }
+   }
+
+   void invalidateStatusCache()
+   {
+      statusCache_.invalidate();
+   }
+
    core::Error add(const std::vector<FilePath>& filePaths)
    {
+      statusCache_.invalidate();
+
       return runGit(ShellArgs() << "add" << "--" << filePaths);
    }
 
    core::Error remove(const std::vector<FilePath>& filePaths)
    {
+      statusCache_.invalidate();
+
       ShellArgs args;
       args << "rm" << "--";
       appendPathArgs(filePaths, &args);
@@ -440,6 +960,8 @@ public:
 
    core::Error discard(const std::vector<FilePath>& filePaths)
    {
+      statusCache_.invalidate();
+
       source_control::StatusResult statusResult;
       Error error = status(root_, &statusResult);
       if (error)
@@ -510,6 +1032,8 @@ public:
 
    core::Error unstage(const std::vector<FilePath>& filePaths)
    {
+      statusCache_.invalidate();
+
       source_control::StatusResult statusResult;
       Error error = status(root_, &statusResult);
       if (error)
@@ -826,6 +1350,8 @@ public:
    core::Error applyPatch(const FilePath& patchFile,
                           PatchMode patchMode)
    {
+      statusCache_.invalidate();
+
       ShellArgs args = ShellArgs() << "apply";
       if (patchMode == PatchModeStage)
          args << "--cached";
@@ -871,6 +1397,203 @@ public:
       }
    }
 
+   // graph lines for count commits of rev (all if count is negative)
+   // starting at skip, served from the graph cache where possible
+   core::Error commitGraph(const std::string& rev,
+                           int skip,
+                           int count,
+                           std::vector<std::string>* pGraphLines)
+   {
+      std::string revArg = rev.empty() ? "HEAD" : rev;
+
+      // resolve the tip of the revision so we know whether the cached
+      // graph is still valid (if we can't then don't use the cache)
+      std::string tip;
+      int exitCode;
+      Error error = runGit(ShellArgs() << "rev-parse" << revArg,
+                           &tip, NULL, &exitCode);
+      if (error)
+         return error;
+      if (exitCode != EXIT_SUCCESS)
+         graphCache_.clear();
+      graphCache_.ensure(rev, boost::algorithm::trim_copy(tip));
+
+      skip = std::max(skip, 0);
+      std::size_t needed = (count < 0) ?
+                              std::numeric_limits<std::size_t>::max() :
+                              static_cast<std::size_t>(skip + count);
+
+      if (graphCache_.size() < needed && !graphCache_.complete())
+      {
+         // fetch at least twice as many commits as we have already so
+         // that paging through the whole history is linear overall
+         ShellArgs revListArgs = ShellArgs() << "rev-list" << "--date-order"
+                                             << "--parents";
+         std::size_t maxCount = 0; // all
+         if (count >= 0)
+         {
+            maxCount = std::max(needed, 2 * graphCache_.size());
+            revListArgs << "--max-count=" + safe_convert::numberToString(maxCount);
+         }
+         revListArgs << revArg;
+
+         std::string revOutput;
+         error = runGit(revListArgs, &revOutput);
+         if (error)
+            return error;
+
+         std::vector<std::string> revOutLines = split(revOutput);
+         revOutput.clear();
+         graphCache_.update(revOutLines, maxCount);
+      }
+
+      for (std::size_t i = skip;
+           i < std::min(needed, graphCache_.size());
+           i++)
+      {
+         pGraphLines->push_back(graphCache_.line(i));
+      }
+
+      return Success();
+   }
+
+   // the path of fileFilter within the repository (for native history)
+   core::Error historyPath(const FilePath& fileFilter, std::string* pPath)
+   {
+      if (fileFilter.empty())
+         return Success();
+      if (!fileFilter.isWithin(root_))
+         return systemError(boost::system::errc::not_supported,
+                            ERROR_LOCATION);
+      *pPath = fileFilter.relativePath(root_);
+      return Success();
+   }
+
+   core::Error nativeCommitInfo(
+         const gitobjects::HistoryEntry& entry,
+         const std::map<gitobjects::ObjectId, std::vector<std::string> >& refs,
+         CommitInfo* pCommitInfo)
+   {
+      gitobjects::Commit commit;
+      Error error = nativeHistory_.readCommit(entry.id, &commit);
+      if (error)
+         return error;
+
+      // (git log would reencode the message)
+      if (!commit.encoding.empty() &&
+          !boost::algorithm::iequals(commit.encoding, "UTF-8"))
+      {
+         return systemError(boost::system::errc::not_supported,
+                            ERROR_LOCATION);
+      }
+
+      // the id and decorations as git log --decorate=full shows them
+      std::string value = entry.id.hex();
+      std::map<gitobjects::ObjectId, std::vector<std::string> >::const_iterator
+                                                   it = refs.find(entry.id);
+      if (it != refs.end())
+         value += " (" + boost::algorithm::join(it->second, ", ") + ")";
+      parseCommitValue(value, pCommitInfo);
+
+      pCommitInfo->author = commit.author;
+      pCommitInfo->date = convertGitRawDate(
+                     safe_convert::numberToString(commit.commitTime),
+                     commit.commitTimeZone);
+
+      BOOST_FOREACH(const gitobjects::ObjectId& parent, entry.parents)
+      {
+         if (!pCommitInfo->parent.empty())
+            pCommitInfo->parent.push_back(' ');
+         pCommitInfo->parent.append(parent.hex(), 0, 8);
+      }
+
+      std::string message = commit.message;
+      if (boost::algorithm::ends_with(message, "\n"))
+         message.erase(message.size() - 1);
+      std::vector<std::string> lines;
+      if (!message.empty())
+         boost::algorithm::split(lines, message,
+                                 boost::algorithm::is_any_of("\n"));
+      BOOST_FOREACH(const std::string& line, lines)
+      {
+         if (pCommitInfo->subject.empty())
+            pCommitInfo->subject = line;
+
+         if (!pCommitInfo->description.empty())
+            pCommitInfo->description.append("\n");
+         pCommitInfo->description.append(line);
+      }
+
+      return Success();
+   }
+
+   core::Error nativeLog(const std::string& rev,
+                         const FilePath& fileFilter,
+                         int skip,
+                         int maxentries,
+                         const std::string& searchText,
+                         std::vector<CommitInfo>* pOutput)
+   {
+      std::string path;
+      Error error = historyPath(fileFilter, &path);
+      if (error)
+         return error;
+
+      const std::vector<gitobjects::HistoryEntry>* pHistory;
+      std::string key;
+      error = nativeHistory_.history(rev, path, &pHistory, &key);
+      if (error)
+         return error;
+
+      std::map<gitobjects::ObjectId, std::vector<std::string> > refs;
+      error = nativeHistory_.decorations(&refs);
+      if (error)
+         return error;
+
+      skip = std::max(skip, 0);
+      std::size_t maxCount = (maxentries < 0) ?
+                              std::numeric_limits<std::size_t>::max() :
+                              static_cast<std::size_t>(maxentries);
+
+      // without a filter the page can be read directly (and has graph lines)
+      bool unfiltered = searchText.empty() && path.empty();
+      if (unfiltered)
+      {
+         graphCache_.ensure(rev, key);
+         std::size_t needed = (maxentries < 0) ?
+                                 pHistory->size() :
+                                 std::min(pHistory->size(), skip + maxCount);
+         graphCache_.update(*pHistory, needed);
+      }
+
+      boost::function<bool(CommitInfo)> filter =
+                                    createSearchTextPredicate(searchText);
+      int skipped = 0;
+      for (std::size_t i = unfiltered ? skip : 0;
+           i < pHistory->size() && pOutput->size() < maxCount;
+           i++)
+      {
+         CommitInfo commitInfo;
+         error = nativeCommitInfo((*pHistory)[i], refs, &commitInfo);
+         if (error)
+            return error;
+
+         if (unfiltered)
+            commitInfo.graph = graphCache_.line(i);
+         else if (!filter(commitInfo))
+            continue;
+         else if (skipped < skip)
+         {
+            skipped++;
+            continue;
+         }
+
+         pOutput->push_back(commitInfo);
+      }
+
+      return Success();
+   }
+
    core::Error logLength(const std::string &rev,
                          const FilePath& fileFilter,
                          const std::string &searchText,
@@ -878,19 +1601,49 @@ public:
    {
       if (searchText.empty())
       {
-         ShellArgs args = ShellArgs() << "log";
-         args << "--pretty=oneline";
-         if (!rev.empty())
+         // count the commits without running git if we can
+         std::string path;
+         const std::vector<gitobjects::HistoryEntry>* pHistory;
+         std::string key;
+         Error error = historyPath(fileFilter, &path);
+         if (!error)
+            error = nativeHistory_.history(rev, path, &pHistory, &key);
+         nativeHistory_.scheduleRelease();
+         if (!error)
+         {
+            *pLength = static_cast<int>(pHistory->size());
+            return Success();
+         }
+         if (error.code() != boost::system::errc::not_supported)
+            LOG_ERROR(error);
+
+         // rev-list can count the commits for us (git >= 1.7.2) which
+         // saves formatting and transferring the entire log
+         bool revListCount = s_gitVersion >= GIT_1_7_2;
+
+         ShellArgs args;
+         if (revListCount)
+            args << "rev-list" << "--count" << (rev.empty() ? "HEAD" : rev);
+         else
+            args << "log" << "--pretty=oneline";
+         if (!revListCount && !rev.empty())
             args << rev;
 
          if (!fileFilter.empty())
             args << "--" << fileFilter;
 
          std::string output;
-         Error error = runGit(args, &output);
+         error = runGit(args, &output);
          if (error)
             return error;
 
+         if (revListCount)
+         {
+            *pLength = safe_convert::stringTo<int>(
+                                    boost::algorithm::trim_copy(output), 0);
+            return Success();
+         }
+
          *pLength = static_cast<int>(std::count(output.begin(), output.end(), '\n'));
          return Success();
       }
@@ -912,17 +1665,26 @@ public:
                    const std::string& searchText,
                    std::vector<CommitInfo>* pOutput)
    {
+      // read the history without running git if we can
+      Error error = nativeLog(rev, fileFilter, skip, maxentries, searchText,
+                              pOutput);
+      nativeHistory_.scheduleRelease();
+      if (!error)
+         return Success();
+      if (error.code() != boost::system::errc::not_supported)
+         LOG_ERROR(error);
+      pOutput->clear();
+
       ShellArgs args = ShellArgs() << "log" << "--encoding=UTF-8"
                        << "--pretty=raw" << "--decorate=full"
                        << "--date-order";
 
-      ShellArgs revListArgs = ShellArgs() << "rev-list" << "--date-order" << "--parents";
-      int revListSkip = skip;
+      int graphSkip = skip;
+      int graphCount = maxentries;
 
       if (!fileFilter.empty())
       {
          args << "--" << fileFilter;
-         revListArgs << "--" << fileFilter;
       }
 
       if (searchText.empty() && fileFilter.empty())
@@ -938,20 +1700,12 @@ public:
          {
             args << "--max-count=" + safe_convert::numberToString(maxentries);
             maxentries = -1;
-
-            revListArgs << "--max-count=" + safe_convert::numberToString(
-                  (skip < 0 ? 0 : skip) + maxentries);
          }
       }
 
       if (!rev.empty())
       {
          args << rev;
-         revListArgs << rev;
-      }
-      else
-      {
-         revListArgs << "HEAD";
       }
 
       if (maxentries < 0)
@@ -959,7 +1713,7 @@ public:
 
       std::vector<std::string> outLines;
       std::string output;
-      Error error = runGit(args, &output);
+      error = runGit(args, &output);
       if (error)
          return error;
       outLines = split(output);
@@ -968,31 +1722,9 @@ public:
       std::vector<std::string> graphLines;
       if (searchText.empty() && fileFilter.empty())
       {
-         std::vector<std::string> revOutLines;
-         std::string revOutput;
-         error = runGit(revListArgs, &revOutput);
+         error = commitGraph(rev, graphSkip, graphCount, &graphLines);
          if (error)
             return error;
-         revOutLines = split(revOutput);
-         revOutput.clear();
-
-         gitgraph::GitGraph graph;
-         for (size_t i = 0; i < revOutLines.size(); i++)
-         {
-            typedef std::vector<std::string> find_vector_type;
-            find_vector_type parents;
-            boost::algorithm::split(parents, revOutLines[i],
-                                    boost::algorithm::is_any_of(" "));
-            if (parents.size() < 1)
-               break;
-
-            std::string commit = parents.front();
-            parents.erase(parents.begin());
-
-            gitgraph::Line line = graph.addCommit(commit, parents);
-            if (revListSkip <= 0 || static_cast<int>(i) >= revListSkip)
-               graphLines.push_back(line.string());
-         }
       }
 
       boost::function<bool(CommitInfo)> filter = createSearchTextPredicate(searchText);
@@ -1145,6 +1877,99 @@ public:
          *pRemoteBranchInfo = RemoteBranchInfo(name, commitsBehind);
       }
 
+      return Success();
+   }
+
+private:
+   // the cache can only be kept up to date if the file monitor is
+   // watching the whole working tree and we can see the git directory
+   bool statusCacheEnabled() const
+   {
+      return !root_.empty() &&
+             projects::projectContext().isMonitoringDirectory(root_) &&
+             root_.childPath(".git").isDirectory();
+   }
+
+   // signature of the git state which affects the status of arbitrary
+   // files (e.g. commits, checkouts, and staging outside of RStudio). git
+   // replaces the index and HEAD by renaming a lock file over them, so the
+   // inode changes on every rewrite (even within the same second)
+   std::string gitStateSignature() const
+   {
+      std::ostringstream ostr;
+      FilePath gitDir = root_.childPath(".git");
+      const char* const kStateFiles[] = { "index", "HEAD" };
+      for (std::size_t i = 0; i < sizeof(kStateFiles)/sizeof(kStateFiles[0]); i++)
+      {
+         FilePath stateFile = gitDir.childPath(kStateFiles[i]);
+#ifndef _WIN32
+         struct stat st;
+         if (::stat(stateFile.absolutePath().c_str(), &st) == 0)
+         {
+#ifdef __APPLE__
+            long mtimeNanos = st.st_mtimespec.tv_nsec;
+#else
+            long mtimeNanos = st.st_mtim.tv_nsec;
+#endif
+            ostr << st.st_ino << ":" << st.st_mtime << "." << mtimeNanos
+                 << ":" << st.st_size;
+         }
+#else
+         if (stateFile.exists())
+            ostr << stateFile.lastWriteTime() << ":" << stateFile.size();
+#endif
+         ostr << ";";
+      }
+      return ostr.str();
+   }
+
+   core::Error refreshStatusCache()
+   {
+      std::string gitState = gitStateSignature();
+      if (statusCache_.valid() && gitState != statusCache_.gitState())
+         statusCache_.invalidate();
+
+      const std::set<std::string>& dirtyPaths = statusCache_.dirtyPaths();
+      if (statusCache_.valid() && dirtyPaths.empty())
+         return Success();
+
+      double startMs = date_time::millisecondsSinceEpoch();
+      std::vector<FileWithStatus> files;
+      if (statusCache_.valid() &&
+          dirtyPaths.size() <= kMaxIncrementalStatusPaths)
+      {
+         std::vector<FilePath> paths;
+         BOOST_FOREACH(const std::string& path, dirtyPaths)
+         {
+            paths.push_back(FilePath(path));
+         }
+
+         Error error = status(paths, &files);
+         if (error)
+         {
+            statusCache_.invalidate();
+            return error;
+         }
+
+         std::size_t count = dirtyPaths.size();
+         statusCache_.update(files);
+         statusCache_.recordRefresh(
+                  false, count, date_time::millisecondsSinceEpoch() - startMs);
+      }
+      else
+      {
+         Error error = status(std::vector<FilePath>(1, root_), &files);
+         if (error)
+         {
+            statusCache_.invalidate();
+            return error;
+         }
+
+         statusCache_.reset(files, gitState);
+         statusCache_.recordRefresh(
+                  true, 1, date_time::millisecondsSinceEpoch() - startMs);
+      }
+
       return Success();
    }
 };
@@ -1227,9 +2052,14 @@ FilePath detectGitDir(const FilePath& workingDir)
 
 } // anonymous namespace
 
-GitFileDecorationContext::GitFileDecorationContext(const FilePath& rootDir)
+GitFileDecorationContext::GitFileDecorationContext(
+                                 const FilePath& rootDir,
+                                 const std::vector<FilePath>& changedFiles)
    : fullRefreshRequired_(false)
 {
+   // make sure we don't use cached status for files which have changed
+   s_git_.markStatusDirty(changedFiles);
+
    // get source control status (merely log errors doing this)
    Error error = git::status(rootDir, &vcsStatus_);
    if (error)
@@ -1280,7 +2110,7 @@ core::Error status(const FilePath& dir, StatusResult* pStatusResult)
    if (s_git_.root().empty())
       return Success();
 
-   return s_git_.status(dir, pStatusResult);
+   return s_git_.cachedStatus(dir, pStatusResult);
 }
 
 Error fileStatus(const FilePath& filePath, VCSStatus* pStatus)
@@ -1432,7 +2262,7 @@ Error vcsFullStatus(const json::JsonRpcRequest&,
                     json::JsonRpcResponse* pResponse)
 {
    StatusResult statusResult;
-   Error error = s_git_.status(s_git_.root(), &statusResult);
+   Error error = s_git_.cachedStatus(s_git_.root(), &statusResult);
    if (error)
       return error;
 
@@ -2424,6 +3254,10 @@ Error detectAndSaveGitExePath()
 
 void onShutdown(bool)
 {
+   // (persist the commits read since history was last released)
+   s_git_.releaseHistory();
+
+
    std::for_each(s_pidsToTerminate_.begin(), s_pidsToTerminate_.end(),
                  &core::system::terminateProcess);
    s_pidsToTerminate_.clear();
@@ -42,7 +42,8 @@ extern const char * const kVcsId;
 class GitFileDecorationContext : public source_control::FileDecorationContext
 {
 public:
-   GitFileDecorationContext(const core::FilePath& rootDir);
+   GitFileDecorationContext(const core::FilePath& rootDir,
+                            const std::vector<core::FilePath>& changedFiles);
    virtual ~GitFileDecorationContext();
    virtual void decorateFile(const core::FilePath &filePath,
                              core::json::Object *pFileObject);
@@ -15,8 +15,12 @@
 
 #include "SessionHistoryArchive.hpp"
 
+#include <set>
 #include <string>
 
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
@@ -92,14 +96,14 @@ void attemptRhistoryMigration()
 
 // simple reader for parsing lines of history file
 ReadCollectionAction readHistoryEntry(const std::string& line,
-                                      HistoryEntry* pEntry,
-                                      int* pNextIndex)
+                                      int index,
+                                      HistoryEntry* pEntry)
 {
    // if the line doesn't have a ':' then ignore it
    if (line.find(':') == std::string::npos)
       return ReadCollectionIgnoreLine;
 
-   pEntry->index = (*pNextIndex)++;
+   pEntry->index = index;
    std::istringstream istr(line);
    istr >> pEntry->timestamp ;
    istr.ignore(1, ':');
@@ -118,6 +122,27 @@ ReadCollectionAction readHistoryEntry(const std::string& line,
    }
 }
 
+boost::uint32_t trigramKey(const std::string& str, std::size_t pos)
+{
+   return (static_cast<boost::uint32_t>(static_cast<unsigned char>(str[pos])) << 16) |
+          (static_cast<boost::uint32_t>(static_cast<unsigned char>(str[pos+1])) << 8) |
+          static_cast<boost::uint32_t>(static_cast<unsigned char>(str[pos+2]));
+}
+
+bool containsAll(const std::string& command,
+                 const std::vector<std::string>& searchTerms)
+{
+   for (std::vector<std::string>::const_iterator it = searchTerms.begin();
+        it != searchTerms.end();
+        ++it)
+   {
+      if (!boost::algorithm::contains(command, *it))
+         return false;
+   }
+
+   return true;
+}
+
 } // anonymous namespace
 
 HistoryArchive& historyArchive()
@@ -128,12 +153,8 @@ HistoryArchive& historyArchive()
 
 Error HistoryArchive::add(const std::string& command)
 {
-   // reset the cache (since this write will invalidate the current one,
-   // no sense in keeping our cache around in memory)
-   entries_.clear();
-   entryCacheLastWriteTime_ = -1;
-
-   // rotate if necessary
+   // rotate if necessary (this will be detected by the next call to
+   // entries(), otherwise the appended entry is read from the tail)
    rotateHistoryDatabase();
 
    // write the entry to the file
@@ -152,54 +173,258 @@ const std::vector<HistoryEntry>& HistoryArchive::entries() const
    // if the file doesn't exist then clear the collection
    if (!historyDBPath.exists())
    {
-      entries_.clear();
+      resetEntryCache();
+      return entries_;
    }
 
-   // otherwise check for divergent lastWriteTime and read the file
-   // if our internal list isn't up to date
-   else if (historyDBPath.lastWriteTime() != entryCacheLastWriteTime_)
+   // if the database was rotated (or otherwise shrank) since we last read
+   // it then re-read everything, starting with the rotated file
+   FilePath rotatedHistoryDBPath = historyDatabaseRotatedFilePath();
+   uintmax_t rotatedSize = rotatedHistoryDBPath.exists() ?
+                                          rotatedHistoryDBPath.size() : 0;
+   uintmax_t size = historyDBPath.size();
+   if (rotatedSize != entryCacheRotatedSize_ || size < entryCacheSize_)
    {
-      entries_.clear();
-
-      // establish a next index counter
-      int nextIndex = 0;
+      resetEntryCache();
 
-      // first read from rotated file if it exists
-      FilePath rotatedHistoryDBPath = historyDatabaseRotatedFilePath();
-      if (rotatedHistoryDBPath.exists())
+      if (rotatedSize > 0)
       {
-         Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                           rotatedHistoryDBPath,
-                           &entries_,
-                           boost::bind(readHistoryEntry, _1, _2, &nextIndex));
+         // (the rotated database doesn't change so an unterminated final
+         // line is as complete as it will ever be)
+         uintmax_t bytesRead = 0;
+         bool unterminated = false;
+         Error error = readEntries(rotatedHistoryDBPath,
+                                   0,
+                                   &bytesRead,
+                                   &unterminated);
          if (error)
             LOG_ERROR(error);
       }
 
+      entryCacheRotatedSize_ = rotatedSize;
+   }
 
-      // now read from main history db
-      std::vector<HistoryEntry> entries;
-      Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                           historyDBPath,
-                           &entries,
-                           boost::bind(readHistoryEntry, _1, _2, &nextIndex));
-      if (error)
+   // read any entries appended since we last read the main history db
+   if (size > entryCacheSize_)
+   {
+      // an entry read from an unterminated final line may have been only
+      // partly written, so it is replaced by whatever the line now holds
+      if (entryCacheUnterminated_)
       {
+         removeLastEntry();
+         entryCacheUnterminated_ = false;
+      }
+
+      uintmax_t bytesRead = 0;
+      Error error = readEntries(historyDBPath,
+                                entryCacheSize_,
+                                &bytesRead,
+                                &entryCacheUnterminated_);
+      if (error)
          LOG_ERROR(error);
+
+      entryCacheSize_ += bytesRead;
+   }
+
+   // return entries
+   return entries_;
+}
+
+void HistoryArchive::search(const std::vector<std::string>& searchTerms,
+                            std::size_t maxEntries,
+                            std::vector<HistoryEntry>* pMatches) const
+{
+   const std::vector<HistoryEntry>& allEntries = entries();
+
+   // examine candidates (or all entries if we couldn't narrow them down)
+   // starting with the most recent
+   const std::vector<std::size_t>* pCandidates = candidates(searchTerms);
+   std::size_t count = pCandidates ? pCandidates->size() : allEntries.size();
+   for (std::size_t i = count; i > 0; i--)
+   {
+      // check limit
+      if (pMatches->size() >= maxEntries)
+         break;
+
+      std::size_t position = pCandidates ? (*pCandidates)[i-1] : i-1;
+      const HistoryEntry& entry = allEntries[position];
+      if (containsAll(entry.command, searchTerms))
+         pMatches->push_back(entry);
+   }
+}
+
+void HistoryArchive::searchByPrefix(const std::string& prefix,
+                                    std::size_t maxEntries,
+                                    bool uniqueOnly,
+                                    std::vector<HistoryEntry>* pMatches) const
+{
+   const std::vector<HistoryEntry>& allEntries = entries();
+
+   // the prefix must also appear somewhere in the command so we can use
+   // it to narrow down the candidates
+   std::vector<std::string> searchTerms;
+   searchTerms.push_back(prefix);
+   const std::vector<std::size_t>* pCandidates = candidates(searchTerms);
+
+   std::set<std::string> matchedCommands;
+   std::size_t count = pCandidates ? pCandidates->size() : allEntries.size();
+   for (std::size_t i = count; i > 0; i--)
+   {
+      // check limit
+      if (pMatches->size() >= maxEntries)
+         break;
+
+      std::size_t position = pCandidates ? (*pCandidates)[i-1] : i-1;
+      const HistoryEntry& entry = allEntries[position];
+      if (boost::algorithm::starts_with(entry.command, prefix))
+      {
+         if (!uniqueOnly || (matchedCommands.count(entry.command) == 0))
+         {
+            pMatches->push_back(entry);
+            matchedCommands.insert(entry.command);
+         }
       }
-      else
+   }
+}
+
+void HistoryArchive::resetEntryCache() const
+{
+   entries_.clear();
+   trigramIndex_.clear();
+   entryCacheSize_ = 0;
+   entryCacheRotatedSize_ = 0;
+   entryCacheUnterminated_ = false;
+}
+
+Error HistoryArchive::readEntries(const FilePath& filePath,
+                                  uintmax_t offset,
+                                  uintmax_t* pBytesRead,
+                                  bool* pUnterminated) const
+{
+   *pUnterminated = false;
+
+   // open the file stream and seek to the first unread byte
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   try
+   {
+      pIfs->seekg(static_cast<std::streamoff>(offset));
+      std::streampos lastLineEnd = pIfs->tellg();
+
+      std::string line;
+      while (true)
       {
-         std::copy(entries.begin(),
-                   entries.end(),
-                   std::back_inserter(entries_));
+         // read the next line. a final line without a newline is read
+         // too but isn't counted in the bytes read (so that it's read
+         // again if the rest of it is yet to be written)
+         std::getline(*pIfs, line);
+         bool unterminated = pIfs->eof();
+         if (unterminated && line.empty())
+            break;
+         else if (!unterminated && pIfs->fail())
+            return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+         if (!unterminated)
+         {
+            lastLineEnd = pIfs->tellg();
+            *pBytesRead = static_cast<uintmax_t>(lastLineEnd) - offset;
+         }
+
+         // trim whitespace then ignore it if it is a blank line
+         boost::algorithm::trim(line);
+         if (line.empty())
+            continue;
+
+         // parse and index it
+         HistoryEntry entry;
+         if (readHistoryEntry(line, entries_.size(), &entry) ==
+             ReadCollectionAddLine)
+         {
+            entries_.push_back(entry);
+            indexEntry(entries_.size() - 1);
+            *pUnterminated = unterminated;
+         }
+
+         if (unterminated)
+            break;
+      }
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
 
-         entryCacheLastWriteTime_ = historyDBPath.lastWriteTime();
+   return Success();
+}
+
+void HistoryArchive::indexEntry(std::size_t position) const
+{
+   // entries are indexed in order so each posting list stays sorted and
+   // a trigram repeated within a command is recorded only once
+   const std::string& command = entries_[position].command;
+   for (std::size_t i = 0; i + 2 < command.size(); i++)
+   {
+      std::vector<std::size_t>& postings = trigramIndex_[trigramKey(command, i)];
+      if (postings.empty() || postings.back() != position)
+         postings.push_back(position);
+   }
+}
+
+void HistoryArchive::removeLastEntry() const
+{
+   // the last entry is at the back of any posting list it appears in
+   std::size_t position = entries_.size() - 1;
+   const std::string& command = entries_[position].command;
+   for (std::size_t i = 0; i + 2 < command.size(); i++)
+   {
+      TrigramIndex::iterator it = trigramIndex_.find(trigramKey(command, i));
+      if (it != trigramIndex_.end() && !it->second.empty() &&
+          it->second.back() == position)
+      {
+         it->second.pop_back();
+         if (it->second.empty())
+            trigramIndex_.erase(it);
       }
+   }
+   entries_.pop_back();
+}
 
+const std::vector<std::size_t>* HistoryArchive::candidates(
+                     const std::vector<std::string>& searchTerms) const
+{
+   // every match must contain every trigram of every search term, so the
+   // shortest posting list for any of those trigrams is a superset of the
+   // matches. returns NULL if no term is long enough to have a trigram
+   static const std::vector<std::size_t> kNoCandidates;
+   const std::vector<std::size_t>* pCandidates = NULL;
+   for (std::vector<std::string>::const_iterator it = searchTerms.begin();
+        it != searchTerms.end();
+        ++it)
+   {
+      const std::string& term = *it;
+      for (std::size_t i = 0; i + 2 < term.size(); i++)
+      {
+         TrigramIndex::const_iterator postingsIt =
+                                    trigramIndex_.find(trigramKey(term, i));
+         if (postingsIt == trigramIndex_.end())
+            return &kNoCandidates;
+
+         if (pCandidates == NULL ||
+             postingsIt->second.size() < pCandidates->size())
+         {
+            pCandidates = &(postingsIt->second);
+         }
+      }
    }
 
-   // return entries
-   return entries_;
+   return pCandidates;
 }
 
 void HistoryArchive::migrateRhistoryIfNecessary()
@@ -20,6 +20,8 @@
 #include <vector>
 
 #include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
 
 namespace rstudio {
 namespace core {
@@ -51,7 +53,11 @@ HistoryArchive& historyArchive();
 class HistoryArchive : boost::noncopyable
 {
 private:
-   HistoryArchive() : entryCacheLastWriteTime_(-1) {}
+   HistoryArchive()
+      : entryCacheSize_(0), entryCacheRotatedSize_(0),
+        entryCacheUnterminated_(false)
+   {
+   }
    friend HistoryArchive& historyArchive();
 
 public:
@@ -61,9 +67,50 @@ public:
    core::Error add(const std::string& command);
    const std::vector<HistoryEntry>& entries() const;
 
+   // find the most recent entries containing all of the search terms
+   // (most recent first)
+   void search(const std::vector<std::string>& searchTerms,
+               std::size_t maxEntries,
+               std::vector<HistoryEntry>* pMatches) const;
+
+   // find the most recent entries starting with prefix (most recent first)
+   void searchByPrefix(const std::string& prefix,
+                       std::size_t maxEntries,
+                       bool uniqueOnly,
+                       std::vector<HistoryEntry>* pMatches) const;
+
+private:
+   void resetEntryCache() const;
+   core::Error readEntries(const core::FilePath& historyDBPath,
+                           uintmax_t offset,
+                           uintmax_t* pBytesRead,
+                           bool* pUnterminated) const;
+   void indexEntry(std::size_t position) const;
+   void removeLastEntry() const;
+   const std::vector<std::size_t>* candidates(
+                     const std::vector<std::string>& searchTerms) const;
+
 private:
-   mutable time_t entryCacheLastWriteTime_;
+   // number of bytes of the history database which have been read into
+   // the cache (new entries are appended so we only need to read the tail)
+   mutable uintmax_t entryCacheSize_;
+
+   // size of the rotated database at the time the cache was populated
+   // (if this changes the database was rotated and we re-read everything)
+   mutable uintmax_t entryCacheRotatedSize_;
+
+   // whether the last entry was read from a final line without a newline
+   // (its bytes aren't counted in entryCacheSize_ so it is read again, and
+   // replaces this entry, once the database grows)
+   mutable bool entryCacheUnterminated_;
+
    mutable std::vector<HistoryEntry> entries_;
+
+   // positions within entries_ of the commands containing each trigram
+   // (ascending, so reverse iteration yields the most recent first)
+   typedef boost::unordered_map<boost::uint32_t, std::vector<std::size_t> >
+                                                               TrigramIndex;
+   mutable TrigramIndex trigramIndex_;
 };
                        
 } // namespace history
@@ -0,0 +1,168 @@
+/*
+ * SessionMetrics.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionMetrics.hpp"
+
+#include <map>
+#include <fstream>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/system/FileMonitor.hpp>
+
+#include <monitor/MonitorClient.hpp>
+#include <monitor/metrics/MetricsRegistry.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionModuleContext.hpp>
+
+#include "../SessionClientEventQueue.hpp"
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules { 
+namespace metrics {
+
+namespace {
+
+// how often metrics are sent to the monitor
+const int kMetricsIntervalSeconds = 60;
+
+// requests are counted by at most this many distinct uri classes (others
+// are counted as "other" so that stray uris can't create unbounded series)
+const std::size_t kMaxUriClasses = 64;
+
+std::map<std::string,monitor::metrics::Counter> s_requestCounters;
+
+monitor::metrics::Counter s_rBusyCounter;
+boost::posix_time::ptime s_rBusySince;
+
+monitor::metrics::Counter requestCounter(const std::string& uriClass)
+{
+   std::map<std::string,monitor::metrics::Counter>::const_iterator it =
+                                          s_requestCounters.find(uriClass);
+   if (it != s_requestCounters.end())
+      return it->second;
+
+   std::string label = s_requestCounters.size() < kMaxUriClasses ?
+                                          uriClass : std::string("other");
+   std::string labels =
+               "uri=\"" + monitor::metrics::escapeLabelValue(label) + "\"";
+   monitor::metrics::Counter counter =
+               monitor::metrics::counter("http_requests_total", labels);
+   if (label == uriClass)
+      s_requestCounters[uriClass] = counter;
+   return counter;
+}
+
+void onBeforeExecute()
+{
+   s_rBusySince = boost::posix_time::microsec_clock::universal_time();
+}
+
+void onConsolePrompt(const std::string&)
+{
+   if (!s_rBusySince.is_not_a_date_time())
+   {
+      boost::posix_time::time_duration busy =
+         boost::posix_time::microsec_clock::universal_time() - s_rBusySince;
+      s_rBusyCounter.add(busy.total_microseconds() / 1000000.0);
+      s_rBusySince = boost::posix_time::ptime();
+   }
+}
+
+double rBusy()
+{
+   return s_rBusySince.is_not_a_date_time() ? 0 : 1;
+}
+
+double clientEventQueueDepth()
+{
+   return static_cast<double>(clientEventQueue().size());
+}
+
+double fileMonitorCount()
+{
+   return static_cast<double>(
+                     core::system::file_monitor::activeMonitorCount());
+}
+
+#ifdef __linux__
+double residentMemoryBytes()
+{
+   // the second field of statm is the resident set size in pages
+   std::ifstream statm("/proc/self/statm");
+   long pages = 0, residentPages = 0;
+   if (!(statm >> pages >> residentPages))
+      return 0;
+   return static_cast<double>(residentPages) * ::sysconf(_SC_PAGESIZE);
+}
+#endif
+
+bool sendMetrics()
+{
+   monitor::client().sendMultiMetrics(
+         monitor::metrics::collect("rsession", kMetricsIntervalSeconds));
+   return true;
+}
+
+} // anonymous namespace
+
+void recordRequest(const std::string& uriClass)
+{
+   requestCounter(uriClass).increment();
+}
+
+Error initialize()
+{
+   using namespace monitor::metrics;
+   s_rBusyCounter = counter("r_busy_seconds_total");
+   registerGauge("r_busy", std::string(), rBusy);
+   registerGauge("client_event_queue_depth",
+                 std::string(),
+                 clientEventQueueDepth);
+   registerGauge("file_monitors", std::string(), fileMonitorCount);
+#ifdef __linux__
+   registerGauge("resident_memory_bytes", std::string(), residentMemoryBytes);
+#endif
+
+   module_context::events().onBeforeExecute.connect(onBeforeExecute);
+   module_context::events().onConsolePrompt.connect(onConsolePrompt);
+
+   // the monitor aggregates the metrics of all sessions (there is no
+   // monitor in standalone mode)
+   if (!session::options().standalone())
+   {
+      module_context::schedulePeriodicWork(
+                  boost::posix_time::seconds(kMetricsIntervalSeconds),
+                  sendMetrics,
+                  false,
+                  false);
+   }
+
+   return Success();
+}
+   
+} // namespace metrics
+} // namespace modules
+} // namesapce session
+} // namespace rstudio
@@ -22,11 +22,13 @@
 
 #include <boost/bind.hpp>
 #include <boost/regex.hpp>
+#include <boost/foreach.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/http/URL.hpp>
 #include <core/http/TcpIpBlockingClient.hpp>
+#include <core/r_util/RLibraryIndex.hpp>
 
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
@@ -288,6 +290,36 @@ SEXP rs_canInstallPackages()
                           &rProtect);
 }
 
+// read the index of a site library maintained by rserver (returns NULL if
+// there is no index for the library or it's out of date, and zero length
+// vectors, not NULL, for an empty library)
+SEXP rs_readLibraryIndex(SEXP libPathSEXP)
+{
+   std::string libPath = r::sexp::asString(libPathSEXP);
+   r_util::LibraryIndex index;
+   if (!r_util::readLibraryIndex(FilePath(kLibraryIndexPath),
+                                 FilePath(string_utils::systemToUtf8(libPath)),
+                                 &index))
+   {
+      return R_NilValue;
+   }
+
+   std::vector<std::string> names, versions, titles;
+   BOOST_FOREACH(const r_util::LibraryPackage& package, index.packages)
+   {
+      names.push_back(package.name);
+      versions.push_back(package.version);
+      titles.push_back(package.title);
+   }
+
+   r::sexp::Protect rProtect;
+   r::sexp::ListBuilder builder(&rProtect);
+   builder.add("name", names);
+   builder.add("version", versions);
+   builder.add("title", titles);
+   return r::sexp::create(builder, &rProtect);
+}
+
 void rs_packageLibraryMutated()
 {
    // broadcast event to server
@@ -394,6 +426,11 @@ Error initialize()
    methodDef3.numArgs = 0;
    r::routines::addCallMethod(methodDef3);
    
+   r::routines::registerCallMethod(
+            "rs_readLibraryIndex",
+            (DL_FUNC) rs_readLibraryIndex,
+            1);
+
    r::routines::registerCallMethod(
             "rs_getCachedAvailablePackages",
             (DL_FUNC) rs_getCachedAvailablePackages,
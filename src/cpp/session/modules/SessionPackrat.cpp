@@ -15,6 +15,14 @@
 
 #include "SessionPackrat.hpp"
 
+#include <map>
+
+#include <boost/crc.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/Hash.hpp>
@@ -48,6 +56,9 @@ using namespace rstudio::core;
 #define kPackratFolder "packrat/"
 #define kPackratLockfile "packrat.lock"
 #define kPackratLibPath kPackratFolder "lib"
+
+// packages are installed at lib/<platform>/<R version>/<package>
+#define kPackratLibraryDepth 2
 #define kPackratLockfilePath kPackratFolder kPackratLockfile
 
 #define kPackratActionRestore "restore"
@@ -217,39 +228,158 @@ std::string updateHash(PackratHashType hashType, PackratHashState hashState,
    return newHash;
 }
 
-// adds content from the given file to the given file if it's a 
-// DESCRIPTION file (used to summarize library content for hashing)
-bool addDescContent(int level, const FilePath& path, std::string* pDescContent)
+// Tracks the DESCRIPTION file of each package in the Packrat private library
+// so the library hash can be recomputed without walking the (very large)
+// library: each package's digest is refreshed as file changes within it are
+// observed, and the library hash combines the digests in path order.
+class LibraryHashState : boost::noncopyable
 {
-   std::string newDescContent;
-   if (path.filename() == "DESCRIPTION") 
+public:
+   LibraryHashState()
+      : valid_(false), incremental_(false)
+   {
+   }
+
+   // whether file changes are being observed (if not every hash must
+   // re-read the library)
+   void setIncremental(bool incremental)
+   {
+      incremental_ = incremental;
+      invalidate();
+   }
+
+   void invalidate()
+   {
+      valid_ = false;
+      digests_.clear();
+   }
+
+   std::string hash()
+   {
+      FilePath libraryPath =
+         projects::projectContext().directory().complete(kPackratLibPath);
+
+      if (!valid_ || !incremental_ || libraryPath != libraryPath_)
+         rebuild(libraryPath);
+
+      if (digests_.empty())
+         return "";
+
+      boost::crc_32_type result;
+      for (std::map<std::string, boost::uint32_t>::const_iterator it =
+              digests_.begin(); it != digests_.end(); ++it)
+      {
+         result.process_bytes(&it->second, sizeof(it->second));
+      }
+
+      std::ostringstream output;
+      output << std::uppercase << std::hex << result.checksum();
+      return output.str();
+   }
+
+   void onLibraryFileChanged(const FilePath& filePath)
+   {
+      if (!valid_)
+         return;
+
+      std::vector<std::string> components;
+      std::string relativePath = filePath.relativePath(libraryPath_);
+      boost::algorithm::split(components, relativePath,
+                              boost::algorithm::is_any_of("/"));
+
+      // a change above the package level (e.g. a new R version library)
+      // requires that we find the libraries again
+      if (components.size() <= static_cast<std::size_t>(kPackratLibraryDepth))
+      {
+         invalidate();
+         return;
+      }
+
+      // otherwise refresh the digest of the package the file belongs to
+      FilePath packagePath = libraryPath_;
+      for (int i = 0; i <= kPackratLibraryDepth; i++)
+         packagePath = packagePath.childPath(components[i]);
+      updateDigest(packagePath.childPath("DESCRIPTION"));
+   }
+
+private:
+   void rebuild(const FilePath& libraryPath)
+   {
+      libraryPath_ = libraryPath;
+      digests_.clear();
+
+      // find the libraries (one per platform and R version)
+      std::vector<FilePath> libraries(1, libraryPath);
+      for (int depth = 0; depth < kPackratLibraryDepth; depth++)
+      {
+         std::vector<FilePath> subdirs;
+         BOOST_FOREACH(const FilePath& dir, libraries)
+         {
+            std::vector<FilePath> children;
+            dir.children(&children);
+            BOOST_FOREACH(const FilePath& child, children)
+            {
+               if (child.isDirectory())
+                  subdirs.push_back(child);
+            }
+         }
+         libraries.swap(subdirs);
+      }
+
+      // read the DESCRIPTION file of each package within them
+      BOOST_FOREACH(const FilePath& library, libraries)
+      {
+         std::vector<FilePath> packages;
+         library.children(&packages);
+         BOOST_FOREACH(const FilePath& package, packages)
+         {
+            updateDigest(package.childPath("DESCRIPTION"));
+         }
+      }
+
+      valid_ = true;
+   }
+
+   void updateDigest(const FilePath& descFilePath)
    {
-      Error error = readStringFromFile(path, &newDescContent);
+      if (!descFilePath.exists())
+      {
+         digests_.erase(descFilePath.absolutePath());
+         return;
+      }
+
+      std::string descContent;
+      Error error = readStringFromFile(descFilePath, &descContent);
+      if (error)
+      {
+         LOG_ERROR(error);
+         digests_.erase(descFilePath.absolutePath());
+         return;
+      }
+
       // include the path of the file; on Windows the DESCRIPTION file moves
       // inside the library post-installation
-      pDescContent->append(path.absolutePath());
-      pDescContent->append(newDescContent);
+      boost::crc_32_type result;
+      result.process_bytes(descFilePath.absolutePath().data(),
+                           descFilePath.absolutePath().length());
+      result.process_bytes(descContent.data(), descContent.length());
+      digests_[descFilePath.absolutePath()] = result.checksum();
    }
-   return true;
-}
+
+private:
+   FilePath libraryPath_;
+   bool valid_;
+   bool incremental_;
+   std::map<std::string, boost::uint32_t> digests_;
+};
+
+LibraryHashState s_libraryHashState;
 
 // computes a hash of the content of all DESCRIPTION files in the Packrat
 // private library
 std::string computeLibraryHash()
 {
-   FilePath libraryPath = 
-      projects::projectContext().directory().complete(kPackratLibPath);
-
-   // find all DESCRIPTION files in the library and concatenate them to form
-   // a hashable state
-   std::string descFileContent;
-   libraryPath.childrenRecursive(
-         boost::bind(addDescContent, _1, _2, &descFileContent));
-
-   if (descFileContent.empty())
-      return "";
-
-   return hash::crc32HexHash(descFileContent);
+   return s_libraryHashState.hash();
 }
 
 // computes the hash of the current project's lockfile
@@ -567,15 +697,23 @@ void onLibraryUpdate(const std::string& oldHash, const std::string& newHash)
 
 void onFileChanged(FilePath sourceFilePath)
 {
-   // ignore file changes while Packrat is running
-   if (s_runningPackratAction != PACKRAT_ACTION_NONE)
-      return;
-   
    // we only care about mutations to files in the Packrat library directory
    // (and packrat.lock)
    FilePath libraryPath = 
       projects::projectContext().directory().complete(kPackratLibPath);
 
+   // ignore file changes while Packrat is running (forgetting what we know
+   // of the library since it's likely to be changing a lot)
+   if (s_runningPackratAction != PACKRAT_ACTION_NONE)
+   {
+      if (sourceFilePath.isWithin(libraryPath))
+         s_libraryHashState.invalidate();
+      return;
+   }
+
+   if (sourceFilePath.isWithin(libraryPath))
+      s_libraryHashState.onLibraryFileChanged(sourceFilePath);
+
    if (sourceFilePath.filename() == kPackratLockfile)
    {
       PACKRAT_TRACE("detected change to lockfile " << sourceFilePath);
@@ -608,6 +746,18 @@ void onFilesChanged(const std::vector<core::system::FileChangeEvent>& changes)
    }
 }
 
+void onMonitoringEnabled(const tree<core::FileInfo>& files)
+{
+   // the library hash can now be maintained from file changes
+   s_libraryHashState.setIncremental(true);
+}
+
+void onMonitoringDisabled()
+{
+   // we'll no longer learn of changes to the library
+   s_libraryHashState.setIncremental(false);
+}
+
 void onConsolePrompt(const std::string& prompt)
 {
    // Execute pending auto-snapshots if any exist. We don't execute these
@@ -718,7 +868,9 @@ Error initPackratMonitoring()
                  ", init monitoring");
 
    session::projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onMonitoringEnabled;
    cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onMonitoringDisabled;
    projects::projectContext().subscribeToFileMonitor("Packrat", cb);
    module_context::events().onSourceEditorFileSaved.connect(onFileChanged);
    module_context::events().onConsolePrompt.connect(onConsolePrompt);
@@ -0,0 +1,100 @@
+/*
+ * SessionTrace.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+
+#include "SessionTrace.hpp"
+
+#include <sstream>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Exec.hpp>
+#include <core/Trace.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
+#include <r/RSexp.hpp>
+#include <r/RRoutines.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules { 
+namespace trace {
+
+namespace {
+
+SEXP rs_setTracingEnabled(SEXP enabledSEXP)
+{
+   core::trace::setEnabled(r::sexp::asLogical(enabledSEXP));
+   return R_NilValue;
+}
+
+// /trace/events returns the spans recorded (as a Chrome trace which can be
+// loaded into chrome://tracing) and /trace/histograms the latencies of all
+// spans by category and name
+void handleTraceRequest(const http::Request& request,
+                        http::Response* pResponse)
+{
+   using namespace boost::algorithm;
+
+   json::Object resultJson;
+   if (starts_with(request.uri(), "/trace/events"))
+   {
+      resultJson = core::trace::traceEvents();
+   }
+   else if (starts_with(request.uri(), "/trace/histograms"))
+   {
+      resultJson = core::trace::latencyHistograms();
+   }
+   else
+   {
+      pResponse->setNotFoundError(request.uri());
+      return;
+   }
+
+   std::ostringstream ostr;
+   json::write(resultJson, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
+}
+   
+} // anonymous namespace
+   
+Error initialize()
+{  
+   R_CallMethodDef setTracingEnabledMethodDef ;
+   setTracingEnabledMethodDef.name = "rs_setTracingEnabled" ;
+   setTracingEnabledMethodDef.fun = (DL_FUNC)rs_setTracingEnabled ;
+   setTracingEnabledMethodDef.numArgs = 1;
+   r::routines::addCallMethod(setTracingEnabledMethodDef);
+
+   using boost::bind;
+   using namespace module_context;
+   ExecBlock initBlock ;
+   initBlock.addFunctions()
+      (bind(registerUriHandler, "/trace/", handleTraceRequest))
+      (bind(sourceModuleRFile, "SessionTrace.R"));
+   return initBlock.execute();
+}
+   
+} // namespace trace
+} // namespace modules
+} // namesapce session
+} // namespace rstudio
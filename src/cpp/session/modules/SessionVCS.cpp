@@ -135,12 +135,13 @@ class NullFileDecorationContext : public FileDecorationContext
 } // anonymous namespace
 
 boost::shared_ptr<FileDecorationContext> fileDecorationContext(
-                                            const core::FilePath& rootDir)
+                                 const core::FilePath& rootDir,
+                                 const std::vector<core::FilePath>& changedFiles)
 {
    if (git::isGitEnabled())
    {
       return boost::shared_ptr<FileDecorationContext>(
-                           new git::GitFileDecorationContext(rootDir));
+                     new git::GitFileDecorationContext(rootDir, changedFiles));
    }
    else if (svn::isSvnEnabled())
    {
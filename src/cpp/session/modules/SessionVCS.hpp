@@ -40,8 +40,12 @@ enum VCS
    VCSSubversion
 };
 
+// changedFiles are files which are known to have changed since their
+// status was last queried (e.g. as reported by a file monitor)
 boost::shared_ptr<FileDecorationContext> fileDecorationContext(
-                                            const core::FilePath& rootDir);
+      const core::FilePath& rootDir,
+      const std::vector<core::FilePath>& changedFiles =
+                                          std::vector<core::FilePath>());
 
 VCS activeVCS();
 std::string activeVCSName();
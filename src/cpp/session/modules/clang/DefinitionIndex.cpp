@@ -17,10 +17,13 @@
 
 #include <deque>
 
+#include <boost/scoped_ptr.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/DateTime.hpp>
 #include <core/PerformanceTimer.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/TaskScheduler.hpp>
 #include <core/libclang/LibClang.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <session/IncrementalFileChangeHandler.hpp>
@@ -30,6 +33,7 @@
 
 #include "RSourceIndex.hpp"
 #include "RCompilationDatabase.hpp"
+#include "FindReferences.hpp"
 
 using namespace rstudio::core;
 using namespace rstudio::core::libclang;
@@ -46,15 +50,67 @@ bool s_initialized = false;
 
 struct CppDefinitions
 {
+   CppDefinitions() : fileLastWrite(0) {}
+
    std::string file;
    std::time_t fileLastWrite;
    std::deque<CppDefinition> definitions;
+   ReferencesByUSR references;
 };
 
 // store definitions by file
 typedef std::map<std::string,CppDefinitions> DefinitionsByFile;
 DefinitionsByFile s_definitionsByFile;
 
+// translation units are parsed by a thread of their own (parsing a file
+// takes long enough to hold up the main thread) and the definitions found
+// are merged into the index on the main thread
+core::tasks::ThreadPool& indexingThread()
+{
+   static core::tasks::ThreadPool* pThread = new core::tasks::ThreadPool(1);
+   return *pThread;
+}
+
+// cancelled at shutdown (so that parses which haven't started are skipped)
+core::tasks::CancellationToken s_indexingToken;
+
+// number of changes to each file (a parse whose file has changed again
+// since it was queued is discarded)
+std::map<std::string,int> s_indexingGeneration;
+
+// index shared by all of the translation units we parse (created once
+// rather than for every file and only used by the indexing thread)
+CXIndex s_definitionIndex = NULL;
+
+CXIndex definitionIndex(bool verbose)
+{
+   if (s_definitionIndex == NULL)
+   {
+      s_definitionIndex = libclang::clang().createIndex(
+                   1 /* Exclude PCH */,
+                   verbose ? 1 : 0);
+   }
+   return s_definitionIndex;
+}
+
+void disposeDefinitionIndex()
+{
+   if (s_definitionIndex != NULL)
+   {
+      libclang::clang().disposeIndex(s_definitionIndex);
+      s_definitionIndex = NULL;
+   }
+}
+
+// references to declarations within this path are recorded in the index
+FilePath s_referencesScopePath;
+
+// number of files indexed since startup (for verbose progress output)
+std::size_t s_indexedFileCount = 0;
+
+// defined below (appends the file's definitions to the index log)
+void logDefinitionsChange(const std::string& file);
+
 // visitor used to populate deque
 bool insertDefinition(const CppDefinition& definition,
                       CppDefinitions* pDefinitions)
@@ -171,13 +227,110 @@ CXChildVisitResult cursorVisitor(CXCursor cxCursor,
    }
 }
 
+// the definitions of a file parsed by the indexing thread
+struct IndexedFile
+{
+   IndexedFile() : parsed(false) {}
+
+   bool parsed;
+   CppDefinitions definitions;
+};
+
+// (runs on the indexing thread)
+IndexedFile parseDefinitions(const std::string& file,
+                             std::time_t fileLastWrite,
+                             const std::vector<std::string>& compileArgs,
+                             const FilePath& referencesScopePath,
+                             bool verbose)
+{
+   boost::scoped_ptr<core::PerformanceTimer> pTimer;
+   if (verbose)
+   {
+      std::cerr << "CLANG DEFINITION INDEXING: " << file << std::endl;
+      pTimer.reset(new core::PerformanceTimer(FilePath(file).filename()));
+   }
+
+   // get args in form clang expects
+   core::system::ProcessArgs argsArray(compileArgs);
+
+   // parse the translation unit
+   IndexedFile indexed;
+   CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
+                         definitionIndex(verbose),
+                         file.c_str(),
+                         argsArray.args(),
+                         argsArray.argCount(),
+                         NULL, 0, // no unsaved files
+                         CXTranslationUnit_None |
+                         CXTranslationUnit_Incomplete);
+   if (tu == NULL)
+      return indexed;
+
+   // create definitions and wire visitor to it
+   indexed.parsed = true;
+   indexed.definitions.file = file;
+   indexed.definitions.fileLastWrite = fileLastWrite;
+   DefinitionVisitor visitor =
+      boost::bind(insertDefinition, _1, &indexed.definitions);
+
+   // visit the cursors
+   libclang::clang().visitChildren(
+        libclang::clang().getTranslationUnitCursor(tu),
+        cursorVisitor,
+        (CXClientData)&visitor);
+
+   // record references to the package's own declarations
+   indexReferences(tu, referencesScopePath, &indexed.definitions.references);
+
+   // dispose translation unit
+   libclang::clang().disposeTranslationUnit(tu);
+
+   return indexed;
+}
+
+// (runs on the main thread once the indexing thread has parsed the file)
+void mergeDefinitions(const std::string& file,
+                      int generation,
+                      const core::tasks::Future<IndexedFile>& result)
+{
+   // (cancelled at shutdown)
+   if (result.error())
+      return;
+
+   // discard the definitions if the file has changed since it was queued
+   if (s_indexingGeneration[file] != generation)
+      return;
+
+   IndexedFile indexed = result.value();
+   if (!indexed.parsed)
+   {
+      LOG_ERROR_MESSAGE("Error parsing translation unit " + file);
+      logDefinitionsChange(file);
+      return;
+   }
+
+   s_definitionsByFile[file] = indexed.definitions;
+
+   if (rSourceIndex().verbose() > 0)
+   {
+      const CppDefinitions& definitions = s_definitionsByFile[file];
+      std::cerr << "  (" << definitions.definitions.size()
+                << " definitions, " << definitions.references.size()
+                << " referenced symbols, " << ++s_indexedFileCount
+                << " files indexed)" << std::endl;
+   }
+
+   // persist the change
+   logDefinitionsChange(file);
+}
+
 void fileChangeHandler(const core::system::FileChangeEvent& event)
 {
    // alias the filename
    std::string file = event.fileInfo().absolutePath();
 
-   // special case: we write all definitions to disk at shutdown, when
-   // we come back up all of the files will come back in as "add" events,
+   // special case: we persist all definitions to disk, when we come
+   // back up all of the files will come back in as "add" events,
    // for this case we need to ignore the add if we already have a fresh
    // enough index of the file
    if (event.type() == core::system::FileChangeEvent::FileAdded)
@@ -192,8 +345,10 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
       }
    }
 
-   // always remove existing definitions
+   // always remove existing definitions (and discard any parse of the file
+   // which is still in progress)
    s_definitionsByFile.erase(file);
+   int generation = ++s_indexingGeneration[file];
 
    // if this is an add or an update then re-index
    if (event.type() == core::system::FileChangeEvent::FileAdded ||
@@ -206,44 +361,25 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
 
       if (!compileArgs.empty())
       {
-         // create index
-         CXIndex index = libclang::clang().createIndex(
-                   1 /* Exclude PCH */,
-                   (rSourceIndex().verbose() > 0) ? 1 : 0);
-
-         // get args in form clang expects
-         core::system::ProcessArgs argsArray(compileArgs);
-
-         // parse the translation unit
-         CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
-                               index,
-                               file.c_str(),
-                               argsArray.args(),
-                               argsArray.argCount(),
-                               NULL, 0, // no unsaved files
-                               CXTranslationUnit_None |
-                               CXTranslationUnit_Incomplete);
-
-
-         // create definitions and wire visitor to it
-         CppDefinitions definitions;
-         definitions.file = file;
-         definitions.fileLastWrite = event.fileInfo().lastWriteTime();
-         s_definitionsByFile[file] = definitions;
-         DefinitionVisitor visitor =
-            boost::bind(insertDefinition, _1, &s_definitionsByFile[file]);
-
-         // visit the cursors
-         libclang::clang().visitChildren(
-              libclang::clang().getTranslationUnitCursor(tu),
-              cursorVisitor,
-              (CXClientData)&visitor);
-
-         // dispose translation unit and index
-         libclang::clang().disposeTranslationUnit(tu);
-         libclang::clang().disposeIndex(index);
+         // parse on the indexing thread and merge (and persist) the
+         // definitions here. the removal needn't be persisted in the
+         // meantime since the persisted definitions are older than the file
+         boost::function<IndexedFile()> parse =
+               boost::bind(parseDefinitions,
+                           file,
+                           event.fileInfo().lastWriteTime(),
+                           compileArgs,
+                           s_referencesScopePath,
+                           rSourceIndex().verbose() > 0);
+         core::tasks::schedule(&indexingThread(), parse, s_indexingToken)
+            .onReady(&core::tasks::mainThreadExecutor(),
+                     boost::bind(mergeDefinitions, file, generation, _1));
+         return;
       }
    }
+
+   // persist the change
+   logDefinitionsChange(file);
 }
 
 } // anonymous namespace
@@ -455,15 +591,145 @@ CppDefinition cppDefinitionFromJson(const json::Object& object)
    return definition;
 }
 
+json::Array fileRangesToJson(const std::vector<FileRange>& ranges)
+{
+   // all references are within the indexed file so we store only
+   // the line and column of the start and end of each range
+   json::Array rangesJson;
+   BOOST_FOREACH(const FileRange& range, ranges)
+   {
+      rangesJson.push_back(static_cast<int>(range.start.line));
+      rangesJson.push_back(static_cast<int>(range.start.column));
+      rangesJson.push_back(static_cast<int>(range.end.line));
+      rangesJson.push_back(static_cast<int>(range.end.column));
+   }
+   return rangesJson;
+}
+
+void fileRangesFromJson(const json::Array& rangesJson,
+                        const FilePath& filePath,
+                        std::vector<FileRange>* pRanges)
+{
+   for (std::size_t i = 0; (i + 3) < rangesJson.size(); i += 4)
+   {
+      if (!json::isType<int>(rangesJson[i]) ||
+          !json::isType<int>(rangesJson[i+1]) ||
+          !json::isType<int>(rangesJson[i+2]) ||
+          !json::isType<int>(rangesJson[i+3]))
+      {
+         LOG_ERROR_MESSAGE("Unexpected non-integer range in definition index");
+         return;
+      }
+
+      FileRange range;
+      range.start = FileLocation(filePath,
+                                 rangesJson[i].get_int(),
+                                 rangesJson[i+1].get_int());
+      range.end = FileLocation(filePath,
+                               rangesJson[i+2].get_int(),
+                               rangesJson[i+3].get_int());
+      pRanges->push_back(range);
+   }
+}
+
+// the index is a snapshot of every file's definitions (a JSON array) and a
+// log of the changes since the snapshot was written (a JSON object per line
+// with either a file's definitions or its removal). changes are appended to
+// the log as files are indexed and the log is folded into the snapshot when
+// the index is loaded, at shutdown, and whenever it grows larger than the
+// snapshot
 FilePath definitionIndexFilePath()
 {
    return module_context::scopedScratchPath().childPath("cpp-definition-cache");
 }
 
-void loadDefinitionIndex()
+FilePath definitionIndexLogFilePath()
+{
+   return module_context::scopedScratchPath().childPath(
+                                             "cpp-definition-cache-log");
+}
+
+json::Object definitionsToJson(const CppDefinitions& definitions)
+{
+   using namespace safe_convert;
+
+   json::Object definitionsJson;
+   definitionsJson["file"] = definitions.file;
+   definitionsJson["file_last_write"] = numberTo<double>(
+                                            definitions.fileLastWrite, 0);
+   json::Array defsArrayJson;
+   std::transform(definitions.definitions.begin(),
+                  definitions.definitions.end(),
+                  std::back_inserter(defsArrayJson),
+                  cppDefinitionToJson);
+   definitionsJson["definitions"] = defsArrayJson;
+   json::Object refsJson;
+   BOOST_FOREACH(const ReferencesByUSR::value_type& refs,
+                 definitions.references)
+   {
+      refsJson[refs.first] = fileRangesToJson(refs.second);
+   }
+   definitionsJson["references"] = refsJson;
+   return definitionsJson;
+}
+
+bool definitionsFromJson(const json::Object& definitionsObject,
+                         CppDefinitions* pDefinitions)
 {
    using namespace safe_convert;
 
+   // indexes written before references were recorded don't have
+   // them (skip so that the file is re-indexed)
+   if (definitionsObject.find("references") == definitionsObject.end())
+      return false;
+
+   json::Array defsArrayJson;
+   json::Object refsJson;
+   double fileLastWrite;
+   Error error = json::readObject(definitionsObject,
+                                  "file", &pDefinitions->file,
+                                  "file_last_write", &fileLastWrite,
+                                  "definitions", &defsArrayJson,
+                                  "references", &refsJson);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+   pDefinitions->fileLastWrite = numberTo<std::time_t>(fileLastWrite, 0);
+
+   BOOST_FOREACH(const json::Value& defJson, defsArrayJson)
+   {
+      if (!json::isType<json::Object>(defJson))
+      {
+         LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
+         continue;
+      }
+
+      CppDefinition definition = cppDefinitionFromJson(defJson.get_obj());
+      if (!definition.empty())
+         pDefinitions->definitions.push_back(definition);
+   }
+
+   FilePath filePath(pDefinitions->file);
+   BOOST_FOREACH(const json::Member& refJson, refsJson)
+   {
+      if (!json::isType<json::Array>(refJson.second))
+      {
+         LOG_ERROR_MESSAGE("Unexpected non-array type in definition index");
+         continue;
+      }
+
+      fileRangesFromJson(refJson.second.get_array(),
+                         filePath,
+                         &pDefinitions->references[refJson.first]);
+   }
+
+   return true;
+}
+
+void loadDefinitionIndexSnapshot()
+{
    FilePath indexFilePath = definitionIndexFilePath();
    if (!indexFilePath.exists())
       return;
@@ -493,75 +759,152 @@ void loadDefinitionIndex()
          continue;
       }
 
-      json::Array defsArrayJson;
-      double fileLastWrite;
       CppDefinitions definitions;
-      Error error = json::readObject(definitionsJson.get_obj(),
-                                     "file", &definitions.file,
-                                     "file_last_write", &fileLastWrite,
-                                     "definitions", &defsArrayJson);
-      if (error)
+      if (definitionsFromJson(definitionsJson.get_obj(), &definitions))
+         s_definitionsByFile[definitions.file] = definitions;
+   }
+}
+
+void replayDefinitionIndexLog()
+{
+   FilePath logFilePath = definitionIndexLogFilePath();
+   if (!logFilePath.exists())
+      return;
+
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(logFilePath, &lines);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   BOOST_FOREACH(const std::string& line, lines)
+   {
+      // (the last line may be incomplete if the session was killed while
+      // it was being written)
+      json::Value recordJson;
+      if (line.empty() ||
+          !json::parse(line, &recordJson) ||
+          !json::isType<json::Object>(recordJson))
       {
-         LOG_ERROR(error);
          continue;
       }
-      definitions.fileLastWrite = numberTo<std::time_t>(fileLastWrite, 0);
 
-      // if the file doesn't exist then bail
-      if (!FilePath::exists(definitions.file))
-         continue;
-
-      BOOST_FOREACH(const json::Value& defJson, defsArrayJson)
+      const json::Object& recordObject = recordJson.get_obj();
+      json::Object::const_iterator removed = recordObject.find("removed");
+      if (removed != recordObject.end())
       {
-         if (!json::isType<json::Object>(defJson))
-         {
-            LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-            continue;
-         }
-
-         CppDefinition definition = cppDefinitionFromJson(defJson.get_obj());
-         if (!definition.empty())
-            definitions.definitions.push_back(definition);
+         if (json::isType<std::string>(removed->second))
+            s_definitionsByFile.erase(removed->second.get_str());
+         continue;
       }
 
-      s_definitionsByFile[definitions.file] = definitions;
+      CppDefinitions definitions;
+      if (definitionsFromJson(recordObject, &definitions))
+         s_definitionsByFile[definitions.file] = definitions;
    }
 }
 
+// size of the snapshot and log (used to decide when to compact)
+uintmax_t s_snapshotSize = 0;
+uintmax_t s_logSize = 0;
 
 void saveDefinitionIndex()
 {
-   using namespace safe_convert;
-
    json::Array indexJson;
    BOOST_FOREACH(const DefinitionsByFile::value_type& defs, s_definitionsByFile)
    {
-      const CppDefinitions& definitions = defs.second;
-      json::Object definitionsJson;
-      definitionsJson["file"] = definitions.file;
-      definitionsJson["file_last_write"] = numberTo<double>(
-                                               definitions.fileLastWrite, 0);
-      json::Array defsArrayJson;
-      std::transform(definitions.definitions.begin(),
-                     definitions.definitions.end(),
-                     std::back_inserter(defsArrayJson),
-                     cppDefinitionToJson);
-      definitionsJson["definitions"] = defsArrayJson;
+      indexJson.push_back(definitionsToJson(defs.second));
+   }
 
-      indexJson.push_back(definitionsJson);
+   std::ostringstream ostr;
+   json::write(indexJson, ostr);
+   std::string contents = ostr.str();
+
+   // write the snapshot before removing the log so that a failure part way
+   // through loses nothing (replaying the log on the new snapshot is
+   // harmless)
+   FilePath indexFilePath = definitionIndexFilePath();
+   FilePath tempFilePath = indexFilePath.parent().childPath(
+                                    indexFilePath.filename() + ".tmp");
+   Error error = writeStringToFile(tempFilePath, contents);
+   if (!error)
+      error = tempFilePath.move(indexFilePath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   error = definitionIndexLogFilePath().removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   s_snapshotSize = contents.size();
+   s_logSize = 0;
+}
+
+void loadDefinitionIndex()
+{
+   loadDefinitionIndexSnapshot();
+   replayDefinitionIndexLog();
+
+   // drop files which no longer exist
+   for (DefinitionsByFile::iterator it = s_definitionsByFile.begin();
+        it != s_definitionsByFile.end(); )
+   {
+      if (!FilePath::exists(it->first))
+         s_definitionsByFile.erase(it++);
+      else
+         ++it;
    }
 
+   // fold the log into the snapshot
+   if (definitionIndexLogFilePath().exists())
+      saveDefinitionIndex();
+   else if (definitionIndexFilePath().exists())
+      s_snapshotSize = definitionIndexFilePath().size();
+}
+
+void logDefinitionsChange(const std::string& file)
+{
+   json::Object recordJson;
+   DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
+   if (it != s_definitionsByFile.end())
+      recordJson = definitionsToJson(it->second);
+   else
+      recordJson["removed"] = file;
+
    std::ostringstream ostr;
-   json::writeFormatted(indexJson, ostr);
-   Error error = writeStringToFile(definitionIndexFilePath(), ostr.str());
+   json::write(recordJson, ostr);
+   ostr << std::endl;
+   std::string record = ostr.str();
+
+   Error error = appendToFile(definitionIndexLogFilePath(), record);
    if (error)
+   {
       LOG_ERROR(error);
+      return;
+   }
+
+   // once the log is larger than the snapshot (i.e. replaying it costs more
+   // than reading the index) fold it into the snapshot
+   s_logSize += record.size();
+   if (s_logSize > s_snapshotSize)
+      saveDefinitionIndex();
 }
 
 void onShutdown(bool terminatedNormally)
 {
-   if (terminatedNormally)
+   if (terminatedNormally && definitionIndexLogFilePath().exists())
       saveDefinitionIndex();
+
+   // skip the parses which haven't started (the files are re-indexed when
+   // we next start since their definitions were removed from the index)
+   // and dispose the index once the current parse (if any) is done
+   s_indexingToken.cancel();
+   indexingThread().post(disposeDefinitionIndex);
 }
 
 
@@ -612,6 +955,46 @@ void searchDefinitions(const std::string& term,
    }
 }
 
+bool isReferenceIndexed(const FileLocation& declaration)
+{
+   return s_initialized &&
+          !s_referencesScopePath.empty() &&
+          declaration.filePath.isWithin(s_referencesScopePath);
+}
+
+bool findIndexedReferences(const std::string& file,
+                           const std::string& USR,
+                           std::vector<FileRange>* pRefs)
+{
+   // bail if we aren't initialized
+   if (!s_initialized)
+      return false;
+
+   // the file must be in the index and the index must be up to date
+   DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
+   if (it == s_definitionsByFile.end())
+      return false;
+   const CppDefinitions& definitions = it->second;
+   FilePath filePath(file);
+   if (!filePath.exists() ||
+       filePath.lastWriteTime() > definitions.fileLastWrite)
+   {
+      return false;
+   }
+
+   // copy the references
+   ReferencesByUSR::const_iterator refsIt =
+                        definitions.references.find(normalizedUSR(USR));
+   if (refsIt != definitions.references.end())
+   {
+      std::copy(refsIt->second.begin(),
+                refsIt->second.end(),
+                std::back_inserter(*pRefs));
+   }
+
+   return true;
+}
+
 Error initializeDefinitionIndex()
 {
    using namespace projects;
@@ -622,6 +1005,7 @@ Error initializeDefinitionIndex()
 
       // check for src and inst/include dirs
       FilePath pkgPath = projects::projectContext().buildTargetPath();
+      s_referencesScopePath = pkgPath;
       FilePath srcPath = pkgPath.childPath("src");
       FilePath includePath = pkgPath.childPath("inst/include");
       if (srcPath.exists() || includePath.exists())
@@ -85,6 +85,15 @@ core::libclang::FileLocation findDefinitionLocation(
 void searchDefinitions(const std::string& term,
                        std::vector<CppDefinition>* pDefinitions);
 
+// does the index record references to the declaration at this location?
+bool isReferenceIndexed(const core::libclang::FileLocation& declaration);
+
+// copy indexed references to USR within file (returns false if the file
+// has no up to date entry in the index)
+bool findIndexedReferences(const std::string& file,
+                           const std::string& USR,
+                           std::vector<core::libclang::FileRange>* pRefs);
+
 core::Error initializeDefinitionIndex();
 
 } // namespace clang
@@ -29,6 +29,7 @@
 
 #include "RSourceIndex.hpp"
 #include "RCompilationDatabase.hpp"
+#include "DefinitionIndex.hpp"
 
 using namespace rstudio::core;
 using namespace rstudio::core::libclang;
@@ -74,6 +75,61 @@ bool equalUSR(const std::string& USR1, const std::string& USR2)
    }
 }
 
+// identifier range for a reference (tokenizes to extract the identifer
+// location for cursors that represent larger source constructs)
+FileRange referenceRange(CXTranslationUnit tu,
+                         const Cursor& cursor,
+                         const Cursor& referencedCursor,
+                         std::string* pSpelling)
+{
+   FileRange foundRange;
+   libclang::Tokens tokens(tu, cursor.getExtent());
+   std::vector<unsigned> indexes;
+
+   // for constructors & destructors we search backwards so that the
+   // match is for the constructor identifier rather than the class
+   // identifer
+   unsigned numTokens = tokens.numTokens();
+   if (referencedCursor.getKind() == CXCursor_Constructor ||
+       referencedCursor.getKind() == CXCursor_Destructor)
+   {
+      for (unsigned i = 0; i < numTokens; i++)
+         indexes.push_back(numTokens - i - 1);
+   }
+   else
+   {
+      for (unsigned i = 0; i < numTokens; i++)
+         indexes.push_back(i);
+   }
+
+   // cycle through the tokens
+   BOOST_FOREACH(unsigned i, indexes)
+   {
+      Token token = tokens.getToken(i);
+      if (token.kind() == CXToken_Identifier &&
+          token.spelling() == cursor.spelling())
+      {
+         // record spelling if necessary
+         if (pSpelling != NULL && pSpelling->empty())
+            *pSpelling = cursor.spelling();
+
+         // record the range
+         foundRange = token.extent().getFileRange();
+
+         break;
+      }
+   }
+
+   // if we didn't find an identifier that matches use the
+   // original match (i.e. important for constructors where
+   // the 'spelling' of the invocation is the name of the
+   // variable declared)
+   if (foundRange.empty())
+      foundRange = cursor.getExtent().getFileRange();
+
+   return foundRange;
+}
+
 CXChildVisitResult findReferencesVisitor(CXCursor cxCursor,
                                          CXCursor,
                                          CXClientData data)
@@ -100,52 +156,10 @@ CXChildVisitResult findReferencesVisitor(CXCursor cxCursor,
       // check for matching USR
       if (equalUSR(referencedCursor.getUSR(), pData->USR))
       {
-         // tokenize to extract identifer location for cursors that
-         // represent larger source constructs
-         FileRange foundRange;
-         libclang::Tokens tokens(pData->tu, cursor.getExtent());
-         std::vector<unsigned> indexes;
-
-         // for constructors & destructors we search backwards so that the
-         // match is for the constructor identifier rather than the class
-         // identifer
-         unsigned numTokens = tokens.numTokens();
-         if (referencedCursor.getKind() == CXCursor_Constructor ||
-             referencedCursor.getKind() == CXCursor_Destructor)
-         {
-            for (unsigned i = 0; i < numTokens; i++)
-               indexes.push_back(numTokens - i - 1);
-         }
-         else
-         {
-            for (unsigned i = 0; i < numTokens; i++)
-               indexes.push_back(i);
-         }
-
-         // cycle through the tokens
-         BOOST_FOREACH(unsigned i, indexes)
-         {
-            Token token = tokens.getToken(i);
-            if (token.kind() == CXToken_Identifier &&
-                token.spelling() == cursor.spelling())
-            {
-               // record spelling if necessary
-               if (pData->spelling.empty())
-                  pData->spelling = cursor.spelling();
-
-               // record the range
-               foundRange = token.extent().getFileRange();
-
-               break;
-            }
-         }
-
-         // if we didn't find an identifier that matches use the
-         // original match (i.e. important for constructors where
-         // the 'spelling' of the invocation is the name of the
-         // variable declared)
-         if (foundRange.empty())
-            foundRange = cursor.getExtent().getFileRange();
+         FileRange foundRange = referenceRange(pData->tu,
+                                               cursor,
+                                               referencedCursor,
+                                               &pData->spelling);
 
          // record the range if it's not a duplicate of the previous range
          if (pData->references.empty() ||
@@ -160,6 +174,61 @@ CXChildVisitResult findReferencesVisitor(CXCursor cxCursor,
    return CXChildVisit_Recurse;
 }
 
+struct IndexReferencesData
+{
+   IndexReferencesData(CXTranslationUnit tu,
+                       const FilePath& scopePath,
+                       ReferencesByUSR* pReferences)
+      : tu(tu), scopePath(scopePath), pReferences(pReferences)
+   {
+   }
+   CXTranslationUnit tu;
+   FilePath scopePath;
+   ReferencesByUSR* pReferences;
+};
+
+CXChildVisitResult indexReferencesVisitor(CXCursor cxCursor,
+                                          CXCursor,
+                                          CXClientData data)
+{
+   // get pointer to data struct
+   IndexReferencesData* pData = (IndexReferencesData*)data;
+
+   // reference to the cursor (ensure valid)
+   Cursor cursor(cxCursor);
+   if (!cursor.isValid())
+      return CXChildVisit_Continue;
+
+   // continue with sibling if it's not from the main file
+   SourceLocation location = cursor.getSourceLocation();
+   if (!location.isFromMainFile())
+      return CXChildVisit_Continue;
+
+   // record references to declarations within the scope path
+   Cursor referencedCursor = cursor.getReferenced();
+   if (referencedCursor.isValid() && referencedCursor.isDeclaration())
+   {
+      FileLocation declLocation =
+               referencedCursor.getSourceLocation().getSpellingLocation();
+      std::string USR = referencedCursor.getUSR();
+      if (!USR.empty() && declLocation.filePath.isWithin(pData->scopePath))
+      {
+         FileRange foundRange = referenceRange(pData->tu,
+                                               cursor,
+                                               referencedCursor,
+                                               NULL);
+
+         std::vector<FileRange>& refs =
+                              (*pData->pReferences)[normalizedUSR(USR)];
+         if (refs.empty() || (refs.back() != foundRange))
+            refs.push_back(foundRange);
+      }
+   }
+
+   // recurse into namespaces, classes, etc.
+   return CXChildVisit_Recurse;
+}
+
 class SourceMarkerGenerator
 {
 public:
@@ -312,7 +381,24 @@ void findReferences(std::string USR,
 
 } // anonymous namespace
 
+std::string normalizedUSR(const std::string& USR)
+{
+   if (boost::algorithm::ends_with(USR, "#"))
+      return USR.substr(0, USR.length() - 1);
+   else
+      return USR;
+}
 
+void indexReferences(CXTranslationUnit tu,
+                     const FilePath& scopePath,
+                     ReferencesByUSR* pReferences)
+{
+   IndexReferencesData indexReferencesData(tu, scopePath, pReferences);
+   libclang::clang().visitChildren(
+               libclang::clang().getTranslationUnitCursor(tu),
+               indexReferencesVisitor,
+               (CXClientData)&indexReferencesData);
+}
 
 core::Error findReferences(const core::libclang::FileLocation& location,
                            std::string* pSpelling,
@@ -340,6 +426,12 @@ core::Error findReferences(const core::libclang::FileLocation& location,
       std::map<std::string,TranslationUnit> indexedUnits =
                            rSourceIndex().getIndexedTranslationUnits();
 
+      // references to declarations within the package are recorded by
+      // the project index (so we can avoid parsing files to find them)
+      bool useReferenceIndex = isReferenceIndexed(
+                           cursor.getSourceLocation().getSpellingLocation());
+      bool foundIndexedReferences = false;
+
       BOOST_FOREACH(const std::string& filename, files)
       {
          // first look in already indexed translation units
@@ -353,6 +445,12 @@ core::Error findReferences(const core::libclang::FileLocation& location,
                            pSpelling,
                            pRefs);
          }
+         // next look in the project index
+         else if (useReferenceIndex &&
+                  findIndexedReferences(filename, USR, pRefs))
+         {
+            foundIndexedReferences = true;
+         }
          else
          {
             // get the compilation arguments for this file and use them to
@@ -390,6 +488,10 @@ core::Error findReferences(const core::libclang::FileLocation& location,
             libclang::clang().disposeIndex(index);
          }
       }
+
+      // references from the index don't carry their spelling
+      if (foundIndexedReferences && pSpelling->empty())
+         *pSpelling = cursor.spelling();
    }
    // not a package, just search locally
    else
@@ -16,25 +16,34 @@
 #ifndef SESSION_MODULES_CLANG_FIND_REFERENCES_HPP
 #define SESSION_MODULES_CLANG_FIND_REFERENCES_HPP
 
+#include <map>
+#include <string>
 #include <vector>
 
 #include <core/Error.hpp>
+#include <core/libclang/LibClang.hpp>
 
 #include <core/json/JsonRpc.hpp>
  
 namespace rstudio {
-
-namespace core {
-namespace libclang {
-   struct FileLocation;
-   struct FileRange;
-}
-}
-
 namespace session {
 namespace modules {      
 namespace clang {
 
+// references to declarations keyed by normalized USR
+typedef std::map<std::string,std::vector<core::libclang::FileRange> >
+                                                            ReferencesByUSR;
+
+// USRs of references to function declarations sometimes accrue an
+// extra trailing # so we strip it for use as an index key
+std::string normalizedUSR(const std::string& USR);
+
+// record all references within the main file of a translation unit to
+// declarations located within scopePath
+void indexReferences(CXTranslationUnit tu,
+                     const core::FilePath& scopePath,
+                     ReferencesByUSR* pReferences);
+
 core::Error findReferences(const core::libclang::FileLocation& location,
                            std::string* pSpelling,
                            std::vector<core::libclang::FileRange>* pRefs);
@@ -26,8 +26,8 @@ namespace source_control {
 VCSStatus StatusResult::getStatus(const FilePath& fileOrDirectory) const
 {
    std::map<std::string, VCSStatus>::const_iterator found =
-         this->filesByPath_.find(fileOrDirectory.absolutePath());
-   if (found != this->filesByPath_.end())
+         pFiles_->filesByPath.find(fileOrDirectory.absolutePath());
+   if (found != pFiles_->filesByPath.end())
       return found->second;
 
    return VCSStatus();
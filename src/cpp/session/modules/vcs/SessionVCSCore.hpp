@@ -20,6 +20,7 @@
 #include <map>
 
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/json/Json.hpp>
 #include <core/FilePath.hpp>
@@ -61,21 +62,29 @@ public:
    StatusResult(const std::vector<FileWithStatus>& files =
                 std::vector<FileWithStatus>())
    {
-      files_ = files;
-      for (std::vector<FileWithStatus>::iterator it = files_.begin();
-           it != files_.end();
+      boost::shared_ptr<Files> pFiles(new Files());
+      pFiles->files = files;
+      for (std::vector<FileWithStatus>::const_iterator it = files.begin();
+           it != files.end();
            it++)
       {
-         filesByPath_[it->path.absolutePath()] = it->status;
+         pFiles->filesByPath[it->path.absolutePath()] = it->status;
       }
+      pFiles_ = pFiles;
    }
 
    VCSStatus getStatus(const core::FilePath& fileOrDirectory) const;
-   std::vector<FileWithStatus> files() const { return files_; }
+   std::vector<FileWithStatus> files() const { return pFiles_->files; }
 
 private:
-   std::vector<FileWithStatus> files_;
-   std::map<std::string, VCSStatus> filesByPath_;
+   struct Files
+   {
+      std::vector<FileWithStatus> files;
+      std::map<std::string, VCSStatus> filesByPath;
+   };
+
+   // never modified once constructed (so results are cheap to copy)
+   boost::shared_ptr<const Files> pFiles_;
 };
 
 
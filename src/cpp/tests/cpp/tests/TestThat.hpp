@@ -34,5 +34,19 @@
 
 #endif
 
+#include <cstdlib>
+
+namespace rstudio {
+namespace tests {
+
+// benchmarks only run when RSTUDIO_CORE_BENCHMARKS is set
+inline bool benchmarksEnabled()
+{
+   return std::getenv("RSTUDIO_CORE_BENCHMARKS") != NULL;
+}
+
+} // namespace tests
+} // namespace rstudio
+
 #endif
 